@@ -25,7 +25,15 @@
 #include "GenericUnit.h"
 #include "GenericUnitSubclasses.h"
 #include "AudioUnitTap.h"
+#include "AudioUnitSpectrum.h"
+#include "AudioUnitRecorder.h"
+#include "AudioUnitGraph.h"
+#include "AudioUnitOfflineRenderer.h"
+#include "AudioUnitSharedMemory.h"
+#include "AudioUnitTapHistory.h"
+#include "AudioUnitAnalysis.h"
 #include "AudioUnitMidi.h"
+#include "RealtimeMemory.h"
 
 namespace cinder {
 	namespace au = audiounit;
@@ -31,8 +31,12 @@ class auBasicApp : public AppNative {
 	// extract samples (for audio analysis, visualization, etc).
 	au::Tap tap;
 	
-	// Samples are extracted from the Tap via a TapSampleBuffer
-	au::TapSampleBuffer sampleBuffer;
+	// For drawing, the Tap can summarize its samples into one
+	// min / max pair per column of pixels
+	std::vector<au::WaveformColumn> waveformColumns;
+	
+	// Streams whatever goes through the tap to a file on disk
+	au::Recorder recorder;
 };
 
 void auBasicApp::setup()
@@ -59,6 +63,14 @@ void auBasicApp::setup()
 	// connecting up a chain which goes speech synth -> reverb -> tap -> mixer -> output
 	speechSynth.connectTo(reverb).connectTo(tap).connectTo(mixer).connectTo(output);
 	
+	// Keeps the waveform summaries up to date as audio goes through the tap,
+	// so drawing it doesn't mean going through thousands of samples every frame
+	tap.setWaveformEnabled();
+	
+	// Has the tap measure the level of each channel as it goes by too,
+	// for the meters in the corner
+	tap.setLevelMeteringEnabled();
+	
 	// Audio Units work on a "pull" model, which means that the output unit drives
 	// the chain be requesting audio from the mixer, which requests audio from the
 	// reverb unit and so on. Here, we tell the output unit to start pulling audio
@@ -86,6 +98,14 @@ void auBasicApp::keyDown( KeyEvent event )
 {
 	if(event.getChar() == 'r') {
 		reverb.showUI();
+	} else if(event.getChar() == 'c') {
+		// press c to start capturing to a file in your home folder, and
+		// again to stop
+		if(recorder.isRecording()) {
+			recorder.stop();
+		} else {
+			recorder.start(tap, getHomeDirectory() / "auBasic.caf");
+		}
 	}
 }
 
@@ -104,16 +124,36 @@ void auBasicApp::draw()
 	// clear out the window with black
 	gl::clear( Color( 0, 0, 0 ) );
 	
-	// samples extracted from a tap will be in the range of -1 to 1
-	tap.getSamples(sampleBuffer);
+	// one column per pixel, covering the last 4096 samples (samples
+	// from a tap will be in the range of -1 to 1)
+	tap.getWaveform(waveformColumns, getWindowWidth(), 4096);
 	PolyLine2f waveform;
-	for(int i = 0; i < sampleBuffer.size(); i++) {
-		float x = i / (float)sampleBuffer.size() * (float)getWindowWidth();
-		float y = ((sampleBuffer[i] + 1) / 2.) * (float)getWindowHeight();
-		waveform.push_back(Vec2f(x,y));
+	for(int i = 0; i < waveformColumns.size(); i++) {
+		float yMin = ((waveformColumns[i].min + 1) / 2.) * (float)getWindowHeight();
+		float yMax = ((waveformColumns[i].max + 1) / 2.) * (float)getWindowHeight();
+		waveform.push_back(Vec2f(i, yMin));
+		waveform.push_back(Vec2f(i, yMax));
 	}
 	
 	gl::draw(waveform);
+	
+	// one meter per channel, from -60 dB up to 0 dB: the bar is the
+	// RMS level, and the lines are the true peak and the peak hold
+	for(UInt32 ch = 0; ch < tap.getChannelCount(); ch++) {
+		const au::LevelReading levels = tap.getLevels(ch);
+		const Rectf meter(10 + ch * 14, 10, 20 + ch * 14, 110);
+		float rms  = (au::LevelMeter::toDecibels(levels.rms, -60) + 60) / 60.;
+		float peak = (au::LevelMeter::toDecibels(levels.truePeak, -60) + 60) / 60.;
+		float hold = (au::LevelMeter::toDecibels(levels.peakHold, -60) + 60) / 60.;
+		
+		gl::color(0.2, 0.8, 0.2);
+		gl::drawSolidRect(Rectf(meter.x1, meter.y2 - rms * meter.getHeight(), meter.x2, meter.y2));
+		gl::drawLine(Vec2f(meter.x1, meter.y2 - peak * meter.getHeight()), Vec2f(meter.x2, meter.y2 - peak * meter.getHeight()));
+		gl::color(levels.peakHold > 1 ? Color(1, 0, 0) : Color(1, 1, 1));
+		gl::drawLine(Vec2f(meter.x1, meter.y2 - hold * meter.getHeight()), Vec2f(meter.x2, meter.y2 - hold * meter.getHeight()));
+	}
+	
+	gl::color(1, 1, 1);
 }
 
 CINDER_APP_NATIVE( auBasicApp, RendererGl )
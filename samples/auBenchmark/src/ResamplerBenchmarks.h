@@ -0,0 +1,159 @@
+#pragma once
+
+// Benchmarks for the Resampler that Input uses to convert from the input
+// device's rate to the rate of whatever it's connected to.
+//
+// Each quality is run at the conversions that come up the most (44.1kHz
+// to 48kHz and back, and 96kHz down to 48kHz) for a few channel counts,
+// a render-sized block at a time, with the ratio wobbling by a few parts
+// per million from block to block the way drift compensation moves it.
+// Alongside the time per frame, each result says how much of one core it
+// would take to keep up in realtime, and how far the output is from an
+// ideal conversion of a full scale sine at a fifth of the lower rate, so
+// cost and quality can be weighed against each other.
+//
+// Like RingBenchmarks.h, nothing in here depends on Cinder (or Core
+// Audio), so it can be built on its own as well as from the sample app.
+
+#include "Resampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ResamplerBenchmarks {
+
+struct Result
+{
+	std::string name;
+	cinder::audiounit::ResamplerQuality quality;
+	double   inputRate;
+	double   outputRate;
+	uint32_t frames;    // output frames per call
+	uint32_t channels;
+	double   nsPerFrame;  // mean, per output frame over all channels
+	double   realtime;    // fraction of one core needed to keep up (0.01 is 1%)
+	double   p99, max;    // ns per call
+	double   errorDB;     // worst difference from an ideal conversion, relative to full scale
+};
+
+static const uint32_t kBlockFrames     = 512;
+static const uint32_t kChannelCounts[] = {1, 2, 8};
+static const double   kRates[][2]      = {{44100, 48000}, {48000, 44100}, {96000, 48000}};
+static const double   kSeconds         = 4; // of audio per run
+
+static inline const char * qualityName(cinder::audiounit::ResamplerQuality quality)
+{
+	static const char * names[] = {"Low", "Medium", "High", "Best"};
+	return names[quality];
+}
+
+static inline Result run(cinder::audiounit::ResamplerQuality quality, double inputRate, double outputRate, uint32_t channels)
+{
+	typedef std::chrono::steady_clock Clock;
+	
+	const double nominal = inputRate / outputRate;
+	const double maxRatio = nominal * 1.002;
+	
+	cinder::audiounit::Resampler resampler;
+	resampler.allocate(channels, kBlockFrames, maxRatio, quality);
+	
+	// a tone at a fifth of the lower rate, which every quality passes
+	const double frequency = std::min(inputRate, outputRate) / 5;
+	const uint32_t blocks = kSeconds * outputRate / kBlockFrames;
+	const size_t inputFrames = ceil(blocks * kBlockFrames * maxRatio) + kBlockFrames;
+	
+	std::vector<std::vector<float> > input(channels, std::vector<float>(inputFrames));
+	std::vector<std::vector<float> > output(channels, std::vector<float>(kBlockFrames));
+	for(uint32_t ch = 0; ch < channels; ch++) {
+		for(size_t i = 0; i < inputFrames; i++) input[ch][i] = sin(2 * M_PI * frequency * i / inputRate);
+	}
+	
+	std::vector<const float *> inputs(channels);
+	std::vector<float *> outputs(channels);
+	for(uint32_t ch = 0; ch < channels; ch++) outputs[ch] = &output[ch][0];
+	
+	std::vector<uint64_t> callTimes;
+	callTimes.reserve(blocks);
+	
+	size_t consumed = 0;
+	double position = -(double)resampler.getLatency(); // of the next output frame, in input frames
+	double worstError = 0;
+	
+	for(uint32_t b = 0; b < blocks; b++) {
+		const double ratio = nominal * (1 + 50e-6 * sin(b * 0.01));
+		
+		for(uint32_t ch = 0; ch < channels; ch++) inputs[ch] = &input[ch][consumed];
+		const uint32_t needed = resampler.getInputFramesNeeded(kBlockFrames, ratio);
+		
+		const Clock::time_point start = Clock::now();
+		resampler.process(&inputs[0], &outputs[0], kBlockFrames, ratio);
+		callTimes.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+		
+		// skip the first second, while the filter's full of the silence it started with
+		for(uint32_t i = 0; i < kBlockFrames; i++, position += ratio) {
+			if(position < inputRate) continue;
+			const double ideal = sin(2 * M_PI * frequency * position / inputRate);
+			worstError = std::max(worstError, fabs(output[0][i] - ideal));
+		}
+		
+		consumed += needed;
+	}
+	
+	uint64_t total = 0;
+	for(size_t i = 0; i < callTimes.size(); i++) total += callTimes[i];
+	std::sort(callTimes.begin(), callTimes.end());
+	const size_t n = callTimes.size();
+	
+	Result r;
+	r.quality    = quality;
+	r.inputRate  = inputRate;
+	r.outputRate = outputRate;
+	r.frames     = kBlockFrames;
+	r.channels   = channels;
+	r.nsPerFrame = total / double(n * kBlockFrames);
+	r.realtime   = r.nsPerFrame * outputRate * 1e-9;
+	r.p99        = callTimes[std::min(n - 1, n * 99 / 100)];
+	r.max        = callTimes[n - 1];
+	r.errorDB    = 20 * log10(std::max(worstError, 1e-12));
+	
+	char name[64];
+	snprintf(name, sizeof(name), "Resampler %s %g>%gk", qualityName(quality), inputRate / 1000, outputRate / 1000);
+	r.name = name;
+	return r;
+}
+
+#pragma mark - Running
+
+// Runs everything. The callback is handed each result as soon as
+// it's ready, so a UI can show progress
+template<typename Callback>
+void runAll(Callback onResult)
+{
+	for(int q = cinder::audiounit::ResamplerQualityLow; q <= cinder::audiounit::ResamplerQualityBest; q++) {
+		for(size_t r = 0; r < sizeof(kRates) / sizeof(kRates[0]); r++) {
+			for(size_t c = 0; c < sizeof(kChannelCounts) / sizeof(kChannelCounts[0]); c++) {
+				onResult(run((cinder::audiounit::ResamplerQuality)q, kRates[r][0], kRates[r][1], kChannelCounts[c]));
+			}
+		}
+	}
+}
+
+static inline void printHeader(FILE * out)
+{
+	fprintf(out, "%-32s %6s %4s %10s %10s %10s %10s %10s\n",
+			"benchmark", "frames", "ch", "ns/frame", "% realtime", "p99 ns", "max ns", "error dB");
+}
+
+static inline void print(FILE * out, const Result &r)
+{
+	fprintf(out, "%-32s %6u %4u %10.2f %10.3f %10.0f %10.0f %10.1f\n",
+			r.name.c_str(), (unsigned)r.frames, (unsigned)r.channels,
+			r.nsPerFrame, r.realtime * 100, r.p99, r.max, r.errorDB);
+}
+
+} // namespace ResamplerBenchmarks
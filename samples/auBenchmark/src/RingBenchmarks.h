@@ -0,0 +1,561 @@
+#pragma once
+
+// Microbenchmarks for the buffers that sit on the render thread:
+//
+//  - Per-channel TPCircularBuffer ProduceBytes / Consume (how Input
+//    used to keep one ring per channel)
+//  - Input's shared buffer, through the same helpers Input.cpp uses
+//    (InputRing.h): RenderCallback frees what's been read and produces
+//    a block, and PullCallback copies out at its connection's cursor
+//    and moves it on with a CAS
+//  - BroadcastBuffer::write, which is what Tap's RenderAndCopy runs
+//  - BroadcastBuffer::read over the Tap's window, which is what
+//    Tap::getSamples runs
+//  - BroadcastBuffer::viewLatest, which is what Tap::getView runs
+//
+// Each is run single-threaded for every block size / channel count,
+// then the Input and Tap paths are run again with a producer and a
+// consumer pinned to separate cores, to see what contention on the
+// shared cache lines costs. Nothing in here depends on Cinder, so it
+// can be built on its own as well as from the sample app.
+
+#include "BroadcastBuffer.h"
+#include "InputRing.h"
+#include "TPCircularBuffer/TPCircularBuffer.h"
+#include "TPCircularBuffer/TPMultichannelCircularBuffer.h"
+#include "TPCircularBuffer/TPMultichannelCircularBuffer+AudioBufferList.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stddef.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace RingBenchmarks {
+
+struct Result
+{
+	std::string name;
+	UInt32 frames;
+	UInt32 channels;
+	double nsPerFrame;       // mean, per frame of one channel
+	double cyclesPerSample;  // mean, per sample over all channels (-1 if there's no cycle counter)
+	double p50, p99, p999, max; // ns per call
+};
+
+static const UInt32 kFrameCounts[]   = {32, 64, 128, 256, 512, 1024, 2048, 4096};
+static const UInt32 kChannelCounts[] = {1, 2, 8, 16, 32, 64};
+
+#pragma mark - Timing
+
+typedef std::chrono::steady_clock Clock;
+
+static inline UInt64 nanosecondsSince(const Clock::time_point &start)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+static inline UInt64 readCycleCounter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static inline bool hasCycleCounter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return true;
+#else
+	return false;
+#endif
+}
+
+static inline UInt32 iterationsFor(UInt32 frames)
+{
+	return std::max<UInt32>(200, (1 << 20) / frames);
+}
+
+// The contended runs also stop after this long, so that a machine
+// with fewer cores than threads doesn't take forever
+static const double kMaxContendedSeconds = 2.;
+
+static inline bool timeIsUp(const Clock::time_point &start)
+{
+	return nanosecondsSince(start) > kMaxContendedSeconds * 1e9;
+}
+
+static inline Result summarize(const std::string &name, UInt32 frames, UInt32 channels,
+							   std::vector<UInt64> &callTimes, UInt64 totalCycles)
+{
+	Result r;
+	r.name     = name;
+	r.frames   = frames;
+	r.channels = channels;
+	
+	if(callTimes.empty()) {
+		r.nsPerFrame = r.cyclesPerSample = r.p50 = r.p99 = r.p999 = r.max = 0;
+		return r;
+	}
+	
+	UInt64 total = 0;
+	for(size_t i = 0; i < callTimes.size(); i++) total += callTimes[i];
+	
+	std::sort(callTimes.begin(), callTimes.end());
+	const size_t n = callTimes.size();
+	
+	r.nsPerFrame      = total / double(n * frames);
+	r.cyclesPerSample = hasCycleCounter() ? totalCycles / double(n * frames * channels) : -1;
+	r.p50  = callTimes[n / 2];
+	r.p99  = callTimes[std::min(n - 1, n * 99 / 100)];
+	r.p999 = callTimes[std::min(n - 1, n * 999 / 1000)];
+	r.max  = callTimes[n - 1];
+	return r;
+}
+
+#pragma mark - Threads
+
+// Pins the calling thread to a core. On Linux this is a hard
+// affinity; on OS X the best we can do is put the producer and
+// consumer in different affinity sets so the scheduler keeps them
+// on different cores (and different L2s, where there's a choice)
+static inline void pinCurrentThread(int core)
+{
+#if defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core % std::max(1u, std::thread::hardware_concurrency()), &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(__APPLE__)
+	thread_affinity_policy_data_t policy = {core + 1};
+	thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY,
+					  (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT);
+#endif
+}
+
+#pragma mark - Buffers
+
+// A non-interleaved float AudioBufferList, like the ones the render
+// callbacks are handed, filled with a ramp so copies aren't of zeros
+struct BufferList
+{
+	BufferList(UInt32 channels, UInt32 frames)
+	{
+		const size_t bytes = offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * channels;
+		list = (AudioBufferList *)calloc(1, bytes);
+		list->mNumberBuffers = channels;
+		storage.resize(channels, std::vector<AudioUnitSampleType>(frames));
+		
+		for(UInt32 i = 0; i < channels; i++) {
+			for(UInt32 f = 0; f < frames; f++) storage[i][f] = f / (float)frames;
+			list->mBuffers[i].mNumberChannels = 1;
+			list->mBuffers[i].mDataByteSize   = frames * sizeof(AudioUnitSampleType);
+			list->mBuffers[i].mData           = &storage[i][0];
+		}
+	}
+	
+	~BufferList() {free(list);}
+	
+	AudioBufferList * list;
+	std::vector<std::vector<AudioUnitSampleType> > storage;
+
+private:
+	BufferList(const BufferList &);
+	BufferList& operator=(const BufferList &);
+};
+
+// Input and Tap both keep (roughly) 4 render slices of history
+static inline UInt32 historyFrames(UInt32 frames)
+{
+	return std::max<UInt32>(frames * 4, 1024);
+}
+
+// Input's buffer with one connection, doing what Input.cpp's
+// RenderCallback and Pull do with it, through the same helpers
+struct InputRing
+{
+	TPMultichannelCircularBuffer ring;
+	UInt64 capacity; // frames
+	std::atomic<UInt64> written;
+	UInt64 released; // producer only
+	std::atomic<UInt64> cursor;
+	
+	InputRing(UInt32 channels, UInt32 frames) : written(0), released(0), cursor(0)
+	{
+		TPMultichannelCircularBufferInit(&ring, channels, frames * sizeof(AudioUnitSampleType));
+		capacity = cinder::audiounit::InputRingCapacity(&ring);
+	}
+	
+	~InputRing() {TPMultichannelCircularBufferCleanup(&ring);}
+	
+	UInt64 fill() const {return written.load(std::memory_order_acquire) - cursor.load(std::memory_order_acquire);}
+	
+	// frees what's been read, pushing a reader that's too far behind on, then writes
+	void render(const AudioBufferList * in, UInt32 frames)
+	{
+		using namespace cinder::audiounit;
+		const UInt64 w = written.load(std::memory_order_relaxed);
+		const UInt64 oldest = InputRingOldest(&ring, w, frames);
+		
+		UInt64 c;
+		InputRingPushCursor(cursor, oldest, c);
+		InputRingRelease(&ring, released, std::min(w, std::max(c, oldest)));
+		
+		if(TPMultichannelCircularBufferProduceAudioBufferList(&ring, in, frames)) {
+			written.store(w + frames, std::memory_order_release);
+		}
+	}
+	
+	// copies straight out of the mirrored lanes, and pads with silence
+	void pull(AudioBufferList * out, UInt32 frames)
+	{
+		const UInt32 copied = cinder::audiounit::InputRingRead(&ring, ring.channels, written, cursor, out, frames);
+		
+		for(UInt32 i = 0; copied < frames && i < out->mNumberBuffers; i++) {
+			memset((AudioUnitSampleType *)out->mBuffers[i].mData + copied, 0, (frames - copied) * sizeof(AudioUnitSampleType));
+		}
+	}
+
+private:
+	InputRing(const InputRing &);
+	InputRing& operator=(const InputRing &);
+};
+
+#pragma mark - Single threaded
+
+static inline Result perChannelRing(UInt32 frames, UInt32 channels)
+{
+	std::vector<TPCircularBuffer> rings(channels);
+	for(UInt32 i = 0; i < channels; i++) {
+		TPCircularBufferInit(&rings[i], historyFrames(frames) * sizeof(AudioUnitSampleType));
+	}
+	
+	BufferList in(channels, frames), out(channels, frames);
+	const UInt32 iterations = iterationsFor(frames);
+	const int32_t bytes = frames * sizeof(AudioUnitSampleType);
+	std::vector<UInt64> times;
+	times.reserve(iterations);
+	UInt64 cycles = 0;
+	
+	for(UInt32 n = 0; n < iterations; n++) {
+		const UInt64 c = readCycleCounter();
+		const Clock::time_point t = Clock::now();
+		
+		for(UInt32 i = 0; i < channels; i++) {
+			TPCircularBufferProduceBytes(&rings[i], in.list->mBuffers[i].mData, bytes);
+		}
+		for(UInt32 i = 0; i < channels; i++) {
+			int32_t available;
+			void * tail = TPCircularBufferTail(&rings[i], &available);
+			memcpy(out.list->mBuffers[i].mData, tail, std::min(bytes, available));
+			TPCircularBufferConsume(&rings[i], std::min(bytes, available));
+		}
+		
+		times.push_back(nanosecondsSince(t));
+		cycles += readCycleCounter() - c;
+	}
+	
+	for(UInt32 i = 0; i < channels; i++) TPCircularBufferCleanup(&rings[i]);
+	return summarize("per-channel TPCircularBuffer", frames, channels, times, cycles);
+}
+
+static inline Result inputRing(UInt32 frames, UInt32 channels)
+{
+	InputRing ring(channels, historyFrames(frames));
+	
+	BufferList in(channels, frames), out(channels, frames);
+	const UInt32 iterations = iterationsFor(frames);
+	std::vector<UInt64> times;
+	times.reserve(iterations);
+	UInt64 cycles = 0;
+	
+	for(UInt32 n = 0; n < iterations; n++) {
+		const UInt64 c = readCycleCounter();
+		const Clock::time_point t = Clock::now();
+		
+		ring.render(in.list, frames);
+		ring.pull(out.list, frames);
+		
+		times.push_back(nanosecondsSince(t));
+		cycles += readCycleCounter() - c;
+	}
+	
+	return summarize("Input render + pull", frames, channels, times, cycles);
+}
+
+static inline Result tapWrite(UInt32 frames, UInt32 channels)
+{
+	cinder::audiounit::BroadcastBuffer buffer;
+	buffer.allocate(channels, historyFrames(frames));
+	
+	BufferList in(channels, frames);
+	const UInt32 iterations = iterationsFor(frames);
+	std::vector<UInt64> times;
+	times.reserve(iterations);
+	UInt64 cycles = 0;
+	
+	for(UInt32 n = 0; n < iterations; n++) {
+		const UInt64 c = readCycleCounter();
+		const Clock::time_point t = Clock::now();
+		
+		buffer.write(in.list, frames);
+		
+		times.push_back(nanosecondsSince(t));
+		cycles += readCycleCounter() - c;
+	}
+	
+	return summarize("Tap RenderAndCopy", frames, channels, times, cycles);
+}
+
+// Tap::getSamples copies out the whole window the tap is tracking,
+// so here "frames" is the window size
+static inline Result tapGetSamples(UInt32 frames, UInt32 channels)
+{
+	cinder::audiounit::BroadcastBuffer buffer;
+	buffer.allocate(channels, frames);
+	
+	BufferList in(channels, frames);
+	buffer.write(in.list, frames);
+	
+	std::vector<std::vector<AudioUnitSampleType> > out(channels);
+	const UInt32 iterations = iterationsFor(frames);
+	std::vector<UInt64> times;
+	times.reserve(iterations);
+	UInt64 cycles = 0;
+	
+	for(UInt32 n = 0; n < iterations; n++) {
+		const UInt64 c = readCycleCounter();
+		const Clock::time_point t = Clock::now();
+		
+		cinder::audiounit::BroadcastBuffer::Cursor cursor;
+		cursor.position = buffer.getWritePosition() - frames;
+		buffer.read(cursor, out);
+		
+		times.push_back(nanosecondsSince(t));
+		cycles += readCycleCounter() - c;
+	}
+	
+	return summarize("Tap getSamples", frames, channels, times, cycles);
+}
+
+static inline Result tapGetView(UInt32 frames, UInt32 channels)
+{
+	cinder::audiounit::BroadcastBuffer buffer;
+	buffer.allocate(channels, frames);
+	
+	BufferList in(channels, frames);
+	buffer.write(in.list, frames);
+	
+	const UInt32 iterations = iterationsFor(frames);
+	std::vector<UInt64> times;
+	times.reserve(iterations);
+	UInt64 cycles = 0;
+	
+	// every view should end on the last frame of the ramp BufferList
+	// wrote. Checking it after the loop keeps the reads from being
+	// optimized away
+	const float last = (frames - 1) / (float)frames;
+	UInt32 mismatches = 0;
+	
+	for(UInt32 n = 0; n < iterations; n++) {
+		const UInt64 c = readCycleCounter();
+		const Clock::time_point t = Clock::now();
+	
+		cinder::audiounit::BroadcastBuffer::View view = buffer.viewLatest(frames);
+		if(view.getChannel(channels - 1)[view.size() - 1] != last || !view.isValid()) mismatches++;
+	
+		times.push_back(nanosecondsSince(t));
+		cycles += readCycleCounter() - c;
+	}
+	
+	if(mismatches > 0) printf("Tap getView: %u of %u views didn't end on the latest sample\n", mismatches, iterations);
+	return summarize("Tap getView", frames, channels, times, cycles);
+}
+
+#pragma mark - Contended
+
+// Input: the input unit's render callback produces while the output
+// unit's pull callback consumes on another core. The producer holds
+// off rather than pushing the reader on, so every block's read
+static inline std::vector<Result> inputRingContended(UInt32 frames, UInt32 channels)
+{
+	InputRing ring(channels, historyFrames(frames));
+	
+	BufferList in(channels, frames), out(channels, frames);
+	const UInt32 iterations = iterationsFor(frames);
+	std::vector<UInt64> producerTimes, consumerTimes;
+	producerTimes.reserve(iterations);
+	consumerTimes.reserve(iterations);
+	UInt64 producerCycles = 0, consumerCycles = 0;
+	const Clock::time_point started = Clock::now();
+	
+	std::thread producer([&] {
+		pinCurrentThread(0);
+		for(UInt32 n = 0; n < iterations; ) {
+			if(timeIsUp(started)) break;
+			if(ring.fill() + frames > ring.capacity) {
+				std::this_thread::yield();
+				continue;
+			}
+			
+			const UInt64 c = readCycleCounter();
+			const Clock::time_point t = Clock::now();
+			ring.render(in.list, frames);
+			producerTimes.push_back(nanosecondsSince(t));
+			producerCycles += readCycleCounter() - c;
+			n++;
+		}
+	});
+	
+	std::thread consumer([&] {
+		pinCurrentThread(1);
+		for(UInt32 n = 0; n < iterations; ) {
+			if(timeIsUp(started)) break;
+			if(ring.fill() < frames) {
+				std::this_thread::yield();
+				continue;
+			}
+			
+			const UInt64 c = readCycleCounter();
+			const Clock::time_point t = Clock::now();
+			ring.pull(out.list, frames);
+			consumerTimes.push_back(nanosecondsSince(t));
+			consumerCycles += readCycleCounter() - c;
+			n++;
+		}
+	});
+	
+	producer.join();
+	consumer.join();
+	
+	std::vector<Result> results;
+	results.push_back(summarize("Input render (contended)", frames, channels, producerTimes, producerCycles));
+	results.push_back(summarize("Input pull (contended)", frames, channels, consumerTimes, consumerCycles));
+	return results;
+}
+
+// Tap: the render thread writes while another thread follows it with
+// a cursor. The reader never blocks the writer, so it may lag; the
+// writer keeps going until the reader has made enough reads
+static inline std::vector<Result> tapContended(UInt32 frames, UInt32 channels)
+{
+	cinder::audiounit::BroadcastBuffer buffer;
+	buffer.allocate(channels, historyFrames(frames));
+	
+	BufferList in(channels, frames);
+	const UInt32 iterations = iterationsFor(frames);
+	std::vector<UInt64> readerTimes;
+	readerTimes.reserve(iterations);
+	UInt64 writerCycles = 0, readerCycles = 0;
+	std::atomic<bool> reading(true);
+	const Clock::time_point started = Clock::now();
+	
+	// the writer has to keep going until the reader's done, but it only
+	// times its first iterations, so nothing's allocated while it's timed
+	std::vector<UInt64> writerTimes(iterations);
+	size_t timedWrites = 0;
+	
+	std::thread writer([&] {
+		pinCurrentThread(0);
+		while(reading) {
+			if(timedWrites == writerTimes.size()) {
+				buffer.write(in.list, frames);
+				continue;
+			}
+			
+			const UInt64 c = readCycleCounter();
+			const Clock::time_point t = Clock::now();
+			buffer.write(in.list, frames);
+			writerTimes[timedWrites++] = nanosecondsSince(t);
+			writerCycles += readCycleCounter() - c;
+		}
+	});
+	
+	std::thread reader([&] {
+		pinCurrentThread(1);
+		std::vector<std::vector<AudioUnitSampleType> > out(channels);
+		cinder::audiounit::BroadcastBuffer::Cursor cursor;
+		
+		for(UInt32 n = 0; n < iterations; ) {
+			if(timeIsUp(started)) break;
+			if(buffer.getWritePosition() < cursor.position + frames) {
+				std::this_thread::yield();
+				continue;
+			}
+			
+			const UInt64 c = readCycleCounter();
+			const Clock::time_point t = Clock::now();
+			buffer.read(cursor, out, frames);
+			readerTimes.push_back(nanosecondsSince(t));
+			readerCycles += readCycleCounter() - c;
+			n++;
+		}
+		reading = false;
+	});
+	
+	writer.join();
+	reader.join();
+	writerTimes.resize(timedWrites);
+	
+	std::vector<Result> results;
+	results.push_back(summarize("Tap RenderAndCopy (contended)", frames, channels, writerTimes, writerCycles));
+	results.push_back(summarize("Tap cursor read (contended)", frames, channels, readerTimes, readerCycles));
+	return results;
+}
+
+#pragma mark - Running
+
+// Runs everything. The callback is handed each result as soon as
+// it's ready, so a UI can show progress
+template<typename Callback>
+void runAll(Callback onResult)
+{
+	for(size_t c = 0; c < sizeof(kChannelCounts) / sizeof(kChannelCounts[0]); c++) {
+		for(size_t f = 0; f < sizeof(kFrameCounts) / sizeof(kFrameCounts[0]); f++) {
+			const UInt32 frames = kFrameCounts[f], channels = kChannelCounts[c];
+			
+			onResult(perChannelRing(frames, channels));
+			onResult(inputRing(frames, channels));
+			onResult(tapWrite(frames, channels));
+			onResult(tapGetSamples(frames, channels));
+			onResult(tapGetView(frames, channels));
+			
+			std::vector<Result> contended = inputRingContended(frames, channels);
+			for(size_t i = 0; i < contended.size(); i++) onResult(contended[i]);
+			
+			contended = tapContended(frames, channels);
+			for(size_t i = 0; i < contended.size(); i++) onResult(contended[i]);
+		}
+	}
+}
+
+static inline void printHeader(FILE * out)
+{
+	fprintf(out, "%-32s %6s %4s %10s %10s %10s %10s %10s %10s\n",
+			"benchmark", "frames", "ch", "ns/frame", "cyc/samp", "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+}
+
+static inline void print(FILE * out, const Result &r)
+{
+	fprintf(out, "%-32s %6u %4u %10.2f %10.3f %10.0f %10.0f %10.0f %10.0f\n",
+			r.name.c_str(), (unsigned)r.frames, (unsigned)r.channels,
+			r.nsPerFrame, r.cyclesPerSample, r.p50, r.p99, r.p999, r.max);
+}
+
+} // namespace RingBenchmarks
@@ -0,0 +1,109 @@
+#include "cinder/app/AppNative.h"
+#include "cinder/gl/gl.h"
+#include "cinder/Thread.h"
+
+#include "AudioUnit.h"
+#include "RingBenchmarks.h"
+#include "ResamplerBenchmarks.h"
+
+using namespace ci;
+using namespace ci::app;
+using namespace std;
+
+// This sample doesn't make any sound. It measures how long the buffers
+// that the Tap and Input use take to move audio around, for a range of
+// block sizes and channel counts, and then what each of the Resampler's
+// qualities costs at the common sample rate conversions. The results
+// are printed to the console as they come in, and the most recent ones
+// are drawn in the window. Run it from a Release build, otherwise
+// you're mostly measuring the lack of inlining.
+
+class auBenchmarkApp : public AppNative {
+  public:
+	void setup();
+	void shutdown();
+	void draw();
+	
+	void runBenchmarks();
+	
+	std::thread benchmarkThread;
+	std::mutex resultsMutex;
+	std::vector<RingBenchmarks::Result> results;
+	bool finished;
+};
+
+void auBenchmarkApp::setup()
+{
+	// The benchmarks run on a background thread so the window stays
+	// responsive. Uncomment this to measure with locked, prefaulted
+	// buffers (see RealtimeMemory.h)
+	// au::RealtimeMemory::setEnabled(true);
+	
+	finished = false;
+	benchmarkThread = std::thread(&auBenchmarkApp::runBenchmarks, this);
+}
+
+void auBenchmarkApp::shutdown()
+{
+	if(benchmarkThread.joinable()) {
+		benchmarkThread.join();
+	}
+}
+
+void auBenchmarkApp::runBenchmarks()
+{
+	RingBenchmarks::printHeader(stdout);
+	
+	RingBenchmarks::runAll([this](const RingBenchmarks::Result &r) {
+		RingBenchmarks::print(stdout, r);
+		std::lock_guard<std::mutex> lock(resultsMutex);
+		results.push_back(r);
+	});
+	
+	fprintf(stdout, "\n");
+	ResamplerBenchmarks::printHeader(stdout);
+	
+	ResamplerBenchmarks::runAll([this](const ResamplerBenchmarks::Result &r) {
+		ResamplerBenchmarks::print(stdout, r);
+		
+		// shown in the window alongside the ring results
+		RingBenchmarks::Result row;
+		row.name       = r.name;
+		row.frames     = r.frames;
+		row.channels   = r.channels;
+		row.nsPerFrame = r.nsPerFrame;
+		row.cyclesPerSample = -1;
+		row.p50 = row.p999 = 0;
+		row.p99 = r.p99;
+		row.max = r.max;
+		
+		std::lock_guard<std::mutex> lock(resultsMutex);
+		results.push_back(row);
+	});
+	
+	std::lock_guard<std::mutex> lock(resultsMutex);
+	finished = true;
+}
+
+void auBenchmarkApp::draw()
+{
+	gl::clear( Color( 0, 0, 0 ) );
+	
+	std::lock_guard<std::mutex> lock(resultsMutex);
+	
+	const float lineHeight = 14;
+	const size_t linesToShow = std::max<size_t>(1, getWindowHeight() / lineHeight - 2);
+	const size_t first = results.size() > linesToShow ? results.size() - linesToShow : 0;
+	
+	gl::drawString(finished ? "Finished" : "Running...", Vec2f(10, 10));
+	
+	char line[256];
+	for(size_t i = first; i < results.size(); i++) {
+		const RingBenchmarks::Result &r = results[i];
+		snprintf(line, sizeof(line), "%-32s %4u frames %2u ch   %8.2f ns/frame   p99 %8.0f ns   max %8.0f ns",
+				 r.name.c_str(), r.frames, r.channels, r.nsPerFrame, r.p99, r.max);
+		gl::drawString(line, Vec2f(10, 10 + (i - first + 1) * lineHeight));
+	}
+}
+
+CINDER_APP_NATIVE( auBenchmarkApp, RendererGl )
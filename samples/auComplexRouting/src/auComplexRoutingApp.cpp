@@ -43,11 +43,21 @@ class auComplexRoutingApp : public AppNative {
 	Tap renderTap;
 	Tap mixdownTap;
 	
-	TapSampleBuffer kickBuffer;
-	TapSampleBuffer hatsBuffer;
-	TapSampleBuffer snareBuffer;
-	TapSampleBuffer renderBuffer;
-	TapSampleBuffer mixdownBuffer;
+	// Renders the four tracks on separate cores (see setup())
+	Graph graph;
+	
+	// Reading the taps through a group lines them up by sample time, so
+	// the waveforms all show exactly the same stretch of audio
+	TapGroup tapGroup;
+	
+	// Views look straight into each tap's history instead of copying
+	// samples out of it (use TapSampleBuffer and getSamples() if you
+	// want your own copy)
+	TapView kickView;
+	TapView hatsView;
+	TapView snareView;
+	TapView renderView;
+	TapView mixdownView;
 	
 	SineWaveRenderContext renderContext;
 	
@@ -104,6 +114,12 @@ void auComplexRoutingApp::setup()
 	compressor = GenericUnit(kAudioUnitType_Effect, kAudioUnitSubType_DynamicsProcessor);
 	mixer.connectTo(compressor).connectTo(mixdownTap).connectTo(output);
 	
+	tapGroup.add(kickTap);
+	tapGroup.add(hatsTap);
+	tapGroup.add(snareTap);
+	tapGroup.add(renderTap);
+	tapGroup.add(mixdownTap);
+	
 	// Loading saved presets for each effect. You can save the state of the effects by
 	// pressing 's', which will save presets in the app's asset folder
 	distortion.loadPreset(loadAsset("distortion.aupreset"));
@@ -112,6 +128,16 @@ void auComplexRoutingApp::setup()
 	panner.loadPreset(loadAsset("panner.aupreset"));
 	compressor.loadPreset(loadAsset("compressor.aupreset"));
 	
+	// The four tracks don't share anything until they reach the mixer, so
+	// they can be rendered at the same time on separate cores instead of
+	// one after the other. The graph works out the tracks from the
+	// connections made above, and renders them ahead of the output at the
+	// start of every buffer
+	graph.capture(output);
+	graph.setParallelRendering();
+	graph.prepare();
+	graph.attach();
+	
 	// Here we're starting all of the loops at the same time, so they stay in sync.
 	kickPlayer.loop();
 	hatsPlayer.loop();
@@ -192,26 +218,30 @@ void auComplexRoutingApp::keyDown( KeyEvent event )
 void auComplexRoutingApp::update()
 {
 	gridSize = Vec2i(getWindowWidth() / 2., getWindowHeight() / 4.);
-	// getting the last batch of samples which have passed through each of the taps
-	kickTap.getSamples(kickBuffer);
-	hatsTap.getSamples(hatsBuffer);
-	snareTap.getSamples(snareBuffer);
-	renderTap.getSamples(renderBuffer);
-	mixdownTap.getSamples(mixdownBuffer);
+	// getting views of the last batch of samples which have passed through all of the taps
+	vector<TapView> views;
+	if(tapGroup.getViews(views, 4096)) {
+		kickView    = views[0];
+		hatsView    = views[1];
+		snareView   = views[2];
+		renderView  = views[3];
+		mixdownView = views[4];
+	}
 }
 
-PolyLine2f waveformForSamples(const TapSampleBuffer &buffer, float width, float height)
+PolyLine2f waveformForSamples(const TapView &view, float width, float height)
 {
 	PolyLine2f waveform;
+	const AudioUnitSampleType * samples = view.getChannel(0);
 	
-	if(!buffer.empty()) {
-		waveform.getPoints().reserve(buffer.size());
+	if(samples && !view.empty()) {
+		waveform.getPoints().reserve(view.size());
 		
-		const float xStep = width / (float)buffer.size();
+		const float xStep = width / (float)view.size();
 		
-		for(int i = 0; i < buffer.size(); i++) {
+		for(int i = 0; i < view.size(); i++) {
 			float x = i * xStep;
-			float y = buffer[i] * (height / 2.f) + (height / 2.f);
+			float y = samples[i] * (height / 2.f) + (height / 2.f);
 			waveform.push_back(Vec2f(x, y));
 		}
 	}
@@ -232,13 +262,13 @@ void auComplexRoutingApp::draw()
 	gl::color(1,1,1);
 	gl::pushMatrices();
 	{
-		gl::draw(waveformForSamples(kickBuffer, gridSize.x, gridSize.y));
+		gl::draw(waveformForSamples(kickView, gridSize.x, gridSize.y));
 		gl::translate(0, gridSize.y);
-		gl::draw(waveformForSamples(hatsBuffer, gridSize.x, gridSize.y));
+		gl::draw(waveformForSamples(hatsView, gridSize.x, gridSize.y));
 		gl::translate(0, gridSize.y);
-		gl::draw(waveformForSamples(snareBuffer, gridSize.x, gridSize.y));
+		gl::draw(waveformForSamples(snareView, gridSize.x, gridSize.y));
 		gl::translate(0, gridSize.y);
-		gl::draw(waveformForSamples(renderBuffer, gridSize.x, gridSize.y));
+		gl::draw(waveformForSamples(renderView, gridSize.x, gridSize.y));
 	}
 	gl::popMatrices();
 	
@@ -246,7 +276,7 @@ void auComplexRoutingApp::draw()
 	gl::pushMatrices();
 	{
 		gl::translate(gridSize.x, 0);
-		gl::draw(waveformForSamples(mixdownBuffer, gridSize.x, getWindowHeight()));
+		gl::draw(waveformForSamples(mixdownView, gridSize.x, getWindowHeight()));
 	}
 	gl::popMatrices();
 }
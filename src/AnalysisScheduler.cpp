@@ -0,0 +1,333 @@
+#include "AudioUnitAnalysis.h"
+#include "Semaphore.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <pthread.h>
+#include <thread>
+#include <time.h>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+using namespace cinder::audiounit;
+using namespace std;
+
+static Float64 ThreadCPUTime()
+{
+#if defined(__APPLE__)
+	thread_basic_info_data_t info;
+	mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+	if(thread_info(pthread_mach_thread_np(pthread_self()), THREAD_BASIC_INFO, (thread_info_t)&info, &count) != KERN_SUCCESS) {
+		return 0;
+	}
+	return info.user_time.seconds + info.system_time.seconds +
+		   (info.user_time.microseconds + info.system_time.microseconds) * 1e-6;
+#else
+	timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+// wakes up a worker whenever one of the Taps has new audio
+static void WakeWorker(void * refCon, const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp)
+{
+	static_cast<Semaphore *>(refCon)->signal();
+}
+
+namespace {
+
+struct Analyzer
+{
+	AnalysisScheduler::AnalyzerID id;
+	Tap tap;
+	const void * tapKey;
+	TapReader reader;
+	AnalyzerCallback callback;
+	void * refCon;
+	UInt32 blockFrames;
+	AnalysisBackpressure backpressure;
+	Float64 sampleRate;
+	
+	// only touched by the worker that's running the analyzer
+	vector<TapSampleBuffer> buffers;
+	
+	// guarded by the scheduler's mutex
+	bool running;
+	AnalyzerStats stats;
+};
+
+// each Tap gets one block callback, however many analyzers follow it
+struct TapEntry
+{
+	Tap tap;
+	const void * key;
+	UInt32 analyzerCount;
+};
+
+} // anonymous namespace
+
+struct AnalysisScheduler::SchedulerImpl
+{
+	vector<boost::shared_ptr<Analyzer> > analyzers;
+	vector<TapEntry> taps;
+	size_t nextAnalyzer; // where the next scan for work starts, so everyone gets a turn
+	AnalyzerID nextID;
+	
+	mutex lock;
+	condition_variable analyzerFinished;
+	Semaphore semaphore;
+	bool stopping;
+	vector<thread> workers;
+	
+	SchedulerImpl(UInt32 threadCount)
+	: nextAnalyzer(0)
+	, nextID(1)
+	, stopping(false)
+	{
+		if(threadCount == 0) {
+			threadCount = max(1, (int)thread::hardware_concurrency() - 1);
+		}
+		
+		for(UInt32 i = 0; i < threadCount; i++) {
+			workers.push_back(thread(&SchedulerImpl::run, this));
+		}
+	}
+	
+	~SchedulerImpl()
+	{
+		{
+			unique_lock<mutex> guard(lock);
+			for(size_t i = 0; i < taps.size(); i++) {
+				taps[i].tap.removeBlockCallback(WakeWorker, &semaphore);
+			}
+			stopping = true;
+		}
+		
+		for(size_t i = 0; i < workers.size(); i++) semaphore.signal();
+		for(size_t i = 0; i < workers.size(); i++) workers[i].join();
+	}
+	
+	AnalyzerID add(Tap &tap, const void * tapKey, AnalyzerCallback callback, void * refCon, UInt32 blockFrames, AnalysisBackpressure backpressure)
+	{
+		unique_lock<mutex> guard(lock);
+		
+		vector<TapEntry>::iterator entry = taps.begin();
+		while(entry != taps.end() && entry->key != tapKey) ++entry;
+		
+		if(entry == taps.end()) {
+			if(!tap.addBlockCallback(WakeWorker, &semaphore)) {
+				return 0;
+			}
+			
+			TapEntry newEntry = {tap, tapKey, 0};
+			entry = taps.insert(taps.end(), newEntry);
+		}
+		
+		entry->analyzerCount++;
+		
+		boost::shared_ptr<Analyzer> analyzer(new Analyzer);
+		analyzer->id           = nextID++;
+		analyzer->tap          = tap;
+		analyzer->tapKey       = tapKey;
+		analyzer->reader       = TapReader(tap);
+		analyzer->callback     = callback;
+		analyzer->refCon       = refCon;
+		analyzer->blockFrames  = max<UInt32>(1, blockFrames);
+		analyzer->backpressure = backpressure;
+		analyzer->sampleRate   = tap.getSampleRate();
+		analyzer->running      = false;
+		analyzers.push_back(analyzer);
+		
+		return analyzer->id;
+	}
+	
+	void remove(AnalyzerID id)
+	{
+		unique_lock<mutex> guard(lock);
+		
+		vector<boost::shared_ptr<Analyzer> >::iterator it = analyzers.begin();
+		while(it != analyzers.end() && (*it)->id != id) ++it;
+		if(it == analyzers.end()) return;
+		
+		boost::shared_ptr<Analyzer> analyzer = *it;
+		analyzers.erase(it);
+		
+		while(analyzer->running) {
+			analyzerFinished.wait(guard);
+		}
+		
+		for(vector<TapEntry>::iterator entry = taps.begin(); entry != taps.end(); ++entry) {
+			if(entry->key == analyzer->tapKey && --entry->analyzerCount == 0) {
+				entry->tap.removeBlockCallback(WakeWorker, &semaphore);
+				taps.erase(entry);
+				break;
+			}
+		}
+	}
+	
+	bool isReady(Analyzer &analyzer)
+	{
+		return !analyzer.running && analyzer.reader.getAvailableFrames() >= analyzer.blockFrames;
+	}
+	
+	// call with the lock held
+	Analyzer * claim()
+	{
+		const size_t count = analyzers.size();
+		
+		for(size_t i = 0; i < count; i++) {
+			const size_t index = (nextAnalyzer + i) % count;
+			if(isReady(*analyzers[index])) {
+				nextAnalyzer = index + 1;
+				analyzers[index]->running = true;
+				return analyzers[index].get();
+			}
+		}
+		
+		return NULL;
+	}
+	
+	void run()
+	{
+		unique_lock<mutex> guard(lock);
+		
+		while(!stopping) {
+			Analyzer * analyzer = claim();
+			
+			if(!analyzer) {
+				guard.unlock();
+				// the timeout is only there as a backstop, in case a
+				// wakeup gets lost while a Tap is being reconfigured
+				semaphore.waitFor(0.1);
+				guard.lock();
+				continue;
+			}
+			
+			// there's one wakeup per Tap block, so if several analyzers
+			// became ready at once, pass it along to another worker
+			for(size_t i = 0; i < analyzers.size(); i++) {
+				if(isReady(*analyzers[i])) {
+					semaphore.signal();
+					break;
+				}
+			}
+			
+			guard.unlock();
+			AnalyzerStats call = analyze(*analyzer);
+			guard.lock();
+			
+			analyzer->stats.calls          += call.calls;
+			analyzer->stats.framesAnalyzed += call.framesAnalyzed;
+			analyzer->stats.framesSkipped  += call.framesSkipped;
+			analyzer->stats.cpuSeconds     += call.cpuSeconds;
+			analyzer->stats.maxCallSeconds  = max(analyzer->stats.maxCallSeconds, call.maxCallSeconds);
+			analyzer->running = false;
+			analyzerFinished.notify_all();
+		}
+	}
+	
+	AnalyzerStats analyze(Analyzer &analyzer)
+	{
+		AnalyzerStats call;
+		const UInt32 blockFrames = analyzer.blockFrames;
+		const UInt64 start = analyzer.reader.getPosition();
+		const UInt32 available = analyzer.reader.getAvailableFrames();
+		
+		UInt32 frames = blockFrames;
+		if(analyzer.backpressure == AnalysisCoalesce) {
+			frames = available - available % blockFrames;
+		} else if(available >= blockFrames * 2) {
+			// skip to the most recent whole block
+			analyzer.reader.readView(available - available % blockFrames - blockFrames);
+		}
+		
+		// the Tap might have been connected since the last call
+		analyzer.buffers.resize(analyzer.tap.getChannelCount());
+		analyzer.reader.read(analyzer.buffers, frames);
+		
+		const UInt32 framesRead = analyzer.buffers.empty() ? 0 : analyzer.buffers[0].size();
+		if(framesRead == 0) return call;
+		
+		// counts whatever the Tap overwrote before the reader got to it, too
+		const UInt64 position = analyzer.reader.getPosition() - framesRead;
+		call.framesSkipped = position - start;
+		
+		const Float64 cpuStart = ThreadCPUTime();
+		const chrono::steady_clock::time_point wallStart = chrono::steady_clock::now();
+		
+		analyzer.callback(analyzer.refCon, analyzer.buffers, position, call.framesSkipped);
+		
+		call.maxCallSeconds = chrono::duration<Float64>(chrono::steady_clock::now() - wallStart).count();
+		call.cpuSeconds     = ThreadCPUTime() - cpuStart;
+		call.calls          = 1;
+		call.framesAnalyzed = framesRead;
+		return call;
+	}
+};
+
+#pragma mark - AnalysisScheduler
+
+AnalysisScheduler::AnalysisScheduler(UInt32 threadCount) : _impl(new SchedulerImpl(threadCount))
+{
+}
+
+AnalysisScheduler::~AnalysisScheduler()
+{
+}
+
+UInt32 AnalysisScheduler::getThreadCount() const
+{
+	return _impl->workers.size();
+}
+
+AnalysisScheduler::AnalyzerID AnalysisScheduler::addAnalyzer(Tap &tap,
+															 AnalyzerCallback callback,
+															 void * refCon,
+															 UInt32 blockFrames,
+															 AnalysisBackpressure backpressure)
+{
+	if(!callback) {
+		std::cout << "AnalysisScheduler needs a callback for each analyzer" << std::endl;
+		return 0;
+	}
+	
+	return _impl->add(tap, tap._impl.get(), callback, refCon, blockFrames, backpressure);
+}
+
+void AnalysisScheduler::removeAnalyzer(AnalyzerID analyzer)
+{
+	_impl->remove(analyzer);
+}
+
+AnalyzerStats AnalysisScheduler::getStats(AnalyzerID analyzer) const
+{
+	unique_lock<mutex> guard(_impl->lock);
+	
+	for(size_t i = 0; i < _impl->analyzers.size(); i++) {
+		const Analyzer &a = *_impl->analyzers[i];
+		if(a.id != analyzer) continue;
+		
+		AnalyzerStats stats = a.stats;
+		if(stats.framesAnalyzed > 0 && a.sampleRate > 0) {
+			stats.load = stats.cpuSeconds / (stats.framesAnalyzed / a.sampleRate);
+		}
+		return stats;
+	}
+	
+	return AnalyzerStats();
+}
+
+void AnalysisScheduler::resetStats()
+{
+	unique_lock<mutex> guard(_impl->lock);
+	
+	for(size_t i = 0; i < _impl->analyzers.size(); i++) {
+		_impl->analyzers[i]->stats = AnalyzerStats();
+	}
+}
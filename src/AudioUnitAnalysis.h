@@ -0,0 +1,102 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "AudioUnitTap.h"
+
+namespace cinder { namespace audiounit {
+
+typedef enum
+{
+	AnalysisCoalesce, // when behind, pass everything that's piled up to the analyzer in one call
+	AnalysisSkip      // when behind, skip to the most recent block (the rest counts as skipped)
+}
+AnalysisBackpressure;
+
+// Called on one of an AnalysisScheduler's worker threads with the next
+// stretch of audio from a Tap, one buffer per channel. position is the
+// Tap position of the first frame (as in TapReader::getPosition()),
+// and framesSkipped is how much audio went by unanalyzed since the
+// previous call. An analyzer only runs on one worker at a time, so
+// whatever refCon points at doesn't need any locking of its own.
+typedef void (*AnalyzerCallback)(void * refCon, const std::vector<TapSampleBuffer> &buffers, UInt64 position, UInt64 framesSkipped);
+
+struct AnalyzerStats
+{
+	UInt64  calls;
+	UInt64  framesAnalyzed;
+	UInt64  framesSkipped;   // by AnalysisSkip, or because the Tap overwrote them first
+	Float64 cpuSeconds;      // spent in the callback
+	Float64 maxCallSeconds;  // the longest single call (wall clock)
+	Float64 load;            // cpuSeconds over the duration of the audio analyzed; 1 means a whole core
+	
+	AnalyzerStats() : calls(0), framesAnalyzed(0), framesSkipped(0), cpuSeconds(0), maxCallSeconds(0), load(0) {}
+};
+
+// An AnalysisScheduler runs analyzers (onset detectors, pitch trackers,
+// loudness meters and so on) over the audio going through any number
+// of Taps, on a fixed pool of worker threads. The workers sleep until a
+// Tap has new audio, and then share out whichever analyzers have a
+// block's worth of it waiting, so the analysis scales with the number of
+// cores rather than coming out of the UI thread's frame time.
+
+// Each analyzer is called with blockFrames frames at a time. When it
+// falls behind (because it's too slow, or the workers are busy) the
+// backpressure setting decides whether it gets everything it missed in
+// one bigger call (a multiple of blockFrames, up to what the Tap keeps)
+// or just the latest block. getStats() says how much CPU each analyzer
+// is using and how much audio it's skipped.
+
+// threadCount 0 means one less than the number of cores (and at least 1).
+
+class AnalysisScheduler
+{
+	struct SchedulerImpl;
+	boost::shared_ptr<SchedulerImpl> _impl;
+
+public:
+	typedef UInt32 AnalyzerID;
+	
+	explicit AnalysisScheduler(UInt32 threadCount = 0);
+	~AnalysisScheduler();
+	
+	UInt32 getThreadCount() const;
+	
+	// Returns 0 if the analyzer couldn't be added (a Tap can only have so
+	// many block callbacks, but each Tap only needs one, no matter how many
+	// analyzers are following it)
+	AnalyzerID addAnalyzer(Tap &tap,
+						   AnalyzerCallback callback,
+						   void * refCon,
+						   UInt32 blockFrames = 1024,
+						   AnalysisBackpressure backpressure = AnalysisCoalesce);
+	
+	// Waits for the analyzer to finish if it's running, so once this
+	// returns it's safe to free whatever refCon points at
+	void removeAnalyzer(AnalyzerID analyzer);
+	
+	AnalyzerStats getStats(AnalyzerID analyzer) const;
+	void resetStats();
+};
+
+} } // namespace cinder::audiounit
@@ -0,0 +1,183 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "GenericUnit.h"
+
+namespace cinder { namespace audiounit {
+
+class Tap;
+
+// A Graph is a snapshot of everything feeding a unit, put together from
+// what connectTo() records as the chain's wired up (see GenericUnit).
+// Units, Taps and Inputs each become a node, and each connection an
+// edge from the node doing the feeding to the input bus it feeds.
+
+// capture() walks back from the sink (usually whatever's connected to
+// the Output) and works out an order to render the nodes in, with every
+// node after everything feeding it and the sink last. It also notices
+// the two shapes the pull model doesn't cope with on its own:
+
+// - a cycle, where a unit ends up feeding itself. There's no order to
+//   render that in, so capture() returns false and getRenderOrder()
+//   should be taken with a grain of salt.
+// - fan-out, where one unit feeds more than one input. Every destination
+//   pulls it, so unless it's rendered once up front (which render()
+//   does) it does its work several times over. Inputs are made to feed
+//   several connections, so they're only counted if you ask.
+
+// render() drives the chain itself from the schedule: after prepare(),
+// each unit is rendered into a buffer of its own, in order, with the
+// same timestamp, and then the sink into the caller's buffers. Audio
+// Units keep the last block they rendered and hand it straight back to
+// anything else that pulls them for the same timestamp, so by the time
+// a unit's pulled by what it feeds, its work is already done. The audio
+// is the same as rendering the sink on its own; what changes is that
+// each unit's work happens at a known point in the schedule, which is
+// what lets independent branches be rendered in parallel. Taps and
+// Inputs aren't rendered up front, as they hand out different audio
+// every time they're pulled; the unit they feed pulls them as usual.
+
+// To do the same while an Output's pulling the chain, capture the
+// Output itself and attach() the Graph to it. At the start of every
+// quantum (in the Output's pre-render notification, on the I/O thread)
+// the Graph renders everything ahead of the Output in the same way,
+// and the Output then pulls the chain as usual and finds it done.
+
+// With setParallelRendering() turned on, prepare() also looks for the
+// point where the chain fans in (a Mixer, usually) and splits what's
+// feeding it into branches that share no units, like the separate
+// tracks going into a mixer's inputs. Each quantum, the branches are
+// handed to a pool of worker threads running at realtime priority.
+// The mixer's inputs are fed from the Graph's buffers rather than
+// connected to the branches, so it picks up their finished audio
+// without pulling them. The render thread never takes a lock or waits
+// for a worker: it starts on the branches itself from the other end of
+// the list, and renders any a worker hasn't got to yet, so a worker
+// that's slow to wake just means that branch is rendered serially, the
+// way it would have been anyway. A branch a worker's already partway
+// through can't be taken back (a unit can't be rendered on two threads
+// at once), so the mixer hears the last quantum that branch finished
+// instead, from a second copy the Graph keeps of each branch's output.
+// A late worker costs its branch a quantum of latency, and one block
+// is heard twice as it falls behind (and one skipped as it catches
+// up), but it's never heard as silence once the branch has finished
+// its first quantum. getParallelStats() counts how often it happens.
+// Render callbacks the branches pull (a Tap's block callbacks, for
+// one) are called on the worker threads.
+
+// Because of that, a chain prepared with parallel rendering has to be
+// driven by the Graph (render(), or attach()) until it's prepared
+// again or cleared; rendered on its own, the mixer hears silence from
+// the branches. Branches that reach the mixer through a Tap or from
+// a unit's second output bus are left serial.
+
+// A Graph holds plain pointers to the units it captured, so recapture
+// it if the chain changes, and don't let it outlive the units.
+
+struct GraphNode
+{
+	GenericUnit * unit; // NULL for a Tap
+	Tap * tap;
+	UInt32 renderBus;   // the output bus the first destination pulls
+	UInt32 destinations;
+	bool rendersAhead;  // whether render() renders it up front
+	bool isInput;
+};
+
+struct GraphParallelStats
+{
+	UInt64 quanta;                 // rendered with branches in parallel
+	UInt64 branchesOnWorkers;
+	UInt64 branchesOnRenderThread; // including the ones no worker got to in time
+	UInt64 late;                   // times the mixer heard a branch's last quantum again, because a worker hadn't finished this one
+};
+
+struct GraphEdge
+{
+	UInt32 source;      // node indices
+	UInt32 destination;
+	UInt32 sourceBus;
+	UInt32 destinationBus;
+};
+
+class Graph
+{
+	struct GraphImpl;
+	boost::shared_ptr<GraphImpl> _impl;
+
+public:
+	Graph();
+	~Graph();
+	
+	// returns false if the chain has a cycle in it
+	bool capture(GenericUnit &sink);
+	void clear();
+	
+	GenericUnit * getSink() const;
+	UInt32 getSinkIndex() const;
+	
+	const std::vector<GraphNode>& getNodes() const;
+	const std::vector<GraphEdge>& getEdges() const;
+	const std::vector<UInt32>& getRenderOrder() const; // node indices, the sink last
+	
+	bool hasCycle() const;
+	std::vector<UInt32> getFanOut(bool includeInputs = false) const; // node indices
+	
+	// the edges feeding a node, by destination bus
+	std::vector<GraphEdge> getInputs(UInt32 node) const;
+	
+	void print() const;
+	
+	// Sets the chain up with prepareChain() (see GenericUnit), and
+	// allocates a buffer for each node that renders ahead. Call it
+	// while the chain's stopped, after capture(). Returns the quantum
+	// render() can be asked for, or 0 on failure
+	UInt32 prepare(UInt32 maximumFramesPerSlice = 0);
+	
+	// Call these before prepare(). workerThreads is a maximum (0 is one
+	// fewer than there are cores); no more are started than there are
+	// branches to share with the render thread
+	void setParallelRendering(bool enabled = true, UInt32 workerThreads = 0);
+	bool isParallelRenderingEnabled() const;
+	
+	// after prepare(): each branch's nodes, in render order
+	UInt32 getBranchCount() const;
+	const std::vector<UInt32>& getBranch(UInt32 branch) const;
+	
+	GraphParallelStats getParallelStats(bool reset = false);
+	
+	// Renders ahead of the sink every time it's rendered. Call these
+	// while the chain's stopped, after prepare()
+	bool attach();
+	void detach();
+	
+	// Render thread. inOutputBusNumber is the sink's
+	OSStatus render(AudioUnitRenderActionFlags *ioActionFlags,
+					const AudioTimeStamp *inTimeStamp,
+					UInt32 inOutputBusNumber,
+					UInt32 inNumberFrames,
+					AudioBufferList *ioData);
+};
+
+} } // namespace cinder::audiounit
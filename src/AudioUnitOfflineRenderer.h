@@ -0,0 +1,100 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "AudioUnitGraph.h"
+#include "AudioUnitRecorder.h"
+
+namespace cinder { namespace audiounit {
+
+// An OfflineRenderer stands in for the Output when you want a chain's
+// audio as fast as it can be rendered rather than in realtime: for
+// bouncing stems, checking that a preset still sounds the way it
+// should, or timing how expensive a chain is.
+
+// Give it a source in place of the Output (the unit, Tap or render
+// callback you'd otherwise connect to the Output, or a Graph captured
+// from that unit to render it in the Graph's order), and render() pulls
+// it block after block in a tight loop, with timestamps it makes up as
+// it goes. The sample times start at 0 (or setSampleTime()) and carry on
+// from one render() to the next. The audio goes into memory, into a
+// file (through a Recorder, which is made to wait rather than drop
+// blocks if the disk can't keep up), or to a callback of your own.
+
+// render() renders the given number of seconds, or stops sooner if
+// setStopAtSilence() is turned on and every channel has stayed below
+// the threshold for holdSeconds (the silence it waited through is
+// kept). getSpeed() then says how many times faster than realtime it
+// went.
+
+// Before rendering, the chain is set up for the renderer's block size
+// with prepareChain(), just as Output::start() would. Only the Audio
+// Unit calls that a chain makes when it's pulled are used, so this
+// also runs without Core Audio, against the software stand-in in
+// CoreAudioStandIn.h (test/OfflineRendererTest.cpp renders with it on
+// Linux). Don't render a chain that an Output is pulling at the same
+// time.
+
+class OfflineRenderer
+{
+	struct OfflineImpl;
+	boost::shared_ptr<OfflineImpl> _impl;
+
+public:
+	OfflineRenderer(UInt32 framesPerSlice = 512);
+	~OfflineRenderer();
+	
+	void setSource(GenericUnit &unit, UInt32 bus = 0);
+	void setSource(Tap &tap);
+	void setSource(Graph &graph); // captured already
+	void setSource(AURenderCallbackStruct callback, UInt32 channels = 2, Float64 sampleRate = 44100);
+	
+	UInt32  getChannelCount() const;
+	Float64 getSampleRate() const;
+	
+	void setFramesPerSlice(UInt32 frames);
+	UInt32 getFramesPerSlice() const;
+	
+	void setSampleTime(Float64 sampleTime);
+	Float64 getSampleTime() const;
+	
+	void setStopAtSilence(bool enabled = true, float thresholdDecibels = -90, float holdSeconds = 0.5);
+	bool isStoppingAtSilence() const;
+	
+	// buffers is filled with one buffer per channel
+	bool render(Float64 seconds, std::vector<TapSampleBuffer> &buffers);
+	bool render(Float64 seconds,
+				const fs::path &filePath,
+				RecorderFileType fileType = RecorderFileCAF,
+				RecorderSampleFormat sampleFormat = RecorderSamplesFloat32);
+	
+	// the callback's called on the calling thread, with each block as it's rendered
+	bool render(Float64 seconds, TapBlockCallback callback, void * refCon);
+	
+	// about the last render()
+	UInt64 getFramesRendered() const;
+	bool stoppedAtSilence() const;
+	double getSpeed() const; // 100 is 100 times faster than realtime
+};
+
+} } // namespace cinder::audiounit
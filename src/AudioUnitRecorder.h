@@ -0,0 +1,108 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "AudioUnitTap.h"
+
+namespace cinder { namespace audiounit {
+
+typedef enum
+{
+	RecorderFileWAV,
+	RecorderFileCAF
+}
+RecorderFileType;
+
+typedef enum
+{
+	RecorderSamplesFloat32,
+	RecorderSamplesInt24
+}
+RecorderSampleFormat;
+
+// A Recorder streams audio to disk as it's rendered, for as long as
+// you like. Start it on a Tap to record whatever passes through it, or
+// on a path, channel count and sample rate and call process() from a
+// render callback of your own.
+
+// On the render thread, each block is just copied into a lock-free
+// queue (nothing is allocated, locked or written there). A writer
+// thread takes the audio off the queue in large batches, converts it
+// to interleaved float32 or packed 24 bit samples, and appends it to
+// the file. Disk space is reserved ahead of the writes, and the header
+// is brought up to date every few seconds, so that if the app dies
+// mid-recording, the file is still readable up to about that point.
+
+// CAF files can be any length. WAV files switch over to RF64 when they
+// go past 4GB (about 3 hours of 48kHz stereo float), which most
+// software can read, but not all of it.
+
+// If the writer falls behind by more than bufferSeconds (on a very
+// slow disk, say), blocks that don't fit in the queue are dropped, and
+// counted in getBlocksDropped() / getFramesDropped(). The recording
+// isn't padded to make up for them.
+
+class Recorder
+{
+	struct RecorderImpl;
+	boost::shared_ptr<RecorderImpl> _impl;
+
+public:
+	Recorder();
+	~Recorder();
+	
+	bool start(Tap &tap,
+			   const fs::path &filePath,
+			   RecorderFileType fileType = RecorderFileCAF,
+			   RecorderSampleFormat sampleFormat = RecorderSamplesFloat32,
+			   float bufferSeconds = 4);
+	
+	bool start(const fs::path &filePath,
+			   UInt32 channels,
+			   Float64 sampleRate,
+			   RecorderFileType fileType = RecorderFileCAF,
+			   RecorderSampleFormat sampleFormat = RecorderSamplesFloat32,
+			   float bufferSeconds = 4);
+	
+	// Writes out everything that's been queued up, finishes off the
+	// file and closes it. Called by the destructor too
+	void stop();
+	
+	bool isRecording() const;
+	bool hasWriteError() const;
+	
+	UInt64 getFramesWritten() const;
+	UInt64 getBlocksDropped() const;
+	UInt64 getFramesDropped() const;
+	
+	// Render thread. Only needed if the recorder wasn't started on a Tap
+	void process(const AudioBufferList * bufferList, UInt32 frames);
+	
+	// Not for the render thread. Like process(), but if the queue's full
+	// it waits for the writer to catch up instead of dropping the block,
+	// for audio that's being rendered faster than realtime (see
+	// OfflineRenderer). Returns false if the block couldn't be written
+	bool write(const AudioBufferList * bufferList, UInt32 frames);
+};
+
+} } // namespace cinder::audiounit
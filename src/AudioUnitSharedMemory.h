@@ -0,0 +1,75 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "AudioUnitTap.h"
+#include "SharedMemorySegment.h"
+#include <string>
+
+namespace cinder { namespace audiounit {
+
+// A SharedMemoryTap publishes the audio going through a Tap (or a
+// render callback) in a named POSIX shared memory segment, so that
+// other processes (visualizers, analysis tools and so on) can follow
+// it without being able to crash or stall the audio process. Readers
+// map the segment read-only, and the writer never waits on them.
+
+// Start it on a Tap, or on a channel count and sample rate and call
+// process() from a render callback. framesToKeep is how far behind the
+// writer a reader can fall (it's rounded up to a whole number of
+// pages); 0 means two seconds. Names follow shm_open()'s rules: they
+// start with a slash (one is added if not), and on OS X they can't be
+// longer than 31 characters. A segment left behind under the same
+// name (by a crashed process, say) is replaced.
+
+// The segment's layout and SharedMemoryTapReader are in
+// SharedMemorySegment.h, which doesn't need Core Audio, so readers can
+// be built on any POSIX system.
+
+class SharedMemoryTap
+{
+	struct SharedMemoryImpl;
+	boost::shared_ptr<SharedMemoryImpl> _impl;
+
+public:
+	static const uint32_t kVersion = kSharedMemoryTapVersion;
+	
+	SharedMemoryTap();
+	~SharedMemoryTap();
+	
+	bool start(Tap &tap, const std::string &name, UInt32 framesToKeep = 0);
+	bool start(const std::string &name, UInt32 channels, Float64 sampleRate, UInt32 framesToKeep = 0);
+	
+	// Marks the segment as closed and unlinks it. Readers that already
+	// have it mapped can keep reading what's there
+	void stop();
+	
+	bool isPublishing() const;
+	std::string getName() const;
+	UInt32 getCapacity() const;
+	
+	// Render thread. Only needed if it wasn't started on a Tap
+	void process(const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp = NULL);
+};
+
+} } // namespace cinder::audiounit
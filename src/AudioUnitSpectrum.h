@@ -0,0 +1,88 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "AudioUnitTap.h"
+
+namespace cinder { namespace audiounit {
+
+typedef enum
+{
+	SpectrumBandsLinear,
+	SpectrumBandsLog,
+	SpectrumBandsMel
+}
+SpectrumBandScale;
+
+// A SpectrumTap runs FFTs over the audio passing through a Tap. It
+// does the work on its own thread, as the audio arrives, so all you
+// have to do from the UI thread is pick up the latest spectrum.
+
+// Each spectrum covers fftSize frames (a power of two, at least 4;
+// anything else is rounded up to one), and a new one is computed
+// every hopSize frames, so consecutive spectra overlap by (fftSize -
+// hopSize) frames. The audio is Hann windowed first.
+
+// With bandCount set to 0, you get the magnitude of every FFT bin
+// (fftSize / 2 + 1 of them, from DC to Nyquist). Otherwise the bins
+// are grouped into bandCount bands, spaced linearly, logarithmically
+// (from 20Hz up) or on the mel scale. Magnitudes are linear, with a
+// full scale sine wave coming out at about 0.5 (because of the window).
+
+// channel is the channel of the Tap to analyze. Pass
+// SpectrumTap::kAllChannels to analyze the average of all of them.
+
+class SpectrumTap
+{
+	struct SpectrumImpl;
+	boost::shared_ptr<SpectrumImpl> _impl;
+	
+public:
+	static const UInt32 kAllChannels = 0xFFFFFFFF;
+	
+	SpectrumTap();
+	SpectrumTap(Tap &tap,
+				UInt32 fftSize = 2048,
+				UInt32 hopSize = 512,
+				UInt32 bandCount = 0,
+				SpectrumBandScale scale = SpectrumBandsLinear,
+				UInt32 channel = kAllChannels);
+	~SpectrumTap();
+	
+	UInt32 getFFTSize() const;
+	UInt32 getHopSize() const;
+	UInt32 getBandCount() const;
+	
+	// the centre frequency (in Hz) of each band or bin
+	std::vector<float> getBandFrequencies() const;
+	
+	// Copies the most recent spectrum into magnitudes. Returns false if
+	// there isn't one yet. If spectrumIndex is given, it's set to the
+	// number of the spectrum (they're counted from 0), so you can tell
+	// whether it's new and whether you've missed any
+	bool getSpectrum(std::vector<float> &magnitudes, UInt64 * spectrumIndex = NULL) const;
+	
+	UInt64 getSpectrumCount() const;
+};
+
+} } // namespace cinder::audiounit
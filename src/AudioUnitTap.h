@@ -23,10 +23,20 @@
 #pragma once
 
 #include "GenericUnit.h"
+#include "BroadcastBuffer.h"
+#include "WaveformPyramid.h"
+#include "LevelMeter.h"
+#include "RingHealth.h"
 
 namespace cinder { namespace audiounit {
 
 typedef std::vector<AudioUnitSampleType> TapSampleBuffer;
+typedef BroadcastBuffer::View TapView;
+
+// Called on the render thread each time a block of audio has been added
+// to a Tap's history. Since it's called on the render thread, it must
+// not lock, allocate or do anything else that might block
+typedef void (*TapBlockCallback)(void * refCon, const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp);
 	
 // The Tap acts like an Audio Unit (as in, you can connect
 // it to other Audio Units). In reality, it hooks up two
@@ -40,13 +50,53 @@ typedef std::vector<AudioUnitSampleType> TapSampleBuffer;
 // this range, but this will typically be due to an Audio Unit
 // overloading its output.
 
-// Note that if you just want to know how loud the audio is,
-// the Mixer will allow you to access that value with less overhead.
+// If you just want to know how loud the audio is, turn on
+// setLevelMeteringEnabled() and use getLevels(). The Tap then measures
+// the peak, RMS and true peak of each channel as it renders (see
+// LevelMeter), so reading them doesn't involve any samples at all.
+
+// The samples are written once per render into a shared history,
+// so any number of TapReaders (see below) can follow the same Tap
+// without it rendering or copying anything extra.
+
+// getView() lets you look at the most recent samples without
+// copying them at all (see BroadcastBuffer::View). The Tap keeps
+// some extra history beyond samplesToTrack (as much again, unless
+// you setViewHeadroom()), so a view stays intact until that much
+// more audio has gone through. If you hold on to a view across
+// frames, check isValid() after you've used it. getSamples() copies
+// the same samples out into vectors.
+
+// If all you want to do is draw a waveform, getWaveform() gives you
+// the min, max and RMS of the audio for each column you're going to
+// draw, instead of every sample. Turning on setWaveformEnabled() has
+// the Tap keep these summaries at several zoom levels as the audio goes
+// by, so that getWaveform() only has to look at a handful of them per
+// column, and can reach much further back than samplesToTrack. Without
+// it (or when zoomed in closer than 16 frames per column), the columns
+// are worked out from the samples themselves.
+
+// Block callbacks let helpers such as SpectrumTap find out about new
+// audio as soon as it's arrived, without polling. A Tap can have up to
+// 8 of them. removeBlockCallback() waits for the callback to return if
+// the render thread happens to be in it, so once it returns, it's safe
+// to free whatever refCon points at.
+
+// getRingHealth() keeps track of how the Tap's readers are keeping up
+// (see RingHealth). The fill is how far behind the Tap a reader was
+// each time it read, and an overrun is a reader being lapped, so that
+// audio it hadn't read yet was overwritten (this is the total across
+// all readers; each TapReader's getFramesDropped() has its own share).
+// An underrun is a block the Tap's source failed to render, which
+// leaves a gap in the history.
 
 class Tap
 {
 	struct TapImpl;
 	boost::shared_ptr<TapImpl> _impl;
+	friend class TapReader;
+	friend class TapGroup;
+	friend class AnalysisScheduler;
 	
 public:
 	Tap(unsigned int samplesToTrack = 4096);
@@ -55,10 +105,122 @@ public:
 	GenericUnit& connectTo(GenericUnit &destination, UInt32 destinationBus = 0, UInt32 sourceBus = 0);
 	
 	void setSource(GenericUnit * source);
-	void setSource(AURenderCallbackStruct callback, UInt32 channels = 2);
+	void setSource(AURenderCallbackStruct callback, UInt32 channels = 2, Float64 sampleRate = 44100);
+	GenericUnit * getSourceUnit() const; // NULL unless the source is a unit
+	
+	// The history's made big enough to keep samplesToTrack intact while
+	// blocks of this many frames are being rendered (prepareChain() calls
+	// this). Call it before the Tap starts rendering
+	bool setMaximumFramesPerSlice(UInt32 frames);
+	
+	// How much history's kept beyond samplesToTrack: how long a view
+	// stays intact, and how far a TapReader can fall behind. 0 (the
+	// default) is samplesToTrack again, or four blocks if that's more.
+	// It's never less than two blocks. Call it before the Tap starts
+	// rendering
+	void setViewHeadroom(UInt32 frames);
+	UInt32 getViewHeadroom() const; // in frames, as it stands now
+	
+	// Pulls a block through the Tap, the same way a unit it's connected
+	// to would (OfflineRenderer uses this to stand in for the Output)
+	OSStatus render(AudioUnitRenderActionFlags *ioActionFlags,
+					const AudioTimeStamp *inTimeStamp,
+					UInt32 inOutputBusNumber,
+					UInt32 inNumberFrames,
+					AudioBufferList *ioData);
+	
+	UInt32  getChannelCount() const;
+	Float64 getSampleRate() const;
+	
+	bool addBlockCallback(TapBlockCallback callback, void * refCon);
+	void removeBlockCallback(TapBlockCallback callback, void * refCon);
+	
+	TapView getView() const;
+	
+	// call these before the Tap starts rendering
+	void setWaveformEnabled(bool enabled = true);
+	bool isWaveformEnabled() const;
+	
+	void getWaveform(std::vector<WaveformColumn> &columns, UInt32 columnCount, UInt32 framesToShow, UInt32 channel = 0) const;
+	
+	// call this before the Tap starts rendering too. The meter's
+	// settings can be changed through getLevelMeter() at any time
+	void setLevelMeteringEnabled(bool enabled = true);
+	bool isLevelMeteringEnabled() const;
+	
+	LevelReading getLevels(UInt32 channel = 0) const;
+	LevelMeter& getLevelMeter();
+	
+	RingHealthReading getRingHealth(bool reset = false);
+	void resetRingHealth();
 	
 	void getSamples(TapSampleBuffer &buffer); // retrieves a mono buffer
 	void getSamples(std::vector<TapSampleBuffer> &buffers);
 };
 
+// A TapReader follows the audio passing through a Tap. Each
+// reader has its own position, so several of them (a recorder,
+// a visualizer and an analyzer, say) can read the same Tap
+// independently of each other.
+
+// read() returns only what has passed through the Tap since the
+// previous read() (or since the reader was created), so the cost of
+// reading depends on how much audio there is rather than on how big
+// the Tap's history is. Pass maxFrames to read in smaller chunks;
+// whatever isn't read stays put for next time. readView() does the
+// same without copying anything (see TapView).
+
+// If a reader isn't read often enough, the Tap will overwrite audio
+// that the reader hasn't seen yet. In that case read() returns false
+// and picks up from the oldest audio the Tap still has, and the
+// frames it missed are added to getFramesDropped().
+
+class TapReader
+{
+	boost::shared_ptr<Tap::TapImpl> _tapImpl;
+	BroadcastBuffer::Cursor _cursor;
+	
+public:
+	TapReader();
+	explicit TapReader(const Tap &tap);
+	
+	bool read(TapSampleBuffer &buffer, UInt32 maxFrames = UINT32_MAX); // reads a mono buffer
+	bool read(std::vector<TapSampleBuffer> &buffers, UInt32 maxFrames = UINT32_MAX);
+	TapView readView(UInt32 maxFrames = UINT32_MAX);
+	
+	UInt32 getAvailableFrames() const;
+	UInt64 getFramesDropped() const {return _cursor.framesDropped;}
+	UInt64 getPosition() const {return _cursor.position;}
+};
+
+// A TapGroup reads several Taps at once, lined up by sample time.
+// Each Tap remembers the sample time of every block that passes
+// through it, so as long as the Taps are rendered as part of the same
+// chain (and so see the same timestamps), the group can hand back
+// exactly the same stretch of time from each of them. This is what
+// you want for comparing tracks against each other (phase, transient
+// alignment, multitrack recording and so on).
+
+// getSamples() / getViews() fill in one entry per Tap, in the order
+// they were added, covering the most recent frames that all of the
+// Taps have in common. They return false if the Taps have no time in
+// common (for instance, if one of them hasn't been rendered yet). If
+// sampleTime is given, it's set to the sample time of the first frame.
+
+class TapGroup
+{
+	std::vector<boost::shared_ptr<Tap::TapImpl> > _taps;
+	
+public:
+	TapGroup();
+	
+	void add(const Tap &tap);
+	void clear();
+	size_t size() const {return _taps.size();}
+	
+	bool getViews(std::vector<TapView> &views, UInt32 frames, Float64 * sampleTime = NULL) const;
+	bool getSamples(std::vector<TapSampleBuffer> &buffers, UInt32 frames, Float64 * sampleTime = NULL) const; // mono, one buffer per Tap
+	bool getSamples(std::vector<std::vector<TapSampleBuffer> > &buffers, UInt32 frames, Float64 * sampleTime = NULL) const;
+};
+
 } } // namespace cinder::audiounit
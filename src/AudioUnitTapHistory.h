@@ -0,0 +1,99 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "AudioUnitTap.h"
+
+namespace cinder { namespace audiounit {
+
+typedef enum
+{
+	TapHistoryInt16,      // 2 bytes per sample, clipped to -1...1
+	TapHistoryInt24,      // 3 bytes per sample, clipped to -1...1
+	TapHistoryBlockFloat  // 2 bytes per sample, plus a scale per block
+}
+TapHistoryEncoding;
+
+// A TapHistory keeps a long history (minutes, rather than the
+// milliseconds a Tap keeps) of the audio going through a Tap, for
+// scrubbing back through it, re-analyzing it and so on. To keep the
+// memory down, the audio is stored at reduced precision: 10 minutes of
+// a mono 48kHz stem takes about 55MB as int16 or block floating point,
+// rather than 110MB as floats.
+
+// TapHistoryBlockFloat stores each block of each channel as 16 bit
+// values plus a scale for the whole block, so unlike int16 it doesn't
+// clip anything over full scale, and quiet passages keep the full 16
+// bits of resolution. It's the best choice unless you're sure the
+// audio stays within -1...1.
+
+// The audio is encoded a block (kBlockFrames) at a time on the render
+// thread, so the most recent partial block isn't in the history yet;
+// get that from the Tap. Each block remembers the sample time of its
+// first frame, so the history can be read by position (frames since it
+// started) or by sample time. read() decodes back to floats, and
+// trims off (from the front) anything that the writer overwrote while
+// it was reading.
+
+// As with Recorder, start it on a Tap, or on a channel count and
+// sample rate and call process() from a render callback. Don't read
+// from it while it's being started or stopped.
+
+class TapHistory
+{
+	struct HistoryImpl;
+	boost::shared_ptr<HistoryImpl> _impl;
+
+public:
+	static const UInt32 kBlockFrames = 1024;
+	
+	TapHistory();
+	~TapHistory();
+	
+	bool start(Tap &tap, Float64 seconds = 600, TapHistoryEncoding encoding = TapHistoryBlockFloat);
+	bool start(UInt32 channels, Float64 sampleRate, Float64 seconds = 600, TapHistoryEncoding encoding = TapHistoryBlockFloat);
+	void stop();
+	
+	UInt32  getChannelCount() const;
+	Float64 getSampleRate() const;
+	TapHistoryEncoding getEncoding() const;
+	size_t  getMemoryUsage() const; // in bytes
+	
+	// The range of positions [oldest, end) that can be read right now
+	UInt64 getOldestPosition() const;
+	UInt64 getEndPosition() const;
+	
+	bool sampleTimeForPosition(UInt64 position, Float64 &sampleTime) const;
+	bool positionForSampleTime(Float64 sampleTime, UInt64 &position) const;
+	
+	// Decodes up to frames frames from position into buffers (one per
+	// channel), clamped to what's in the history. Returns the position of
+	// the first frame decoded; buffers[n].size() says how many there were
+	UInt64 read(UInt64 position, UInt32 frames, std::vector<TapSampleBuffer> &buffers) const;
+	bool readAtSampleTime(Float64 sampleTime, UInt32 frames, std::vector<TapSampleBuffer> &buffers) const;
+	
+	// Render thread. Only needed if it wasn't started on a Tap
+	void process(const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp = NULL);
+};
+
+} } // namespace cinder::audiounit
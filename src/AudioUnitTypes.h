@@ -22,8 +22,12 @@
 
 #pragma once
 
+#if defined(__APPLE__)
 #include <AudioUnit/AUComponent.h>
 #include <CoreAudio/CoreAudioTypes.h>
+#else
+#include "CoreAudioStandIn.h"
+#endif
 #include <boost/shared_ptr.hpp>
 #include <vector>
 
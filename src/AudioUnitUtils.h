@@ -23,7 +23,9 @@
 #pragma once
 
 #include "AudioUnitTypes.h"
+#include "RealtimeMemory.h"
 #include "cinder/Filesystem.h"
+#include <iostream>
 #include <string>
 #include <sstream>
 
@@ -86,17 +88,19 @@ static std::string StringForAudioComponentDescription(const AudioComponentDescri
 	return ss.str();
 }
 
+// Buffers from AudioBufferListAlloc are meant to be used on the render
+// thread, so they come from the RealtimeMemory pool when it's enabled
 static AudioBufferList * AudioBufferListAlloc(UInt32 channels, UInt32 samplesPerChannel)
 {
 	AudioBufferList * bufferList = NULL;
 	size_t bufferListSize = offsetof(AudioBufferList, mBuffers[0]) + (sizeof(AudioBuffer) * channels);
-	bufferList = (AudioBufferList *)calloc(1, bufferListSize);
+	bufferList = (AudioBufferList *)cinder::audiounit::RealtimeMemory::allocate(bufferListSize);
 	bufferList->mNumberBuffers = channels;
 	
 	for(UInt32 i = 0; i < bufferList->mNumberBuffers; i++) {
 		bufferList->mBuffers[i].mNumberChannels = 1;
 		bufferList->mBuffers[i].mDataByteSize   = samplesPerChannel * sizeof(AudioUnitSampleType);
-		bufferList->mBuffers[i].mData           = calloc(samplesPerChannel, sizeof(AudioUnitSampleType));
+		bufferList->mBuffers[i].mData           = cinder::audiounit::RealtimeMemory::allocate(samplesPerChannel * sizeof(AudioUnitSampleType));
 	}
 	return bufferList;
 }
@@ -104,12 +108,14 @@ static AudioBufferList * AudioBufferListAlloc(UInt32 channels, UInt32 samplesPer
 static void AudioBufferListRelease(AudioBufferList * bufferList)
 {
 	for(int i = 0; i < bufferList->mNumberBuffers; i++) {
-		free(bufferList->mBuffers[i].mData);
+		cinder::audiounit::RealtimeMemory::deallocate(bufferList->mBuffers[i].mData);
 	}
 		
-	free(bufferList);
+	cinder::audiounit::RealtimeMemory::deallocate(bufferList);
 }
 
+#if defined(__APPLE__)
+
 static std::string StringForPathFromURL(const CFURLRef &urlRef)
 {
 	CFStringRef filePath = CFURLCopyFileSystemPath(urlRef, kCFURLPOSIXPathStyle);
@@ -126,3 +132,5 @@ static CFURLRef CreateURLFromPath(const ci::fs::path &path)
 												   path.string().length(),
 												   false);
 }
+
+#endif
@@ -0,0 +1,445 @@
+#include "BroadcastBuffer.h"
+#include "RealtimeMemory.h"
+#include "TPCircularBuffer/TPCircularBuffer.h"
+#include <algorithm>
+
+using namespace cinder::audiounit;
+using namespace std;
+
+// What the buffer remembers about each block that was written.
+// sequence works like the buffer's reserve position: it's zeroed while
+// the writer fills the record in, and set to the block's number (+1)
+// once it's done
+struct BlockRecord
+{
+	std::atomic<UInt64> sequence;
+	UInt64  position;
+	Float64 sampleTime;
+	UInt32  frames;
+	
+	BlockRecord() : sequence(0), position(0), sampleTime(0), frames(0) {}
+};
+
+struct BroadcastBuffer::Storage
+{
+	void * memory;
+	UInt32 channels;
+	UInt32 capacity;    // frames per channel
+	UInt32 laneLength;  // bytes per channel, not counting the mirror
+	
+	// The writer bumps reservePosition before touching the buffer and
+	// writePosition once it's finished. Anything older than
+	// (reservePosition - capacity) may have been overwritten.
+	std::atomic<UInt64> reservePosition;
+	std::atomic<UInt64> writePosition;
+	
+	// enough records to cover the whole buffer with small (16 frame) blocks
+	std::vector<BlockRecord> records;
+	std::atomic<UInt64> blocksWritten;
+	Float64 nextSampleTime; // only touched by the writer
+	
+	Storage(UInt32 channels, UInt32 framesToKeep)
+	: memory(NULL)
+	, channels(0)
+	, capacity(0)
+	, laneLength(0)
+	, reservePosition(0)
+	, writePosition(0)
+	, records(max<UInt32>(64, framesToKeep / 16))
+	, blocksWritten(0)
+	, nextSampleTime(0)
+	{
+		const int32_t length = TPCircularBufferRoundLength(framesToKeep * sizeof(AudioUnitSampleType));
+		memory = TPCircularBufferMirroredAllocate(length, channels);
+		
+		if(memory) {
+			this->channels = channels;
+			laneLength = length;
+			capacity   = length / sizeof(AudioUnitSampleType);
+			RealtimeMemory::lock(memory, (size_t)laneLength * 2 * channels);
+		}
+	}
+	
+	~Storage()
+	{
+		RealtimeMemory::unlock(memory, (size_t)laneLength * 2 * channels);
+		TPCircularBufferMirroredDeallocate(memory, laneLength, channels);
+	}
+	
+	const AudioUnitSampleType * channelData(UInt32 channel, UInt64 position) const
+	{
+		const char * lane = (const char *)memory + (size_t)channel * laneLength * 2;
+		return (const AudioUnitSampleType *)lane + (position % capacity);
+	}
+	
+	AudioUnitSampleType * channelData(UInt32 channel, UInt64 position)
+	{
+		char * lane = (char *)memory + (size_t)channel * laneLength * 2;
+		return (AudioUnitSampleType *)lane + (position % capacity);
+	}
+	
+	UInt64 oldestPosition() const
+	{
+		const UInt64 reserved = reservePosition.load(memory_order_acquire);
+		return reserved > capacity ? reserved - capacity : 0;
+	}
+	
+	void recordBlock(UInt64 position, UInt32 frames, const AudioTimeStamp * timeStamp)
+	{
+		if(timeStamp && (timeStamp->mFlags & kAudioTimeStampSampleTimeValid)) {
+			nextSampleTime = timeStamp->mSampleTime;
+		}
+		
+		const UInt64 block = blocksWritten.load(memory_order_relaxed);
+		BlockRecord &record = records[block % records.size()];
+		
+		record.sequence.store(0, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+		record.position   = position;
+		record.sampleTime = nextSampleTime;
+		record.frames     = frames;
+		record.sequence.store(block + 1, memory_order_release);
+		
+		blocksWritten.store(block + 1, memory_order_release);
+		nextSampleTime += frames;
+	}
+	
+	// Looks through the records from newest to oldest for the block that
+	// match() accepts. Gives up as soon as it reaches a record the writer
+	// is in the middle of replacing
+	template<typename Match>
+	bool findBlock(Match match, UInt64 &position, Float64 &sampleTime) const
+	{
+		const UInt64 blocks = blocksWritten.load(memory_order_acquire);
+		const UInt64 oldestBlock = blocks > records.size() ? blocks - records.size() : 0;
+		
+		for(UInt64 block = blocks; block > oldestBlock; block--) {
+			const BlockRecord &record = records[(block - 1) % records.size()];
+			
+			if(record.sequence.load(memory_order_acquire) != block) return false;
+			const UInt64  p = record.position;
+			const Float64 t = record.sampleTime;
+			const UInt32  f = record.frames;
+			atomic_thread_fence(memory_order_acquire);
+			if(record.sequence.load(memory_order_relaxed) != block) return false;
+			
+			if(match(p, t, f)) {
+				position   = p;
+				sampleTime = t;
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	bool sampleTimeForPosition(UInt64 position, Float64 &sampleTime) const
+	{
+		UInt64 blockPosition;
+		Float64 blockSampleTime;
+		
+		if(!findBlock([position](UInt64 p, Float64, UInt32 f) { return position >= p && position < p + f; },
+					  blockPosition, blockSampleTime)) return false;
+		
+		sampleTime = blockSampleTime + (position - blockPosition);
+		return true;
+	}
+	
+	bool positionForSampleTime(Float64 sampleTime, UInt64 &position) const
+	{
+		UInt64 blockPosition;
+		Float64 blockSampleTime;
+		
+		if(!findBlock([sampleTime](UInt64, Float64 t, UInt32 f) { return sampleTime >= t && sampleTime < t + f; },
+					  blockPosition, blockSampleTime)) return false;
+		
+		position = blockPosition + (UInt64)(sampleTime - blockSampleTime);
+		return true;
+	}
+};
+
+BroadcastBuffer::BroadcastBuffer()
+{
+}
+
+BroadcastBuffer::~BroadcastBuffer()
+{
+}
+
+bool BroadcastBuffer::allocate(UInt32 channels, UInt32 framesToKeep)
+{
+	// any Views of the old storage keep it alive until they're done with it
+	release();
+	
+	if(channels == 0 || framesToKeep == 0) return true;
+	
+	boost::shared_ptr<Storage> storage(new Storage(channels, framesToKeep));
+	if(!storage->memory) return false;
+	
+	_storage = storage;
+	return true;
+}
+
+void BroadcastBuffer::release()
+{
+	_storage.reset();
+}
+
+UInt32 BroadcastBuffer::getChannelCount() const
+{
+	return _storage ? _storage->channels : 0;
+}
+
+UInt32 BroadcastBuffer::getCapacity() const
+{
+	return _storage ? _storage->capacity : 0;
+}
+
+#pragma mark - Writing
+
+void BroadcastBuffer::write(const AudioBufferList * bufferList, UInt32 inNumberFrames, const AudioTimeStamp * timeStamp)
+{
+	Storage * s = _storage.get();
+	if(!s || inNumberFrames == 0) return;
+	
+	const UInt64 start = s->writePosition.load(memory_order_relaxed);
+	const UInt64 end   = start + inNumberFrames;
+	
+	// if we're handed more than we can hold, only the newest audio is kept
+	const UInt32 framesToSkip = inNumberFrames > s->capacity ? inNumberFrames - s->capacity : 0;
+	const UInt32 framesToCopy = inNumberFrames - framesToSkip;
+	
+	// let readers know which part of the history is about to be overwritten
+	s->reservePosition.store(end, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	
+	for(UInt32 i = 0; i < s->channels; i++) {
+		AudioUnitSampleType * dst = s->channelData(i, start + framesToSkip);
+		
+		if(i < bufferList->mNumberBuffers) {
+			const AudioUnitSampleType * src = (const AudioUnitSampleType *)bufferList->mBuffers[i].mData;
+			memcpy(dst, src + framesToSkip, framesToCopy * sizeof(AudioUnitSampleType));
+		} else {
+			memset(dst, 0, framesToCopy * sizeof(AudioUnitSampleType));
+		}
+	}
+	
+	// the record goes in before the frames are published, so anyone who
+	// can see the frames can also find out when they were rendered
+	s->recordBlock(start, inNumberFrames, timeStamp);
+	s->writePosition.store(end, memory_order_release);
+}
+
+#pragma mark - Reading
+
+UInt64 BroadcastBuffer::getWritePosition() const
+{
+	return _storage ? _storage->writePosition.load(memory_order_acquire) : 0;
+}
+
+UInt64 BroadcastBuffer::getOldestPosition() const
+{
+	return _storage ? _storage->oldestPosition() : 0;
+}
+
+bool BroadcastBuffer::sampleTimeForPosition(UInt64 position, Float64 &sampleTime) const
+{
+	return _storage && _storage->sampleTimeForPosition(position, sampleTime);
+}
+
+bool BroadcastBuffer::positionForSampleTime(Float64 sampleTime, UInt64 &position) const
+{
+	return _storage && _storage->positionForSampleTime(sampleTime, position);
+}
+
+BroadcastBuffer::Cursor BroadcastBuffer::cursorAtWritePosition() const
+{
+	Cursor cursor;
+	cursor.position = getWritePosition();
+	return cursor;
+}
+
+BroadcastBuffer::Cursor BroadcastBuffer::cursorAtOldestPosition() const
+{
+	Cursor cursor;
+	cursor.position = getOldestPosition();
+	return cursor;
+}
+
+UInt32 BroadcastBuffer::getAvailableFrames(const Cursor &cursor) const
+{
+	if(!_storage) return 0;
+	
+	const UInt64 end   = _storage->writePosition.load(memory_order_acquire);
+	const UInt64 start = min(max(cursor.position, _storage->oldestPosition()), end);
+	return end - start;
+}
+
+// Works out where a read from the cursor should start and end, and
+// counts anything the cursor has already missed as dropped. Returns false
+// if the reader lagged
+static bool StartReading(BroadcastBuffer::Cursor &cursor, UInt64 oldest, UInt64 end, UInt32 maxFrames, UInt64 &start, UInt64 &stop)
+{
+	bool lagged = false;
+	
+	// a cursor past the write position belongs to a previous allocation
+	if(cursor.position > end) {
+		cursor.position = end;
+		lagged = true;
+	}
+	
+	start = min(max(cursor.position, oldest), end);
+	stop  = start + min<UInt64>(end - start, maxFrames);
+	
+	if(start != cursor.position) {
+		cursor.framesDropped += start - cursor.position;
+		lagged = true;
+	}
+	
+	return !lagged;
+}
+
+bool BroadcastBuffer::read(Cursor &cursor, vector<vector<AudioUnitSampleType> > &buffers, UInt32 maxFrames) const
+{
+	const Storage * s = _storage.get();
+	
+	if(!s) {
+		for(size_t i = 0; i < buffers.size(); i++) buffers[i].clear();
+		cursor.position = 0;
+		return true;
+	}
+	
+	UInt64 start, end;
+	bool kept = StartReading(cursor, s->oldestPosition(), s->writePosition.load(memory_order_acquire), maxFrames, start, end);
+	
+	const size_t buffersToCopy = min(buffers.size(), (size_t)s->channels);
+	const UInt32 framesToCopy  = end - start;
+	
+	for(size_t i = 0; i < buffersToCopy; i++) {
+		const AudioUnitSampleType * src = s->channelData(i, start);
+		buffers[i].assign(src, src + framesToCopy);
+	}
+	
+	// anything the writer has started overwriting while we were
+	// copying can't be trusted, so it gets dropped from the front
+	atomic_thread_fence(memory_order_acquire);
+	const UInt64 oldest = s->oldestPosition();
+	
+	if(oldest > start) {
+		const size_t framesToDrop = min(oldest, end) - start;
+		for(size_t i = 0; i < buffersToCopy; i++) {
+			buffers[i].erase(buffers[i].begin(), buffers[i].begin() + framesToDrop);
+		}
+		cursor.framesDropped += framesToDrop;
+		kept = false;
+	}
+	
+	for(size_t i = buffersToCopy; i < buffers.size(); i++) {
+		buffers[i].clear();
+	}
+	
+	cursor.position = end;
+	return kept;
+}
+
+BroadcastBuffer::View BroadcastBuffer::readView(Cursor &cursor, UInt32 maxFrames) const
+{
+	View v;
+	
+	if(!_storage) {
+		cursor.position = 0;
+		return v;
+	}
+	
+	UInt64 start, end;
+	StartReading(cursor, _storage->oldestPosition(), _storage->writePosition.load(memory_order_acquire), maxFrames, start, end);
+	
+	v._storage  = _storage;
+	v._position = start;
+	v._frames   = end - start;
+	
+	cursor.position = end;
+	return v;
+}
+
+#pragma mark - Views
+
+BroadcastBuffer::View BroadcastBuffer::view(UInt64 position, UInt32 frames) const
+{
+	View v;
+	if(!_storage) return v;
+	
+	const UInt64 end   = _storage->writePosition.load(memory_order_acquire);
+	const UInt64 start = min(max(position, _storage->oldestPosition()), end);
+	
+	v._storage  = _storage;
+	v._position = start;
+	v._frames   = min<UInt64>(frames, end - start);
+	return v;
+}
+
+BroadcastBuffer::View BroadcastBuffer::viewLatest(UInt32 frames) const
+{
+	const UInt64 end = getWritePosition();
+	return view(end > frames ? end - frames : 0, frames);
+}
+
+BroadcastBuffer::View::View()
+: _position(0)
+, _frames(0)
+{
+}
+
+UInt32 BroadcastBuffer::View::getChannelCount() const
+{
+	return _storage ? _storage->channels : 0;
+}
+
+const AudioUnitSampleType * BroadcastBuffer::View::getChannel(UInt32 channel) const
+{
+	if(!_storage || channel >= _storage->channels) return NULL;
+	return _storage->channelData(channel, _position);
+}
+
+bool BroadcastBuffer::View::isValid() const
+{
+	// the frames are intact as long as the writer hasn't reserved
+	// anything a whole buffer's length past the start of the view. The
+	// fence keeps whatever the caller read from the view ahead of the check
+	atomic_thread_fence(memory_order_acquire);
+	return !_storage || _storage->reservePosition.load(memory_order_relaxed) <= _position + _storage->capacity;
+}
+
+bool BroadcastBuffer::View::getSampleTime(Float64 &sampleTime) const
+{
+	return _storage && _frames > 0 && _storage->sampleTimeForPosition(_position, sampleTime);
+}
+
+bool BroadcastBuffer::View::copyTo(vector<vector<AudioUnitSampleType> > &buffers) const
+{
+	const size_t buffersToCopy = _storage ? min(buffers.size(), (size_t)_storage->channels) : 0;
+	
+	for(size_t i = 0; i < buffersToCopy; i++) {
+		const AudioUnitSampleType * src = _storage->channelData(i, _position);
+		buffers[i].assign(src, src + _frames);
+	}
+	
+	for(size_t i = buffersToCopy; i < buffers.size(); i++) {
+		buffers[i].clear();
+	}
+	
+	if(!_storage) return true;
+	
+	atomic_thread_fence(memory_order_acquire);
+	const UInt64 oldest = _storage->oldestPosition();
+	
+	if(oldest > _position) {
+		const size_t framesToDrop = min<UInt64>(oldest - _position, _frames);
+		for(size_t i = 0; i < buffersToCopy; i++) {
+			buffers[i].erase(buffers[i].begin(), buffers[i].begin() + framesToDrop);
+		}
+		return false;
+	}
+	
+	return true;
+}
@@ -0,0 +1,176 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "AudioUnitTypes.h"
+#include <boost/shared_ptr.hpp>
+#include <atomic>
+#include <stdint.h>
+
+namespace cinder { namespace audiounit {
+
+// BroadcastBuffer keeps a rolling history of planar audio which
+// is written by one thread (typically the render thread) and read
+// by any number of others.
+
+// Unlike TPCircularBuffer, readers never consume anything. Each
+// reader keeps its own Cursor (a position in the stream) and the
+// writer simply overwrites the oldest audio as it goes. The writer
+// never waits on readers; if a reader falls more than a buffer's
+// length behind, it finds out that it has lagged and skips ahead
+// to the oldest audio which is still intact.
+
+// Positions are counted in frames since the buffer was allocated.
+
+// The reserve and write positions work like a seqlock's sequence
+// counter. Before touching the memory the writer publishes how far
+// it's about to write (the reserve position), and once it's done it
+// publishes the write position. A reader copies what it wants and
+// then re-checks the reserve position; anything the writer might have
+// touched in the meantime is thrown away rather than returned torn.
+// The writer never waits and never retries, no matter what the
+// readers are doing.
+
+// The writer can also pass the AudioTimeStamp of each block it
+// writes. The buffer remembers the sample time of (roughly) its
+// capacity's worth of recent blocks, so positions in the stream can
+// be matched up with sample times, and so with other buffers written
+// during the same render cycles.
+
+class BroadcastBuffer
+{
+	struct Storage;
+	
+public:
+	struct Cursor
+	{
+		Cursor() : position(0), framesDropped(0) {}
+		UInt64 position;
+		UInt64 framesDropped; // frames skipped over so far because the reader lagged
+	};
+	
+	// A View looks straight into the buffer's memory instead of copying
+	// out of it. Because the memory is mirrored, every channel of a view
+	// is one contiguous run of samples, even where it wraps around.
+	
+	// Holding a View keeps the memory it points into alive, even if the
+	// buffer is reallocated or destroyed in the meantime. It can't stop
+	// the writer from overwriting the frames though, so read what you
+	// need and then check isValid(): if it returns false, the writer
+	// got to some of the frames while you were reading them.
+	class View
+	{
+	public:
+		View();
+		
+		UInt32 getChannelCount() const;
+		UInt32 size() const {return _frames;}
+		bool empty() const  {return _frames == 0;}
+		UInt64 getPosition() const {return _position;}
+		
+		// The sample time of the first frame in the view, if the writer
+		// was given timestamps and the block it came from is still known
+		bool getSampleTime(Float64 &sampleTime) const;
+		
+		// frames [0, size()) of the given channel
+		const AudioUnitSampleType * getChannel(UInt32 channel) const;
+		
+		// true if none of the viewed frames have been overwritten yet.
+		// This is a single atomic load, so it's fine to call often
+		bool isValid() const;
+		
+		// Copies the view into buffers (one per channel). Frames which
+		// the writer overwrote during the copy are trimmed from the front,
+		// so the copy is always a consistent snapshot across channels.
+		// Returns false if anything had to be trimmed
+		bool copyTo(std::vector<std::vector<AudioUnitSampleType> > &buffers) const;
+		
+	private:
+		friend class BroadcastBuffer;
+		boost::shared_ptr<const Storage> _storage;
+		UInt64 _position;
+		UInt32 _frames;
+	};
+	
+	BroadcastBuffer();
+	~BroadcastBuffer();
+	
+	// (re)allocates the buffer and resets the stream position to 0.
+	// This must not be called while the buffer is being written or read
+	bool allocate(UInt32 channels, UInt32 framesToKeep);
+	void release();
+	
+	UInt32 getChannelCount() const;
+	UInt32 getCapacity() const;
+	
+	// Writer side. Copies the first inNumberFrames of each buffer
+	// in the list and publishes them with a single atomic store. Blocks
+	// written without a (valid) sample time are assumed to follow on
+	// directly from the previous block
+	void write(const AudioBufferList * bufferList, UInt32 inNumberFrames, const AudioTimeStamp * timeStamp = NULL);
+	
+	// Reader side
+	UInt64 getWritePosition() const;
+	UInt64 getOldestPosition() const;
+	
+	Cursor cursorAtWritePosition() const;
+	Cursor cursorAtOldestPosition() const;
+	
+	// Converting between stream positions and sample times. These
+	// return false if the position / sample time isn't in a block
+	// which the buffer still has a record of
+	bool sampleTimeForPosition(UInt64 position, Float64 &sampleTime) const;
+	bool positionForSampleTime(Float64 sampleTime, UInt64 &position) const;
+	
+	// Number of frames written since the cursor which haven't been overwritten yet
+	UInt32 getAvailableFrames(const Cursor &cursor) const;
+	
+	// Replaces the contents of buffers with everything written since
+	// the cursor (or the oldest maxFrames of it), then advances the cursor.
+	// Returns false if the reader lagged (ie. some of the audio it hadn't
+	// read yet was overwritten); the cursor's framesDropped says how much.
+	bool read(Cursor &cursor, std::vector<std::vector<AudioUnitSampleType> > &buffers, UInt32 maxFrames = UINT32_MAX) const;
+	
+	// Like read(), but instead of copying, returns a view of the frames
+	// and advances the cursor past them. If the view turns out to be
+	// invalid once you've used it, those frames weren't counted as dropped
+	View readView(Cursor &cursor, UInt32 maxFrames = UINT32_MAX) const;
+	
+	// Returns a view of up to frames frames, starting at position. The
+	// view is clamped to the audio that's still intact, so it may start
+	// later or be shorter than asked for (check getPosition() and size())
+	View view(UInt64 position, UInt32 frames) const;
+	
+	// A view of the most recent frames that have been written
+	View viewLatest(UInt32 frames) const;
+
+private:
+	BroadcastBuffer(const BroadcastBuffer &);
+	BroadcastBuffer& operator=(const BroadcastBuffer &);
+	
+	// Everything the writer and readers share lives in a Storage, which
+	// Views hold on to so the memory outlives them
+	boost::shared_ptr<Storage> _storage;
+};
+
+} } // namespace cinder::audiounit
@@ -0,0 +1,595 @@
+#if !defined(__APPLE__)
+
+#include "CoreAudioStandIn.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Apple's units start out with this
+static const UInt32 kDefaultMaximumFramesPerSlice = 1156;
+static const Float64 kDefaultSampleRate = 44100;
+static const UInt32 kDefaultChannels = 2;
+
+struct OpaqueAudioComponent
+{
+	AudioComponentDescription desc;
+};
+
+namespace {
+
+typedef pair<AudioUnitScope, AudioUnitElement> Address;
+
+struct ParameterAddress
+{
+	AudioUnitParameterID id;
+	AudioUnitScope scope;
+	AudioUnitElement element;
+	
+	bool operator<(const ParameterAddress &other) const
+	{
+		if(id != other.id) return id < other.id;
+		if(scope != other.scope) return scope < other.scope;
+		return element < other.element;
+	}
+};
+
+// what's feeding one of a unit's input busses
+struct InputSource
+{
+	AURenderCallbackStruct callback;
+	AudioUnitConnection connection;
+};
+
+AudioStreamBasicDescription DefaultStreamFormat()
+{
+	AudioStreamBasicDescription asbd;
+	memset(&asbd, 0, sizeof(asbd));
+	asbd.mSampleRate       = kDefaultSampleRate;
+	asbd.mFormatID         = kAudioFormatLinearPCM;
+	asbd.mFormatFlags      = kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+	asbd.mBytesPerPacket   = sizeof(Float32);
+	asbd.mFramesPerPacket  = 1;
+	asbd.mBytesPerFrame    = sizeof(Float32);
+	asbd.mChannelsPerFrame = kDefaultChannels;
+	asbd.mBitsPerChannel   = 32;
+	return asbd;
+}
+
+template <typename T>
+OSStatus GetValue(const T &value, void * outData, UInt32 * ioDataSize)
+{
+	if(!outData || !ioDataSize || *ioDataSize < sizeof(T)) return kAudio_ParamError;
+	memcpy(outData, &value, sizeof(T));
+	*ioDataSize = sizeof(T);
+	return noErr;
+}
+
+template <typename T>
+OSStatus SetValue(T &value, const void * inData, UInt32 inDataSize)
+{
+	if(!inData || inDataSize < sizeof(T)) return kAudio_ParamError;
+	memcpy(&value, inData, sizeof(T));
+	return noErr;
+}
+
+} // anonymous namespace
+
+// The stand-in for an Audio Unit instance. Everything but rendering
+// happens while the unit's being set up, the same as with the real
+// thing, so none of it's locked.
+struct ComponentInstanceRecord
+{
+	AudioComponentDescription desc;
+	bool initialized;
+	bool running;
+	UInt32 maximumFramesPerSlice;
+	UInt32 meteringMode;
+	AudioDeviceID currentDevice;
+	UInt32 enableIO[2];
+	vector<SInt32> channelMap;
+	AURenderCallbackStruct inputCallback;
+	
+	map<Address, AudioStreamBasicDescription> formats;
+	map<Address, UInt32> elementCounts;
+	map<AudioUnitElement, InputSource> sources;
+	map<ParameterAddress, AudioUnitParameterValue> parameters;
+	vector<AURenderCallbackStruct> notifications;
+	
+	// Buffers for the unit's last block, which it renders into when it's
+	// not given any, and for mixing in its second source onwards. They're
+	// sized when the unit's initialized, so rendering doesn't allocate
+	vector<AudioUnitSampleType> samples;
+	vector<char> outputList;
+	vector<char> mixList;
+	
+	// like Apple's units, asking again for the block that was just
+	// rendered gets the same block back rather than rendering another
+	bool cached;
+	Float64 cachedSampleTime;
+	UInt32 cachedBus;
+	UInt32 cachedFrames;
+	UInt32 cachedChannels;
+	
+	ComponentInstanceRecord(const AudioComponentDescription &description)
+	: desc(description)
+	, initialized(false)
+	, running(false)
+	, maximumFramesPerSlice(kDefaultMaximumFramesPerSlice)
+	, meteringMode(0)
+	, currentDevice(kAudioObjectUnknown)
+	, cached(false)
+	{
+		enableIO[0] = 0; // input
+		enableIO[1] = 1; // output
+		inputCallback.inputProc = NULL;
+		inputCallback.inputProcRefCon = NULL;
+	}
+	
+	bool isOutputUnit() const {return desc.componentType == kAudioUnitType_Output;}
+	
+	AudioStreamBasicDescription getFormat(AudioUnitScope scope, AudioUnitElement element) const
+	{
+		map<Address, AudioStreamBasicDescription>::const_iterator f = formats.find(Address(scope, element));
+		return f == formats.end() ? DefaultStreamFormat() : f->second;
+	}
+	
+	UInt32 getElementCount(AudioUnitScope scope) const
+	{
+		map<Address, UInt32>::const_iterator c = elementCounts.find(Address(scope, 0));
+		if(c != elementCounts.end()) return c->second;
+		if(scope == kAudioUnitScope_Global) return 1;
+		if(isOutputUnit()) return 2;
+		return scope == kAudioUnitScope_Input && desc.componentType == kAudioUnitType_Generator ? 0 : 1;
+	}
+	
+	void allocateBuffers()
+	{
+		UInt32 channels = kDefaultChannels;
+		for(map<Address, AudioStreamBasicDescription>::const_iterator f = formats.begin(); f != formats.end(); ++f) {
+			channels = max(channels, f->second.mChannelsPerFrame);
+		}
+		
+		const size_t listBytes = offsetof(AudioBufferList, mBuffers[0]) + channels * sizeof(AudioBuffer);
+		samples.assign((size_t)channels * maximumFramesPerSlice * 2, 0);
+		outputList.assign(listBytes, 0);
+		mixList.assign(listBytes, 0);
+		
+		AudioBufferList * lists[2] = {getOutputList(), getMixList()};
+		for(int l = 0; l < 2; l++) {
+			lists[l]->mNumberBuffers = channels;
+			for(UInt32 ch = 0; ch < channels; ch++) {
+				lists[l]->mBuffers[ch].mNumberChannels = 1;
+				lists[l]->mBuffers[ch].mDataByteSize   = maximumFramesPerSlice * sizeof(AudioUnitSampleType);
+				lists[l]->mBuffers[ch].mData           = &samples[((size_t)l * channels + ch) * maximumFramesPerSlice];
+			}
+		}
+	}
+	
+	AudioBufferList * getOutputList() {return reinterpret_cast<AudioBufferList *>(&outputList[0]);}
+	
+	bool isCached(const AudioTimeStamp * timeStamp, UInt32 bus, UInt32 frames, UInt32 channels) const
+	{
+		return cached && (timeStamp->mFlags & kAudioTimeStampSampleTimeValid) && timeStamp->mSampleTime == cachedSampleTime &&
+			   bus == cachedBus && frames == cachedFrames && channels == cachedChannels;
+	}
+	
+	// copies a block into or out of the cache (whichever isn't already the other)
+	void copyBlock(AudioBufferList * to, const AudioBufferList * from, UInt32 frames)
+	{
+		for(UInt32 ch = 0; ch < to->mNumberBuffers; ch++) {
+			if(!to->mBuffers[ch].mData) to->mBuffers[ch].mData = from->mBuffers[ch].mData;
+			if(to->mBuffers[ch].mData != from->mBuffers[ch].mData) {
+				memcpy(to->mBuffers[ch].mData, from->mBuffers[ch].mData, frames * sizeof(AudioUnitSampleType));
+			}
+			to->mBuffers[ch].mDataByteSize = frames * sizeof(AudioUnitSampleType);
+		}
+	}
+	
+	void cache(const AudioTimeStamp * timeStamp, UInt32 bus, UInt32 frames, const AudioBufferList * ioData)
+	{
+		cached = (timeStamp->mFlags & kAudioTimeStampSampleTimeValid) != 0;
+		if(!cached) return;
+		
+		AudioBufferList * output = getOutputList();
+		const UInt32 channels = output->mNumberBuffers;
+		output->mNumberBuffers = ioData->mNumberBuffers;
+		copyBlock(output, ioData, frames);
+		output->mNumberBuffers = channels;
+		
+		cachedSampleTime = timeStamp->mSampleTime;
+		cachedBus = bus;
+		cachedFrames = frames;
+		cachedChannels = ioData->mNumberBuffers;
+	}
+	AudioBufferList * getMixList()    {return reinterpret_cast<AudioBufferList *>(&mixList[0]);}
+	
+	OSStatus pull(const InputSource &source, AudioUnitElement bus, const AudioTimeStamp * timeStamp, UInt32 frames, AudioBufferList * ioData)
+	{
+		AudioUnitRenderActionFlags flags = 0;
+		if(source.callback.inputProc) {
+			return source.callback.inputProc(source.callback.inputProcRefCon, &flags, timeStamp, bus, frames, ioData);
+		} else {
+			return AudioUnitRender(source.connection.sourceAudioUnit, &flags, timeStamp, source.connection.sourceOutputNumber, frames, ioData);
+		}
+	}
+	
+	// sums whatever's connected to the input busses into ioData
+	OSStatus render(AudioUnitRenderActionFlags * ioActionFlags, const AudioTimeStamp * timeStamp, UInt32 frames, AudioBufferList * ioData)
+	{
+		AudioBufferList * output = getOutputList();
+		AudioBufferList * mix = getMixList();
+		if(ioData->mNumberBuffers > mix->mNumberBuffers) return kAudio_ParamError;
+		
+		// like Apple's units, render into our own buffers if we're not given any
+		for(UInt32 ch = 0; ch < ioData->mNumberBuffers; ch++) {
+			if(!ioData->mBuffers[ch].mData) ioData->mBuffers[ch].mData = output->mBuffers[ch].mData;
+			ioData->mBuffers[ch].mDataByteSize = frames * sizeof(AudioUnitSampleType);
+		}
+		
+		if(sources.empty()) {
+			for(UInt32 ch = 0; ch < ioData->mNumberBuffers; ch++) {
+				memset(ioData->mBuffers[ch].mData, 0, frames * sizeof(AudioUnitSampleType));
+			}
+			*ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+			return noErr;
+		}
+		
+		map<AudioUnitElement, InputSource>::const_iterator source = sources.begin();
+		OSStatus status = pull(source->second, source->first, timeStamp, frames, ioData);
+		
+		mix->mNumberBuffers = ioData->mNumberBuffers;
+		for(++source; source != sources.end() && status == noErr; ++source) {
+			status = pull(source->second, source->first, timeStamp, frames, mix);
+			
+			for(UInt32 ch = 0; ch < ioData->mNumberBuffers && status == noErr; ch++) {
+				AudioUnitSampleType * into = (AudioUnitSampleType *)ioData->mBuffers[ch].mData;
+				const AudioUnitSampleType * from = (const AudioUnitSampleType *)mix->mBuffers[ch].mData;
+				for(UInt32 i = 0; i < frames; i++) into[i] += from[i];
+			}
+		}
+		
+		return status;
+	}
+};
+
+static mutex s_componentsMutex;
+static vector<OpaqueAudioComponent *> s_components;
+
+static bool Matches(const AudioComponentDescription &desc, const AudioComponentDescription &pattern)
+{
+	return (!pattern.componentType         || desc.componentType         == pattern.componentType) &&
+		   (!pattern.componentSubType      || desc.componentSubType      == pattern.componentSubType) &&
+		   (!pattern.componentManufacturer || desc.componentManufacturer == pattern.componentManufacturer);
+}
+
+#pragma mark - Components
+
+// every description has a stand-in, made the first time it's looked for
+AudioComponent AudioComponentFindNext(AudioComponent inComponent, const AudioComponentDescription * inDesc)
+{
+	if(!inDesc || inComponent) return NULL;
+	
+	lock_guard<mutex> lock(s_componentsMutex);
+	for(size_t i = 0; i < s_components.size(); i++) {
+		if(Matches(s_components[i]->desc, *inDesc)) return s_components[i];
+	}
+	
+	OpaqueAudioComponent * component = new OpaqueAudioComponent;
+	component->desc = *inDesc;
+	s_components.push_back(component);
+	return component;
+}
+
+OSStatus AudioComponentInstanceNew(AudioComponent inComponent, AudioComponentInstance * outInstance)
+{
+	if(!inComponent || !outInstance) return kAudio_ParamError;
+	*outInstance = new ComponentInstanceRecord(inComponent->desc);
+	return noErr;
+}
+
+OSStatus AudioComponentInstanceDispose(AudioComponentInstance inInstance)
+{
+	delete inInstance;
+	return noErr;
+}
+
+#pragma mark - Units
+
+OSStatus AudioUnitInitialize(AudioUnit inUnit)
+{
+	if(!inUnit) return kAudio_ParamError;
+	if(!inUnit->initialized) inUnit->allocateBuffers();
+	inUnit->initialized = true;
+	return noErr;
+}
+
+OSStatus AudioUnitUninitialize(AudioUnit inUnit)
+{
+	if(!inUnit) return kAudio_ParamError;
+	inUnit->initialized = false;
+	inUnit->cached = false;
+	return noErr;
+}
+
+OSStatus AudioUnitReset(AudioUnit inUnit, AudioUnitScope, AudioUnitElement)
+{
+	if(!inUnit) return kAudio_ParamError;
+	inUnit->cached = false;
+	return noErr;
+}
+
+OSStatus AudioUnitGetProperty(AudioUnit inUnit, AudioUnitPropertyID inID, AudioUnitScope inScope, AudioUnitElement inElement, void * outData, UInt32 * ioDataSize)
+{
+	if(!inUnit) return kAudio_ParamError;
+	
+	switch(inID) {
+		case kAudioUnitProperty_MaximumFramesPerSlice:
+			return GetValue(inUnit->maximumFramesPerSlice, outData, ioDataSize);
+		
+		case kAudioUnitProperty_StreamFormat:
+			return GetValue(inUnit->getFormat(inScope, inElement), outData, ioDataSize);
+		
+		case kAudioUnitProperty_SampleRate:
+			return GetValue(inUnit->getFormat(inScope, inElement).mSampleRate, outData, ioDataSize);
+		
+		case kAudioUnitProperty_ElementCount:
+			return GetValue(inUnit->getElementCount(inScope), outData, ioDataSize);
+		
+		case kAudioUnitProperty_Latency:
+			return GetValue(Float64(0), outData, ioDataSize);
+		
+		case kAudioUnitProperty_MeteringMode:
+			return GetValue(inUnit->meteringMode, outData, ioDataSize);
+		
+		case kAudioOutputUnitProperty_IsRunning:
+			if(!inUnit->isOutputUnit()) return kAudioUnitErr_InvalidProperty;
+			return GetValue(UInt32(inUnit->running), outData, ioDataSize);
+		
+		case kAudioOutputUnitProperty_EnableIO:
+			if(!inUnit->isOutputUnit() || inElement > 1) return kAudioUnitErr_InvalidProperty;
+			return GetValue(inUnit->enableIO[inElement == 1 ? 0 : 1], outData, ioDataSize);
+		
+		case kAudioOutputUnitProperty_CurrentDevice:
+			if(!inUnit->isOutputUnit()) return kAudioUnitErr_InvalidProperty;
+			return GetValue(inUnit->currentDevice, outData, ioDataSize);
+		
+		case kAudioOutputUnitProperty_ChannelMap: {
+			if(!inUnit->isOutputUnit() || !outData || !ioDataSize) return kAudioUnitErr_InvalidProperty;
+			const UInt32 size = min<UInt32>(*ioDataSize, inUnit->channelMap.size() * sizeof(SInt32));
+			if(size) memcpy(outData, &inUnit->channelMap[0], size);
+			*ioDataSize = size;
+			return noErr;
+		}
+		
+		default:
+			return kAudioUnitErr_InvalidProperty;
+	}
+}
+
+OSStatus AudioUnitSetProperty(AudioUnit inUnit, AudioUnitPropertyID inID, AudioUnitScope inScope, AudioUnitElement inElement, const void * inData, UInt32 inDataSize)
+{
+	if(!inUnit) return kAudio_ParamError;
+	
+	switch(inID) {
+		case kAudioUnitProperty_MaximumFramesPerSlice:
+			if(inUnit->initialized) return kAudioUnitErr_Initialized;
+			return SetValue(inUnit->maximumFramesPerSlice, inData, inDataSize);
+		
+		case kAudioUnitProperty_StreamFormat: {
+			AudioStreamBasicDescription asbd;
+			OSStatus s = SetValue(asbd, inData, inDataSize);
+			if(s == noErr) inUnit->formats[Address(inScope, inElement)] = asbd;
+			return s;
+		}
+		
+		case kAudioUnitProperty_SampleRate: {
+			AudioStreamBasicDescription asbd = inUnit->getFormat(inScope, inElement);
+			OSStatus s = SetValue(asbd.mSampleRate, inData, inDataSize);
+			if(s == noErr) inUnit->formats[Address(inScope, inElement)] = asbd;
+			return s;
+		}
+		
+		case kAudioUnitProperty_ElementCount: {
+			UInt32 count = 0;
+			OSStatus s = SetValue(count, inData, inDataSize);
+			if(s == noErr) inUnit->elementCounts[Address(inScope, 0)] = count;
+			return s;
+		}
+		
+		case kAudioUnitProperty_MeteringMode:
+			return SetValue(inUnit->meteringMode, inData, inDataSize);
+		
+		// a bus is fed by a callback or a connection, whichever was set last
+		case kAudioUnitProperty_SetRenderCallback: {
+			InputSource source;
+			memset(&source, 0, sizeof(source));
+			OSStatus s = SetValue(source.callback, inData, inDataSize);
+			if(s != noErr) return s;
+			if(source.callback.inputProc) inUnit->sources[inElement] = source;
+			else inUnit->sources.erase(inElement);
+			return noErr;
+		}
+		
+		case kAudioUnitProperty_MakeConnection: {
+			InputSource source;
+			memset(&source, 0, sizeof(source));
+			OSStatus s = SetValue(source.connection, inData, inDataSize);
+			if(s != noErr) return s;
+			if(source.connection.sourceAudioUnit) inUnit->sources[source.connection.destInputNumber] = source;
+			else inUnit->sources.erase(source.connection.destInputNumber);
+			return noErr;
+		}
+		
+		case kAudioOutputUnitProperty_EnableIO:
+			if(!inUnit->isOutputUnit() || inElement > 1) return kAudioUnitErr_InvalidProperty;
+			return SetValue(inUnit->enableIO[inElement == 1 ? 0 : 1], inData, inDataSize);
+		
+		case kAudioOutputUnitProperty_CurrentDevice:
+			if(!inUnit->isOutputUnit()) return kAudioUnitErr_InvalidProperty;
+			return SetValue(inUnit->currentDevice, inData, inDataSize);
+		
+		case kAudioOutputUnitProperty_ChannelMap:
+			if(!inUnit->isOutputUnit() || (!inData && inDataSize)) return kAudioUnitErr_InvalidProperty;
+			inUnit->channelMap.assign((const SInt32 *)inData, (const SInt32 *)inData + inDataSize / sizeof(SInt32));
+			return noErr;
+		
+		case kAudioOutputUnitProperty_SetInputCallback:
+			if(!inUnit->isOutputUnit()) return kAudioUnitErr_InvalidProperty;
+			return SetValue(inUnit->inputCallback, inData, inDataSize);
+		
+		default:
+			return kAudioUnitErr_InvalidProperty;
+	}
+}
+
+OSStatus AudioUnitGetParameter(AudioUnit inUnit, AudioUnitParameterID inID, AudioUnitScope inScope, AudioUnitElement inElement, AudioUnitParameterValue * outValue)
+{
+	if(!inUnit || !outValue) return kAudio_ParamError;
+	
+	const ParameterAddress address = {inID, inScope, inElement};
+	map<ParameterAddress, AudioUnitParameterValue>::const_iterator p = inUnit->parameters.find(address);
+	*outValue = p == inUnit->parameters.end() ? 0 : p->second;
+	return noErr;
+}
+
+OSStatus AudioUnitSetParameter(AudioUnit inUnit, AudioUnitParameterID inID, AudioUnitScope inScope, AudioUnitElement inElement, AudioUnitParameterValue inValue, UInt32)
+{
+	if(!inUnit) return kAudio_ParamError;
+	
+	const ParameterAddress address = {inID, inScope, inElement};
+	inUnit->parameters[address] = inValue;
+	return noErr;
+}
+
+OSStatus AudioUnitAddRenderNotify(AudioUnit inUnit, AURenderCallback inProc, void * inProcUserData)
+{
+	if(!inUnit || !inProc) return kAudio_ParamError;
+	
+	AURenderCallbackStruct notification = {inProc, inProcUserData};
+	inUnit->notifications.push_back(notification);
+	return noErr;
+}
+
+OSStatus AudioUnitRemoveRenderNotify(AudioUnit inUnit, AURenderCallback inProc, void * inProcUserData)
+{
+	if(!inUnit) return kAudio_ParamError;
+	
+	vector<AURenderCallbackStruct> &n = inUnit->notifications;
+	for(size_t i = 0; i < n.size(); i++) {
+		if(n[i].inputProc == inProc && n[i].inputProcRefCon == inProcUserData) {
+			n.erase(n.begin() + i);
+			break;
+		}
+	}
+	return noErr;
+}
+
+OSStatus AudioUnitRender(AudioUnit inUnit,
+						 AudioUnitRenderActionFlags * ioActionFlags,
+						 const AudioTimeStamp * inTimeStamp,
+						 UInt32 inOutputBusNumber,
+						 UInt32 inNumberFrames,
+						 AudioBufferList * ioData)
+{
+	if(!inUnit || !ioData || !inTimeStamp) return kAudio_ParamError;
+	if(!inUnit->initialized) return kAudioUnitErr_Uninitialized;
+	if(inNumberFrames > inUnit->maximumFramesPerSlice) return kAudioUnitErr_TooManyFramesToProcess;
+	
+	AudioUnitRenderActionFlags flags = ioActionFlags ? *ioActionFlags : 0;
+	const vector<AURenderCallbackStruct> &notifications = inUnit->notifications;
+	
+	for(size_t i = 0; i < notifications.size(); i++) {
+		AudioUnitRenderActionFlags pre = flags | kAudioUnitRenderAction_PreRender;
+		notifications[i].inputProc(notifications[i].inputProcRefCon, &pre, inTimeStamp, inOutputBusNumber, inNumberFrames, ioData);
+	}
+	
+	OSStatus status = noErr;
+	if(inUnit->isCached(inTimeStamp, inOutputBusNumber, inNumberFrames, ioData->mNumberBuffers)) {
+		inUnit->copyBlock(ioData, inUnit->getOutputList(), inNumberFrames);
+	} else {
+		status = inUnit->render(&flags, inTimeStamp, inNumberFrames, ioData);
+		if(status == noErr) inUnit->cache(inTimeStamp, inOutputBusNumber, inNumberFrames, ioData);
+		else inUnit->cached = false;
+	}
+	
+	for(size_t i = 0; i < notifications.size(); i++) {
+		AudioUnitRenderActionFlags post = flags | kAudioUnitRenderAction_PostRender;
+		if(status != noErr) post |= kAudioUnitRenderAction_PostRenderError;
+		notifications[i].inputProc(notifications[i].inputProcRefCon, &post, inTimeStamp, inOutputBusNumber, inNumberFrames, ioData);
+	}
+	
+	if(ioActionFlags) *ioActionFlags = flags;
+	return status;
+}
+
+OSStatus AudioOutputUnitStart(AudioUnit ci)
+{
+	if(!ci || !ci->isOutputUnit()) return kAudio_ParamError;
+	if(!ci->initialized) return kAudioUnitErr_Uninitialized;
+	ci->running = true;
+	return noErr;
+}
+
+OSStatus AudioOutputUnitStop(AudioUnit ci)
+{
+	if(!ci || !ci->isOutputUnit()) return kAudio_ParamError;
+	ci->running = false;
+	return noErr;
+}
+
+#pragma mark - Hardware
+
+// one made up input device and one made up output device, which take
+// whatever sample rate and buffer size they're given
+static const AudioDeviceID kInputDevice  = 2;
+static const AudioDeviceID kOutputDevice = 3;
+static Float64 s_deviceSampleRate[2] = {kDefaultSampleRate, kDefaultSampleRate};
+static UInt32  s_deviceBufferFrames[2] = {512, 512};
+
+static int DeviceIndex(AudioObjectID device)
+{
+	return device == kInputDevice ? 0 : device == kOutputDevice ? 1 : -1;
+}
+
+OSStatus AudioObjectGetPropertyData(AudioObjectID inObjectID, const AudioObjectPropertyAddress * inAddress, UInt32, const void *, UInt32 * ioDataSize, void * outData)
+{
+	if(!inAddress) return kAudio_ParamError;
+	
+	if(inObjectID == kAudioObjectSystemObject) {
+		switch(inAddress->mSelector) {
+			case kAudioHardwarePropertyDefaultInputDevice:  return GetValue(kInputDevice, outData, ioDataSize);
+			case kAudioHardwarePropertyDefaultOutputDevice: return GetValue(kOutputDevice, outData, ioDataSize);
+			default: return kAudioHardwareUnknownPropertyError;
+		}
+	}
+	
+	const int device = DeviceIndex(inObjectID);
+	if(device < 0) return kAudio_ParamError;
+	
+	switch(inAddress->mSelector) {
+		case kAudioDevicePropertyNominalSampleRate: return GetValue(s_deviceSampleRate[device], outData, ioDataSize);
+		case kAudioDevicePropertyBufferFrameSize:   return GetValue(s_deviceBufferFrames[device], outData, ioDataSize);
+		default: return kAudioHardwareUnknownPropertyError;
+	}
+}
+
+OSStatus AudioObjectSetPropertyData(AudioObjectID inObjectID, const AudioObjectPropertyAddress * inAddress, UInt32, const void *, UInt32 inDataSize, const void * inData)
+{
+	if(!inAddress) return kAudio_ParamError;
+	
+	const int device = DeviceIndex(inObjectID);
+	if(device < 0) return kAudioHardwareUnknownPropertyError;
+	
+	switch(inAddress->mSelector) {
+		case kAudioDevicePropertyNominalSampleRate: return SetValue(s_deviceSampleRate[device], inData, inDataSize);
+		case kAudioDevicePropertyBufferFrameSize:   return SetValue(s_deviceBufferFrames[device], inData, inDataSize);
+		default: return kAudioHardwareUnknownPropertyError;
+	}
+}
+
+#endif // !defined(__APPLE__)
@@ -0,0 +1,316 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+// On platforms without Core Audio, this stands in for the parts of
+// CoreAudioTypes.h, AUComponent.h and AudioHardware.h that the block
+// uses, so that chains can still be built and pulled: by an
+// OfflineRenderer or a Graph, say, in tests and batch jobs on a Linux
+// build machine. The types and constants match Apple's, and the unit
+// calls are implemented in software by CoreAudioStandIn.cpp.
+
+// The stand-in units don't process audio: each one sums whatever's
+// connected to its input busses (or renders silence if nothing is).
+// They keep their properties and parameters, and they enforce the
+// rules a chain depends on. Rendering an uninitialized unit fails,
+// and so does asking for more than MaximumFramesPerSlice frames. Output
+// units keep track of whether they've been started, but nothing pulls
+// them. There's no hardware, so the AudioObject calls only answer for
+// the (made up) default devices.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
+#pragma mark - CoreAudioTypes
+
+typedef int32_t  OSStatus;
+typedef uint32_t OSType;
+typedef uint8_t  UInt8;
+typedef int8_t   SInt8;
+typedef uint16_t UInt16;
+typedef int16_t  SInt16;
+typedef uint32_t UInt32;
+typedef int32_t  SInt32;
+typedef uint64_t UInt64;
+typedef int64_t  SInt64;
+typedef float    Float32;
+typedef double   Float64;
+typedef unsigned char Boolean;
+
+enum { noErr = 0 };
+
+#ifndef TARGET_OS_IPHONE
+	#define TARGET_OS_IPHONE 0
+#endif
+
+typedef Float32 AudioSampleType;
+typedef Float32 AudioUnitSampleType;
+
+struct AudioBuffer
+{
+	UInt32 mNumberChannels;
+	UInt32 mDataByteSize;
+	void * mData;
+};
+
+struct AudioBufferList
+{
+	UInt32      mNumberBuffers;
+	AudioBuffer mBuffers[1]; // really mNumberBuffers of them
+};
+
+struct SMPTETime
+{
+	SInt16 mSubframes;
+	SInt16 mSubframeDivisor;
+	UInt32 mCounter;
+	UInt32 mType;
+	UInt32 mFlags;
+	SInt16 mHours;
+	SInt16 mMinutes;
+	SInt16 mSeconds;
+	SInt16 mFrames;
+};
+
+struct AudioTimeStamp
+{
+	Float64   mSampleTime;
+	UInt64    mHostTime;
+	Float64   mRateScalar;
+	UInt64    mWordClockTime;
+	SMPTETime mSMPTETime;
+	UInt32    mFlags;
+	UInt32    mReserved;
+};
+
+enum
+{
+	kAudioTimeStampSampleTimeValid    = 1 << 0,
+	kAudioTimeStampHostTimeValid      = 1 << 1,
+	kAudioTimeStampRateScalarValid    = 1 << 2,
+	kAudioTimeStampWordClockTimeValid = 1 << 3,
+	kAudioTimeStampSMPTETimeValid     = 1 << 4
+};
+
+struct AudioStreamBasicDescription
+{
+	Float64 mSampleRate;
+	UInt32  mFormatID;
+	UInt32  mFormatFlags;
+	UInt32  mBytesPerPacket;
+	UInt32  mFramesPerPacket;
+	UInt32  mBytesPerFrame;
+	UInt32  mChannelsPerFrame;
+	UInt32  mBitsPerChannel;
+	UInt32  mReserved;
+};
+
+enum
+{
+	kAudioFormatLinearPCM             = 'lpcm',
+	kAudioFormatFlagIsFloat           = 1 << 0,
+	kAudioFormatFlagIsPacked          = 1 << 3,
+	kAudioFormatFlagIsNonInterleaved  = 1 << 5,
+	kAudioFormatFlagsNativeFloatPacked = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked
+};
+
+#pragma mark - AUComponent
+
+typedef struct OpaqueAudioComponent * AudioComponent;
+typedef struct ComponentInstanceRecord * AudioComponentInstance;
+typedef AudioComponentInstance AudioUnit;
+
+typedef UInt32  AudioUnitRenderActionFlags;
+typedef UInt32  AudioUnitPropertyID;
+typedef UInt32  AudioUnitScope;
+typedef UInt32  AudioUnitElement;
+typedef UInt32  AudioUnitParameterID;
+typedef Float32 AudioUnitParameterValue;
+
+struct AudioComponentDescription
+{
+	OSType componentType;
+	OSType componentSubType;
+	OSType componentManufacturer;
+	UInt32 componentFlags;
+	UInt32 componentFlagsMask;
+};
+
+typedef OSStatus (*AURenderCallback)(void * inRefCon,
+									 AudioUnitRenderActionFlags * ioActionFlags,
+									 const AudioTimeStamp * inTimeStamp,
+									 UInt32 inBusNumber,
+									 UInt32 inNumberFrames,
+									 AudioBufferList * ioData);
+
+struct AURenderCallbackStruct
+{
+	AURenderCallback inputProc;
+	void * inputProcRefCon;
+};
+
+struct AudioUnitConnection
+{
+	AudioUnit sourceAudioUnit;
+	UInt32    sourceOutputNumber;
+	UInt32    destInputNumber;
+};
+
+enum
+{
+	kAudioUnitType_Output          = 'auou',
+	kAudioUnitType_MusicDevice     = 'aumu',
+	kAudioUnitType_Effect          = 'aufx',
+	kAudioUnitType_Mixer           = 'aumx',
+	kAudioUnitType_Generator       = 'augn',
+	kAudioUnitType_FormatConverter = 'aufc',
+	
+	kAudioUnitSubType_HALOutput         = 'ahal',
+	kAudioUnitSubType_RemoteIO          = 'rioc',
+	kAudioUnitSubType_GenericOutput     = 'genr',
+	kAudioUnitSubType_MultiChannelMixer = 'mcmx',
+	
+	kAudioUnitManufacturer_Apple = 'appl'
+};
+
+enum
+{
+	kAudioUnitScope_Global = 0,
+	kAudioUnitScope_Input  = 1,
+	kAudioUnitScope_Output = 2
+};
+
+enum
+{
+	kAudioUnitProperty_ClassInfo             = 0,
+	kAudioUnitProperty_MakeConnection        = 1,
+	kAudioUnitProperty_SampleRate            = 2,
+	kAudioUnitProperty_StreamFormat          = 8,
+	kAudioUnitProperty_ElementCount          = 11,
+	kAudioUnitProperty_Latency               = 12,
+	kAudioUnitProperty_MaximumFramesPerSlice = 14,
+	kAudioUnitProperty_SetRenderCallback     = 23,
+	kAudioUnitProperty_MeteringMode          = 3007,
+	
+	kAudioOutputUnitProperty_CurrentDevice    = 2000,
+	kAudioOutputUnitProperty_IsRunning        = 2001,
+	kAudioOutputUnitProperty_ChannelMap       = 2002,
+	kAudioOutputUnitProperty_EnableIO         = 2003,
+	kAudioOutputUnitProperty_SetInputCallback = 2005
+};
+
+enum
+{
+	kAudioUnitRenderAction_PreRender       = 1 << 2,
+	kAudioUnitRenderAction_PostRender      = 1 << 3,
+	kAudioUnitRenderAction_OutputIsSilence = 1 << 4,
+	kAudioUnitRenderAction_PostRenderError = 1 << 8
+};
+
+enum
+{
+	kAudio_ParamError                      = -50,
+	kAudioUnitErr_InvalidProperty          = -10879,
+	kAudioUnitErr_InvalidParameter         = -10878,
+	kAudioUnitErr_InvalidElement           = -10877,
+	kAudioUnitErr_NoConnection             = -10876,
+	kAudioUnitErr_FailedInitialization     = -10875,
+	kAudioUnitErr_TooManyFramesToProcess   = -10874,
+	kAudioUnitErr_Uninitialized            = -10867,
+	kAudioUnitErr_InvalidScope             = -10866,
+	kAudioUnitErr_CannotDoInCurrentContext = -10863,
+	kAudioUnitErr_Initialized              = -10849
+};
+
+enum
+{
+	kMultiChannelMixerParam_Volume          = 0,
+	kMultiChannelMixerParam_Enable          = 1,
+	kMultiChannelMixerParam_Pan             = 2,
+	kMultiChannelMixerParam_PreAveragePower = 1000,
+	kMultiChannelMixerParam_PrePeakHoldLevel = 2000,
+	kMultiChannelMixerParam_PostAveragePower = 3000,
+	kMultiChannelMixerParam_PostPeakHoldLevel = 4000
+};
+
+AudioComponent AudioComponentFindNext(AudioComponent inComponent, const AudioComponentDescription * inDesc);
+OSStatus AudioComponentInstanceNew(AudioComponent inComponent, AudioComponentInstance * outInstance);
+OSStatus AudioComponentInstanceDispose(AudioComponentInstance inInstance);
+
+OSStatus AudioUnitInitialize(AudioUnit inUnit);
+OSStatus AudioUnitUninitialize(AudioUnit inUnit);
+OSStatus AudioUnitReset(AudioUnit inUnit, AudioUnitScope inScope, AudioUnitElement inElement);
+
+OSStatus AudioUnitGetProperty(AudioUnit inUnit, AudioUnitPropertyID inID, AudioUnitScope inScope, AudioUnitElement inElement, void * outData, UInt32 * ioDataSize);
+OSStatus AudioUnitSetProperty(AudioUnit inUnit, AudioUnitPropertyID inID, AudioUnitScope inScope, AudioUnitElement inElement, const void * inData, UInt32 inDataSize);
+
+OSStatus AudioUnitGetParameter(AudioUnit inUnit, AudioUnitParameterID inID, AudioUnitScope inScope, AudioUnitElement inElement, AudioUnitParameterValue * outValue);
+OSStatus AudioUnitSetParameter(AudioUnit inUnit, AudioUnitParameterID inID, AudioUnitScope inScope, AudioUnitElement inElement, AudioUnitParameterValue inValue, UInt32 inBufferOffsetInFrames);
+
+OSStatus AudioUnitAddRenderNotify(AudioUnit inUnit, AURenderCallback inProc, void * inProcUserData);
+OSStatus AudioUnitRemoveRenderNotify(AudioUnit inUnit, AURenderCallback inProc, void * inProcUserData);
+
+OSStatus AudioUnitRender(AudioUnit inUnit,
+						 AudioUnitRenderActionFlags * ioActionFlags,
+						 const AudioTimeStamp * inTimeStamp,
+						 UInt32 inOutputBusNumber,
+						 UInt32 inNumberFrames,
+						 AudioBufferList * ioData);
+
+OSStatus AudioOutputUnitStart(AudioUnit ci);
+OSStatus AudioOutputUnitStop(AudioUnit ci);
+
+#pragma mark - AudioHardware
+
+typedef UInt32 AudioObjectID;
+typedef AudioObjectID AudioDeviceID;
+typedef UInt32 AudioObjectPropertySelector;
+typedef UInt32 AudioObjectPropertyScope;
+typedef UInt32 AudioObjectPropertyElement;
+
+struct AudioObjectPropertyAddress
+{
+	AudioObjectPropertySelector mSelector;
+	AudioObjectPropertyScope    mScope;
+	AudioObjectPropertyElement  mElement;
+};
+
+enum
+{
+	kAudioObjectUnknown      = 0,
+	kAudioObjectSystemObject = 1,
+	
+	kAudioObjectPropertyScopeGlobal   = 'glob',
+	kAudioObjectPropertyElementMaster = 0,
+	
+	kAudioHardwarePropertyDefaultInputDevice  = 'dIn ',
+	kAudioHardwarePropertyDefaultOutputDevice = 'dOut',
+	kAudioDevicePropertyNominalSampleRate     = 'nsrt',
+	kAudioDevicePropertyBufferFrameSize       = 'fsiz',
+	
+	kAudioHardwareUnknownPropertyError = 'who?'
+};
+
+OSStatus AudioObjectGetPropertyData(AudioObjectID inObjectID, const AudioObjectPropertyAddress * inAddress, UInt32 inQualifierDataSize, const void * inQualifierData, UInt32 * ioDataSize, void * outData);
+OSStatus AudioObjectSetPropertyData(AudioObjectID inObjectID, const AudioObjectPropertyAddress * inAddress, UInt32 inQualifierDataSize, const void * inQualifierData, UInt32 inDataSize, const void * inData);
@@ -0,0 +1,308 @@
+#include "DSP.h"
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <Accelerate/Accelerate.h>
+#endif
+
+using namespace cinder::audiounit;
+using namespace std;
+
+#pragma mark - Kernels
+
+void DSP::multiply(const float * a, const float * b, float * out, UInt32 n)
+{
+#if defined(__APPLE__)
+	vDSP_vmul(a, 1, b, 1, out, 1, n);
+#else
+	for(UInt32 i = 0; i < n; i++) out[i] = a[i] * b[i];
+#endif
+}
+
+void DSP::hannWindow(float * out, UInt32 n)
+{
+#if defined(__APPLE__)
+	vDSP_hann_window(out, n, vDSP_HANN_DENORM);
+#else
+	for(UInt32 i = 0; i < n; i++) out[i] = 0.5f * (1.f - cosf(2.f * M_PI * i / n));
+#endif
+}
+
+float DSP::maxMagnitude(const float * in, UInt32 n)
+{
+#if defined(__APPLE__)
+	float result = 0;
+	vDSP_maxmgv(in, 1, &result, n);
+	return result;
+#else
+	float result = 0;
+	for(UInt32 i = 0; i < n; i++) {
+		const float magnitude = fabsf(in[i]);
+		result = magnitude > result ? magnitude : result;
+	}
+	return result;
+#endif
+}
+
+float DSP::meanSquare(const float * in, UInt32 n)
+{
+	if(n == 0) return 0;
+#if defined(__APPLE__)
+	float result = 0;
+	vDSP_measqv(in, 1, &result, n);
+	return result;
+#else
+	float sum = 0;
+	for(UInt32 i = 0; i < n; i++) sum += in[i] * in[i];
+	return sum / n;
+#endif
+}
+
+void DSP::fir(const float * in, const float * coefficients, float * out, UInt32 n, UInt32 taps)
+{
+#if defined(__APPLE__)
+	vDSP_conv(in, 1, coefficients, 1, out, 1, n, taps);
+#else
+	// one tap at a time over the whole block, so the inner loop is a
+	// straight multiply-add across contiguous samples
+	for(UInt32 i = 0; i < n; i++) out[i] = 0;
+	for(UInt32 k = 0; k < taps; k++) {
+		const float c = coefficients[k];
+		const float * x = in + k;
+		for(UInt32 i = 0; i < n; i++) out[i] += x[i] * c;
+	}
+#endif
+}
+
+#pragma mark - Conversions
+
+void DSP::floatToInt16(const float * in, SInt16 * out, UInt32 n, float scale)
+{
+#if defined(__APPLE__)
+	// scaled and clipped a chunk at a time, so there's no need for scratch space
+	const float lo = -32768, hi = 32767;
+	float scaled[256];
+	for(UInt32 i = 0; i < n; i += 256) {
+		const UInt32 count = min<UInt32>(256, n - i);
+		vDSP_vsmul(in + i, 1, &scale, scaled, 1, count);
+		vDSP_vclip(scaled, 1, &lo, &hi, scaled, 1, count);
+		vDSP_vfixr16(scaled, 1, out + i, 1, count);
+	}
+#else
+	for(UInt32 i = 0; i < n; i++) {
+		const float scaled = in[i] * scale;
+		out[i] = lrintf(scaled < -32768.f ? -32768.f : scaled > 32767.f ? 32767.f : scaled);
+	}
+#endif
+}
+
+void DSP::int16ToFloat(const SInt16 * in, float * out, UInt32 n, float scale)
+{
+#if defined(__APPLE__)
+	vDSP_vflt16(in, 1, out, 1, n);
+	vDSP_vsmul(out, 1, &scale, out, 1, n);
+#else
+	for(UInt32 i = 0; i < n; i++) out[i] = in[i] * scale;
+#endif
+}
+
+void DSP::floatToInt24(const float * in, UInt8 * out, UInt32 n, float scale)
+{
+	for(UInt32 i = 0; i < n; i++) {
+		const float scaled = in[i] * scale;
+		const SInt32 sample = lrintf(scaled < -8388608.f ? -8388608.f : scaled > 8388607.f ? 8388607.f : scaled);
+		out[i * 3]     = sample;
+		out[i * 3 + 1] = sample >> 8;
+		out[i * 3 + 2] = sample >> 16;
+	}
+}
+
+void DSP::int24ToFloat(const UInt8 * in, float * out, UInt32 n, float scale)
+{
+	// the sample goes in the top 3 bytes of an int32, so that shifting it
+	// back down sign extends it
+	for(UInt32 i = 0; i < n; i++) {
+		const SInt32 sample = (SInt32)((UInt32)in[i * 3] << 8 | (UInt32)in[i * 3 + 1] << 16 | (UInt32)in[i * 3 + 2] << 24) >> 8;
+		out[i] = sample * scale;
+	}
+}
+
+#pragma mark - FFT
+
+#if defined(__APPLE__)
+
+struct FFT::FFTImpl
+{
+	UInt32 size;
+	vDSP_Length log2Size;
+	FFTSetup setup;
+	vector<float> real, imag;
+	
+	FFTImpl(UInt32 size) : size(size), log2Size(log2f(size)), real(size / 2), imag(size / 2)
+	{
+		setup = vDSP_create_fftsetup(log2Size, kFFTRadix2);
+	}
+	
+	~FFTImpl()
+	{
+		vDSP_destroy_fftsetup(setup);
+	}
+	
+	void computeMagnitudes(const float * input, float * magnitudes)
+	{
+		const UInt32 half = size / 2;
+		DSPSplitComplex split = {&real[0], &imag[0]};
+		
+		vDSP_ctoz((const DSPComplex *)input, 2, &split, 1, half);
+		vDSP_fft_zrip(setup, &split, 1, log2Size, FFT_FORWARD);
+		
+		// zrip packs the (real) Nyquist bin into imag[0]
+		const float nyquist = imag[0];
+		imag[0] = 0;
+		
+		vDSP_zvabs(&split, 1, magnitudes, 1, half);
+		magnitudes[half] = fabsf(nyquist);
+		
+		// zrip's output is 2x the usual DFT, and a sine's energy is split
+		// between the positive and negative frequency bins
+		const float scale = 1.f / size;
+		vDSP_vsmul(magnitudes, 1, &scale, magnitudes, 1, half + 1);
+		
+		// (except for DC and Nyquist, which only have one bin each)
+		magnitudes[0]    *= 0.5f;
+		magnitudes[half] *= 0.5f;
+	}
+};
+
+#else
+
+// A radix-2 complex FFT of size / 2 points on split (separate real and
+// imaginary) arrays, with the usual post-processing step to turn it into
+// a real FFT of size points. Keeping the real and imaginary parts apart
+// means each butterfly pass is a straight run over contiguous memory,
+// which the compiler can vectorize.
+struct FFT::FFTImpl
+{
+	UInt32 size;
+	vector<float> real, imag;
+	vector<float> cosTable, sinTable; // twiddles for the half size complex FFT
+	vector<float> postCos, postSin;   // twiddles for the real FFT post-processing
+	vector<UInt32> bitReversed;
+	
+	FFTImpl(UInt32 size) : size(size), real(size / 2), imag(size / 2)
+	{
+		const UInt32 half = size / 2;
+		
+		cosTable.resize(half / 2 + 1);
+		sinTable.resize(half / 2 + 1);
+		for(UInt32 i = 0; i < cosTable.size(); i++) {
+			cosTable[i] = cos(2 * M_PI * i / half);
+			sinTable[i] = -sin(2 * M_PI * i / half);
+		}
+		
+		postCos.resize(half);
+		postSin.resize(half);
+		for(UInt32 i = 0; i < half; i++) {
+			postCos[i] = cos(2 * M_PI * i / size);
+			postSin[i] = -sin(2 * M_PI * i / size);
+		}
+		
+		UInt32 bits = 0;
+		while((1u << bits) < half) bits++;
+		bitReversed.resize(half);
+		for(UInt32 i = 0; i < half; i++) {
+			UInt32 r = 0;
+			for(UInt32 b = 0; b < bits; b++) r |= ((i >> b) & 1) << (bits - 1 - b);
+			bitReversed[i] = r;
+		}
+	}
+	
+	void transform()
+	{
+		const UInt32 n = size / 2;
+		float * re = &real[0];
+		float * im = &imag[0];
+		
+		for(UInt32 span = 1; span < n; span *= 2) {
+			const UInt32 stride = n / (span * 2);
+			
+			for(UInt32 start = 0; start < n; start += span * 2) {
+				float * aRe = re + start;
+				float * aIm = im + start;
+				float * bRe = aRe + span;
+				float * bIm = aIm + span;
+				
+				for(UInt32 k = 0; k < span; k++) {
+					const float wRe = cosTable[k * stride];
+					const float wIm = sinTable[k * stride];
+					const float tRe = bRe[k] * wRe - bIm[k] * wIm;
+					const float tIm = bRe[k] * wIm + bIm[k] * wRe;
+					bRe[k] = aRe[k] - tRe;
+					bIm[k] = aIm[k] - tIm;
+					aRe[k] += tRe;
+					aIm[k] += tIm;
+				}
+			}
+		}
+	}
+	
+	void computeMagnitudes(const float * input, float * magnitudes)
+	{
+		const UInt32 half = size / 2;
+		
+		// even samples go in the real part, odd samples in the imaginary part
+		for(UInt32 i = 0; i < half; i++) {
+			real[bitReversed[i]] = input[i * 2];
+			imag[bitReversed[i]] = input[i * 2 + 1];
+		}
+		
+		transform();
+		
+		const float scale = 2.f / size;
+		magnitudes[0]    = fabsf(real[0] + imag[0]) * scale / 2;
+		magnitudes[half] = fabsf(real[0] - imag[0]) * scale / 2;
+		
+		for(UInt32 k = 1; k < half; k++) {
+			// split the half size transform back into the transforms of
+			// the even and odd samples, then combine them
+			const float zRe = real[k], zIm = imag[k];
+			const float cRe = real[half - k], cIm = -imag[half - k];
+			const float evenRe = (zRe + cRe) / 2, evenIm = (zIm + cIm) / 2;
+			const float oddRe  = (zIm - cIm) / 2, oddIm  = (cRe - zRe) / 2;
+			const float re = evenRe + oddRe * postCos[k] - oddIm * postSin[k];
+			const float im = evenIm + oddRe * postSin[k] + oddIm * postCos[k];
+			magnitudes[k] = sqrtf(re * re + im * im) * scale;
+		}
+	}
+};
+
+#endif
+
+// both implementations split the input into size / 2 complex values,
+// and work on those in pairs
+static UInt32 CheckedSize(UInt32 size)
+{
+	assert(size >= 4 && (size & (size - 1)) == 0);
+	return size;
+}
+
+FFT::FFT(UInt32 size) : _impl(new FFTImpl(CheckedSize(size)))
+{
+}
+
+FFT::~FFT()
+{
+}
+
+UInt32 FFT::getSize() const
+{
+	return _impl->size;
+}
+
+void FFT::computeMagnitudes(const float * input, float * magnitudes)
+{
+	_impl->computeMagnitudes(input, magnitudes);
+}
@@ -0,0 +1,76 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "AudioUnitTypes.h"
+
+namespace cinder { namespace audiounit {
+
+// Vector kernels for the analysis helpers (SpectrumTap and so on).
+// On OS X these use the Accelerate framework; elsewhere they're plain
+// loops written so that the compiler can vectorize them.
+
+struct DSP
+{
+	static void multiply(const float * a, const float * b, float * out, UInt32 n);
+	static void hannWindow(float * out, UInt32 n);
+	
+	static float maxMagnitude(const float * in, UInt32 n); // largest absolute value
+	static float meanSquare(const float * in, UInt32 n);
+	
+	// out[i] = sum of in[i + k] * coefficients[k], for k < taps. in has to
+	// hold n + taps - 1 samples (ie. taps - 1 samples of history first)
+	static void fir(const float * in, const float * coefficients, float * out, UInt32 n, UInt32 taps);
+	
+	// Conversions to and from integer samples: out = in * scale, rounded
+	// and clipped to the integer's range on the way in. 24 bit samples
+	// are packed, 3 bytes each, little endian
+	static void floatToInt16(const float * in, SInt16 * out, UInt32 n, float scale);
+	static void int16ToFloat(const SInt16 * in, float * out, UInt32 n, float scale);
+	static void floatToInt24(const float * in, UInt8 * out, UInt32 n, float scale);
+	static void int24ToFloat(const UInt8 * in, float * out, UInt32 n, float scale);
+};
+
+// A real-to-complex FFT of a fixed size (a power of two, at least 4).
+// An FFT object holds its own scratch space, so it should only be
+// used by one thread at a time.
+
+class FFT
+{
+	struct FFTImpl;
+	boost::shared_ptr<FFTImpl> _impl;
+	
+public:
+	explicit FFT(UInt32 size);
+	~FFT();
+	
+	UInt32 getSize() const;
+	
+	// Fills magnitudes (which must have room for size / 2 + 1 values)
+	// with the magnitude of each bin, from DC up to Nyquist. They're
+	// scaled so that a full scale sine wave sitting in the middle of a
+	// bin comes out at 1 (before any windowing)
+	void computeMagnitudes(const float * input, float * magnitudes);
+};
+
+} } // namespace cinder::audiounit
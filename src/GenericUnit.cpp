@@ -1,6 +1,7 @@
 #include "GenericUnit.h"
 #include "AudioUnitTap.h"
 #include "AudioUnitUtils.h"
+#include <algorithm>
 #include <iostream>
 
 using namespace cinder::audiounit;
@@ -42,6 +43,7 @@ GenericUnit& GenericUnit::operator=(const GenericUnit &orig)
 GenericUnit::GenericUnit(GenericUnit&& orig)
 : _desc(move(orig._desc))
 , _unit(move(orig._unit))
+, _sources(move(orig._sources))
 {
 }
 
@@ -50,6 +52,7 @@ GenericUnit& GenericUnit::operator=(GenericUnit &&orig)
 	if(this != &orig) {
 		_desc = move(orig._desc);
 		_unit = move(orig._unit);
+		_sources = move(orig._sources);
 	}
 	return *this;
 }
@@ -96,6 +99,7 @@ GenericUnit& GenericUnit::connectTo(GenericUnit &otherUnit, UInt32 destinationBu
 									  sizeof(AudioUnitConnection)),
 				 "connecting units");
 	
+	otherUnit.setSource(destinationBus, this, NULL, sourceBus);
 	return otherUnit;
 }
 
@@ -105,6 +109,21 @@ Tap& GenericUnit::connectTo(Tap &tap)
 	return tap;
 }
 
+void GenericUnit::setSource(UInt32 bus, GenericUnit * unit, Tap * tap, UInt32 sourceBus)
+{
+	for(size_t i = 0; i < _sources.size(); i++) {
+		if(_sources[i].bus == bus) {
+			_sources.erase(_sources.begin() + i);
+			break;
+		}
+	}
+	
+	if(unit || tap) {
+		Source source = {bus, unit, tap, sourceBus};
+		_sources.push_back(source);
+	}
+}
+
 OSStatus GenericUnit::render(AudioUnitRenderActionFlags *flags,
 							 const AudioTimeStamp *timestamp,
 							 UInt32 bus,
@@ -114,8 +133,92 @@ OSStatus GenericUnit::render(AudioUnitRenderActionFlags *flags,
 	return AudioUnitRender(*_unit, flags, timestamp, bus, frames, data);
 }
 
+#pragma mark - Render Quantum
+
+bool GenericUnit::setMaximumFramesPerSlice(UInt32 frames)
+{
+	if(!_unit) return false;
+	if(getMaximumFramesPerSlice() == frames) return true;
+	
+	PRINT_IF_ERR(AudioUnitUninitialize(*_unit), "uninitializing unit to change its maximum frames per slice");
+	
+	OSStatus s = AudioUnitSetProperty(*_unit,
+									  kAudioUnitProperty_MaximumFramesPerSlice,
+									  kAudioUnitScope_Global,
+									  0,
+									  &frames,
+									  sizeof(frames));
+	
+	PRINT_IF_ERR(s, "setting maximum frames per slice");
+	RETURN_FALSE_IF_ERR(AudioUnitInitialize(*_unit), "initializing unit after changing its maximum frames per slice");
+	return s == noErr;
+}
+
+UInt32 GenericUnit::getMaximumFramesPerSlice() const
+{
+	UInt32 frames = 0;
+	UInt32 size = sizeof(frames);
+	
+	if(!_unit || AudioUnitGetProperty(*_unit,
+									  kAudioUnitProperty_MaximumFramesPerSlice,
+									  kAudioUnitScope_Global,
+									  0,
+									  &frames,
+									  &size) != noErr) {
+		return 0;
+	}
+	
+	return frames;
+}
+
+// Everything upstream of this unit, each one once, however many
+// paths there are to it
+void GenericUnit::collectChain(vector<GenericUnit *> &units, vector<Tap *> &taps)
+{
+	if(find(units.begin(), units.end(), this) != units.end()) return;
+	units.push_back(this);
+	
+	for(size_t i = 0; i < _sources.size(); i++) {
+		const Source &source = _sources[i];
+		
+		if(source.tap) {
+			if(find(taps.begin(), taps.end(), source.tap) == taps.end()) taps.push_back(source.tap);
+			if(source.tap->getSourceUnit()) source.tap->getSourceUnit()->collectChain(units, taps);
+		} else if(source.unit) {
+			source.unit->collectChain(units, taps);
+		}
+	}
+}
+
+UInt32 GenericUnit::prepareChain(UInt32 maximumFramesPerSlice)
+{
+	vector<GenericUnit *> units;
+	vector<Tap *> taps;
+	collectChain(units, taps);
+	
+	// the biggest quantum anything's already set up for is one the
+	// chain might be asked for, so everything has to be ready for it
+	UInt32 frames = maximumFramesPerSlice;
+	if(frames == 0) {
+		for(size_t i = 0; i < units.size(); i++) frames = max(frames, units[i]->getMaximumFramesPerSlice());
+	}
+	
+	if(frames == 0) {
+		std::cout << "Couldn't find a maximum frames per slice for the chain" << std::endl;
+		return 0;
+	}
+	
+	bool prepared = true;
+	for(size_t i = 0; i < units.size(); i++) prepared = units[i]->setMaximumFramesPerSlice(frames) && prepared;
+	for(size_t i = 0; i < taps.size(); i++)  prepared = taps[i]->setMaximumFramesPerSlice(frames) && prepared;
+	
+	return prepared ? frames : 0;
+}
+
 #pragma mark - Presets
 
+#if defined(__APPLE__)
+
 bool GenericUnit::loadPreset(const DataSourceRef presetSource)
 {
 	if(presetSource->isFilePath()) {
@@ -242,6 +345,8 @@ bool GenericUnit::savePreset(const CFURLRef &presetURL) const
 	return writeSuccess;
 }
 
+#endif
+
 #pragma mark - Render Callbacks
 
 void GenericUnit::setRenderCallback(AURenderCallbackStruct callback, UInt32 bus)
@@ -253,4 +358,7 @@ void GenericUnit::setRenderCallback(AURenderCallbackStruct callback, UInt32 bus)
 									  &callback,
 									  sizeof(callback)),
 				 "setting render callback");
+	
+	// connectTo() records where the callback comes from after setting it
+	setSource(bus, NULL);
 }
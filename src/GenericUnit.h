@@ -22,25 +22,50 @@
 
 #pragma once
 
+#if defined(__APPLE__)
 #include <AudioToolbox/AudioToolbox.h>
+#endif
 #include "cinder/Filesystem.h"
 #include "AudioUnitTypes.h"
+#include <vector>
 
 #ifndef CI_AU_ENABLE_GUI
-	#define CI_AU_ENABLE_GUI !(TARGET_OS_IPHONE)
+	#if defined(__APPLE__)
+		#define CI_AU_ENABLE_GUI !(TARGET_OS_IPHONE)
+	#else
+		#define CI_AU_ENABLE_GUI 0
+	#endif
 #endif
 
 namespace cinder { namespace audiounit {
 	
 class Tap;
+class Graph;
 
 // GenericUnit is a general-purpose class to simplify using Audio Units in
 // Cinder apps. It can be used to represent any Audio Unit. Note that
 // there are several subclasses of GenericUnit which provide additional
 // convenience functions & utilities for specific Audio Units.
 
+// connectTo() also remembers what's feeding each of a unit's input
+// busses, so a whole chain can be set up from its output end at once.
+// prepareChain() walks everything upstream of a unit (through Taps and
+// Inputs too), finds the biggest render quantum any of it is set up for
+// (its MaximumFramesPerSlice), and sets that on all of it. Inputs and
+// Taps size their buffers for it at the same time, so that nothing has
+// to be allocated once audio's running. Output::start() does this for
+// you. Since it uninitializes and initializes units along the way, call
+// it while the chain's stopped. The units in a chain have to outlive it
+// (as they already do for the render callbacks connectTo() sets up).
+// A Graph (see AudioUnitGraph.h) reads the same records to work out the
+// chain's shape and an order to render it in.
+
 class GenericUnit
 {	
+	friend class Tap;
+	friend class Input;
+	friend class Graph;
+	
 public:
 	GenericUnit(){};
 	explicit GenericUnit(AudioComponentDescription description);
@@ -73,8 +98,10 @@ public:
 							UInt32 inNumberFrames,
 							AudioBufferList *ioData);
 	
+#if defined(__APPLE__)
 	// These functions expect an absolute path to the preset file (including the file extension).
-	// The file extension should be ".aupreset" by convention, but it's not necessary
+	// The file extension should be ".aupreset" by convention, but it's not necessary.
+	// Presets are property lists, so there are none without Core Foundation
 	bool savePreset(const fs::path &presetPath) const;
 	bool loadPreset(const fs::path &presetPath);
 	
@@ -83,10 +110,19 @@ public:
 	
 	bool savePreset(const CFURLRef &presetURL) const;
 	bool loadPreset(const CFURLRef &presetURL);
+#endif
 	
 	void setRenderCallback(AURenderCallbackStruct callback, UInt32 destinationBus = 0);
 	void reset(){AudioUnitReset(*_unit, kAudioUnitScope_Global, 0);}
 	
+	// MaximumFramesPerSlice can only be changed while the unit's
+	// uninitialized, so setting it uninitializes and reinitializes it
+	virtual bool setMaximumFramesPerSlice(UInt32 frames);
+	UInt32 getMaximumFramesPerSlice() const;
+	
+	// returns the quantum the chain was set up for, or 0 if any of it couldn't be
+	UInt32 prepareChain(UInt32 maximumFramesPerSlice = 0);
+	
 #if CI_AU_ENABLE_GUI
 	void showUI(const std::string &title = "Audio Unit UI",
 				UInt32 x = 50,
@@ -98,6 +134,20 @@ protected:
 	AudioUnitRef _unit;
 	AudioComponentDescription _desc;
 	
+	// what's feeding each input bus: either another unit (from its
+	// sourceBus output), or a Tap
+	struct Source
+	{
+		UInt32 bus;
+		GenericUnit * unit;
+		Tap * tap;
+		UInt32 sourceBus;
+	};
+	
+	std::vector<Source> _sources;
+	void setSource(UInt32 bus, GenericUnit * unit, Tap * tap = NULL, UInt32 sourceBus = 0);
+	void collectChain(std::vector<GenericUnit *> &units, std::vector<Tap *> &taps);
+	
 	void initUnit();
 
 	static void AudioUnitDeleter(AudioUnit * unit);
@@ -23,6 +23,8 @@
 #pragma once
 
 #include "GenericUnit.h"
+#include "Resampler.h"
+#include "RingHealth.h"
 
 namespace cinder { namespace audiounit {
 
@@ -62,6 +64,8 @@ public:
 	void  disableOutputMetering();
 };
 
+#if defined(__APPLE__)
+
 // Wraps the AUAudioFilePlayer unit.
 	
 // This audio unit allows you to play any file that
@@ -93,11 +97,18 @@ public:
 	void stop();
 };
 
+#endif // defined(__APPLE__)
+
 // Wraps the AUHAL output unit
 
 // This unit drives the "pull" model of Core Audio and
 // sends audio to the actual hardware (ie. speakers / headphones)
 
+// start() calls prepareChain() first, so that every unit, Tap and Input
+// feeding it is ready for the biggest block it can be asked for. To run
+// with bigger blocks (4096 frames for batch work, say), call
+// prepareChain(4096) or setMaximumFramesPerSlice(4096) before start().
+
 class Output : public GenericUnit
 {
 public:
@@ -119,6 +130,58 @@ public:
 // sets a render callback on downstream units and retreives
 // samples from an internal buffer when render() is called.
 
+// The input device and whatever's pulling from the buffer (usually the
+// output device) run off separate clocks, which never quite agree. Left
+// alone, the buffer slowly runs dry (and the input drops out) or fills
+// up (and the newest input is thrown away). With drift compensation
+// turned on, the Input keeps an eye on how full the buffer is, and
+// resamples what it hands downstream by a tiny fraction of a percent to
+// hold it at targetFrames (half the buffer by default). getDriftRatio()
+// says how much it's correcting by: 1.0001 means the input's being
+// consumed 100 parts per million faster than the output's running.
+
+// setSampleRate() asks the input device to run at a particular rate (0,
+// the default, leaves it at whatever it's set to). getSampleRate() says
+// what it ended up running at, once the Input's started. If that's not
+// the rate of the unit it's connected to, the Input converts between the
+// two itself, at setResamplerQuality() (ResamplerQualityHigh by default).
+// The buffer holds audio at the device's rate, so samplesToBuffer and
+// targetFrames count frames at that rate.
+
+// An Input can be connected to several units at once (a monitor chain
+// and a recorder, say), up to 8 including a Tap. The device is still
+// only rendered once per cycle, and every connection reads all of what
+// it captured, through its own cursor into the buffer, at its own rate
+// and with its own drift compensation. One that stops pulling doesn't
+// hold up the others; it just skips ahead to the newest audio.
+
+// By default every one of the device's channels is captured. On an
+// interface with lots of them, setChannelMap() picks out the ones that
+// are needed: {8, 9, 40, 41} captures just those four, and hands them
+// downstream as channels 0 to 3 (-1 in the map makes a silent channel).
+// Only the mapped channels are rendered, buffered and copied, so the
+// memory and time the Input takes go with the size of the map rather
+// than the size of the device. The map can only be changed while the
+// Input's stopped, and changing it restarts every connection's reading
+// from the beginning of the buffer.
+
+// getRingHealth() says how each connection's been getting on with the
+// buffer (see RingHealth): an underrun is a pull that found too little
+// audio and was padded with silence, and an overrun is the connection
+// falling so far behind that the oldest audio it hadn't read yet had to
+// make way for the newest. The fill levels are in frames at the device's
+// rate, as each pull found them.
+
+// The buffer the device is rendered into is allocated up front, for as
+// many frames as the HAL unit's MaximumFramesPerSlice allows (1024 at
+// least). setMaximumFramesPerSlice() (which prepareChain() calls, along
+// with Output::start()) grows it, along with the ring if that's shorter
+// than two blocks. That can't be done while the Input's running, so
+// then it only succeeds if the buffers already take blocks that big;
+// call it while the Input's stopped to be sure. A block that
+// somehow doesn't fit is dropped (and counted as an overrun) rather than
+// written past the end.
+
 class Input : public GenericUnit
 {
 	struct InputImpl;
@@ -126,13 +189,36 @@ class Input : public GenericUnit
 	
 	bool _isReady;
 	bool configureInputDevice();
+	bool prepareResampler();
 	
 public:
 	Input(unsigned int samplesToBuffer = 2048);
 	~Input();
 	
 	GenericUnit& connectTo(GenericUnit &otherUnit, UInt32 destinationBus = 0, UInt32 sourceBus = 0);
-	using GenericUnit::connectTo; // for connectTo(Tap&)
+	Tap& connectTo(Tap &tap);
+	UInt32 getConnectionCount() const;
+	
+	// Turning drift compensation on or off sets the connections up again,
+	// and they hand out silence while that happens
+	bool setDriftCompensationEnabled(bool enabled = true, UInt32 targetFrames = 0);
+	bool isDriftCompensationEnabled() const;
+	Float64 getDriftRatio(UInt32 connection = 0) const; // in the order they were connected
+	
+	bool setSampleRate(Float64 sampleRate);
+	Float64 getSampleRate() const;
+	void setResamplerQuality(ResamplerQuality quality);
+	ResamplerQuality getResamplerQuality() const;
+	
+	RingHealthReading getRingHealth(UInt32 connection = 0, bool reset = false);
+	void resetRingHealth();
+	
+	bool setMaximumFramesPerSlice(UInt32 frames);
+	
+	// call this while the Input is stopped too
+	bool setChannelMap(const std::vector<SInt32> &deviceChannels);
+	const std::vector<SInt32>& getChannelMap() const;
+	UInt32 getChannelCount() const;
 	
 	OSStatus render(AudioUnitRenderActionFlags *ioActionFlags,
 					const AudioTimeStamp *inTimeStamp,
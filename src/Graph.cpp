@@ -0,0 +1,957 @@
+#include "AudioUnitGraph.h"
+#include "AudioUnitTap.h"
+#include "AudioUnitUtils.h"
+#include "GenericUnitSubclasses.h"
+#include "Semaphore.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <pthread.h>
+#include <string.h>
+#include <thread>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#endif
+
+using namespace cinder::audiounit;
+using namespace std;
+
+typedef enum
+{
+	NodeVisiting,
+	NodeDone
+}
+NodeState;
+
+static bool EdgeBusLess(const GraphEdge &a, const GraphEdge &b)
+{
+	return a.destinationBus < b.destinationBus;
+}
+
+// A branch's state is tagged with the quantum it's for, so that a worker
+// that's fallen a quantum behind can't claim anything
+static const UInt64 kBranchPending = 1;
+static const UInt64 kBranchClaimed = 2;
+static const UInt64 kBranchDone    = 3;
+
+static inline UInt64 BranchState(UInt64 quantum, UInt64 state)
+{
+	return (quantum << 2) | state;
+}
+
+static inline UInt64 BranchStep(UInt64 state)
+{
+	return state & 3;
+}
+
+// Asks for the same sort of scheduling the I/O thread gets. On other
+// platforms that usually takes privileges, so if it's refused the
+// workers carry on at normal priority
+static void PromoteToRealtime(double periodSeconds)
+{
+#if defined(__APPLE__)
+	mach_timebase_info_data_t timebase;
+	mach_timebase_info(&timebase);
+	const double ticksPerSecond = 1e9 * timebase.denom / timebase.numer;
+	
+	thread_time_constraint_policy_data_t policy;
+	policy.period      = periodSeconds * ticksPerSecond;
+	policy.computation = policy.period / 2;
+	policy.constraint  = policy.period;
+	policy.preemptible = true;
+	
+	if(thread_policy_set(pthread_mach_thread_np(pthread_self()),
+						 THREAD_TIME_CONSTRAINT_POLICY,
+						 (thread_policy_t)&policy,
+						 THREAD_TIME_CONSTRAINT_POLICY_COUNT) != KERN_SUCCESS) {
+		std::cout << "Graph couldn't give a worker realtime priority" << std::endl;
+	}
+#else
+	(void)periodSeconds;
+	
+	sched_param param;
+	param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+	
+	const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if(error != 0) {
+		std::cout << "Graph couldn't give a worker realtime priority (" << strerror(error) << "), so it runs at normal priority" << std::endl;
+	}
+#endif
+}
+
+namespace {
+
+struct Branch
+{
+	vector<UInt32> nodes; // in render order
+	atomic<UInt64> state;
+	atomic<OSStatus> status;
+	
+	// the quantum it was last handed out for. Only written while no
+	// worker has it claimed
+	AudioTimeStamp timeStamp;
+	UInt32 frames;
+	
+	// The fan-in hears a branch through copies of what its nodes that
+	// feed the fan-in rendered, made once the branch is finished. There
+	// are two, so the last quantum it finished can still be heard while
+	// a worker's partway through the next. Whoever has the branch
+	// claimed writes the one latest doesn't point at
+	struct Copy
+	{
+		vector<AudioUnitSampleType> samples; // each output's channels, a quantum apiece
+		UInt32 frames;
+	};
+	
+	vector<UInt32> outputs;      // node indices
+	vector<UInt32> outputStarts; // the first of each output's channels in a copy
+	vector<UInt32> outputChannels;
+	Copy copies[2];
+	atomic<int> latest; // -1 until it's finished a quantum
+	
+	Branch() : state(0), status(noErr), frames(0), latest(-1) {}
+};
+
+} // anonymous namespace
+
+struct Graph::GraphImpl
+{
+	GenericUnit * sink;
+	UInt32 sinkIndex;
+	vector<GraphNode> nodes;
+	vector<GraphEdge> edges;
+	vector<UInt32> order;
+	bool cycle;
+	
+	// only used while capturing
+	map<const void *, UInt32> indices; // by unit or Tap
+	vector<NodeState> states;
+	
+	// for the nodes that render ahead, allocated by prepare()
+	vector<AudioBufferListRef> buffers;
+	vector<vector<void *> > bufferData;
+	UInt32 maxFrames;
+	Float64 sampleRate;
+	
+	// what renders ahead of the sink: the branches (in parallel), then
+	// the rest in order. Everything's in serial when there are no branches
+	bool parallel;
+	UInt32 maxWorkers;
+	vector<boost::shared_ptr<Branch> > branches;
+	vector<UInt32> serial;
+	
+	// The fan-in's inputs the branches feed. While they're rendering in
+	// parallel these are fed from the branches' copies instead of pulling
+	// the branch, so one that isn't finished in time is heard as the last
+	// quantum it did finish, rather than rendered again on the render thread
+	struct BranchInput
+	{
+		GraphImpl * impl;
+		Branch * branch;
+		UInt32 output; // which of the branch's outputs
+		GraphEdge edge;
+		AudioUnit source;
+		AudioUnit destination;
+	};
+	
+	UInt32 splitIndex;
+	vector<BranchInput> branchInputs;
+	vector<AudioUnitSampleType> silence;
+	
+	vector<thread> workers;
+	Semaphore semaphore;
+	atomic<bool> stopping;
+	atomic<UInt64> quantum;
+	
+	atomic<UInt64> quantaInParallel;
+	atomic<UInt64> branchesOnWorkers;
+	atomic<UInt64> branchesOnRenderThread;
+	atomic<UInt64> late;
+	
+	bool attached;
+	Float64 lastSampleTime;
+	
+	GraphImpl()
+	: sink(NULL)
+	, sinkIndex(0)
+	, cycle(false)
+	, maxFrames(0)
+	, sampleRate(44100)
+	, parallel(false)
+	, maxWorkers(0)
+	, splitIndex(0)
+	, stopping(false)
+	, quantum(0)
+	, quantaInParallel(0)
+	, branchesOnWorkers(0)
+	, branchesOnRenderThread(0)
+	, late(0)
+	, attached(false)
+	, lastSampleTime(-1)
+	{
+	}
+	
+	~GraphImpl()
+	{
+		detach();
+		releaseBuffers();
+	}
+	
+	void releaseBuffers()
+	{
+		stopWorkers();
+		reconnectBranches();
+		branches.clear();
+		serial.clear();
+		
+		for(size_t i = 0; i < buffers.size(); i++) {
+			for(UInt32 ch = 0; buffers[i] && ch < buffers[i]->mNumberBuffers; ch++) {
+				buffers[i]->mBuffers[ch].mData = bufferData[i][ch];
+			}
+		}
+		buffers.clear();
+		bufferData.clear();
+		maxFrames = 0;
+	}
+	
+	void addEdge(UInt32 source, UInt32 destination, UInt32 sourceBus, UInt32 destinationBus)
+	{
+		GraphEdge edge = {source, destination, sourceBus, destinationBus};
+		edges.push_back(edge);
+		
+		if(nodes[source].destinations++ == 0) nodes[source].renderBus = sourceBus;
+	}
+	
+	// depth first, so a node goes into the order once everything
+	// feeding it has
+	UInt32 visit(GenericUnit * unit, Tap * tap)
+	{
+		const void * key = unit ? (const void *)unit : (const void *)tap;
+		map<const void *, UInt32>::const_iterator found = indices.find(key);
+		
+		if(found != indices.end()) {
+			// it's still waiting on what feeds it, so it's feeding itself
+			if(states[found->second] == NodeVisiting) cycle = true;
+			return found->second;
+		}
+		
+		const UInt32 index = nodes.size();
+		GraphNode node = {unit, tap, 0, 0, false, unit && dynamic_cast<Input *>(unit) != NULL};
+		nodes.push_back(node);
+		states.push_back(NodeVisiting);
+		indices[key] = index;
+		
+		if(tap) {
+			if(tap->getSourceUnit()) addEdge(visit(tap->getSourceUnit(), NULL), index, 0, 0);
+		} else {
+			for(size_t i = 0; i < unit->_sources.size(); i++) {
+				const GenericUnit::Source &source = unit->_sources[i];
+				if(source.tap) {
+					addEdge(visit(NULL, source.tap), index, 0, source.bus);
+				} else {
+					addEdge(visit(source.unit, NULL), index, source.sourceBus, source.bus);
+				}
+			}
+		}
+		
+		states[index] = NodeDone;
+		order.push_back(index);
+		return index;
+	}
+	
+	vector<GraphEdge> inputsOf(UInt32 node) const
+	{
+		vector<GraphEdge> inputs;
+		for(size_t i = 0; i < edges.size(); i++) {
+			if(edges[i].destination == node) inputs.push_back(edges[i]);
+		}
+		stable_sort(inputs.begin(), inputs.end(), EdgeBusLess);
+		return inputs;
+	}
+	
+	// Follows the chain back from the sink to where it first fans in, and
+	// sorts everything feeding that point by which of its inputs it feeds.
+	// Inputs that share a node end up in the same branch
+	void findBranches()
+	{
+		UInt32 split = sinkIndex;
+		vector<GraphEdge> inputs = inputsOf(split);
+		while(inputs.size() == 1) {
+			split = inputs[0].source;
+			inputs = inputsOf(split);
+		}
+		
+		if(inputs.size() < 2) return;
+		splitIndex = split;
+		
+		const UInt32 kUnowned = UInt32(-1);
+		vector<UInt32> owner(nodes.size(), kUnowned);
+		vector<UInt32> group(inputs.size());
+		for(size_t i = 0; i < group.size(); i++) group[i] = i;
+		
+		for(UInt32 i = 0; i < inputs.size(); i++) {
+			vector<UInt32> stack(1, inputs[i].source);
+			
+			while(!stack.empty()) {
+				const UInt32 n = stack.back();
+				stack.pop_back();
+				
+				if(owner[n] == kUnowned) {
+					owner[n] = i;
+					const vector<GraphEdge> feeding = inputsOf(n);
+					for(size_t e = 0; e < feeding.size(); e++) stack.push_back(feeding[e].source);
+				} else {
+					// shared with another input, so the two are one branch
+					UInt32 a = owner[n], b = i;
+					while(group[a] != a) a = group[a];
+					while(group[b] != b) b = group[b];
+					group[max(a, b)] = min(a, b);
+				}
+			}
+		}
+		
+		// a branch's inputs are fed from the buffers its last units render
+		// into, so a branch that feeds the fan-in from anywhere else (a
+		// Tap, or a second output bus) stays serial
+		vector<bool> servable(inputs.size(), true);
+		for(UInt32 i = 0; i < inputs.size(); i++) {
+			const GraphNode &source = nodes[inputs[i].source];
+			if(source.rendersAhead && inputs[i].sourceBus == source.renderBus) continue;
+			
+			UInt32 root = i;
+			while(group[root] != root) root = group[root];
+			servable[root] = false;
+		}
+		
+		for(UInt32 i = 0; i < inputs.size(); i++) {
+			if(group[i] != i || !servable[i]) continue;
+			
+			boost::shared_ptr<Branch> branch(new Branch);
+			for(size_t o = 0; o < order.size(); o++) {
+				const UInt32 n = order[o];
+				if(owner[n] == kUnowned || !nodes[n].rendersAhead) continue;
+				
+				UInt32 root = owner[n];
+				while(group[root] != root) root = group[root];
+				if(root == i) branch->nodes.push_back(n);
+			}
+			
+			if(!branch->nodes.empty()) branches.push_back(branch);
+		}
+		
+		if(branches.size() < 2) branches.clear();
+	}
+	
+	// Feeds each of the fan-in's inputs that a branch renders from the
+	// Graph instead (see PullBranch)
+	bool connectBranches()
+	{
+		if(branches.empty()) return true;
+		
+		vector<Branch *> branchOf(nodes.size(), NULL);
+		for(size_t b = 0; b < branches.size(); b++) {
+			for(size_t i = 0; i < branches[b]->nodes.size(); i++) branchOf[branches[b]->nodes[i]] = branches[b].get();
+		}
+		
+		// the callbacks point into this, so it's filled before any are set
+		const vector<GraphEdge> inputs = inputsOf(splitIndex);
+		UInt32 widest = 0;
+		for(size_t i = 0; i < inputs.size(); i++) {
+			Branch * branch = branchOf[inputs[i].source];
+			if(!branch) continue;
+			
+			// a node feeding more than one of the inputs is only copied once
+			const UInt32 source = inputs[i].source;
+			UInt32 output = find(branch->outputs.begin(), branch->outputs.end(), source) - branch->outputs.begin();
+			if(output == branch->outputs.size()) {
+				branch->outputs.push_back(source);
+				branch->outputChannels.push_back(buffers[source]->mNumberBuffers);
+			}
+			
+			BranchInput input = {this, branch, output, inputs[i], *nodes[source].unit, *nodes[splitIndex].unit};
+			branchInputs.push_back(input);
+			widest = max(widest, buffers[source]->mNumberBuffers);
+		}
+		
+		for(size_t b = 0; b < branches.size(); b++) {
+			Branch &branch = *branches[b];
+			UInt32 channels = 0;
+			for(size_t o = 0; o < branch.outputs.size(); o++) {
+				branch.outputStarts.push_back(channels);
+				channels += branch.outputChannels[o];
+			}
+			
+			for(int c = 0; c < 2; c++) {
+				branch.copies[c].samples.assign(channels * maxFrames, 0);
+				branch.copies[c].frames = 0;
+			}
+			branch.latest.store(-1);
+		}
+		
+		silence.assign(widest * maxFrames, 0);
+		
+		for(size_t i = 0; i < branchInputs.size(); i++) {
+			const AURenderCallbackStruct callback = {PullBranch, &branchInputs[i]};
+			OSStatus status = AudioUnitSetProperty(branchInputs[i].destination,
+												   kAudioUnitProperty_SetRenderCallback,
+												   kAudioUnitScope_Input,
+												   branchInputs[i].edge.destinationBus,
+												   &callback,
+												   sizeof(callback));
+			
+			if(status != noErr) {
+				PRINT_IF_ERR(status, "feeding graph branch");
+				branchInputs.resize(i);
+				return false;
+			}
+		}
+		
+		return true;
+	}
+	
+	// Puts the connections connectBranches() replaced back
+	void reconnectBranches()
+	{
+		for(size_t i = 0; i < branchInputs.size(); i++) {
+			const BranchInput &input = branchInputs[i];
+			AudioUnitConnection connection = {input.source, input.edge.sourceBus, input.edge.destinationBus};
+			PRINT_IF_ERR(AudioUnitSetProperty(input.destination,
+											  kAudioUnitProperty_MakeConnection,
+											  kAudioUnitScope_Input,
+											  input.edge.destinationBus,
+											  &connection,
+											  sizeof(connection)),
+						 "reconnecting graph branch");
+		}
+		
+		branchInputs.clear();
+		silence.clear();
+	}
+	
+	void schedule()
+	{
+		branches.clear();
+		serial.clear();
+		
+		if(parallel) findBranches();
+		
+		vector<bool> inBranch(nodes.size(), false);
+		for(size_t b = 0; b < branches.size(); b++) {
+			for(size_t i = 0; i < branches[b]->nodes.size(); i++) inBranch[branches[b]->nodes[i]] = true;
+		}
+		
+		for(size_t o = 0; o < order.size(); o++) {
+			const UInt32 n = order[o];
+			if(nodes[n].rendersAhead && !inBranch[n]) serial.push_back(n);
+		}
+	}
+	
+	// one fewer than there are branches, as the render thread takes one
+	void startWorkers()
+	{
+		if(branches.empty()) return;
+		
+		UInt32 count = maxWorkers > 0 ? maxWorkers : max(1, (int)thread::hardware_concurrency() - 1);
+		count = min<UInt32>(count, branches.size() - 1);
+		
+		for(UInt32 i = 0; i < count; i++) {
+			workers.push_back(thread(&GraphImpl::run, this, i));
+		}
+	}
+	
+	void stopWorkers()
+	{
+		if(workers.empty()) return;
+		
+		stopping.store(true, memory_order_release);
+		for(size_t i = 0; i < workers.size(); i++) semaphore.signal();
+		for(size_t i = 0; i < workers.size(); i++) workers[i].join();
+		
+		workers.clear();
+		stopping.store(false);
+	}
+	
+	// Render thread, or a worker
+	OSStatus renderNode(UInt32 index, const AudioTimeStamp * ts, UInt32 frameCount)
+	{
+		AudioBufferList * bufferList = buffers[index].get();
+		for(UInt32 ch = 0; ch < bufferList->mNumberBuffers; ch++) {
+			bufferList->mBuffers[ch].mData = bufferData[index][ch];
+			bufferList->mBuffers[ch].mDataByteSize = frameCount * sizeof(AudioUnitSampleType);
+		}
+		
+		AudioUnitRenderActionFlags flags = 0;
+		const GraphNode &node = nodes[index];
+		return node.unit->render(&flags, ts, node.renderBus, frameCount, bufferList);
+	}
+	
+	bool claim(Branch &branch, UInt64 q)
+	{
+		UInt64 expected = BranchState(q, kBranchPending);
+		return branch.state.compare_exchange_strong(expected, BranchState(q, kBranchClaimed), memory_order_acq_rel);
+	}
+	
+	void finish(Branch &branch, UInt64 q)
+	{
+		OSStatus status = noErr;
+		for(size_t i = 0; i < branch.nodes.size() && status == noErr; i++) {
+			status = renderNode(branch.nodes[i], &branch.timeStamp, branch.frames);
+		}
+		
+		if(status == noErr) publish(branch);
+		
+		branch.status.store(status, memory_order_relaxed);
+		branch.state.store(BranchState(q, kBranchDone), memory_order_release);
+	}
+	
+	// Copies what the branch rendered for the fan-in into the copy that
+	// isn't the latest, and makes it the latest. The fan-in could be
+	// reading the other one right now
+	void publish(Branch &branch)
+	{
+		const int next = branch.latest.load(memory_order_relaxed) == 0 ? 1 : 0;
+		Branch::Copy &copy = branch.copies[next];
+		
+		for(size_t o = 0; o < branch.outputs.size(); o++) {
+			const AudioBufferList * rendered = buffers[branch.outputs[o]].get();
+			for(UInt32 ch = 0; ch < branch.outputChannels[o]; ch++) {
+				memcpy(&copy.samples[(branch.outputStarts[o] + ch) * maxFrames],
+					   rendered->mBuffers[ch].mData,
+					   branch.frames * sizeof(AudioUnitSampleType));
+			}
+		}
+		
+		copy.frames = branch.frames;
+		branch.latest.store(next, memory_order_release);
+	}
+	
+	void run(UInt32 worker)
+	{
+		PromoteToRealtime(maxFrames / sampleRate);
+		
+		while(true) {
+			semaphore.wait();
+			if(stopping.load(memory_order_acquire)) return;
+			
+			const UInt64 q = quantum.load(memory_order_acquire);
+			for(size_t i = 0; i < branches.size(); i++) {
+				Branch &branch = *branches[(worker + i) % branches.size()];
+				if(claim(branch, q)) {
+					finish(branch, q);
+					branchesOnWorkers.fetch_add(1, memory_order_relaxed);
+				}
+			}
+		}
+	}
+	
+	// Render thread. Everything but the sink
+	OSStatus renderAhead(const AudioTimeStamp * ts, UInt32 frameCount)
+	{
+		if(maxFrames == 0) return kAudioUnitErr_Uninitialized;
+		if(frameCount > maxFrames) return kAudioUnitErr_TooManyFramesToProcess;
+		
+		OSStatus result = branches.empty() ? noErr : renderBranches(ts, frameCount);
+		
+		for(size_t i = 0; i < serial.size() && result == noErr; i++) {
+			result = renderNode(serial[i], ts, frameCount);
+		}
+		
+		return result;
+	}
+	
+	OSStatus renderBranches(const AudioTimeStamp * ts, UInt32 frameCount)
+	{
+		// A branch a worker's still partway through from an earlier
+		// quantum is left to it, and the fan-in hears the last quantum it
+		// finished again. Nothing's writing the others by now
+		const UInt64 q = quantum.load(memory_order_relaxed) + 1;
+		for(size_t i = 0; i < branches.size(); i++) {
+			Branch &branch = *branches[i];
+			if(BranchStep(branch.state.load(memory_order_acquire)) == kBranchClaimed) continue;
+			
+			branch.timeStamp = *ts;
+			branch.frames = frameCount;
+			branch.state.store(BranchState(q, kBranchPending), memory_order_release);
+		}
+		quantum.store(q, memory_order_release);
+		
+		for(size_t i = 0; i < workers.size(); i++) semaphore.signal();
+		
+		// the workers start at the front, so this starts at the back, and
+		// takes whatever they haven't got to. It doesn't wait for the ones
+		// they have (see PullBranch)
+		for(size_t i = branches.size(); i-- > 0;) {
+			if(claim(*branches[i], q)) {
+				finish(*branches[i], q);
+				branchesOnRenderThread.fetch_add(1, memory_order_relaxed);
+			}
+		}
+		
+		OSStatus result = noErr;
+		const UInt64 done = BranchState(q, kBranchDone);
+		
+		for(size_t i = 0; i < branches.size() && result == noErr; i++) {
+			if(branches[i]->state.load(memory_order_acquire) == done) result = branches[i]->status.load(memory_order_relaxed);
+		}
+		
+		quantaInParallel.fetch_add(1, memory_order_relaxed);
+		return result;
+	}
+	
+	// Render thread. The fan-in pulling one of its inputs a branch feeds.
+	// Hands over the latest quantum the branch finished: this one, if it
+	// has by now, or the one before if a worker's running late. Until
+	// the branch has finished one at all, that's silence
+	static OSStatus PullBranch(void * inRefCon,
+							   AudioUnitRenderActionFlags * ioActionFlags,
+							   const AudioTimeStamp * inTimeStamp,
+							   UInt32 inBusNumber,
+							   UInt32 inNumberFrames,
+							   AudioBufferList * ioData)
+	{
+		const BranchInput &input = *static_cast<const BranchInput *>(inRefCon);
+		GraphImpl * impl = input.impl;
+		const Branch &branch = *input.branch;
+		
+		const UInt64 done = BranchState(impl->quantum.load(memory_order_relaxed), kBranchDone);
+		if(branch.state.load(memory_order_acquire) != done) impl->late.fetch_add(1, memory_order_relaxed);
+		
+		const int latest = branch.latest.load(memory_order_acquire);
+		const Branch::Copy * copy = latest >= 0 ? &branch.copies[latest] : NULL;
+		const UInt32 frames = copy ? min(copy->frames, inNumberFrames) : 0;
+		const UInt32 channels = branch.outputChannels[input.output];
+		const UInt32 bytes = inNumberFrames * sizeof(AudioUnitSampleType);
+		
+		for(UInt32 ch = 0; ch < ioData->mNumberBuffers; ch++) {
+			AudioBuffer &buffer = ioData->mBuffers[ch];
+			const AudioUnitSampleType * samples = copy && ch < channels
+												? &copy->samples[(branch.outputStarts[input.output] + ch) * impl->maxFrames]
+												: NULL;
+			
+			buffer.mDataByteSize = bytes;
+			
+			// the copy isn't written again until the next quantum, so it
+			// can be handed over as it is. Short of that, it's silence
+			if(buffer.mData == NULL) {
+				const UInt32 spare = min<UInt32>(ch, impl->silence.size() / impl->maxFrames - 1);
+				buffer.mData = samples && frames == inNumberFrames ? (void *)samples : &impl->silence[spare * impl->maxFrames];
+				continue;
+			}
+			
+			AudioUnitSampleType * out = (AudioUnitSampleType *)buffer.mData;
+			const UInt32 copied = samples ? frames : 0;
+			if(copied > 0) memcpy(out, samples, copied * sizeof(AudioUnitSampleType));
+			memset(out + copied, 0, (inNumberFrames - copied) * sizeof(AudioUnitSampleType));
+		}
+		
+		if(!copy) *ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+		return noErr;
+	}
+	
+	// The sink's pre-render notification. A sink with several output
+	// busses is rendered once for each, so this only goes once per
+	// timestamp. Anything that goes wrong shows up again when the sink
+	// pulls the unit it happened in
+	static OSStatus RenderNotify(void * inRefCon,
+								 AudioUnitRenderActionFlags * ioActionFlags,
+								 const AudioTimeStamp * inTimeStamp,
+								 UInt32 inBusNumber,
+								 UInt32 inNumberFrames,
+								 AudioBufferList * ioData)
+	{
+		GraphImpl * impl = static_cast<GraphImpl *>(inRefCon);
+		
+		if((*ioActionFlags & kAudioUnitRenderAction_PreRender) && inTimeStamp->mSampleTime != impl->lastSampleTime) {
+			impl->lastSampleTime = inTimeStamp->mSampleTime;
+			impl->renderAhead(inTimeStamp, inNumberFrames);
+		}
+		
+		return noErr;
+	}
+	
+	void detach()
+	{
+		if(!attached) return;
+		PRINT_IF_ERR(AudioUnitRemoveRenderNotify(*sink, RenderNotify, this), "detaching graph");
+		attached = false;
+	}
+	
+	std::string describe(UInt32 index) const
+	{
+		const GraphNode &node = nodes[index];
+		if(node.tap) return "Tap";
+		if(node.isInput) return "Input";
+		return StringForAudioComponentDescription(node.unit->_desc);
+	}
+};
+
+Graph::Graph() : _impl(new GraphImpl)
+{
+}
+
+Graph::~Graph()
+{
+}
+
+#pragma mark - Topology
+
+bool Graph::capture(GenericUnit &sink)
+{
+	clear();
+	
+	_impl->sink = &sink;
+	_impl->sinkIndex = _impl->visit(&sink, NULL);
+	_impl->indices.clear();
+	_impl->states.clear();
+	
+	// Taps and Inputs hand out new audio every time they're pulled, so
+	// they're left to be pulled by whatever they feed
+	for(size_t i = 0; i < _impl->nodes.size(); i++) {
+		GraphNode &node = _impl->nodes[i];
+		node.rendersAhead = node.unit && !node.isInput && i != _impl->sinkIndex;
+	}
+	
+	if(_impl->cycle) {
+		std::cout << "Graph found a cycle in the chain feeding " << _impl->describe(_impl->sinkIndex) << std::endl;
+		return false;
+	}
+	
+	return true;
+}
+
+void Graph::clear()
+{
+	_impl->detach();
+	_impl->sink = NULL;
+	_impl->sinkIndex = 0;
+	_impl->nodes.clear();
+	_impl->edges.clear();
+	_impl->order.clear();
+	_impl->cycle = false;
+	_impl->releaseBuffers();
+}
+
+GenericUnit * Graph::getSink() const
+{
+	return _impl->sink;
+}
+
+UInt32 Graph::getSinkIndex() const
+{
+	return _impl->sinkIndex;
+}
+
+const vector<GraphNode>& Graph::getNodes() const
+{
+	return _impl->nodes;
+}
+
+const vector<GraphEdge>& Graph::getEdges() const
+{
+	return _impl->edges;
+}
+
+const vector<UInt32>& Graph::getRenderOrder() const
+{
+	return _impl->order;
+}
+
+bool Graph::hasCycle() const
+{
+	return _impl->cycle;
+}
+
+vector<UInt32> Graph::getFanOut(bool includeInputs) const
+{
+	vector<UInt32> fanOut;
+	for(UInt32 i = 0; i < _impl->nodes.size(); i++) {
+		const GraphNode &node = _impl->nodes[i];
+		if(node.destinations > 1 && (includeInputs || !node.isInput)) fanOut.push_back(i);
+	}
+	return fanOut;
+}
+
+vector<GraphEdge> Graph::getInputs(UInt32 node) const
+{
+	return _impl->inputsOf(node);
+}
+
+void Graph::print() const
+{
+	std::cout << "Graph of " << _impl->nodes.size() << " nodes, in render order:" << std::endl;
+	
+	for(size_t i = 0; i < _impl->order.size(); i++) {
+		const UInt32 index = _impl->order[i];
+		const GraphNode &node = _impl->nodes[index];
+		
+		std::cout << "  " << index << ": " << _impl->describe(index);
+		if(index == _impl->sinkIndex) std::cout << " (sink)";
+		if(node.destinations > 1) std::cout << " (feeds " << node.destinations << ")";
+		std::cout << std::endl;
+		
+		const vector<GraphEdge> inputs = getInputs(index);
+		for(size_t e = 0; e < inputs.size(); e++) {
+			std::cout << "      bus " << inputs[e].destinationBus << " <- " << inputs[e].source << " (bus " << inputs[e].sourceBus << ")" << std::endl;
+		}
+	}
+	
+	if(_impl->cycle) std::cout << "  (has a cycle)" << std::endl;
+}
+
+#pragma mark - Rendering
+
+UInt32 Graph::prepare(UInt32 maximumFramesPerSlice)
+{
+	_impl->releaseBuffers();
+	
+	if(!_impl->sink) {
+		std::cout << "Graph has to capture() a chain before it can prepare it" << std::endl;
+		return 0;
+	}
+	
+	if(_impl->cycle) {
+		std::cout << "Graph can't render a chain with a cycle in it" << std::endl;
+		return 0;
+	}
+	
+	const UInt32 frames = _impl->sink->prepareChain(maximumFramesPerSlice);
+	if(frames == 0) return 0;
+	
+	_impl->buffers.resize(_impl->nodes.size());
+	_impl->bufferData.resize(_impl->nodes.size());
+	
+	for(size_t i = 0; i < _impl->nodes.size(); i++) {
+		const GraphNode &node = _impl->nodes[i];
+		if(!node.rendersAhead) continue;
+		
+		AudioStreamBasicDescription ASBD = {0};
+		UInt32 ASBDSize = sizeof(ASBD);
+		
+		OSStatus status = AudioUnitGetProperty(*node.unit,
+											   kAudioUnitProperty_StreamFormat,
+											   kAudioUnitScope_Output,
+											   node.renderBus,
+											   &ASBD,
+											   &ASBDSize);
+		
+		if(status != noErr || ASBD.mChannelsPerFrame == 0) {
+			PRINT_IF_ERR(status, "getting graph node's output ASBD");
+			std::cout << "Graph couldn't find out what " << _impl->describe(i) << " renders" << std::endl;
+			_impl->releaseBuffers();
+			return 0;
+		}
+		
+		// a unit's allowed to point these at its own buffers, so they're
+		// put back before every render (and before they're released)
+		AudioBufferList * bufferList = AudioBufferListAlloc(ASBD.mChannelsPerFrame, frames);
+		_impl->buffers[i] = AudioBufferListRef(bufferList, AudioBufferListRelease);
+		
+		for(UInt32 ch = 0; ch < bufferList->mNumberBuffers; ch++) {
+			_impl->bufferData[i].push_back(bufferList->mBuffers[ch].mData);
+		}
+	}
+	
+	AudioStreamBasicDescription sinkASBD = {0};
+	UInt32 sinkASBDSize = sizeof(sinkASBD);
+	
+	if(AudioUnitGetProperty(*_impl->sink, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &sinkASBD, &sinkASBDSize) == noErr &&
+	   sinkASBD.mSampleRate > 0) {
+		_impl->sampleRate = sinkASBD.mSampleRate;
+	}
+	
+	_impl->maxFrames = frames;
+	_impl->schedule();
+	
+	if(!_impl->connectBranches()) {
+		std::cout << "Graph couldn't feed " << _impl->describe(_impl->splitIndex) << " from its branches" << std::endl;
+		_impl->releaseBuffers();
+		return 0;
+	}
+	
+	_impl->startWorkers();
+	return frames;
+}
+
+OSStatus Graph::render(AudioUnitRenderActionFlags *ioActionFlags,
+					   const AudioTimeStamp *inTimeStamp,
+					   UInt32 inOutputBusNumber,
+					   UInt32 inNumberFrames,
+					   AudioBufferList *ioData)
+{
+	if(!_impl->sink) return kAudioUnitErr_Uninitialized;
+	
+	const OSStatus status = _impl->renderAhead(inTimeStamp, inNumberFrames);
+	if(status != noErr) return status;
+	
+	return _impl->sink->render(ioActionFlags, inTimeStamp, inOutputBusNumber, inNumberFrames, ioData);
+}
+
+bool Graph::attach()
+{
+	if(_impl->attached) return true;
+	
+	if(!_impl->sink || _impl->maxFrames == 0) {
+		std::cout << "Graph has to be prepared before it can be attached" << std::endl;
+		return false;
+	}
+	
+	_impl->lastSampleTime = -1;
+	
+	OSStatus status = AudioUnitAddRenderNotify(*_impl->sink, GraphImpl::RenderNotify, _impl.get());
+	if(status != noErr) {
+		PRINT_IF_ERR(status, "attaching graph");
+		return false;
+	}
+	
+	_impl->attached = true;
+	return true;
+}
+
+void Graph::detach()
+{
+	_impl->detach();
+}
+
+#pragma mark - Parallel Rendering
+
+void Graph::setParallelRendering(bool enabled, UInt32 workerThreads)
+{
+	_impl->parallel = enabled;
+	_impl->maxWorkers = workerThreads;
+}
+
+bool Graph::isParallelRenderingEnabled() const
+{
+	return _impl->parallel;
+}
+
+UInt32 Graph::getBranchCount() const
+{
+	return _impl->branches.size();
+}
+
+const vector<UInt32>& Graph::getBranch(UInt32 branch) const
+{
+	return _impl->branches.at(branch)->nodes;
+}
+
+GraphParallelStats Graph::getParallelStats(bool reset)
+{
+	GraphParallelStats stats;
+	
+	if(reset) {
+		stats.quanta                 = _impl->quantaInParallel.exchange(0, memory_order_relaxed);
+		stats.branchesOnWorkers      = _impl->branchesOnWorkers.exchange(0, memory_order_relaxed);
+		stats.branchesOnRenderThread = _impl->branchesOnRenderThread.exchange(0, memory_order_relaxed);
+		stats.late                   = _impl->late.exchange(0, memory_order_relaxed);
+	} else {
+		stats.quanta                 = _impl->quantaInParallel.load(memory_order_relaxed);
+		stats.branchesOnWorkers      = _impl->branchesOnWorkers.load(memory_order_relaxed);
+		stats.branchesOnRenderThread = _impl->branchesOnRenderThread.load(memory_order_relaxed);
+		stats.late                   = _impl->late.load(memory_order_relaxed);
+	}
+	
+	return stats;
+}
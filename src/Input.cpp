@@ -1,7 +1,12 @@
 #include "GenericUnitSubclasses.h"
 #include "AudioUnitTap.h"
 #include "AudioUnitUtils.h"
-#include "TPCircularBuffer/TPCircularBuffer.h"
+#include "InputRing.h"
+#include "Resampler.h"
+#include "TPCircularBuffer/TPMultichannelCircularBuffer+AudioBufferList.h"
+#include <atomic>
+#include <math.h>
+#include <thread>
 
 // TODO: init process is a bit of a mess
 
@@ -35,18 +40,161 @@ OSStatus PullCallback(void *inRefCon,
 					  UInt32 inNumberFrames,
 					  AudioBufferList *ioData);
 
+// Drift compensation steers the resampling ratio with a PI controller,
+// working in seconds of buffered audio so that it behaves the same at
+// any sample rate or buffer size. The fill level is smoothed first, since
+// the input and output block sizes make it zigzag from pull to pull
+static const Float64 kFillSmoothing    = 2;      // seconds
+static const Float64 kProportionalGain = 0.1;    // per second
+static const Float64 kIntegralGain     = 0.0025; // per second squared (critically damped)
+static const Float64 kMaxCorrection    = 0.002;  // 2000ppm, well beyond any real clock's drift
+static const UInt32  kResamplerFrames  = 512;    // longer pulls are resampled in pieces
+
+static const UInt32  kMaxConnections   = 8;
+
+struct InputContext;
+
+// Every unit the Input's connected to reads the same captured audio
+// through its own cursor, at its own pace and its own sample rate
+struct InputConnection
+{
+	InputContext * input;
+	std::atomic<bool> active;
+	std::atomic<UInt64> cursor; // frames read, counted from when the Input was created
+	const void * destination;   // so that connecting to the same thing again reuses it
+	UInt32 bus;
+	bool followsDevice;         // for a Tap, which runs at whatever the device runs at
+	Float64 graphRate;          // the rate of whatever's pulling from it
+	
+	// resampling and drift compensation (render thread only, apart from ratio)
+	bool resampling;
+	Float64 nominalRatio; // captureRate / graphRate
+	bool primed;
+	Float64 smoothedFill;
+	Float64 driftIntegral;
+	std::atomic<Float64> ratio; // the drift correction, on top of nominalRatio
+	Resampler resampler;
+	std::vector<const float *> resamplerInputs;
+	std::vector<float *> resamplerOutputs;
+	std::vector<float> discarded; // for channels that downstream doesn't want
+	
+	// what the resampler was last set up for, so it's only set up again
+	// when one of them changes (preparedChannels is 0 until it's set up)
+	UInt32 preparedChannels;
+	Float64 preparedCaptureRate;
+	Float64 preparedGraphRate;
+	bool preparedDrift;
+	ResamplerQuality preparedQuality;
+	
+	RingHealth health; // fill as this connection sees it, and what it's lost
+};
+
+// The input device is rendered once per cycle, into one buffer, however
+// many connections there are. RenderCallback is the only thing that
+// moves the buffer's head and tail: before writing a block it frees
+// whatever every connection has read, and if one's fallen so far behind
+// that there's no room, it pushes that connection's cursor on. The
+// connection notices when it goes to move its cursor, since the update
+// fails, and throws away what it read in the meantime.
 struct InputContext
 {
-	vector<TPCircularBuffer> circularBuffers;
+	TPMultichannelCircularBuffer circularBuffer;
 	AudioUnitRef inputUnit;
 	AudioBufferListRef bufferList;
+	UInt32 channels;
+	UInt32 capacity;  // frames
+	UInt32 maxFrames; // the most bufferList can take at once
+	Float64 captureRate; // the input device's rate, which is what's in the buffer
+	std::atomic<UInt64> written; // frames captured since the Input was created
+	UInt64 released;             // frames freed up again (render callback only)
+	InputConnection connections[kMaxConnections];
+	
+	bool driftCompensation;
+	UInt32 targetFill;
+	
+	// the connections are pulled on other threads, which don't stop when
+	// the Input does (see SuspendPulls())
+	std::atomic<bool> pullsSuspended;
+	std::atomic<int> pullsInFlight;
 };
 
 struct Input::InputImpl
 {
 	InputContext ctx;
+	InputConnection * tapConnection; // what render() reads from
+	UInt32 deviceChannels; // what's captured without a channel map
+	std::vector<SInt32> channelMap;
+	bool channelMapApplied;
+	Float64 requestedRate; // 0 for whatever the device is set to
+	ResamplerQuality quality;
 };
 
+// PullCallback runs on whatever's pulling the Input (the Output's render
+// thread, usually), which carries on whether the Input's running or not.
+// Before anything a pull reads is reallocated or changed, the pulls are
+// suspended: they hand out silence instead, and this waits for any
+// that are partway through to finish
+static void SuspendPulls(InputContext &ctx)
+{
+	ctx.pullsSuspended.store(true);
+	while(ctx.pullsInFlight.load() > 0) {
+		std::this_thread::yield();
+	}
+}
+
+static void ResumePulls(InputContext &ctx)
+{
+	ctx.pullsSuspended.store(false);
+}
+
+// Sizes the buffers for the number of channels that are actually being
+// captured. Any connections start reading again from the beginning
+static void AllocateBuffers(InputContext &ctx, UInt32 channels)
+{
+	TPMultichannelCircularBuffer * circBuffer = &ctx.circularBuffer;
+	
+	if(circBuffer->buffer) {
+		RealtimeMemory::unlock(circBuffer->buffer, (size_t)circBuffer->length * 2 * circBuffer->channels);
+		TPMultichannelCircularBufferCleanup(circBuffer);
+	}
+	
+	ctx.channels   = channels;
+	ctx.bufferList = AudioBufferListRef(AudioBufferListAlloc(channels, ctx.maxFrames), AudioBufferListRelease);
+	TPMultichannelCircularBufferInit(circBuffer, channels, ctx.capacity * sizeof(AudioUnitSampleType));
+	RealtimeMemory::lock(circBuffer->buffer, (size_t)circBuffer->length * 2 * circBuffer->channels);
+	
+	ctx.written  = 0;
+	ctx.released = 0;
+	for(UInt32 i = 0; i < kMaxConnections; i++) {
+		ctx.connections[i].cursor = 0;
+		ctx.connections[i].health.setCapacity(circBuffer->length / sizeof(AudioUnitSampleType));
+	}
+}
+
+// Grows the buffers, if they need it, to take blocks of up to frames.
+// The ring's kept at least two blocks long, so that one can be written
+// while the one before it is still being read. The device mustn't be
+// running, and the connections are suspended while it's done
+static void ReserveFrames(InputContext &ctx, UInt32 frames)
+{
+	if(frames <= ctx.maxFrames && 2 * frames <= ctx.capacity) return;
+	
+	SuspendPulls(ctx);
+	ctx.maxFrames = max(ctx.maxFrames, frames);
+	ctx.capacity  = max(ctx.capacity, 2 * frames);
+	AllocateBuffers(ctx, ctx.channels);
+	ResumePulls(ctx);
+}
+
+// the buffers can't be reallocated while the device is rendering into them
+static bool IsRunning(AudioUnit unit)
+{
+	UInt32 running = 0;
+	UInt32 runningSize = sizeof(running);
+	AudioUnitGetProperty(unit, kAudioOutputUnitProperty_IsRunning, kAudioUnitScope_Global, 0, &running, &runningSize);
+	return running != 0;
+}
+
 Input::Input(unsigned int samplesToBuffer)
 : _isReady(false)
 , _impl(new InputImpl)
@@ -65,11 +213,29 @@ Input::Input(unsigned int samplesToBuffer)
 				 "getting input ASBD");
 	
 	_impl->ctx.inputUnit  = _unit;
-	_impl->ctx.bufferList = AudioBufferListRef(AudioBufferListAlloc(ASBD.mChannelsPerFrame, 1024), AudioBufferListRelease);
-	_impl->ctx.circularBuffers.resize(ASBD.mChannelsPerFrame);
+	_impl->ctx.capacity   = samplesToBuffer;
+	_impl->ctx.maxFrames  = max<UInt32>(1024, GenericUnit::getMaximumFramesPerSlice());
+	_impl->ctx.captureRate = ASBD.mSampleRate > 0 ? ASBD.mSampleRate : 44100;
+	_impl->ctx.circularBuffer.buffer = NULL;
+	_impl->ctx.driftCompensation = false;
+	_impl->ctx.pullsSuspended = false;
+	_impl->ctx.pullsInFlight = 0;
+	_impl->tapConnection = NULL;
+	_impl->deviceChannels = ASBD.mChannelsPerFrame;
+	_impl->channelMapApplied = false;
+	_impl->requestedRate = 0;
+	_impl->quality = ResamplerQualityHigh;
+	AllocateBuffers(_impl->ctx, ASBD.mChannelsPerFrame);
 	
-	for(int i = 0; i < ASBD.mChannelsPerFrame; i++) {
-		TPCircularBufferInit(&_impl->ctx.circularBuffers[i], samplesToBuffer * sizeof(AudioUnitSampleType));
+	for(UInt32 i = 0; i < kMaxConnections; i++) {
+		InputConnection &connection = _impl->ctx.connections[i];
+		connection.input       = &_impl->ctx;
+		connection.active      = false;
+		connection.cursor      = 0;
+		connection.destination = NULL;
+		connection.resampling  = false;
+		connection.ratio       = 1;
+		connection.preparedChannels = 0;
 	}
 }
 
@@ -77,13 +243,64 @@ Input::~Input()
 {
 	stop();
 	
-	for(int i = 0; i < _impl->ctx.circularBuffers.size(); i++) {
-		TPCircularBufferCleanup(&_impl->ctx.circularBuffers[i]);
-	}
+	TPMultichannelCircularBuffer * circBuffer = &_impl->ctx.circularBuffer;
+	RealtimeMemory::unlock(circBuffer->buffer, (size_t)circBuffer->length * 2 * circBuffer->channels);
+	TPMultichannelCircularBufferCleanup(circBuffer);
 }
 
 #pragma mark - Connections
 
+static bool PrepareConnection(InputContext &ctx, InputConnection &connection, ResamplerQuality quality);
+
+static UInt32 ActiveConnectionCount(const InputContext &ctx)
+{
+	UInt32 count = 0;
+	for(UInt32 i = 0; i < kMaxConnections; i++) {
+		if(ctx.connections[i].active) count++;
+	}
+	return count;
+}
+
+// Finds the connection to destination's bus (or a free one), and sets it
+// up to start reading from the newest audio. Returns NULL if they're all taken
+static InputConnection * Connect(InputContext &ctx, const void * destination, UInt32 bus, Float64 graphRate, ResamplerQuality quality)
+{
+	InputConnection * connection = NULL;
+	
+	for(UInt32 i = 0; i < kMaxConnections && !connection; i++) {
+		InputConnection &candidate = ctx.connections[i];
+		if(candidate.active && candidate.destination == destination && candidate.bus == bus) {
+			connection = &candidate;
+		}
+	}
+	
+	for(UInt32 i = 0; i < kMaxConnections && !connection; i++) {
+		if(!ctx.connections[i].active) connection = &ctx.connections[i];
+	}
+	
+	if(!connection) {
+		std::cout << "Input can't be connected to more than " << kMaxConnections << " things at once" << std::endl;
+		return NULL;
+	}
+	
+	// connecting to the same thing again carries on counting where it was
+	if(!connection->active) connection->health.reset();
+	
+	// the same destination may still be pulling it
+	SuspendPulls(ctx);
+	connection->active.store(false);
+	connection->destination   = destination;
+	connection->bus           = bus;
+	connection->followsDevice = graphRate <= 0;
+	connection->graphRate     = graphRate > 0 ? graphRate : ctx.captureRate;
+	PrepareConnection(ctx, *connection, quality);
+	
+	connection->cursor.store(ctx.written.load());
+	connection->active.store(true);
+	ResumePulls(ctx);
+	return connection;
+}
+
 GenericUnit& Input::connectTo(GenericUnit &otherUnit, UInt32 destinationBus, UInt32 sourceBus)
 {
 	AudioStreamBasicDescription ASBD;
@@ -97,19 +314,267 @@ GenericUnit& Input::connectTo(GenericUnit &otherUnit, UInt32 destinationBus, UIn
 									   &ASBDSize),
 				  "getting hardware input destination's format");
 	
-	PRINT_IF_ERR(AudioUnitSetProperty(*_unit,
-									   kAudioUnitProperty_StreamFormat,
-									   kAudioUnitScope_Output,
-									   1,
-									   &ASBD,
-									   sizeof(ASBD)),
-				  "setting hardware input's output format");
+	const Float64 graphRate = ASBD.mSampleRate;
+	
+	// The HAL unit hands over audio in the first destination's format, but
+	// at the device's own rate; the Input resamples it itself on the way
+	// out. Later connections get the same channels, whatever their rate
+	if(ActiveConnectionCount(_impl->ctx) == 0) {
+		ASBD.mSampleRate = _impl->ctx.captureRate;
+		ASBD.mChannelsPerFrame = _impl->ctx.channels;
+		
+		PRINT_IF_ERR(AudioUnitSetProperty(*_unit,
+										   kAudioUnitProperty_StreamFormat,
+										   kAudioUnitScope_Output,
+										   1,
+										   &ASBD,
+										   sizeof(ASBD)),
+					  "setting hardware input's output format");
+	}
+	
+	InputConnection * connection = Connect(_impl->ctx, &otherUnit, destinationBus, graphRate, _impl->quality);
+	
+	if(connection) {
+		AURenderCallbackStruct callback = {PullCallback, connection};
+		otherUnit.setRenderCallback(callback, destinationBus);
+		otherUnit.setSource(destinationBus, this);
+	}
 	
-	AURenderCallbackStruct callback = {PullCallback, &_impl->ctx};
-	otherUnit.setRenderCallback(callback, destinationBus);
 	return otherUnit;
 }
 
+Tap& Input::connectTo(Tap &tap)
+{
+	// the Tap pulls through render(), at the device's rate
+	InputConnection * connection = Connect(_impl->ctx, &tap, 0, 0, _impl->quality);
+	if(connection) _impl->tapConnection = connection;
+	
+	return GenericUnit::connectTo(tap);
+}
+
+UInt32 Input::getConnectionCount() const
+{
+	return ActiveConnectionCount(_impl->ctx);
+}
+
+#pragma mark - Sample Rate
+
+bool Input::setSampleRate(Float64 sampleRate)
+{
+	if(sampleRate < 0) {
+		std::cout << "Input can't run at " << sampleRate << "Hz" << std::endl;
+		return false;
+	}
+	
+	_impl->requestedRate = sampleRate;
+	
+	// the device gets set up again at the new rate on the next start()
+	if(_isReady) {
+		PRINT_IF_ERR(AudioUnitUninitialize(*_unit), "uninitializing input unit to change its sample rate");
+		_isReady = false;
+	}
+	
+	return true;
+}
+
+Float64 Input::getSampleRate() const
+{
+	return _impl->ctx.captureRate;
+}
+
+void Input::setResamplerQuality(ResamplerQuality quality)
+{
+	_impl->quality = quality;
+}
+
+ResamplerQuality Input::getResamplerQuality() const
+{
+	return _impl->quality;
+}
+
+// whether the connection's resampler is already set up for the way things are
+static bool IsPrepared(const InputContext &ctx, const InputConnection &connection, ResamplerQuality quality)
+{
+	const Float64 graphRate = connection.followsDevice ? ctx.captureRate : connection.graphRate;
+	
+	return connection.preparedChannels    == ctx.channels &&
+		   connection.preparedCaptureRate == ctx.captureRate &&
+		   connection.preparedGraphRate   == graphRate &&
+		   connection.preparedDrift       == ctx.driftCompensation &&
+		   connection.preparedQuality     == quality;
+}
+
+// Pulls have to be suspended (see SuspendPulls())
+static bool PrepareConnection(InputContext &ctx, InputConnection &connection, ResamplerQuality quality)
+{
+	if(connection.followsDevice) connection.graphRate = ctx.captureRate;
+	
+	connection.resampler.release();
+	connection.preparedChannels = 0;
+	connection.nominalRatio = ctx.captureRate / connection.graphRate;
+	connection.resampling   = ctx.driftCompensation || ctx.captureRate != connection.graphRate;
+	connection.ratio        = 1;
+	
+	if(connection.resampling) {
+		const Float64 maxRatio = connection.nominalRatio * (ctx.driftCompensation ? 1 + kMaxCorrection : 1);
+		
+		if(!connection.resampler.allocate(ctx.channels, kResamplerFrames, maxRatio, quality)) {
+			// it carries on without converting, rather than not at all
+			connection.resampling = false;
+			return false;
+		}
+		
+		connection.resamplerInputs.assign(ctx.channels, (const float *)NULL);
+		connection.resamplerOutputs.assign(ctx.channels, (float *)NULL);
+		connection.discarded.assign(kResamplerFrames, 0);
+		connection.primed        = false;
+		connection.smoothedFill  = 0;
+		connection.driftIntegral = 0;
+	}
+	
+	connection.preparedChannels    = ctx.channels;
+	connection.preparedCaptureRate = ctx.captureRate;
+	connection.preparedGraphRate   = connection.graphRate;
+	connection.preparedDrift       = ctx.driftCompensation;
+	connection.preparedQuality     = quality;
+	return true;
+}
+
+// Sets up again whichever connections aren't set up for the way things
+// are now. Pulls have to be suspended
+static bool PrepareConnections(InputContext &ctx, ResamplerQuality quality)
+{
+	bool prepared = true;
+	
+	for(UInt32 i = 0; i < kMaxConnections; i++) {
+		InputConnection &connection = ctx.connections[i];
+		if(connection.active && !IsPrepared(ctx, connection, quality)) {
+			prepared = PrepareConnection(ctx, connection, quality) && prepared;
+		}
+	}
+	
+	return prepared;
+}
+
+// Only suspends the pulls if there's something to set up, so starting
+// the Input again while the Output's pulling it doesn't interrupt it
+bool Input::prepareResampler()
+{
+	InputContext &ctx = _impl->ctx;
+	bool upToDate = true;
+	
+	for(UInt32 i = 0; i < kMaxConnections; i++) {
+		if(ctx.connections[i].active && !IsPrepared(ctx, ctx.connections[i], _impl->quality)) upToDate = false;
+	}
+	
+	if(upToDate) return true;
+	
+	SuspendPulls(ctx);
+	const bool prepared = PrepareConnections(ctx, _impl->quality);
+	ResumePulls(ctx);
+	return prepared;
+}
+
+#pragma mark - Channel Map
+
+bool Input::setChannelMap(const std::vector<SInt32> &deviceChannels)
+{
+	for(size_t i = 0; i < deviceChannels.size(); i++) {
+		if(deviceChannels[i] < -1) {
+			std::cout << "Input's channel map can only hold device channels, or -1 for silence" << std::endl;
+			return false;
+		}
+	}
+	
+	// the device renders into the buffers too
+	if(IsRunning(*_unit)) {
+		std::cout << "Input has to be stopped to change its channel map" << std::endl;
+		return false;
+	}
+	
+	// and whatever the Input's connected to can be pulling from them
+	// whether it's running or not. The connections' resamplers have to
+	// match the new channel count
+	SuspendPulls(_impl->ctx);
+	_impl->channelMap = deviceChannels;
+	AllocateBuffers(_impl->ctx, deviceChannels.empty() ? _impl->deviceChannels : deviceChannels.size());
+	bool prepared = PrepareConnections(_impl->ctx, _impl->quality);
+	ResumePulls(_impl->ctx);
+	
+	// the map's handed to the device on the next start()
+	if(_isReady) {
+		PRINT_IF_ERR(AudioUnitUninitialize(*_unit), "uninitializing input unit to change its channel map");
+		_isReady = false;
+	}
+	
+	return prepared;
+}
+
+const std::vector<SInt32>& Input::getChannelMap() const
+{
+	return _impl->channelMap;
+}
+
+UInt32 Input::getChannelCount() const
+{
+	return _impl->ctx.channels;
+}
+
+#pragma mark - Drift Compensation
+
+bool Input::setDriftCompensationEnabled(bool enabled, UInt32 targetFrames)
+{
+	InputContext &ctx = _impl->ctx;
+	
+	if(targetFrames == 0) targetFrames = ctx.capacity / 2;
+	
+	// the input needs room to write a block or two on top of the target.
+	// If there isn't, it's turned off
+	const bool fits = targetFrames + ctx.maxFrames <= ctx.capacity;
+	if(enabled && !fits) {
+		std::cout << "Input's buffer (" << ctx.capacity << " frames) is too small to hold "
+				  << targetFrames << " frames for drift compensation" << std::endl;
+	}
+	
+	// the pulls read these, and the resamplers may be set up again
+	SuspendPulls(ctx);
+	ctx.driftCompensation = enabled && fits;
+	if(ctx.driftCompensation) ctx.targetFill = targetFrames;
+	const bool prepared = PrepareConnections(ctx, _impl->quality);
+	ResumePulls(ctx);
+	
+	return (!enabled || fits) && prepared;
+}
+
+bool Input::isDriftCompensationEnabled() const
+{
+	return _impl->ctx.driftCompensation;
+}
+
+Float64 Input::getDriftRatio(UInt32 connection) const
+{
+	// connections are handed out in order, and never given back
+	if(connection >= kMaxConnections || !_impl->ctx.connections[connection].active) return 1;
+	return _impl->ctx.connections[connection].ratio.load();
+}
+
+#pragma mark - Ring Health
+
+RingHealthReading Input::getRingHealth(UInt32 connection, bool reset)
+{
+	if(connection >= kMaxConnections || !_impl->ctx.connections[connection].active) {
+		RingHealth unused;
+		return unused.getReading();
+	}
+	
+	return _impl->ctx.connections[connection].health.getReading(reset);
+}
+
+void Input::resetRingHealth()
+{
+	for(UInt32 i = 0; i < kMaxConnections; i++) _impl->ctx.connections[i].health.reset();
+}
+
 #pragma mark - Start / Stop
 
 bool Input::start()
@@ -117,6 +582,14 @@ bool Input::start()
 	if(!_isReady) _isReady = configureInputDevice();
 	if(!_isReady) return false;
 	
+	// whatever the HAL unit might hand the render callback has to fit,
+	// even if nothing's called prepareChain(). If it's already running,
+	// they already do
+	if(!IsRunning(*_unit)) ReserveFrames(_impl->ctx, GenericUnit::getMaximumFramesPerSlice());
+	
+	// the rates on either side are only settled now
+	if(!prepareResampler()) return false;
+	
 	RETURN_BOOL(AudioOutputUnitStart(*_unit), "starting input unit");
 }
 
@@ -125,6 +598,41 @@ bool Input::stop()
 	RETURN_BOOL(AudioOutputUnitStop(*_unit), "stopping input unit");
 }
 
+#pragma mark - Render Quantum
+
+bool Input::setMaximumFramesPerSlice(UInt32 frames)
+{
+	InputContext &ctx = _impl->ctx;
+	
+	if(GenericUnit::getMaximumFramesPerSlice() == frames && frames <= ctx.maxFrames && 2 * frames <= ctx.capacity) {
+		return true;
+	}
+	
+	if(IsRunning(*_unit)) {
+		// the device keeps its own setting until it's restarted, which is
+		// fine as long as the buffers already take the bigger blocks
+		if(frames <= ctx.maxFrames && 2 * frames <= ctx.capacity) return true;
+		
+		std::cout << "Input has to be stopped to grow its buffers for blocks of " << frames << " frames" << std::endl;
+		return false;
+	}
+	
+	// as with the sample rate, the rest of the set up is redone on the next start()
+	PRINT_IF_ERR(AudioUnitUninitialize(*_unit), "uninitializing input unit to change its maximum frames per slice");
+	_isReady = false;
+	
+	RETURN_FALSE_IF_ERR(AudioUnitSetProperty(*_unit,
+											 kAudioUnitProperty_MaximumFramesPerSlice,
+											 kAudioUnitScope_Global,
+											 0,
+											 &frames,
+											 sizeof(frames)),
+						"setting input unit's maximum frames per slice");
+	
+	ReserveFrames(ctx, frames);
+	return true;
+}
+
 #pragma mark - Configuration
 
 bool Input::configureInputDevice()
@@ -171,25 +679,89 @@ bool Input::configureInputDevice()
 											 deviceIDSize),
 						"setting HAL unit's device ID");
 	
+	if(_impl->requestedRate > 0) {
+		AudioObjectPropertyAddress rateAddress = {
+			kAudioDevicePropertyNominalSampleRate,
+			kAudioObjectPropertyScopeGlobal,
+			kAudioObjectPropertyElementMaster
+		};
+		
+		// if the device can't do it, it carries on at its current rate
+		// and the difference gets resampled
+		PRINT_IF_ERR(AudioObjectSetPropertyData(inputDeviceID,
+												&rateAddress,
+												0,
+												NULL,
+												sizeof(_impl->requestedRate),
+												&_impl->requestedRate),
+					 "setting input device's sample rate");
+	}
+	
+	// the input element's input scope is the device side
 	AudioStreamBasicDescription deviceASBD = {0};
 	UInt32 ASBDSize = sizeof(deviceASBD);
 	RETURN_FALSE_IF_ERR(AudioUnitGetProperty(*_unit,
 											 kAudioUnitProperty_StreamFormat,
-											 kAudioUnitScope_Output,
+											 kAudioUnitScope_Input,
 											 1,
 											 &deviceASBD,
 											 &ASBDSize),
+						"getting input device's stream format");
+	
+	if(deviceASBD.mSampleRate > 0) {
+		_impl->ctx.captureRate = deviceASBD.mSampleRate;
+	}
+	
+	// The HAL unit only renders the device channels in the map. A map
+	// that's been cleared is put back to how it started
+	std::vector<SInt32> channelMap = _impl->channelMap;
+	if(channelMap.empty() && _impl->channelMapApplied) {
+		for(UInt32 i = 0; i < _impl->ctx.channels; i++) {
+			channelMap.push_back(i < deviceASBD.mChannelsPerFrame ? (SInt32)i : -1);
+		}
+	}
+	
+	for(size_t i = 0; i < channelMap.size(); i++) {
+		if(channelMap[i] >= (SInt32)deviceASBD.mChannelsPerFrame) {
+			std::cout << "Input's channel map asks for channel " << channelMap[i]
+					  << ", but the device only has " << deviceASBD.mChannelsPerFrame << std::endl;
+			return false;
+		}
+	}
+	
+	if(!channelMap.empty()) {
+		RETURN_FALSE_IF_ERR(AudioUnitSetProperty(*_unit,
+												 kAudioOutputUnitProperty_ChannelMap,
+												 kAudioUnitScope_Output,
+												 1,
+												 &channelMap[0],
+												 channelMap.size() * sizeof(SInt32)),
+							"setting input channel map");
+		
+		_impl->channelMapApplied = !_impl->channelMap.empty();
+	}
+	
+	AudioStreamBasicDescription outputASBD = {0};
+	ASBDSize = sizeof(outputASBD);
+	RETURN_FALSE_IF_ERR(AudioUnitGetProperty(*_unit,
+											 kAudioUnitProperty_StreamFormat,
+											 kAudioUnitScope_Output,
+											 1,
+											 &outputASBD,
+											 &ASBDSize),
 						"getting default input stream format");
 	
-	deviceASBD.mSampleRate = 44100;
+	// matching the device's rate keeps the HAL unit's converter out of it
+	outputASBD.mSampleRate = _impl->ctx.captureRate;
+	outputASBD.mChannelsPerFrame = _impl->ctx.channels;
 	
 	RETURN_FALSE_IF_ERR(AudioUnitSetProperty(*_unit,
 											 kAudioUnitProperty_StreamFormat,
 											 kAudioUnitScope_Output,
 											 1,
-											 &deviceASBD,
-											 sizeof(deviceASBD)),
-						"setting input sample rate to 44100");
+											 &outputASBD,
+											 sizeof(outputASBD)),
+						"setting input sample rate");
 	
 	AURenderCallbackStruct inputCallback = {RenderCallback, &_impl->ctx};
 	
@@ -206,13 +778,57 @@ bool Input::configureInputDevice()
 
 #pragma mark - Callbacks / Rendering
 
+// Called before writing a block of frames. Frees everything that every
+// connection's read, plus whatever a connection that's fallen too far
+// behind will have to skip to make room
+static void ReleaseReadFrames(InputContext * ctx, UInt32 frames)
+{
+	const UInt64 written = ctx->written.load(memory_order_relaxed);
+	
+	// nothing older than this can still be there once the block's written
+	const UInt64 oldest = InputRingOldest(&ctx->circularBuffer, written, frames);
+	UInt64 release = written;
+	
+	for(UInt32 i = 0; i < kMaxConnections; i++) {
+		InputConnection &connection = ctx->connections[i];
+		if(!connection.active.load(memory_order_acquire)) continue;
+		
+		UInt64 cursor;
+		const UInt64 lost = InputRingPushCursor(connection.cursor, oldest, cursor);
+		if(lost > 0) connection.health.recordOverrun(lost);
+		
+		release = min(release, max(cursor, oldest));
+	}
+	
+	InputRingRelease(&ctx->circularBuffer, ctx->released, release);
+}
+
 OSStatus Input::render(AudioUnitRenderActionFlags *flags,
 					   const AudioTimeStamp *timestamp,
 					   UInt32 bus,
 					   UInt32 frames,
 					   AudioBufferList *data)
 {
-	return PullCallback(&_impl->ctx, flags, timestamp, bus, frames, data);
+	if(!_impl->tapConnection) {
+		// render() is how a Tap reads from the Input; without connecting
+		// one first there's no cursor to read with
+		for(UInt32 i = 0; i < data->mNumberBuffers; i++) {
+			memset(data->mBuffers[i].mData, 0, data->mBuffers[i].mDataByteSize);
+		}
+		return noErr;
+	}
+	
+	return PullCallback(_impl->tapConnection, flags, timestamp, bus, frames, data);
+}
+
+// a block that never made it into the buffer is missed by every connection
+static void RecordOverrun(InputContext * ctx, UInt32 frames)
+{
+	for(UInt32 i = 0; i < kMaxConnections; i++) {
+		if(ctx->connections[i].active.load(memory_order_acquire)) {
+			ctx->connections[i].health.recordOverrun(frames);
+		}
+	}
 }
 
 OSStatus RenderCallback(void *inRefCon,
@@ -224,28 +840,156 @@ OSStatus RenderCallback(void *inRefCon,
 {
 	InputContext * ctx = static_cast<InputContext *>(inRefCon);
 	
+	// the buffers are sized ahead of time (see ReserveFrames()), and
+	// nothing's allocated here, so a block that doesn't fit is lost
+	if(inNumberFrames > ctx->maxFrames) {
+		RecordOverrun(ctx, inNumberFrames);
+		return kAudioUnitErr_TooManyFramesToProcess;
+	}
+	
+	// the HAL unit can leave these shorter than they started out
+	AudioBufferList * bufferList = ctx->bufferList.get();
+	for(UInt32 i = 0; i < bufferList->mNumberBuffers; i++) {
+		bufferList->mBuffers[i].mDataByteSize = inNumberFrames * sizeof(AudioUnitSampleType);
+	}
+	
 	OSStatus s = AudioUnitRender(*(ctx->inputUnit),
 								 ioActionFlags,
 								 inTimeStamp,
 								 inBusNumber,
 								 inNumberFrames,
-								 ctx->bufferList.get());
+								 bufferList);
 	
 	PRINT_IF_ERR(s, "rendering audio input");
 	
 	if(s == noErr) {
-		size_t buffersToCopy = min(ctx->bufferList->mNumberBuffers, ctx->circularBuffers.size());
+		ReleaseReadFrames(ctx, inNumberFrames);
 		
-		for(int i = 0; i < buffersToCopy; i++) {
-			TPCircularBufferProduceBytes(&ctx->circularBuffers[i],
-										 ctx->bufferList->mBuffers[i].mData,
-										 inNumberFrames * sizeof(AudioUnitSampleType));
+		// all channels are published with one atomic update
+		if(TPMultichannelCircularBufferProduceAudioBufferList(&ctx->circularBuffer, bufferList, inNumberFrames)) {
+			ctx->written.store(ctx->written.load(memory_order_relaxed) + inNumberFrames, memory_order_release);
+		} else {
+			// only a block bigger than the whole buffer can't be made room
+			// for, and then none of it's kept
+			RecordOverrun(ctx, inNumberFrames);
 		}
 	}
 	
 	return s;
 }
 
+static void SilenceFrom(AudioBufferList * bufferList, UInt32 frame, UInt32 frames)
+{
+	for(UInt32 i = 0; i < bufferList->mNumberBuffers; i++) {
+		memset((AudioUnitSampleType *)bufferList->mBuffers[i].mData + frame, 0, (frames - frame) * sizeof(AudioUnitSampleType));
+	}
+}
+
+// fill is in capture frames, frames in graph frames
+static void UpdateDriftRatio(InputConnection * connection, UInt64 fill, UInt32 frames)
+{
+	const InputContext * ctx = connection->input;
+	const Float64 dt = frames / connection->graphRate;
+	
+	connection->smoothedFill += (fill - connection->smoothedFill) * (1 - exp(-dt / kFillSmoothing));
+	
+	// positive when there's too much audio buffered, so it should be consumed faster
+	const Float64 error = (connection->smoothedFill - ctx->targetFill) / ctx->captureRate;
+	
+	connection->driftIntegral = min(max(connection->driftIntegral + kIntegralGain * error * dt, -kMaxCorrection), kMaxCorrection);
+	
+	const Float64 correction = kProportionalGain * error + connection->driftIntegral;
+	connection->ratio.store(1 + min(max(correction, -kMaxCorrection), kMaxCorrection));
+}
+
+static void PullResampled(InputConnection * connection, AudioBufferList * ioData, UInt32 frames)
+{
+	InputContext * ctx = connection->input;
+	UInt64 cursor = connection->cursor.load(memory_order_acquire);
+	UInt64 fill   = ctx->written.load(memory_order_acquire) - cursor;
+	
+	Float64 ratio = connection->nominalRatio;
+	
+	connection->health.recordFill(fill);
+	
+	if(ctx->driftCompensation) {
+		// after starting (or running dry), wait for the buffer to fill up to
+		// the target before handing anything out. The integral's kept, since
+		// the clocks will still be drifting the same way
+		if(!connection->primed) {
+			if(fill < ctx->targetFill) {
+				SilenceFrom(ioData, 0, frames);
+				return;
+			}
+			
+			connection->primed = true;
+			connection->smoothedFill = fill;
+			connection->resampler.reset();
+		}
+		
+		UpdateDriftRatio(connection, fill, frames);
+		ratio *= connection->ratio.load();
+	}
+	
+	for(UInt32 done = 0; done < frames; ) {
+		const UInt32 chunk  = min(frames - done, kResamplerFrames);
+		const UInt32 needed = connection->resampler.getInputFramesNeeded(chunk, ratio);
+		
+		cursor = connection->cursor.load(memory_order_acquire);
+		fill   = ctx->written.load(memory_order_acquire) - cursor;
+		if(fill < needed) {
+			// without drift compensation it just carries on when there's
+			// more input, like the plain ring does
+			SilenceFrom(ioData, done, frames);
+			connection->health.recordUnderrun(frames - done);
+			connection->primed = false;
+			return;
+		}
+		
+		for(UInt32 ch = 0; ch < ctx->channels; ch++) {
+			connection->resamplerInputs[ch]  = InputRingReadPointer(&ctx->circularBuffer, cursor, ch);
+			connection->resamplerOutputs[ch] = ch < ioData->mNumberBuffers
+											 ? (float *)ioData->mBuffers[ch].mData + done
+											 : &connection->discarded[0];
+		}
+		
+		connection->resampler.process(&connection->resamplerInputs[0], &connection->resamplerOutputs[0], chunk, ratio);
+		
+		// if it was pushed on while this was reading, the input may have been overwritten under it
+		if(!connection->cursor.compare_exchange_strong(cursor, cursor + needed)) {
+			SilenceFrom(ioData, done, frames);
+			connection->health.recordUnderrun(frames - done);
+			connection->primed = false;
+			connection->resampler.reset();
+			return;
+		}
+		
+		done += chunk;
+	}
+	
+	for(UInt32 i = ctx->channels; i < ioData->mNumberBuffers; i++) {
+		memset(ioData->mBuffers[i].mData, 0, frames * sizeof(AudioUnitSampleType));
+	}
+}
+
+static void Pull(InputConnection * connection, AudioBufferList * ioData, UInt32 frames)
+{
+	InputContext * ctx = connection->input;
+	connection->health.recordFill(ctx->written.load(memory_order_acquire) - connection->cursor.load(memory_order_acquire));
+	
+	// copies as much as there is, and the rest is silence
+	const UInt32 copied = InputRingRead(&ctx->circularBuffer, ctx->channels, ctx->written, connection->cursor, ioData, frames);
+	
+	if(copied < frames) {
+		SilenceFrom(ioData, copied, frames);
+		connection->health.recordUnderrun(frames - copied);
+	}
+	
+	for(UInt32 i = ctx->channels; i < ioData->mNumberBuffers; i++) {
+		memset(ioData->mBuffers[i].mData, 0, frames * sizeof(AudioUnitSampleType));
+	}
+}
+
 OSStatus PullCallback(void *inRefCon,
 					  AudioUnitRenderActionFlags *ioActionFlags,
 					  const AudioTimeStamp *inTimeStamp,
@@ -253,24 +997,19 @@ OSStatus PullCallback(void *inRefCon,
 					  UInt32 inNumberFrames,
 					  AudioBufferList *ioData)
 {
-	InputContext * ctx = static_cast<InputContext *>(inRefCon);
+	InputConnection * connection = static_cast<InputConnection *>(inRefCon);
+	InputContext * ctx = connection->input;
 	
-	size_t buffersToCopy = min(ioData->mNumberBuffers, ctx->circularBuffers.size());
+	ctx->pullsInFlight.fetch_add(1);
 	
-	for(int i = 0; i < buffersToCopy; i++) {
-		int32_t circBufferSize;
-		AudioUnitSampleType * circBufferTail = (AudioUnitSampleType *) TPCircularBufferTail(&ctx->circularBuffers[i], &circBufferSize);
-		bool circBufferHasEnoughSamples = circBufferSize / sizeof(AudioUnitSampleType) >= inNumberFrames ? true : false;
-		
-		if(!circBufferHasEnoughSamples) {
-			// clear buffer, so bytes that don't get written are silence instead of noise
-			memset(ioData->mBuffers[i].mData, 0, ioData->mBuffers[i].mDataByteSize);
-		}
-		
-		size_t bytesToConsume = min(ioData->mBuffers[i].mDataByteSize, (UInt32)circBufferSize);
-		memcpy(ioData->mBuffers[i].mData, circBufferTail, bytesToConsume);
-		TPCircularBufferConsume(&ctx->circularBuffers[i], bytesToConsume);
+	if(ctx->pullsSuspended.load()) {
+		SilenceFrom(ioData, 0, inNumberFrames);
+	} else if(connection->resampling) {
+		PullResampled(connection, ioData, inNumberFrames);
+	} else {
+		Pull(connection, ioData, inNumberFrames);
 	}
 	
+	ctx->pullsInFlight.fetch_sub(1);
 	return noErr;
 }
@@ -0,0 +1,109 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "AudioUnitTypes.h"
+#include "TPCircularBuffer/TPMultichannelCircularBuffer.h"
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+
+// What an Input does with its buffer. The device's render callback is
+// the only thing that moves the buffer's head and tail, and each
+// connection reads at its own cursor and moves it on with a CAS, which
+// fails if the render callback pushed the cursor on in the meantime.
+// These are kept out of Input.cpp so that the ring benchmarks in
+// auBenchmark run the same code.
+
+namespace cinder { namespace audiounit {
+
+// in frames
+static inline UInt64 InputRingCapacity(const TPMultichannelCircularBuffer * ring)
+{
+	return ring->length / sizeof(AudioUnitSampleType);
+}
+
+// Render callback. The oldest frame that can still be there once a
+// block of frames is written after the first written
+static inline UInt64 InputRingOldest(const TPMultichannelCircularBuffer * ring, UInt64 written, UInt32 frames)
+{
+	const UInt64 capacity = InputRingCapacity(ring);
+	return written + frames > capacity ? written + frames - capacity : 0;
+}
+
+// Render callback. Pushes a cursor that's behind oldest on to it, and
+// returns how many frames it lost. The reader might be moving it on at
+// the same time, in which case it may not lose anything after all
+static inline UInt64 InputRingPushCursor(std::atomic<UInt64> &cursor, UInt64 oldest, UInt64 &position)
+{
+	position = cursor.load(std::memory_order_acquire);
+	while(position < oldest) {
+		if(cursor.compare_exchange_weak(position, oldest)) {
+			const UInt64 lost = oldest - position;
+			position = oldest;
+			return lost;
+		}
+	}
+	return 0;
+}
+
+// Render callback. Frees everything before release
+static inline void InputRingRelease(TPMultichannelCircularBuffer * ring, UInt64 &released, UInt64 release)
+{
+	if(release > released) {
+		TPMultichannelCircularBufferConsume(ring, (release - released) * sizeof(AudioUnitSampleType));
+		released = release;
+	}
+}
+
+// The buffer's mirrored, so a channel's frames are contiguous from any position
+static inline float * InputRingReadPointer(TPMultichannelCircularBuffer * ring, UInt64 position, UInt32 channel)
+{
+	return (float *)TPMultichannelCircularBufferLane(ring, channel, (position % InputRingCapacity(ring)) * sizeof(AudioUnitSampleType));
+}
+
+// Reader. Copies as much as there is of frames from the cursor into the
+// first channels of ioData, and moves the cursor on. Returns how many it
+// copied, which is none if the cursor was pushed on while it was reading,
+// since what it read may have been overwritten under it
+static inline UInt32 InputRingRead(TPMultichannelCircularBuffer * ring,
+								   UInt32 channels,
+								   const std::atomic<UInt64> &written,
+								   std::atomic<UInt64> &cursor,
+								   AudioBufferList * ioData,
+								   UInt32 frames)
+{
+	UInt64 position = cursor.load(std::memory_order_acquire);
+	UInt32 copied = std::min<UInt64>(written.load(std::memory_order_acquire) - position, frames);
+	for(UInt32 i = 0; i < ioData->mNumberBuffers; i++) {
+		copied = std::min<UInt32>(copied, ioData->mBuffers[i].mDataByteSize / sizeof(AudioUnitSampleType));
+	}
+	
+	for(UInt32 i = 0; i < ioData->mNumberBuffers && i < channels; i++) {
+		memcpy(ioData->mBuffers[i].mData, InputRingReadPointer(ring, position, i), copied * sizeof(AudioUnitSampleType));
+	}
+	
+	return cursor.compare_exchange_strong(position, position + copied) ? copied : 0;
+}
+
+} } // namespace cinder::audiounit
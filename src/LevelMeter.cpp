@@ -0,0 +1,259 @@
+#include "LevelMeter.h"
+#include "DSP.h"
+#include "RealtimeMemory.h"
+#include <algorithm>
+#include <math.h>
+#include <new>
+
+using namespace cinder::audiounit;
+using namespace std;
+
+// the true peak filter runs over this many frames at a time, so its
+// scratch space doesn't depend on the render block size
+static const UInt32 kChunkFrames = 256;
+static const UInt32 kHistoryFrames = LevelMeter::kTapsPerPhase - 1;
+
+// below this, levels are just rounded down to silence (which also
+// keeps the decaying values from turning into denormals)
+static const float kSilence = 1e-10f;
+
+struct LevelMeter::Channel
+{
+	// what the readers see
+	std::atomic<float> peak;
+	std::atomic<float> rms;
+	std::atomic<float> truePeak;
+	std::atomic<float> peakHold;
+	
+	// render thread only
+	float peakState;
+	float meanSquare;
+	float truePeakState;
+	float holdState;
+	double holdFramesLeft;
+	float history[kHistoryFrames + kChunkFrames];
+	
+	Channel()
+	: peak(0), rms(0), truePeak(0), peakHold(0)
+	, peakState(0), meanSquare(0), truePeakState(0), holdState(0), holdFramesLeft(0)
+	{
+		fill(history, history + kHistoryFrames + kChunkFrames, 0.f);
+	}
+};
+
+LevelMeter::LevelMeter()
+: _channelState(NULL)
+, _scratch(NULL)
+, _channels(0)
+, _sampleRate(44100)
+, _rmsWindow(0.3f)
+, _peakRelease(20)
+, _peakHoldTime(2)
+, _truePeakEnabled(true)
+, _resetPeakHold(false)
+{
+	// A 48 tap, Blackman windowed sinc interpolator, split into one
+	// 12 tap filter per output phase. Each phase lands between two input
+	// samples (1/8, 3/8, 5/8 and 7/8 of the way), and is normalized for
+	// unity gain at DC. The taps are stored backwards, since DSP::fir()
+	// runs forwards through the history
+	const UInt32 taps = kOversampling * kTapsPerPhase;
+	const double centre = (taps - 1) / 2.;
+	
+	for(UInt32 p = 0; p < kOversampling; p++) {
+		double sum = 0;
+		
+		for(UInt32 j = 0; j < kTapsPerPhase; j++) {
+			const UInt32 k = j * kOversampling + p;
+			const double t = (k - centre) / kOversampling;
+			const double sinc = sin(M_PI * t) / (M_PI * t);
+			const double window = 0.42 - 0.5 * cos(2 * M_PI * (k + 0.5) / taps) + 0.08 * cos(4 * M_PI * (k + 0.5) / taps);
+			_phases[p][kTapsPerPhase - 1 - j] = sinc * window;
+			sum += sinc * window;
+		}
+		
+		for(UInt32 j = 0; j < kTapsPerPhase; j++) _phases[p][j] /= sum;
+	}
+}
+
+LevelMeter::~LevelMeter()
+{
+	release();
+}
+
+bool LevelMeter::allocate(UInt32 channels, Float64 sampleRate)
+{
+	release();
+	
+	if(sampleRate > 0) _sampleRate = sampleRate;
+	if(channels == 0) return true;
+	
+	void * memory = RealtimeMemory::allocate(sizeof(Channel) * channels);
+	_scratch = (float *)RealtimeMemory::allocate(sizeof(float) * kChunkFrames);
+	
+	if(!memory || !_scratch) {
+		RealtimeMemory::deallocate(memory);
+		release();
+		return false;
+	}
+	
+	_channelState = static_cast<Channel *>(memory);
+	for(UInt32 i = 0; i < channels; i++) new (&_channelState[i]) Channel();
+	
+	_channels = channels;
+	return true;
+}
+
+void LevelMeter::release()
+{
+	for(UInt32 i = 0; i < _channels; i++) _channelState[i].~Channel();
+	
+	RealtimeMemory::deallocate(_channelState);
+	RealtimeMemory::deallocate(_scratch);
+	_channelState = NULL;
+	_scratch  = NULL;
+	_channels = 0;
+}
+
+#pragma mark - Settings
+
+void LevelMeter::setRMSWindow(float seconds)
+{
+	_rmsWindow.store(max(seconds, 0.f));
+}
+
+void LevelMeter::setPeakRelease(float decibelsPerSecond)
+{
+	_peakRelease.store(max(decibelsPerSecond, 0.f));
+}
+
+void LevelMeter::setPeakHoldTime(float seconds)
+{
+	_peakHoldTime.store(max(seconds, 0.f));
+}
+
+void LevelMeter::setTruePeakEnabled(bool enabled)
+{
+	_truePeakEnabled.store(enabled);
+}
+
+#pragma mark - Metering
+
+void LevelMeter::process(const AudioBufferList * bufferList, UInt32 frames)
+{
+	if(!_channelState || frames == 0) return;
+	
+	// the ballistics are applied once per block, so the coefficients
+	// are worked out for however many frames this block has
+	const float framesPerWindow = max<float>(_rmsWindow.load(memory_order_relaxed) * _sampleRate, 1);
+	const float rmsDecay     = expf(-(float)frames / framesPerWindow);
+	const float peakDecay    = powf(10.f, -_peakRelease.load(memory_order_relaxed) * frames / _sampleRate / 20.f);
+	const double holdFrames  = _peakHoldTime.load(memory_order_relaxed) * _sampleRate;
+	const bool truePeak      = _truePeakEnabled.load(memory_order_relaxed);
+	const bool resetHold     = _resetPeakHold.exchange(false);
+	
+	for(UInt32 ch = 0; ch < _channels; ch++) {
+		Channel &c = _channelState[ch];
+		const AudioUnitSampleType * samples = ch < bufferList->mNumberBuffers ? (const AudioUnitSampleType *)bufferList->mBuffers[ch].mData : NULL;
+		
+		float blockPeak = 0, blockMeanSquare = 0, blockTruePeak = 0;
+		
+		if(samples) {
+			blockPeak       = DSP::maxMagnitude(samples, frames);
+			blockMeanSquare = DSP::meanSquare(samples, frames);
+			
+			// interpolates each chunk (plus the end of the one before it)
+			// at every phase, and keeps the largest result
+			for(UInt32 i = 0; truePeak && i < frames; i += kChunkFrames) {
+				const UInt32 n = min(kChunkFrames, frames - i);
+				copy(samples + i, samples + i + n, c.history + kHistoryFrames);
+				
+				for(UInt32 p = 0; p < kOversampling; p++) {
+					DSP::fir(c.history, _phases[p], _scratch, n, kTapsPerPhase);
+					blockTruePeak = max(blockTruePeak, DSP::maxMagnitude(_scratch, n));
+				}
+				
+				copy(c.history + n, c.history + n + kHistoryFrames, c.history);
+			}
+			
+			blockTruePeak = max(blockTruePeak, blockPeak);
+		} else {
+			fill(c.history, c.history + kHistoryFrames, 0.f);
+		}
+		
+		c.peakState     = max(blockPeak, c.peakState * peakDecay);
+		c.truePeakState = truePeak ? max(blockTruePeak, c.truePeakState * peakDecay) : 0;
+		c.meanSquare    = blockMeanSquare + rmsDecay * (c.meanSquare - blockMeanSquare);
+		
+		if(c.peakState     < kSilence) c.peakState = 0;
+		if(c.truePeakState < kSilence) c.truePeakState = 0;
+		if(c.meanSquare    < kSilence * kSilence) c.meanSquare = 0;
+		
+		const float blockHold = truePeak ? blockTruePeak : blockPeak;
+		
+		if(resetHold) {
+			c.holdState = 0;
+			c.holdFramesLeft = 0;
+		}
+		
+		if(blockHold >= c.holdState) {
+			c.holdState = blockHold;
+			c.holdFramesLeft = holdFrames;
+		} else if(c.holdFramesLeft > 0) {
+			c.holdFramesLeft -= frames;
+		} else {
+			c.holdState = max(blockHold, c.holdState * peakDecay);
+		}
+		
+		c.peak.store(c.peakState, memory_order_relaxed);
+		c.rms.store(sqrtf(c.meanSquare), memory_order_relaxed);
+		c.truePeak.store(c.truePeakState, memory_order_relaxed);
+		c.peakHold.store(c.holdState, memory_order_relaxed);
+	}
+}
+
+void LevelMeter::BlockCallback(void * refCon, const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp)
+{
+	static_cast<LevelMeter *>(refCon)->process(bufferList, frames);
+}
+
+OSStatus LevelMeter::RenderNotify(void * inRefCon,
+								  AudioUnitRenderActionFlags * ioActionFlags,
+								  const AudioTimeStamp * inTimeStamp,
+								  UInt32 inBusNumber,
+								  UInt32 inNumberFrames,
+								  AudioBufferList * ioData)
+{
+	if((*ioActionFlags & kAudioUnitRenderAction_PostRender) && !(*ioActionFlags & kAudioUnitRenderAction_PostRenderError)) {
+		static_cast<LevelMeter *>(inRefCon)->process(ioData, inNumberFrames);
+	}
+	
+	return noErr;
+}
+
+#pragma mark - Reading
+
+LevelReading LevelMeter::getLevels(UInt32 channel) const
+{
+	LevelReading levels = {0, 0, 0, 0};
+	
+	if(channel < _channels) {
+		const Channel &c = _channelState[channel];
+		levels.peak     = c.peak.load(memory_order_relaxed);
+		levels.rms      = c.rms.load(memory_order_relaxed);
+		levels.truePeak = c.truePeak.load(memory_order_relaxed);
+		levels.peakHold = c.peakHold.load(memory_order_relaxed);
+	}
+	
+	return levels;
+}
+
+void LevelMeter::resetPeakHold()
+{
+	_resetPeakHold.store(true);
+}
+
+float LevelMeter::toDecibels(float level, float floor)
+{
+	return level > 0 ? max(floor, 20.f * log10f(level)) : floor;
+}
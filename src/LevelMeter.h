@@ -0,0 +1,124 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "AudioUnitTypes.h"
+#include <atomic>
+
+namespace cinder { namespace audiounit {
+
+// Levels are linear amplitudes (1 being full scale). Use
+// LevelMeter::toDecibels() to turn them into dBFS.
+struct LevelReading
+{
+	float peak;
+	float rms;
+	float truePeak;
+	float peakHold;
+};
+
+// A LevelMeter measures how loud a stream of audio is, on the render
+// thread, as it goes by. Each block costs a few vectorized passes over
+// the samples, and the results are kept in atomics, so the UI thread can
+// draw meters without copying any samples or making any Audio Unit
+// calls (unlike Mixer::getInputLevel()).
+
+// For each channel it keeps:
+//  - peak: the largest sample, falling back at setPeakRelease() dB per
+//    second after that
+//  - rms: the RMS level, averaged with a time constant of setRMSWindow()
+//  - truePeak: the peak of the signal between the samples as well as at
+//    them, found by oversampling by 4 (as in ITU-R BS.1770). This is
+//    what a DAC will actually put out, and it can be a few dB over the
+//    sample peak. It falls back the same way the peak does
+//  - peakHold: the highest true peak (or sample peak, with true peak
+//    turned off), held for setPeakHoldTime() seconds
+
+// A Tap can run one for you (see Tap::setLevelMeteringEnabled()). To
+// meter anything else, call process() from a render callback, or hand
+// BlockCallback to Tap::addBlockCallback(), or RenderNotify to
+// AudioUnitAddRenderNotify() to meter a unit's output.
+
+// allocate() must be called (off the render thread) before process().
+// The settings can be changed at any time.
+
+class LevelMeter
+{
+public:
+	LevelMeter();
+	~LevelMeter();
+	
+	// (re)allocates the meter. This must not be called while process() is running
+	bool allocate(UInt32 channels, Float64 sampleRate);
+	void release();
+	
+	UInt32  getChannelCount() const {return _channels;}
+	Float64 getSampleRate() const {return _sampleRate;}
+	
+	void setRMSWindow(float seconds);              // default 0.3
+	void setPeakRelease(float decibelsPerSecond);  // default 20
+	void setPeakHoldTime(float seconds);           // default 2
+	void setTruePeakEnabled(bool enabled = true);  // default true
+	bool isTruePeakEnabled() const {return _truePeakEnabled.load();}
+	
+	// Render thread. Buffer n of the list is channel n; extra buffers are
+	// ignored, and missing ones are treated as silence
+	void process(const AudioBufferList * bufferList, UInt32 frames);
+	
+	static void BlockCallback(void * refCon, const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp);
+	static OSStatus RenderNotify(void * inRefCon,
+								 AudioUnitRenderActionFlags * ioActionFlags,
+								 const AudioTimeStamp * inTimeStamp,
+								 UInt32 inBusNumber,
+								 UInt32 inNumberFrames,
+								 AudioBufferList * ioData);
+	
+	// Any thread
+	LevelReading getLevels(UInt32 channel = 0) const;
+	void resetPeakHold();
+	
+	static float toDecibels(float level, float floor = -120);
+	
+	static const UInt32 kOversampling = 4;
+	static const UInt32 kTapsPerPhase = 12;
+
+private:
+	LevelMeter(const LevelMeter &);
+	LevelMeter& operator=(const LevelMeter &);
+	
+	struct Channel;
+	
+	Channel * _channelState;
+	float * _scratch; // one chunk of filter output (render thread only)
+	float _phases[kOversampling][kTapsPerPhase];
+	UInt32 _channels;
+	Float64 _sampleRate;
+	
+	std::atomic<float> _rmsWindow;
+	std::atomic<float> _peakRelease;
+	std::atomic<float> _peakHoldTime;
+	std::atomic<bool>  _truePeakEnabled;
+	std::atomic<bool>  _resetPeakHold;
+};
+
+} } // namespace cinder::audiounit
@@ -0,0 +1,339 @@
+#include "AudioUnitOfflineRenderer.h"
+#include "AudioUnitUtils.h"
+#include "DSP.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stddef.h>
+
+using namespace cinder::audiounit;
+using namespace std;
+
+typedef enum
+{
+	OfflineSourceNone,
+	OfflineSourceUnit,
+	OfflineSourceTap,
+	OfflineSourceGraph,
+	OfflineSourceCallback
+}
+OfflineSourceType;
+
+static void WriteBlock(void * refCon, const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp)
+{
+	static_cast<Recorder *>(refCon)->write(bufferList, frames);
+}
+
+struct OfflineRenderer::OfflineImpl
+{
+	OfflineSourceType sourceType;
+	GenericUnit * sourceUnit;
+	UInt32 sourceBus;
+	Tap * sourceTap;
+	Graph * sourceGraph;
+	AURenderCallbackStruct sourceCallback;
+	UInt32 channels;
+	Float64 sampleRate;
+	UInt32 framesPerSlice;
+	Float64 sampleTime;
+	
+	bool stopAtSilence;
+	float silenceThreshold; // linear
+	float silenceHold;      // seconds
+	
+	// about the last render
+	UInt64 framesRendered;
+	bool silenceReached;
+	double speed;
+	
+	OSStatus pull(AudioUnitRenderActionFlags * flags, const AudioTimeStamp * timeStamp, UInt32 frames, AudioBufferList * bufferList)
+	{
+		if(sourceType == OfflineSourceUnit) {
+			return sourceUnit->render(flags, timeStamp, sourceBus, frames, bufferList);
+		} else if(sourceType == OfflineSourceTap) {
+			return sourceTap->render(flags, timeStamp, 0, frames, bufferList);
+		} else if(sourceType == OfflineSourceGraph) {
+			return sourceGraph->render(flags, timeStamp, 0, frames, bufferList);
+		} else {
+			return (sourceCallback.inputProc)(sourceCallback.inputProcRefCon, flags, timeStamp, 0, frames, bufferList);
+		}
+	}
+	
+	// the same set up Output::start() does, for this block size
+	bool prepare()
+	{
+		if(sourceType == OfflineSourceGraph) {
+			if(sourceGraph->prepare(framesPerSlice) != 0) return true;
+			std::cout << "OfflineRenderer couldn't prepare its graph for blocks of " << framesPerSlice << " frames" << std::endl;
+			return false;
+		}
+		
+		GenericUnit * unit = sourceType == OfflineSourceUnit ? sourceUnit
+						   : sourceType == OfflineSourceTap  ? sourceTap->getSourceUnit()
+						   : NULL;
+		
+		if(unit && unit->prepareChain(framesPerSlice) == 0) {
+			std::cout << "OfflineRenderer couldn't prepare its source for blocks of " << framesPerSlice << " frames" << std::endl;
+			return false;
+		}
+		
+		if(sourceType == OfflineSourceTap) sourceTap->setMaximumFramesPerSlice(framesPerSlice);
+		return true;
+	}
+	
+	// Renders up to seconds of audio, straight into buffers if they're
+	// given, and hands each block to callback if there is one
+	bool render(Float64 seconds, vector<TapSampleBuffer> * buffers, TapBlockCallback callback, void * refCon)
+	{
+		framesRendered = 0;
+		silenceReached = false;
+		speed = 0;
+		
+		if(sourceType == OfflineSourceNone || channels == 0) {
+			std::cout << "OfflineRenderer needs a source to render" << std::endl;
+			return false;
+		}
+		
+		if(!prepare()) return false;
+		
+		const UInt64 totalFrames = max(0., round(seconds * sampleRate));
+		const UInt64 holdFrames  = ceil(silenceHold * sampleRate);
+		
+		// Rendering into memory goes straight into the buffers, so the
+		// scratch space is only needed for files and callbacks. None of
+		// this is on a render thread, so it's all plain memory
+		vector<TapSampleBuffer> scratch(buffers ? 0 : channels, TapSampleBuffer(framesPerSlice));
+		vector<UInt8> listBytes(offsetof(AudioBufferList, mBuffers) + sizeof(AudioBuffer) * channels);
+		AudioBufferList * bufferList = (AudioBufferList *)&listBytes[0];
+		bufferList->mNumberBuffers = channels;
+		
+		if(buffers) buffers->assign(channels, TapSampleBuffer(totalFrames));
+		
+		AudioTimeStamp timeStamp;
+		memset(&timeStamp, 0, sizeof(timeStamp));
+		timeStamp.mFlags = kAudioTimeStampSampleTimeValid;
+		
+		UInt64 quietFrames = 0;
+		bool succeeded = true;
+		const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		
+		while(framesRendered < totalFrames) {
+			const UInt32 frames = min<UInt64>(framesPerSlice, totalFrames - framesRendered);
+			
+			for(UInt32 ch = 0; ch < channels; ch++) {
+				bufferList->mBuffers[ch].mNumberChannels = 1;
+				bufferList->mBuffers[ch].mDataByteSize   = frames * sizeof(AudioUnitSampleType);
+				bufferList->mBuffers[ch].mData           = buffers ? &(*buffers)[ch][framesRendered] : &scratch[ch][0];
+			}
+			
+			AudioUnitRenderActionFlags flags = 0;
+			timeStamp.mSampleTime = sampleTime;
+			
+			const OSStatus status = pull(&flags, &timeStamp, frames, bufferList);
+			if(status != noErr) {
+				PRINT_IF_ERR(status, "rendering offline");
+				succeeded = false;
+				break;
+			}
+			
+			// a unit's allowed to hand back its own buffers instead of ours
+			if(buffers) {
+				for(UInt32 ch = 0; ch < channels; ch++) {
+					float * destination = &(*buffers)[ch][framesRendered];
+					if(bufferList->mBuffers[ch].mData != destination) {
+						memcpy(destination, bufferList->mBuffers[ch].mData, frames * sizeof(AudioUnitSampleType));
+					}
+				}
+			}
+			
+			if(callback) callback(refCon, bufferList, frames, &timeStamp);
+			
+			framesRendered += frames;
+			sampleTime += frames;
+			
+			if(stopAtSilence) {
+				float peak = 0;
+				for(UInt32 ch = 0; ch < channels; ch++) {
+					peak = max(peak, DSP::maxMagnitude((const float *)bufferList->mBuffers[ch].mData, frames));
+				}
+				
+				quietFrames = peak < silenceThreshold ? quietFrames + frames : 0;
+				if(quietFrames >= holdFrames) {
+					silenceReached = true;
+					break;
+				}
+			}
+		}
+		
+		const double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		speed = elapsed > 0 ? framesRendered / sampleRate / elapsed : 0;
+		
+		if(buffers) {
+			for(UInt32 ch = 0; ch < channels; ch++) (*buffers)[ch].resize(framesRendered);
+		}
+		
+		return succeeded;
+	}
+};
+
+OfflineRenderer::OfflineRenderer(UInt32 framesPerSlice) : _impl(new OfflineImpl)
+{
+	_impl->sourceType       = OfflineSourceNone;
+	_impl->sourceUnit       = NULL;
+	_impl->sourceBus        = 0;
+	_impl->sourceTap        = NULL;
+	_impl->sourceGraph      = NULL;
+	_impl->channels         = 0;
+	_impl->sampleRate       = 44100;
+	_impl->framesPerSlice   = max<UInt32>(framesPerSlice, 1);
+	_impl->sampleTime       = 0;
+	_impl->stopAtSilence    = false;
+	_impl->silenceThreshold = 0;
+	_impl->silenceHold      = 0;
+	_impl->framesRendered   = 0;
+	_impl->silenceReached   = false;
+	_impl->speed            = 0;
+}
+
+OfflineRenderer::~OfflineRenderer()
+{
+}
+
+#pragma mark - Source
+
+void OfflineRenderer::setSource(GenericUnit &unit, UInt32 bus)
+{
+	_impl->sourceType = OfflineSourceUnit;
+	_impl->sourceUnit = &unit;
+	_impl->sourceBus  = bus;
+	
+	AudioStreamBasicDescription ASBD = {0};
+	UInt32 ASBDSize = sizeof(ASBD);
+	
+	PRINT_IF_ERR(AudioUnitGetProperty(unit,
+									  kAudioUnitProperty_StreamFormat,
+									  kAudioUnitScope_Output,
+									  bus,
+									  &ASBD,
+									  &ASBDSize),
+				 "getting offline source's ASBD");
+	
+	_impl->channels   = ASBD.mChannelsPerFrame > 0 ? ASBD.mChannelsPerFrame : 2;
+	_impl->sampleRate = ASBD.mSampleRate > 0 ? ASBD.mSampleRate : 44100;
+}
+
+void OfflineRenderer::setSource(Tap &tap)
+{
+	_impl->sourceType = OfflineSourceTap;
+	_impl->sourceTap  = &tap;
+	_impl->channels   = tap.getChannelCount();
+	_impl->sampleRate = tap.getSampleRate();
+}
+
+void OfflineRenderer::setSource(Graph &graph)
+{
+	if(graph.getSink()) setSource(*graph.getSink());
+	
+	_impl->sourceType  = OfflineSourceGraph;
+	_impl->sourceGraph = &graph;
+	if(!graph.getSink()) _impl->channels = 0;
+}
+
+void OfflineRenderer::setSource(AURenderCallbackStruct callback, UInt32 channels, Float64 sampleRate)
+{
+	_impl->sourceType     = OfflineSourceCallback;
+	_impl->sourceCallback = callback;
+	_impl->channels       = channels;
+	_impl->sampleRate     = sampleRate;
+}
+
+UInt32 OfflineRenderer::getChannelCount() const
+{
+	return _impl->channels;
+}
+
+Float64 OfflineRenderer::getSampleRate() const
+{
+	return _impl->sampleRate;
+}
+
+#pragma mark - Settings
+
+void OfflineRenderer::setFramesPerSlice(UInt32 frames)
+{
+	_impl->framesPerSlice = max<UInt32>(frames, 1);
+}
+
+UInt32 OfflineRenderer::getFramesPerSlice() const
+{
+	return _impl->framesPerSlice;
+}
+
+void OfflineRenderer::setSampleTime(Float64 sampleTime)
+{
+	_impl->sampleTime = sampleTime;
+}
+
+Float64 OfflineRenderer::getSampleTime() const
+{
+	return _impl->sampleTime;
+}
+
+void OfflineRenderer::setStopAtSilence(bool enabled, float thresholdDecibels, float holdSeconds)
+{
+	_impl->stopAtSilence    = enabled;
+	_impl->silenceThreshold = powf(10, thresholdDecibels / 20);
+	_impl->silenceHold      = max(holdSeconds, 0.f);
+}
+
+bool OfflineRenderer::isStoppingAtSilence() const
+{
+	return _impl->stopAtSilence;
+}
+
+#pragma mark - Rendering
+
+bool OfflineRenderer::render(Float64 seconds, std::vector<TapSampleBuffer> &buffers)
+{
+	return _impl->render(seconds, &buffers, NULL, NULL);
+}
+
+bool OfflineRenderer::render(Float64 seconds, const fs::path &filePath, RecorderFileType fileType, RecorderSampleFormat sampleFormat)
+{
+	if(_impl->channels == 0) {
+		std::cout << "OfflineRenderer needs a source to render" << std::endl;
+		return false;
+	}
+	
+	Recorder recorder;
+	if(!recorder.start(filePath, _impl->channels, _impl->sampleRate, fileType, sampleFormat)) {
+		return false;
+	}
+	
+	const bool rendered = _impl->render(seconds, NULL, WriteBlock, &recorder);
+	recorder.stop();
+	
+	return rendered && !recorder.hasWriteError() && recorder.getFramesWritten() == _impl->framesRendered;
+}
+
+bool OfflineRenderer::render(Float64 seconds, TapBlockCallback callback, void * refCon)
+{
+	return _impl->render(seconds, NULL, callback, refCon);
+}
+
+#pragma mark - Results
+
+UInt64 OfflineRenderer::getFramesRendered() const
+{
+	return _impl->framesRendered;
+}
+
+bool OfflineRenderer::stoppedAtSilence() const
+{
+	return _impl->silenceReached;
+}
+
+double OfflineRenderer::getSpeed() const
+{
+	return _impl->speed;
+}
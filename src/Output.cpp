@@ -22,6 +22,13 @@ Output::Output()
 
 bool Output::start()
 {
+	// everything that feeds the output is set up for the same render
+	// quantum before any of it gets rendered. If some of it can't be, the
+	// output still starts, the way it always has
+	if(prepareChain() == 0) {
+		std::cout << "Couldn't prepare the chain feeding the output for its render quantum, starting anyway" << std::endl;
+	}
+	
 	RETURN_BOOL(AudioOutputUnitStart(*_unit), "starting output unit");
 }
 
@@ -0,0 +1,281 @@
+#include "RealtimeMemory.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+#if defined(__APPLE__)
+#include <mach/vm_statistics.h>
+#endif
+
+using namespace cinder::audiounit;
+using namespace std;
+
+// Allocations are rounded to whole cache lines, so two buffers
+// never share one between them
+static const size_t kPoolAlignment = 64;
+static const size_t kHugePageSize  = 2 * 1024 * 1024;
+
+struct RealtimeMemoryPool
+{
+	char * memory;
+	size_t length;
+	bool   hugePages;
+	map<size_t, size_t> freeRanges; // offset -> length
+	map<size_t, size_t> usedRanges; // offset -> length
+	
+	RealtimeMemoryPool() : memory(NULL), length(0), hugePages(false) {}
+	
+	bool contains(void * p) const {
+		return memory && (char *)p >= memory && (char *)p < memory + length;
+	}
+};
+
+static mutex s_mutex;
+static atomic<bool> s_enabled(false);
+static atomic<size_t> s_lockedBytes(0);
+static RealtimeMemoryPool s_pool;
+static map<void *, size_t> s_lockedRegions;
+static map<void *, size_t> s_overflowAllocations;
+
+#pragma mark - Locking
+
+// Writes each page back as it is. Only reading it can leave it mapped
+// to the shared zero page (or copy-on-write), so the first write on the
+// render thread would still fault
+static void PrefaultRange(void * memory, size_t bytes)
+{
+	const size_t pageSize = sysconf(_SC_PAGESIZE);
+	volatile char * p = (volatile char *)memory;
+	
+	for(size_t offset = 0; offset < bytes; offset += pageSize) {
+		p[offset] = p[offset];
+	}
+}
+
+// expects s_mutex to be held
+static bool LockRange(void * memory, size_t bytes)
+{
+	PrefaultRange(memory, bytes);
+	
+	if(mlock(memory, bytes) != 0) {
+		cout << "Error " << errno << " while locking " << bytes << " bytes of real-time memory "
+		<< "(check the memlock limit)" << endl;
+		return false;
+	}
+	
+	s_lockedRegions[memory] = bytes;
+	s_lockedBytes += bytes;
+	return true;
+}
+
+// expects s_mutex to be held
+static void UnlockRange(void * memory)
+{
+	map<void *, size_t>::iterator region = s_lockedRegions.find(memory);
+	if(region == s_lockedRegions.end()) return;
+	
+	munlock(region->first, region->second);
+	s_lockedBytes -= region->second;
+	s_lockedRegions.erase(region);
+}
+
+#pragma mark - Pool
+
+static void * MapPoolMemory(size_t &length, bool &hugePages)
+{
+	void * memory = MAP_FAILED;
+	const size_t hugeLength = ((length + kHugePageSize - 1) / kHugePageSize) * kHugePageSize;
+	
+#if defined(__APPLE__) && defined(VM_FLAGS_SUPERPAGE_SIZE_2MB)
+	memory = mmap(NULL, hugeLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, VM_FLAGS_SUPERPAGE_SIZE_2MB, 0);
+#elif defined(MAP_HUGETLB)
+	memory = mmap(NULL, hugeLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+	
+	if(memory != MAP_FAILED) {
+		length = hugeLength;
+		hugePages = true;
+		return memory;
+	}
+	
+	// no huge pages reserved, so fall back to regular pages (and on
+	// Linux, ask for transparent huge pages where the kernel allows it)
+	hugePages = false;
+	memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	
+	if(memory == MAP_FAILED) return NULL;
+	
+#if defined(MADV_HUGEPAGE)
+	madvise(memory, length, MADV_HUGEPAGE);
+#endif
+	
+	return memory;
+}
+
+// expects s_mutex to be held
+static void CreatePool(size_t poolSize)
+{
+	if(s_pool.memory || poolSize == 0) return;
+	
+	size_t length = ((poolSize + kPoolAlignment - 1) / kPoolAlignment) * kPoolAlignment;
+	bool hugePages;
+	void * memory = MapPoolMemory(length, hugePages);
+	
+	if(!memory) {
+		cout << "Error " << errno << " while mapping real-time memory pool" << endl;
+		return;
+	}
+	
+	// writing every page now means the render thread never has to fault them in
+	memset(memory, 0, length);
+	LockRange(memory, length);
+	
+	s_pool.memory    = (char *)memory;
+	s_pool.length    = length;
+	s_pool.hugePages = hugePages;
+	s_pool.freeRanges[0] = length;
+}
+
+// expects s_mutex to be held
+static void * AllocateFromPool(size_t bytes)
+{
+	for(map<size_t, size_t>::iterator range = s_pool.freeRanges.begin(); range != s_pool.freeRanges.end(); ++range) {
+		if(range->second < bytes) continue;
+		
+		const size_t offset    = range->first;
+		const size_t remaining = range->second - bytes;
+		
+		s_pool.freeRanges.erase(range);
+		if(remaining > 0) s_pool.freeRanges[offset + bytes] = remaining;
+		s_pool.usedRanges[offset] = bytes;
+		
+		void * memory = s_pool.memory + offset;
+		memset(memory, 0, bytes);
+		return memory;
+	}
+	
+	return NULL;
+}
+
+// expects s_mutex to be held
+static void ReturnToPool(void * memory)
+{
+	const size_t offset = (char *)memory - s_pool.memory;
+	map<size_t, size_t>::iterator used = s_pool.usedRanges.find(offset);
+	if(used == s_pool.usedRanges.end()) return;
+	
+	size_t start  = offset;
+	size_t length = used->second;
+	s_pool.usedRanges.erase(used);
+	
+	// merging with the free ranges on either side, so the pool doesn't fragment
+	map<size_t, size_t>::iterator next = s_pool.freeRanges.lower_bound(start);
+	
+	if(next != s_pool.freeRanges.end() && next->first == start + length) {
+		length += next->second;
+		s_pool.freeRanges.erase(next++);
+	}
+	
+	if(next != s_pool.freeRanges.begin()) {
+		map<size_t, size_t>::iterator previous = next;
+		--previous;
+		if(previous->first + previous->second == start) {
+			start   = previous->first;
+			length += previous->second;
+			s_pool.freeRanges.erase(previous);
+		}
+	}
+	
+	s_pool.freeRanges[start] = length;
+}
+
+#pragma mark - Public interface
+
+void RealtimeMemory::setEnabled(bool enabled, size_t poolSize)
+{
+	lock_guard<mutex> guard(s_mutex);
+	
+	if(enabled) CreatePool(poolSize);
+	s_enabled = enabled;
+}
+
+bool RealtimeMemory::isEnabled()
+{
+	return s_enabled;
+}
+
+void * RealtimeMemory::allocate(size_t bytes)
+{
+	if(!s_enabled) return calloc(1, bytes);
+	
+	bytes = ((max(bytes, (size_t)1) + kPoolAlignment - 1) / kPoolAlignment) * kPoolAlignment;
+	
+	lock_guard<mutex> guard(s_mutex);
+	
+	void * memory = AllocateFromPool(bytes);
+	
+	if(!memory) {
+		// the pool is full, so this allocation gets locked on its own
+		if(posix_memalign(&memory, kPoolAlignment, bytes) != 0) return NULL;
+		memset(memory, 0, bytes);
+		LockRange(memory, bytes);
+		s_overflowAllocations[memory] = bytes;
+	}
+	
+	return memory;
+}
+
+void RealtimeMemory::deallocate(void * memory)
+{
+	if(!memory) return;
+	
+	lock_guard<mutex> guard(s_mutex);
+	
+	if(s_pool.contains(memory)) {
+		ReturnToPool(memory);
+		return;
+	}
+	
+	map<void *, size_t>::iterator overflow = s_overflowAllocations.find(memory);
+	
+	if(overflow != s_overflowAllocations.end()) {
+		UnlockRange(memory);
+		s_overflowAllocations.erase(overflow);
+	}
+	
+	free(memory);
+}
+
+bool RealtimeMemory::lock(void * memory, size_t bytes)
+{
+	if(!s_enabled || !memory || bytes == 0) return false;
+	
+	lock_guard<mutex> guard(s_mutex);
+	return LockRange(memory, bytes);
+}
+
+void RealtimeMemory::unlock(void * memory, size_t bytes)
+{
+	if(!memory || bytes == 0) return;
+	
+	lock_guard<mutex> guard(s_mutex);
+	UnlockRange(memory);
+}
+
+size_t RealtimeMemory::getLockedBytes()
+{
+	return s_lockedBytes;
+}
+
+bool RealtimeMemory::isUsingHugePages()
+{
+	lock_guard<mutex> guard(s_mutex);
+	return s_pool.hugePages;
+}
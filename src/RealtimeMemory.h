@@ -0,0 +1,69 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+namespace cinder { namespace audiounit {
+
+// RealtimeMemory is an opt-in mode for the memory that the render
+// thread touches (Tap and Input history buffers, and the scratch
+// AudioBufferLists used while rendering).
+
+// Normally that memory is mapped lazily by the OS, so the render
+// thread takes a page fault the first time it touches each page,
+// and under memory pressure the pages can be swapped out later on.
+// With the mode enabled, scratch buffers come out of a pool which is
+// touched (prefaulted) and mlock()ed up front, and history buffers
+// are locked as soon as they're created. The pool is backed by huge
+// pages when the system has them available.
+
+// Call setEnabled(true) before creating any Taps or Inputs. Buffers
+// created before that keep using ordinary memory. Locking memory is
+// subject to the process's memlock limit; if it can't be locked, the
+// memory is still prefaulted and an error is logged.
+
+struct RealtimeMemory
+{
+	static void setEnabled(bool enabled, size_t poolSize = 16 * 1024 * 1024);
+	static bool isEnabled();
+
+	// Zeroed memory for the render thread. These come from the
+	// pool when the mode is enabled (falling back to individually
+	// locked allocations if the pool runs out), and from calloc()
+	// when it isn't
+	static void * allocate(size_t bytes);
+	static void   deallocate(void * memory);
+
+	// Prefaults and locks memory allocated elsewhere (such as
+	// mirrored ring buffers). Does nothing unless the mode is enabled
+	static bool lock(void * memory, size_t bytes);
+	static void unlock(void * memory, size_t bytes);
+
+	// Bytes currently locked by this block, as counted against the
+	// process's memlock limit (ie. mirrored memory counts twice)
+	static size_t getLockedBytes();
+	static bool   isUsingHugePages();
+};
+
+} } // namespace cinder::audiounit
@@ -0,0 +1,554 @@
+#include "AudioUnitRecorder.h"
+#include "RealtimeMemory.h"
+#include "Semaphore.h"
+#include "TPCircularBuffer/TPMultichannelCircularBuffer.h"
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <math.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace cinder::audiounit;
+using namespace std;
+
+// the writer takes (up to) this many frames off the queue per write
+static const UInt32 kBatchFrames = 32768;
+
+// if the audio is trickling in slower than that, it writes whatever it
+// has this often anyway
+static const double kMaxSecondsBetweenWrites = 0.5;
+static const double kSecondsBetweenHeaderUpdates = 5;
+
+// disk space is reserved this far ahead of the writes
+static const off_t kPreallocationBytes = 64 * 1024 * 1024;
+
+static const UInt32 kWAVHeaderBytes = 116;
+
+#pragma mark - File headers
+
+namespace {
+
+struct HeaderBytes
+{
+	vector<UInt8> bytes;
+	
+	void tag(const char * t) {bytes.insert(bytes.end(), t, t + 4);}
+	void zeros(UInt32 n)     {bytes.insert(bytes.end(), n, 0);}
+	
+	void le(UInt64 value, UInt32 size) {for(UInt32 i = 0; i < size; i++) bytes.push_back(value >> (i * 8));}
+	void be(UInt64 value, UInt32 size) {for(UInt32 i = size; i > 0; i--) bytes.push_back(value >> ((i - 1) * 8));}
+	
+	void beDouble(Float64 value)
+	{
+		UInt64 bits;
+		memcpy(&bits, &value, sizeof(bits));
+		be(bits, 8);
+	}
+};
+
+} // anonymous namespace
+
+static UInt32 BytesPerSample(RecorderSampleFormat format)
+{
+	return format == RecorderSamplesInt24 ? 3 : 4;
+}
+
+// Builds a complete header for a file holding the given number of
+// frames. It's always the same size for a given file type, so it can be
+// written over the old one in place as the file grows.
+
+// WAV files start out with a 28 byte JUNK chunk, which becomes the ds64
+// chunk (with 64 bit sizes) if the file ends up being RF64.
+static void BuildHeader(vector<UInt8> &header,
+						RecorderFileType type,
+						RecorderSampleFormat format,
+						UInt32 channels,
+						Float64 sampleRate,
+						UInt64 frames)
+{
+	const UInt32 bytesPerSample = BytesPerSample(format);
+	const UInt32 bytesPerFrame  = bytesPerSample * channels;
+	const UInt64 dataBytes      = frames * bytesPerFrame;
+	HeaderBytes h;
+	
+	if(type == RecorderFileWAV) {
+		const UInt64 riffSize = kWAVHeaderBytes - 8 + dataBytes + (dataBytes & 1);
+		const bool rf64 = riffSize > 0xFFFFFFFF;
+		const UInt32 channelMask = channels == 1 ? 0x4 : channels == 2 ? 0x3 : 0;
+		
+		h.tag(rf64 ? "RF64" : "RIFF");
+		h.le(rf64 ? 0xFFFFFFFF : riffSize, 4);
+		h.tag("WAVE");
+		
+		h.tag(rf64 ? "ds64" : "JUNK");
+		h.le(28, 4);
+		if(rf64) {
+			h.le(riffSize, 8);
+			h.le(dataBytes, 8);
+			h.le(frames, 8);
+			h.le(0, 4);
+		} else {
+			h.zeros(28);
+		}
+		
+		// WAVE_FORMAT_EXTENSIBLE, with a PCM or IEEE float sub format
+		h.tag("fmt ");
+		h.le(40, 4);
+		h.le(0xFFFE, 2);
+		h.le(channels, 2);
+		h.le((UInt32)sampleRate, 4);
+		h.le((UInt32)sampleRate * bytesPerFrame, 4);
+		h.le(bytesPerFrame, 2);
+		h.le(bytesPerSample * 8, 2);
+		h.le(22, 2);
+		h.le(bytesPerSample * 8, 2);
+		h.le(channelMask, 4);
+		h.le(format == RecorderSamplesFloat32 ? 3 : 1, 4);
+		const UInt8 guid[] = {0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+		h.bytes.insert(h.bytes.end(), guid, guid + sizeof(guid));
+		
+		h.tag("fact");
+		h.le(4, 4);
+		h.le(min<UInt64>(frames, 0xFFFFFFFF), 4);
+		
+		h.tag("data");
+		h.le(rf64 ? 0xFFFFFFFF : dataBytes, 4);
+	} else {
+		// everything in a CAF header is big endian (the samples
+		// themselves are little endian, as flagged in the desc chunk)
+		const UInt32 kFlagIsFloat = 1, kFlagIsLittleEndian = 2;
+		
+		h.tag("caff");
+		h.be(1, 2);
+		h.be(0, 2);
+		
+		h.tag("desc");
+		h.be(32, 8);
+		h.beDouble(sampleRate);
+		h.tag("lpcm");
+		h.be(kFlagIsLittleEndian | (format == RecorderSamplesFloat32 ? kFlagIsFloat : 0), 4);
+		h.be(bytesPerFrame, 4);
+		h.be(1, 4);
+		h.be(channels, 4);
+		h.be(bytesPerSample * 8, 4);
+		
+		// the data chunk's size includes its 4 byte edit count
+		h.tag("data");
+		h.be(dataBytes + 4, 8);
+		h.be(0, 4);
+	}
+	
+	header.swap(h.bytes);
+}
+
+#pragma mark - File I/O
+
+static bool WriteFully(int fd, const void * data, size_t bytes, off_t offset)
+{
+	const char * p = static_cast<const char *>(data);
+	
+	while(bytes > 0) {
+		const ssize_t written = pwrite(fd, p, bytes, offset);
+		if(written < 0) {
+			if(errno == EINTR) continue;
+			return false;
+		}
+		p += written;
+		offset += written;
+		bytes -= written;
+	}
+	
+	return true;
+}
+
+// Reserves disk space for [offset, offset + length) without changing
+// the size of the file. This is only a hint, so failures are ignored
+static void Preallocate(int fd, off_t offset, off_t length)
+{
+#if defined(__APPLE__)
+	fstore_t store = {F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, length, 0};
+	if(fcntl(fd, F_PREALLOCATE, &store) == -1) {
+		store.fst_flags = F_ALLOCATEALL;
+		fcntl(fd, F_PREALLOCATE, &store);
+	}
+#elif defined(__linux__)
+	fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, length);
+#endif
+}
+
+#pragma mark - Queue
+
+namespace {
+
+// The render thread's half of the recorder. Blocks go into a lock-free
+// multichannel ring (one lane per channel), and the writer thread is
+// woken up once there's a batch worth of audio waiting.
+struct RecorderQueue
+{
+	TPMultichannelCircularBuffer buffer;
+	UInt32 channels;
+	int32_t wakeBytes;
+	
+	std::atomic<bool> recording;
+	std::atomic<int> inFlight;
+	std::atomic<UInt64> blocksDropped;
+	std::atomic<UInt64> framesDropped;
+	Semaphore semaphore;
+	
+	RecorderQueue() : buffer(), channels(0), wakeBytes(0), recording(false), inFlight(0), blocksDropped(0), framesDropped(0)
+	{
+	}
+	
+	void push(const AudioBufferList * bufferList, UInt32 frames)
+	{
+		inFlight.fetch_add(1);
+		
+		if(recording.load()) {
+			const int32_t bytes = frames * sizeof(AudioUnitSampleType);
+			
+			if(TPMultichannelCircularBufferSpace(&buffer) < bytes) {
+				blocksDropped.fetch_add(1, memory_order_relaxed);
+				framesDropped.fetch_add(frames, memory_order_relaxed);
+			} else {
+				for(UInt32 ch = 0; ch < channels; ch++) {
+					void * lane = TPMultichannelCircularBufferHead(&buffer, ch);
+					if(ch < bufferList->mNumberBuffers && bufferList->mBuffers[ch].mData) {
+						memcpy(lane, bufferList->mBuffers[ch].mData, bytes);
+					} else {
+						memset(lane, 0, bytes);
+					}
+				}
+				
+				TPMultichannelCircularBufferProduce(&buffer, bytes);
+				
+				const int32_t filled = TPMultichannelCircularBufferFillCount(&buffer);
+				if(filled >= wakeBytes && filled - bytes < wakeBytes) semaphore.signal();
+			}
+		}
+		
+		inFlight.fetch_sub(1);
+	}
+	
+	// For when the audio's coming in faster than realtime (see
+	// OfflineRenderer). Rather than dropping a block that doesn't fit,
+	// this waits for the writer to make room for it
+	bool pushWaiting(const AudioBufferList * bufferList, UInt32 frames)
+	{
+		const int32_t bytes = frames * sizeof(AudioUnitSampleType);
+		if(bytes > buffer.length) return false;
+		
+		while(recording.load() && TPMultichannelCircularBufferSpace(&buffer) < bytes) {
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		
+		push(bufferList, frames);
+		return recording.load();
+	}
+};
+
+} // anonymous namespace
+
+static void RecordBlock(void * refCon, const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp)
+{
+	static_cast<RecorderQueue *>(refCon)->push(bufferList, frames);
+}
+
+#pragma mark - Writer
+
+struct Recorder::RecorderImpl
+{
+	RecorderQueue queue;
+	Tap tap;
+	bool attachedToTap;
+	
+	// writer state
+	int fd;
+	RecorderFileType fileType;
+	RecorderSampleFormat sampleFormat;
+	Float64 sampleRate;
+	off_t preallocatedTo;
+	vector<UInt8> header;
+	vector<UInt8> batch;
+	
+	std::atomic<UInt64> framesWritten;
+	std::atomic<bool> writeError;
+	std::atomic<bool> stopping;
+	thread writer;
+	
+	RecorderImpl() : attachedToTap(false), fd(-1), framesWritten(0), writeError(false), stopping(false)
+	{
+	}
+	
+	// a Recorder's a handle, so the recording only ends with the last copy of it
+	~RecorderImpl()
+	{
+		close();
+	}
+	
+	bool open(const fs::path &filePath, UInt32 channels, Float64 sampleRate, RecorderFileType fileType, RecorderSampleFormat sampleFormat, float bufferSeconds)
+	{
+		if(channels == 0 || sampleRate <= 0) {
+			std::cout << "Recorder needs at least one channel and a sample rate" << std::endl;
+			return false;
+		}
+		
+		fd = ::open(filePath.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(fd < 0) {
+			std::cout << "Recorder couldn't open " << filePath << ": " << strerror(errno) << std::endl;
+			return false;
+		}
+		
+		this->fileType     = fileType;
+		this->sampleFormat = sampleFormat;
+		this->sampleRate   = sampleRate;
+		framesWritten  = 0;
+		writeError     = false;
+		stopping       = false;
+		preallocatedTo = 0;
+		
+		// a header for 0 frames, so there's a valid (empty) file from the start
+		BuildHeader(header, fileType, sampleFormat, channels, sampleRate, 0);
+		if(!WriteFully(fd, &header[0], header.size(), 0)) {
+			std::cout << "Recorder couldn't write to " << filePath << ": " << strerror(errno) << std::endl;
+			::close(fd);
+			fd = -1;
+			return false;
+		}
+		
+		// the queue always has room for at least a couple of batches
+		const UInt32 queueFrames = max<UInt32>(ceilf(bufferSeconds * sampleRate), kBatchFrames * 2);
+		if(!TPMultichannelCircularBufferInit(&queue.buffer, channels, queueFrames * sizeof(AudioUnitSampleType))) {
+			std::cout << "Recorder couldn't allocate its queue" << std::endl;
+			::close(fd);
+			fd = -1;
+			return false;
+		}
+		RealtimeMemory::lock(queue.buffer.buffer, (size_t)queue.buffer.length * 2 * queue.buffer.channels);
+		queue.channels  = channels;
+		queue.wakeBytes = kBatchFrames * sizeof(AudioUnitSampleType);
+		queue.blocksDropped = 0;
+		queue.framesDropped = 0;
+		
+		batch.resize((size_t)kBatchFrames * channels * BytesPerSample(sampleFormat));
+		
+		writer = thread(&RecorderImpl::run, this);
+		queue.recording = true;
+		return true;
+	}
+	
+	void close()
+	{
+		if(fd < 0) return;
+		
+		if(attachedToTap) {
+			tap.removeBlockCallback(RecordBlock, &queue);
+			tap = Tap();
+			attachedToTap = false;
+		}
+		
+		// once nothing's in the middle of push(), nothing more can be
+		// queued, so the writer can drain the queue and finish up
+		queue.recording = false;
+		while(queue.inFlight.load() > 0) {
+			std::this_thread::yield();
+		}
+		
+		stopping = true;
+		queue.semaphore.signal();
+		writer.join();
+		
+		RealtimeMemory::unlock(queue.buffer.buffer, (size_t)queue.buffer.length * 2 * queue.buffer.channels);
+		TPMultichannelCircularBufferCleanup(&queue.buffer);
+		
+		const off_t dataBytes = (off_t)framesWritten.load() * queue.channels * BytesPerSample(sampleFormat);
+		off_t fileSize = header.size() + dataBytes;
+		
+		// RIFF chunks have to be an even number of bytes long
+		if(fileType == RecorderFileWAV && (dataBytes & 1) && !writeError) {
+			const UInt8 pad = 0;
+			WriteFully(fd, &pad, 1, fileSize);
+			fileSize++;
+		}
+		
+		updateHeader();
+		
+		// gives back whatever was preallocated past the end
+		if(ftruncate(fd, fileSize) != 0 || fsync(fd) != 0) {
+			std::cout << "Recorder couldn't finish the file: " << strerror(errno) << std::endl;
+		}
+		
+		::close(fd);
+		fd = -1;
+	}
+	
+	void run()
+	{
+		chrono::steady_clock::time_point lastHeaderUpdate = chrono::steady_clock::now();
+		
+		for(;;) {
+			// checked before draining, so that everything queued before
+			// stop() was called gets written
+			const bool finishing = stopping.load();
+			if(!finishing) queue.semaphore.waitFor(kMaxSecondsBetweenWrites);
+			
+			UInt32 available;
+			while((available = TPMultichannelCircularBufferFillCount(&queue.buffer) / sizeof(AudioUnitSampleType)) > 0) {
+				writeBatch(min(available, kBatchFrames));
+			}
+			
+			const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+			if(now - lastHeaderUpdate > chrono::duration<double>(kSecondsBetweenHeaderUpdates)) {
+				updateHeader();
+				lastHeaderUpdate = now;
+			}
+			
+			if(finishing) break;
+		}
+	}
+	
+	void writeBatch(UInt32 frames)
+	{
+		const UInt32 channels = queue.channels;
+		
+		// interleaves (and converts) straight out of the queue's lanes
+		for(UInt32 ch = 0; ch < channels; ch++) {
+			const float * in = (const float *)TPMultichannelCircularBufferTail(&queue.buffer, ch);
+			
+			if(sampleFormat == RecorderSamplesFloat32) {
+				float * out = (float *)&batch[0] + ch;
+				for(UInt32 i = 0; i < frames; i++) out[i * channels] = in[i];
+			} else {
+				UInt8 * out = &batch[ch * 3];
+				for(UInt32 i = 0; i < frames; i++) {
+					const float clipped = max(-1.f, min(in[i], 1.f));
+					const SInt32 sample = min<SInt32>(lrintf(clipped * 8388608.f), 8388607);
+					UInt8 * o = out + i * channels * 3;
+					o[0] = sample;
+					o[1] = sample >> 8;
+					o[2] = sample >> 16;
+				}
+			}
+		}
+		
+		TPMultichannelCircularBufferConsume(&queue.buffer, frames * sizeof(AudioUnitSampleType));
+		
+		// after an error, the queue is still drained (so the render
+		// thread doesn't start dropping blocks), but nothing's written
+		if(writeError) return;
+		
+		const size_t bytes  = (size_t)frames * channels * BytesPerSample(sampleFormat);
+		const off_t  offset = header.size() + (off_t)framesWritten.load() * channels * BytesPerSample(sampleFormat);
+		
+		while(offset + (off_t)bytes > preallocatedTo) {
+			Preallocate(fd, preallocatedTo, kPreallocationBytes);
+			preallocatedTo += kPreallocationBytes;
+		}
+		
+		if(!WriteFully(fd, &batch[0], bytes, offset)) {
+			std::cout << "Recorder stopped writing after an error: " << strerror(errno) << std::endl;
+			writeError = true;
+			return;
+		}
+		
+		framesWritten.fetch_add(frames);
+	}
+	
+	void updateHeader()
+	{
+		if(writeError) return;
+		
+		BuildHeader(header, fileType, sampleFormat, queue.channels, sampleRate, framesWritten.load());
+		if(!WriteFully(fd, &header[0], header.size(), 0)) {
+			std::cout << "Recorder couldn't update the file's header: " << strerror(errno) << std::endl;
+			writeError = true;
+		}
+	}
+};
+
+#pragma mark - Recorder
+
+Recorder::Recorder() : _impl(new RecorderImpl)
+{
+}
+
+Recorder::~Recorder()
+{
+}
+
+bool Recorder::start(Tap &tap, const fs::path &filePath, RecorderFileType fileType, RecorderSampleFormat sampleFormat, float bufferSeconds)
+{
+	stop();
+	
+	if(tap.getChannelCount() == 0) {
+		std::cout << "Recorder can't record a Tap without a source" << std::endl;
+		return false;
+	}
+	
+	if(!_impl->open(filePath, tap.getChannelCount(), tap.getSampleRate(), fileType, sampleFormat, bufferSeconds)) {
+		return false;
+	}
+	
+	if(!tap.addBlockCallback(RecordBlock, &_impl->queue)) {
+		_impl->close();
+		return false;
+	}
+	
+	_impl->tap = tap;
+	_impl->attachedToTap = true;
+	return true;
+}
+
+bool Recorder::start(const fs::path &filePath, UInt32 channels, Float64 sampleRate, RecorderFileType fileType, RecorderSampleFormat sampleFormat, float bufferSeconds)
+{
+	stop();
+	return _impl->open(filePath, channels, sampleRate, fileType, sampleFormat, bufferSeconds);
+}
+
+void Recorder::stop()
+{
+	_impl->close();
+}
+
+bool Recorder::isRecording() const
+{
+	return _impl->queue.recording.load();
+}
+
+bool Recorder::hasWriteError() const
+{
+	return _impl->writeError.load();
+}
+
+UInt64 Recorder::getFramesWritten() const
+{
+	return _impl->framesWritten.load();
+}
+
+UInt64 Recorder::getBlocksDropped() const
+{
+	return _impl->queue.blocksDropped.load();
+}
+
+UInt64 Recorder::getFramesDropped() const
+{
+	return _impl->queue.framesDropped.load();
+}
+
+void Recorder::process(const AudioBufferList * bufferList, UInt32 frames)
+{
+	RecordBlock(&_impl->queue, bufferList, frames, NULL);
+}
+
+bool Recorder::write(const AudioBufferList * bufferList, UInt32 frames)
+{
+	if(!_impl->queue.pushWaiting(bufferList, frames)) {
+		std::cout << "Recorder couldn't queue a block of " << frames << " frames" << std::endl;
+		return false;
+	}
+	
+	return !hasWriteError();
+}
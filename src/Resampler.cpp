@@ -0,0 +1,255 @@
+#include "Resampler.h"
+#include "RealtimeMemory.h"
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <string.h>
+
+#if defined(__APPLE__)
+#include <Accelerate/Accelerate.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+using namespace cinder::audiounit;
+using namespace std;
+
+// The Kaiser window's beta sets the stopband attenuation (and widens the
+// transition band as it goes up). Every preset has a multiple of 8 taps,
+// which the dot product below relies on. Interpolating between phases
+// adds an error that falls with the square of the phase count, so the
+// better presets need more of them to keep it under the stopband.
+struct ResamplerPreset
+{
+	uint32_t taps;
+	double   beta;
+	uint32_t phases;
+};
+
+static const ResamplerPreset kPresets[] = {
+	{ 16,  6.0,   64}, // ResamplerQualityLow
+	{ 32,  8.6,  256}, // ResamplerQualityMedium
+	{ 64,  9.5,  512}, // ResamplerQualityHigh
+	{128, 11.5, 1024}  // ResamplerQualityBest
+};
+
+// zeroth order modified Bessel function of the first kind, for the window
+static double BesselI0(double x)
+{
+	double sum = 1, term = 1;
+	for(int k = 1; k < 50 && term > sum * 1e-12; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum  += term;
+	}
+	return sum;
+}
+
+#pragma mark - Kernels
+
+// out = a + mix * (b - a)
+static inline void Interpolate(const float * a, const float * b, float mix, float * out, uint32_t n)
+{
+#if defined(__APPLE__)
+	vDSP_vintb(a, 1, b, 1, &mix, out, 1, n);
+#else
+	// there's no reduction here, so the compiler vectorizes it by itself
+	for(uint32_t i = 0; i < n; i++) out[i] = a[i] + mix * (b[i] - a[i]);
+#endif
+}
+
+// n has to be a multiple of 8
+static inline float DotProduct(const float * a, const float * b, uint32_t n)
+{
+#if defined(__APPLE__)
+	float sum;
+	vDSP_dotpr(a, 1, b, 1, &sum, n);
+	return sum;
+#elif defined(__SSE__)
+	__m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+	for(uint32_t i = 0; i < n; i += 8) {
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i),     _mm_loadu_ps(b + i)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, _mm_add_ps(sum0, sum1));
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__ARM_NEON)
+	float32x4_t sum0 = vdupq_n_f32(0), sum1 = vdupq_n_f32(0);
+	for(uint32_t i = 0; i < n; i += 8) {
+		sum0 = vmlaq_f32(sum0, vld1q_f32(a + i),     vld1q_f32(b + i));
+		sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+	}
+	float lanes[4];
+	vst1q_f32(lanes, vaddq_f32(sum0, sum1));
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+	// eight independent sums, so the adds don't all wait on each other
+	float sum[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	for(uint32_t i = 0; i < n; i += 8) {
+		for(uint32_t j = 0; j < 8; j++) sum[j] += a[i + j] * b[i + j];
+	}
+	return ((sum[0] + sum[1]) + (sum[2] + sum[3])) + ((sum[4] + sum[5]) + (sum[6] + sum[7]));
+#endif
+}
+
+#pragma mark - Resampler
+
+Resampler::Resampler()
+: _table(NULL)
+, _kernel(NULL)
+, _history(NULL)
+, _quality(ResamplerQualityHigh)
+, _channels(0)
+, _taps(0)
+, _phases(0)
+, _maxOutputFrames(0)
+, _maxInputFrames(0)
+, _maxRatio(1)
+, _phase(0)
+{
+}
+
+Resampler::~Resampler()
+{
+	release();
+}
+
+bool Resampler::allocate(uint32_t channels, uint32_t maxOutputFrames, double maxRatio, ResamplerQuality quality)
+{
+	release();
+	
+	if(channels == 0 || maxOutputFrames == 0 || maxRatio <= 0 || quality < ResamplerQualityLow || quality > ResamplerQualityBest) {
+		std::cout << "Resampler needs at least one channel, a ratio and a quality" << std::endl;
+		return false;
+	}
+	
+	const ResamplerPreset &preset = kPresets[quality];
+	
+	// When it's downsampling the filter has to cut off below the output's
+	// Nyquist frequency, so it's stretched over proportionally more input
+	// frames to keep the same transition band (relative to the output
+	// rate). A fraction of a percent either way is just drift, so the
+	// tap count's left alone for that
+	const double stretch = maxRatio > 1.01 ? maxRatio : 1;
+	
+	_quality         = quality;
+	_channels        = channels;
+	_taps            = (uint32_t)ceil(preset.taps * stretch / 8) * 8;
+	_phases          = preset.phases;
+	_maxOutputFrames = maxOutputFrames;
+	_maxRatio        = maxRatio;
+	_maxInputFrames  = ceil(maxOutputFrames * maxRatio) + 2;
+	
+	_table   = (float *)RealtimeMemory::allocate(sizeof(float) * (_phases + 1) * _taps);
+	_kernel  = (float *)RealtimeMemory::allocate(sizeof(float) * _taps);
+	_history = (float *)RealtimeMemory::allocate(sizeof(float) * channels * (_taps + _maxInputFrames));
+	
+	if(!_table || !_kernel || !_history) {
+		std::cout << "Resampler couldn't allocate its buffers" << std::endl;
+		release();
+		return false;
+	}
+	
+	// Row p of the table is the filter for an output frame p / _phases of
+	// the way between two input frames. The cutoff sits half a transition
+	// band below the lower of the two rates' Nyquist frequencies
+	const double attenuation = preset.beta / 0.1102 + 8.7;
+	const double transition  = (attenuation - 7.95) / (14.36 * _taps);
+	const double cutoff      = max(0.05, 0.5 / max(1.0, maxRatio) - transition / 2);
+	const double halfWidth   = _taps / 2.0;
+	const double windowScale = 1.0 / BesselI0(preset.beta);
+	
+	for(uint32_t p = 0; p <= _phases; p++) {
+		float * row = _table + p * _taps;
+		const double fraction = (double)p / _phases;
+		double sum = 0;
+		
+		for(uint32_t k = 0; k < _taps; k++) {
+			// distance from the output frame to the input frame under tap k
+			const double d = (double)k + 1 - halfWidth - fraction;
+			const double x = d / halfWidth;
+			const double window = fabs(x) >= 1 ? 0 : BesselI0(preset.beta * sqrt(1 - x * x)) * windowScale;
+			const double sinc   = d == 0 ? 1 : sin(2 * M_PI * cutoff * d) / (2 * M_PI * cutoff * d);
+			
+			row[k] = 2 * cutoff * sinc * window;
+			sum += row[k];
+		}
+		
+		// unity gain at DC for every position, so there's no ripple as it moves
+		for(uint32_t k = 0; k < _taps; k++) row[k] /= sum;
+	}
+	
+	reset();
+	return true;
+}
+
+void Resampler::release()
+{
+	RealtimeMemory::deallocate(_table);
+	RealtimeMemory::deallocate(_kernel);
+	RealtimeMemory::deallocate(_history);
+	_table   = NULL;
+	_kernel  = NULL;
+	_history = NULL;
+	_channels = 0;
+	_maxOutputFrames = 0;
+}
+
+void Resampler::reset()
+{
+	if(_history) {
+		memset(_history, 0, sizeof(float) * _channels * (_taps + _maxInputFrames));
+	}
+	_phase = 0;
+}
+
+uint32_t Resampler::getInputFramesNeeded(uint32_t outputFrames, double ratio) const
+{
+	// process() clamps these the same way
+	ratio        = min(max(ratio, 1e-3), _maxRatio);
+	outputFrames = min(outputFrames, _maxOutputFrames);
+	
+	if(outputFrames == 0) return 0;
+	return floor(_phase + (outputFrames - 1) * ratio) + 1;
+}
+
+void Resampler::process(const float * const * input, float * const * output, uint32_t outputFrames, double ratio)
+{
+	ratio        = min(max(ratio, 1e-3), _maxRatio);
+	outputFrames = min(outputFrames, _maxOutputFrames);
+	
+	const uint32_t inputFrames = getInputFramesNeeded(outputFrames, ratio);
+	const uint32_t stride      = _taps + _maxInputFrames;
+	
+	for(uint32_t ch = 0; ch < _channels; ch++) {
+		memcpy(_history + ch * stride + _taps, input[ch], inputFrames * sizeof(float));
+	}
+	
+	for(uint32_t i = 0; i < outputFrames; i++) {
+		// output frame i sits at _taps / 2 + position in the history, and
+		// the taps cover the input frames from first on
+		const double   position = _phase + i * ratio;
+		const double   whole    = floor(position);
+		const uint32_t first    = (uint32_t)(whole + 1);
+		const double   scaled   = (position - whole) * _phases;
+		const uint32_t row      = min<uint32_t>(scaled, _phases - 1);
+		
+		// one kernel serves every channel
+		const float * a = _table + row * _taps;
+		Interpolate(a, a + _taps, scaled - row, _kernel, _taps);
+		
+		for(uint32_t ch = 0; ch < _channels; ch++) {
+			output[ch][i] = DotProduct(_kernel, _history + ch * stride + first, _taps);
+		}
+	}
+	
+	// keep the last _taps frames around for next time
+	for(uint32_t ch = 0; ch < _channels; ch++) {
+		float * history = _history + ch * stride;
+		memmove(history, history + inputFrames, _taps * sizeof(float));
+	}
+	
+	_phase += outputFrames * ratio - inputFrames;
+}
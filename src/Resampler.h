@@ -0,0 +1,107 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace cinder { namespace audiounit {
+
+// Longer filters sound better and cost more: the cost per output frame
+// (per channel) goes up with the number of taps, and so does the
+// latency. The figures are for a ratio of 1 or under. Downsampling
+// stretches the filter over ratio times as many taps (and as much
+// latency), so that the passband and attenuation hold relative to the
+// output rate.
+typedef enum
+{
+	ResamplerQualityLow,     // 16 taps:  about 60dB,  flat to 0.26 fs, 8 frames of latency
+	ResamplerQualityMedium,  // 32 taps:  about 80dB,  flat to 0.32 fs, 16 frames
+	ResamplerQualityHigh,    // 64 taps:  about 95dB,  flat to 0.40 fs, 32 frames
+	ResamplerQualityBest     // 128 taps: about 110dB, flat to 0.44 fs, 64 frames
+}
+ResamplerQuality;
+
+// A Resampler converts a stream of audio from one rate to another with
+// a Kaiser windowed sinc filter, at a ratio that can change from one
+// call to the next. Input uses it to convert from the input device's
+// rate to the rate of whatever it's connected to, and to soak up the
+// drift between the input and output devices' clocks.
+
+// The ratio is the number of input frames consumed per output frame, so
+// 44.1kHz to 48kHz is a ratio of 0.91875. The filter's coefficients are
+// worked out for a range of fractional positions when it's allocated,
+// and interpolated between on the fly, so changing the ratio costs
+// nothing. The inner loops use vDSP on OS X and SSE or NEON elsewhere.
+
+// It doesn't depend on Core Audio or Cinder, so it can be built and
+// tested on its own (see auBenchmark's ResamplerBenchmarks.h for what
+// each quality costs).
+
+// The output lags the input by getLatency() input frames. allocate()
+// must be called (off the render thread) before process().
+
+class Resampler
+{
+public:
+	Resampler();
+	~Resampler();
+	
+	// maxRatio is the highest ratio process() will be asked for, which
+	// sets both how much input it can take and where the filter cuts off
+	// (it has to cut lower to avoid aliasing when the ratio's over 1)
+	bool allocate(uint32_t channels, uint32_t maxOutputFrames, double maxRatio = 1.01, ResamplerQuality quality = ResamplerQualityHigh);
+	void release();
+	void reset(); // forgets the history, as if the stream had just started
+	
+	uint32_t getChannelCount() const {return _channels;}
+	uint32_t getMaxOutputFrames() const {return _maxOutputFrames;}
+	uint32_t getTaps() const {return _taps;}
+	uint32_t getLatency() const {return _taps / 2;} // input frames
+	ResamplerQuality getQuality() const {return _quality;}
+	
+	// how many input frames process() will consume to produce outputFrames
+	uint32_t getInputFramesNeeded(uint32_t outputFrames, double ratio) const;
+	
+	// Render thread. Reads getInputFramesNeeded(outputFrames, ratio) frames
+	// from each input channel, and writes outputFrames (no more than
+	// getMaxOutputFrames()) to each output channel
+	void process(const float * const * input, float * const * output, uint32_t outputFrames, double ratio);
+	
+private:
+	Resampler(const Resampler &);
+	Resampler& operator=(const Resampler &);
+	
+	float * _table;   // (_phases + 1) rows of _taps coefficients
+	float * _kernel;  // the coefficients for the current position
+	float * _history; // per channel: _taps frames of history, then the new input
+	ResamplerQuality _quality;
+	uint32_t _channels;
+	uint32_t _taps;
+	uint32_t _phases;
+	uint32_t _maxOutputFrames;
+	uint32_t _maxInputFrames;
+	double _maxRatio;
+	double _phase;    // position of the next output frame, relative to the new input
+};
+
+} } // namespace cinder::audiounit
@@ -0,0 +1,93 @@
+#include "RingHealth.h"
+#include <algorithm>
+
+using namespace cinder::audiounit;
+using namespace std;
+
+RingHealth::RingHealth()
+: _capacity(0)
+{
+	reset();
+}
+
+void RingHealth::setCapacity(UInt32 frames)
+{
+	_capacity.store(frames, memory_order_relaxed);
+}
+
+#pragma mark - Recording
+
+void RingHealth::recordFill(UInt64 frames)
+{
+	const UInt32 fill = min<UInt64>(frames, UINT32_MAX);
+	const UInt32 capacity = _capacity.load(memory_order_relaxed);
+	
+	// there's usually just the one thread recording, so these hardly ever
+	// loop. They do have to cope with reset() racing them, though
+	UInt32 lowest = _minFill.load(memory_order_relaxed);
+	while(fill < lowest && !_minFill.compare_exchange_weak(lowest, fill, memory_order_relaxed)) {}
+	
+	UInt32 highest = _maxFill.load(memory_order_relaxed);
+	while(fill > highest && !_maxFill.compare_exchange_weak(highest, fill, memory_order_relaxed)) {}
+	
+	if(capacity > 0) {
+		const UInt64 bin = (UInt64)fill * RingHealthReading::kHistogramBins / capacity;
+		_fillHistogram[min<UInt64>(bin, RingHealthReading::kHistogramBins - 1)].fetch_add(1, memory_order_relaxed);
+	}
+	
+	_fillReadings.fetch_add(1, memory_order_relaxed);
+}
+
+void RingHealth::recordUnderrun(UInt32 framesSilenced)
+{
+	_underruns.fetch_add(1, memory_order_relaxed);
+	_framesSilenced.fetch_add(framesSilenced, memory_order_relaxed);
+}
+
+void RingHealth::recordOverrun(UInt64 framesDropped)
+{
+	_overruns.fetch_add(1, memory_order_relaxed);
+	_framesDropped.fetch_add(framesDropped, memory_order_relaxed);
+}
+
+#pragma mark - Reading
+
+RingHealthReading RingHealth::getReading(bool reset)
+{
+	RingHealthReading r;
+	
+	// exchanging rather than loading and then storing means nothing
+	// recorded in between is lost; it just lands in the next reading
+	if(reset) {
+		r.underruns      = _underruns.exchange(0, memory_order_relaxed);
+		r.overruns       = _overruns.exchange(0, memory_order_relaxed);
+		r.framesDropped  = _framesDropped.exchange(0, memory_order_relaxed);
+		r.framesSilenced = _framesSilenced.exchange(0, memory_order_relaxed);
+		r.minFill        = _minFill.exchange(UINT32_MAX, memory_order_relaxed);
+		r.maxFill        = _maxFill.exchange(0, memory_order_relaxed);
+		r.fillReadings   = _fillReadings.exchange(0, memory_order_relaxed);
+		for(UInt32 i = 0; i < RingHealthReading::kHistogramBins; i++) {
+			r.fillHistogram[i] = _fillHistogram[i].exchange(0, memory_order_relaxed);
+		}
+	} else {
+		r.underruns      = _underruns.load(memory_order_relaxed);
+		r.overruns       = _overruns.load(memory_order_relaxed);
+		r.framesDropped  = _framesDropped.load(memory_order_relaxed);
+		r.framesSilenced = _framesSilenced.load(memory_order_relaxed);
+		r.minFill        = _minFill.load(memory_order_relaxed);
+		r.maxFill        = _maxFill.load(memory_order_relaxed);
+		r.fillReadings   = _fillReadings.load(memory_order_relaxed);
+		for(UInt32 i = 0; i < RingHealthReading::kHistogramBins; i++) {
+			r.fillHistogram[i] = _fillHistogram[i].load(memory_order_relaxed);
+		}
+	}
+	
+	r.capacity = _capacity.load(memory_order_relaxed);
+	if(r.minFill == UINT32_MAX) r.minFill = 0;
+	return r;
+}
+
+void RingHealth::reset()
+{
+	getReading(true);
+}
@@ -0,0 +1,97 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "AudioUnitTypes.h"
+#include <atomic>
+
+namespace cinder { namespace audiounit {
+
+// What a RingHealth has seen since it was last reset. Fill levels are in
+// frames; fillHistogram[n] counts the times the fill was between n and
+// n + 1 sixteenths of the ring's capacity.
+struct RingHealthReading
+{
+	static const UInt32 kHistogramBins = 16;
+	
+	UInt64 underruns;      // reads that came up short, and were padded with silence
+	UInt64 overruns;       // times the writer got so far ahead that audio was lost
+	UInt64 framesDropped;  // audio lost to overruns
+	UInt64 framesSilenced; // silence handed out by underruns
+	UInt32 minFill;        // 0 if there haven't been any fill readings
+	UInt32 maxFill;
+	UInt32 capacity;
+	UInt64 fillReadings;
+	UInt64 fillHistogram[kHistogramBins];
+};
+
+// A RingHealth keeps count of how well a ring buffer's keeping up: how
+// often its reader finds it empty (an underrun, which you hear as a
+// dropout) or its writer finds it full (an overrun, where audio is thrown
+// away), and how full it is from one read to the next. Input keeps one
+// for each of its connections (see Input::getRingHealth()) and a Tap
+// keeps one for its history (see Tap::getRingHealth()).
+
+// Everything's kept in atomics with relaxed ordering, so recording costs
+// a handful of uncontended atomic adds, and never waits. getReading()
+// can be called from any thread. With reset set, it hands back what
+// was recorded up to that point and starts counting again, so calling it
+// once a second (say) gives the min and max fill over each second. The
+// fields are read one at a time, so a reading taken while the render
+// thread's recording can be off by the block in progress.
+
+class RingHealth
+{
+public:
+	RingHealth();
+	
+	// the capacity the histogram's bins are relative to. Like reset(),
+	// this can be called from any thread
+	void setCapacity(UInt32 frames);
+	UInt32 getCapacity() const {return _capacity.load(std::memory_order_relaxed);}
+	
+	// Render thread (or whichever thread is reading or writing the ring)
+	void recordFill(UInt64 frames);
+	void recordUnderrun(UInt32 framesSilenced);
+	void recordOverrun(UInt64 framesDropped);
+	
+	// Any thread
+	RingHealthReading getReading(bool reset = false);
+	void reset();
+
+private:
+	RingHealth(const RingHealth &);
+	RingHealth& operator=(const RingHealth &);
+	
+	std::atomic<UInt32> _capacity;
+	std::atomic<UInt64> _underruns;
+	std::atomic<UInt64> _overruns;
+	std::atomic<UInt64> _framesDropped;
+	std::atomic<UInt64> _framesSilenced;
+	std::atomic<UInt32> _minFill;
+	std::atomic<UInt32> _maxFill;
+	std::atomic<UInt64> _fillReadings;
+	std::atomic<UInt64> _fillHistogram[RingHealthReading::kHistogramBins];
+};
+
+} } // namespace cinder::audiounit
@@ -0,0 +1,82 @@
+#include "Semaphore.h"
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/task.h>
+#endif
+
+using namespace cinder::audiounit;
+
+#if defined(__APPLE__)
+
+Semaphore::Semaphore()
+{
+	semaphore_create(mach_task_self(), &_semaphore, SYNC_POLICY_FIFO, 0);
+}
+
+Semaphore::~Semaphore()
+{
+	semaphore_destroy(mach_task_self(), _semaphore);
+}
+
+void Semaphore::signal()
+{
+	semaphore_signal(_semaphore);
+}
+
+void Semaphore::wait()
+{
+	while(semaphore_wait(_semaphore) == KERN_ABORTED);
+}
+
+bool Semaphore::waitFor(double seconds)
+{
+	mach_timespec_t timeout;
+	timeout.tv_sec  = (unsigned int)seconds;
+	timeout.tv_nsec = (clock_res_t)((seconds - floor(seconds)) * 1e9);
+	return semaphore_timedwait(_semaphore, timeout) == KERN_SUCCESS;
+}
+
+#else
+
+Semaphore::Semaphore()
+{
+	sem_init(&_semaphore, 0, 0);
+}
+
+Semaphore::~Semaphore()
+{
+	sem_destroy(&_semaphore);
+}
+
+void Semaphore::signal()
+{
+	sem_post(&_semaphore);
+}
+
+void Semaphore::wait()
+{
+	while(sem_wait(&_semaphore) != 0 && errno == EINTR);
+}
+
+bool Semaphore::waitFor(double seconds)
+{
+	timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec  += (time_t)seconds;
+	deadline.tv_nsec += (long)((seconds - floor(seconds)) * 1e9);
+	
+	if(deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec  += 1;
+		deadline.tv_nsec -= 1000000000;
+	}
+	
+	int result;
+	while((result = sem_timedwait(&_semaphore, &deadline)) != 0 && errno == EINTR);
+	return result == 0;
+}
+
+#endif
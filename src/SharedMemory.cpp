@@ -0,0 +1,147 @@
+#include "AudioUnitSharedMemory.h"
+#include <iostream>
+#include <thread>
+
+using namespace cinder::audiounit;
+using namespace std;
+
+// The segment itself (and the protocol readers rely on) is in
+// SharedMemorySegment.cpp. This is only the Core Audio side: pulling
+// blocks off a Tap or a render callback and handing them to the writer.
+
+struct SharedMemoryTap::SharedMemoryImpl
+{
+	SharedMemorySegmentWriter writer;
+	vector<const float *> channels; // sized when the segment opens, so write() doesn't allocate
+	Tap tap;
+	bool attachedToTap;
+	
+	// same as Recorder: lets stop() wait out a process() call that's in progress
+	std::atomic<bool> publishing;
+	std::atomic<int> inFlight;
+	
+	SharedMemoryImpl() : attachedToTap(false), publishing(false), inFlight(0) {}
+	
+	// a SharedMemoryTap's a handle, so the segment only closes with the last copy of it
+	~SharedMemoryImpl()
+	{
+		close();
+	}
+	
+	bool open(const string &name, UInt32 channelCount, Float64 sampleRate, UInt32 framesToKeep)
+	{
+		if(!writer.open(name, channelCount, sampleRate, framesToKeep)) {
+			return false;
+		}
+		
+		channels.assign(channelCount, NULL);
+		publishing = true;
+		return true;
+	}
+	
+	void close()
+	{
+		if(!writer.isOpen()) return;
+		
+		if(attachedToTap) {
+			tap.removeBlockCallback(PublishBlock, this);
+			tap = Tap();
+			attachedToTap = false;
+		}
+		
+		publishing = false;
+		while(inFlight.load() > 0) {
+			std::this_thread::yield();
+		}
+		
+		writer.close();
+	}
+	
+	void write(const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp)
+	{
+		inFlight.fetch_add(1);
+		
+		if(publishing.load() && frames > 0) {
+			const UInt32 channelCount = min<UInt32>(bufferList->mNumberBuffers, channels.size());
+			for(UInt32 ch = 0; ch < channelCount; ch++) {
+				channels[ch] = (const float *)bufferList->mBuffers[ch].mData;
+			}
+			
+			const bool hasSampleTime = timeStamp && (timeStamp->mFlags & kAudioTimeStampSampleTimeValid);
+			const bool hasHostTime   = timeStamp && (timeStamp->mFlags & kAudioTimeStampHostTimeValid);
+			
+			writer.write(&channels[0], channelCount, frames,
+						 hasSampleTime ? &timeStamp->mSampleTime : NULL,
+						 hasHostTime ? timeStamp->mHostTime : 0);
+		}
+		
+		inFlight.fetch_sub(1);
+	}
+	
+	static void PublishBlock(void * refCon, const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp)
+	{
+		static_cast<SharedMemoryImpl *>(refCon)->write(bufferList, frames, timeStamp);
+	}
+};
+
+SharedMemoryTap::SharedMemoryTap() : _impl(new SharedMemoryImpl)
+{
+}
+
+SharedMemoryTap::~SharedMemoryTap()
+{
+}
+
+bool SharedMemoryTap::start(Tap &tap, const std::string &name, UInt32 framesToKeep)
+{
+	stop();
+	
+	if(tap.getChannelCount() == 0) {
+		std::cout << "SharedMemoryTap can't publish a Tap without a source" << std::endl;
+		return false;
+	}
+	
+	if(!_impl->open(name, tap.getChannelCount(), tap.getSampleRate(), framesToKeep)) {
+		return false;
+	}
+	
+	if(!tap.addBlockCallback(SharedMemoryImpl::PublishBlock, _impl.get())) {
+		_impl->close();
+		return false;
+	}
+	
+	_impl->tap = tap;
+	_impl->attachedToTap = true;
+	return true;
+}
+
+bool SharedMemoryTap::start(const std::string &name, UInt32 channels, Float64 sampleRate, UInt32 framesToKeep)
+{
+	stop();
+	return _impl->open(name, channels, sampleRate, framesToKeep);
+}
+
+void SharedMemoryTap::stop()
+{
+	_impl->close();
+}
+
+bool SharedMemoryTap::isPublishing() const
+{
+	return _impl->publishing.load();
+}
+
+std::string SharedMemoryTap::getName() const
+{
+	return _impl->writer.getName();
+}
+
+UInt32 SharedMemoryTap::getCapacity() const
+{
+	return _impl->writer.getCapacity();
+}
+
+void SharedMemoryTap::process(const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp)
+{
+	_impl->write(bufferList, frames, timeStamp);
+}
@@ -0,0 +1,466 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SharedMemorySegment.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace cinder::audiounit;
+using namespace std;
+
+// other processes (and languages) depend on this layout
+static_assert(sizeof(SharedMemoryTapHeader) == 80, "SharedMemoryTapHeader's layout has changed");
+static_assert(sizeof(SharedMemoryTapBlockRecord) == 40, "SharedMemoryTapBlockRecord's layout has changed");
+
+static const char kMagic[8] = {'A', 'U', 'T', 'A', 'P', 'S', 'H', 'M'};
+static const double kDefaultSecondsToKeep = 2;
+
+static size_t RoundUpToPage(size_t bytes)
+{
+	const size_t page = sysconf(_SC_PAGESIZE);
+	return (bytes + page - 1) / page * page;
+}
+
+static string SegmentName(const string &name)
+{
+	return !name.empty() && name[0] == '/' ? name : "/" + name;
+}
+
+// if there's a segment by this name already (left over from a
+// crash, or another writer), tells its readers it's finished with
+static void MarkClosed(const string &name)
+{
+	const int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if(fd < 0) return;
+	
+	struct stat info;
+	if(fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(SharedMemoryTapHeader)) {
+		void * h = mmap(NULL, sizeof(SharedMemoryTapHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if(h != MAP_FAILED) {
+			static_cast<SharedMemoryTapHeader *>(h)->closed.store(1);
+			munmap(h, sizeof(SharedMemoryTapHeader));
+		}
+	}
+	
+	::close(fd);
+}
+
+#pragma mark - Mapping
+
+SharedMemoryMapping::SharedMemoryMapping()
+: header(NULL)
+, records(NULL)
+, lanes(NULL)
+, headerBytes(0)
+, laneBytes(0)
+, channels(0)
+{
+}
+
+bool SharedMemoryMapping::map(int fd, size_t headerBytes, size_t laneBytes, uint32_t channels, bool writable)
+{
+	const int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+	
+	void * h = mmap(NULL, headerBytes, protection, MAP_SHARED, fd, 0);
+	if(h == MAP_FAILED) return false;
+	
+	header  = static_cast<SharedMemoryTapHeader *>(h);
+	records = reinterpret_cast<SharedMemoryTapBlockRecord *>(header + 1);
+	this->headerBytes = headerBytes;
+	
+	// reserve room for every lane twice over, then map each
+	// lane's pages into both halves of its space
+	void * reserved = mmap(NULL, laneBytes * 2 * channels, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if(reserved == MAP_FAILED) {
+		unmap();
+		return false;
+	}
+	
+	lanes = static_cast<char *>(reserved);
+	this->laneBytes = laneBytes;
+	this->channels  = channels;
+	
+	for(uint32_t ch = 0; ch < channels; ch++) {
+		char * lane = lanes + ch * laneBytes * 2;
+		const off_t offset = headerBytes + ch * laneBytes;
+		
+		if(mmap(lane, laneBytes, protection, MAP_SHARED | MAP_FIXED, fd, offset) == MAP_FAILED ||
+		   mmap(lane + laneBytes, laneBytes, protection, MAP_SHARED | MAP_FIXED, fd, offset) == MAP_FAILED) {
+			unmap();
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+void SharedMemoryMapping::unmap()
+{
+	if(header) munmap(header, headerBytes);
+	if(lanes)  munmap(lanes, laneBytes * 2 * channels);
+	*this = SharedMemoryMapping();
+}
+
+float * SharedMemoryMapping::lane(uint32_t channel, uint64_t position) const
+{
+	return reinterpret_cast<float *>(lanes + channel * laneBytes * 2) + position % header->capacity;
+}
+
+#pragma mark - Writer
+
+SharedMemorySegmentWriter::SharedMemorySegmentWriter() : _nextSampleTime(0)
+{
+}
+
+SharedMemorySegmentWriter::~SharedMemorySegmentWriter()
+{
+	close();
+}
+
+bool SharedMemorySegmentWriter::open(const std::string &name, uint32_t channels, double sampleRate, uint32_t framesToKeep)
+{
+	close();
+	
+	if(channels == 0 || sampleRate <= 0) {
+		std::cout << "SharedMemoryTap needs at least one channel and a sample rate" << std::endl;
+		return false;
+	}
+	
+	_name = SegmentName(name);
+	MarkClosed(_name);
+	shm_unlink(_name.c_str());
+	
+	if(framesToKeep == 0) framesToKeep = sampleRate * kDefaultSecondsToKeep;
+	
+	const size_t   laneBytes   = RoundUpToPage((size_t)framesToKeep * sizeof(float));
+	const uint32_t capacity    = laneBytes / sizeof(float);
+	const uint32_t recordCount = max<uint32_t>(64, capacity / 16);
+	const size_t   headerBytes = RoundUpToPage(sizeof(SharedMemoryTapHeader) + recordCount * sizeof(SharedMemoryTapBlockRecord));
+	
+	const int fd = shm_open(_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+	if(fd < 0) {
+		std::cout << "SharedMemoryTap couldn't create " << _name << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	
+	const bool mapped = ftruncate(fd, headerBytes + laneBytes * channels) == 0 && _mapping.map(fd, headerBytes, laneBytes, channels, true);
+	::close(fd);
+	
+	if(!mapped) {
+		std::cout << "SharedMemoryTap couldn't map " << _name << ": " << strerror(errno) << std::endl;
+		shm_unlink(_name.c_str());
+		return false;
+	}
+	
+	// the segment starts out zeroed, so only the fixed fields need
+	// filling in. The magic goes in last, once the rest is valid
+	SharedMemoryTapHeader * h = _mapping.header;
+	h->version     = kSharedMemoryTapVersion;
+	h->headerBytes = headerBytes;
+	h->channels    = channels;
+	h->capacity    = capacity;
+	h->recordCount = recordCount;
+	h->writerPID   = getpid();
+	h->sampleRate  = sampleRate;
+	h->laneBytes   = laneBytes;
+	atomic_thread_fence(memory_order_release);
+	memcpy(h->magic, kMagic, sizeof(kMagic));
+	
+	_nextSampleTime = 0;
+	return true;
+}
+
+void SharedMemorySegmentWriter::close()
+{
+	if(!_mapping.header) return;
+	
+	_mapping.header->closed.store(1, memory_order_release);
+	_mapping.unmap();
+	shm_unlink(_name.c_str());
+}
+
+void SharedMemorySegmentWriter::write(const float * const * channels, uint32_t channelCount, uint32_t frames, const double * sampleTime, uint64_t hostTime)
+{
+	if(!_mapping.header || frames == 0) return;
+	
+	SharedMemoryTapHeader * h = _mapping.header;
+	const uint64_t start = h->writePosition.load(memory_order_relaxed);
+	const uint64_t end   = start + frames;
+	
+	// a block longer than the whole buffer only leaves its end behind
+	const uint32_t skip   = frames > h->capacity ? frames - h->capacity : 0;
+	const uint32_t copied = frames - skip;
+	
+	h->reservePosition.store(end, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	
+	for(uint32_t ch = 0; ch < h->channels; ch++) {
+		float * lane = _mapping.lane(ch, start + skip);
+		if(ch < channelCount && channels[ch]) {
+			memcpy(lane, channels[ch] + skip, copied * sizeof(float));
+		} else {
+			memset(lane, 0, copied * sizeof(float));
+		}
+	}
+	
+	recordBlock(start, frames, sampleTime, hostTime);
+	h->writePosition.store(end, memory_order_release);
+}
+
+void SharedMemorySegmentWriter::recordBlock(uint64_t position, uint32_t frames, const double * sampleTime, uint64_t hostTime)
+{
+	SharedMemoryTapHeader * h = _mapping.header;
+	
+	if(sampleTime) {
+		_nextSampleTime = *sampleTime;
+	}
+	
+	const uint64_t block = h->blocksWritten.load(memory_order_relaxed);
+	SharedMemoryTapBlockRecord &record = _mapping.records[block % h->recordCount];
+	
+	record.sequence.store(0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	record.position   = position;
+	record.sampleTime = _nextSampleTime;
+	record.hostTime   = hostTime;
+	record.frames     = frames;
+	record.sequence.store(block + 1, memory_order_release);
+	
+	h->blocksWritten.store(block + 1, memory_order_release);
+	_nextSampleTime += frames;
+}
+
+#pragma mark - Reader
+
+struct SharedMemoryTapReader::ReaderImpl
+{
+	SharedMemoryMapping mapping;
+	
+	~ReaderImpl()
+	{
+		mapping.unmap();
+	}
+	
+	uint64_t oldestIntactPosition(uint64_t reservePosition) const
+	{
+		const uint32_t capacity = mapping.header->capacity;
+		return reservePosition > capacity ? reservePosition - capacity : 0;
+	}
+};
+
+SharedMemoryTapReader::SharedMemoryTapReader() : _impl(new ReaderImpl), _position(0), _framesDropped(0)
+{
+}
+
+SharedMemoryTapReader::SharedMemoryTapReader(const std::string &name) : _impl(new ReaderImpl), _position(0), _framesDropped(0)
+{
+	open(name);
+}
+
+SharedMemoryTapReader::~SharedMemoryTapReader()
+{
+}
+
+bool SharedMemoryTapReader::open(const std::string &name)
+{
+	close();
+	
+	const string segmentName = SegmentName(name);
+	const int fd = shm_open(segmentName.c_str(), O_RDONLY, 0);
+	if(fd < 0) {
+		std::cout << "SharedMemoryTapReader couldn't open " << segmentName << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	
+	// the header first, to find out how the rest is laid out
+	struct stat info;
+	SharedMemoryTapHeader header;
+	bool valid = fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(header);
+	
+	if(valid) {
+		void * h = mmap(NULL, sizeof(header), PROT_READ, MAP_SHARED, fd, 0);
+		valid = h != MAP_FAILED;
+		if(valid) {
+			const SharedMemoryTapHeader * mapped = static_cast<const SharedMemoryTapHeader *>(h);
+			valid = memcmp(mapped->magic, kMagic, sizeof(kMagic)) == 0;
+			atomic_thread_fence(memory_order_acquire);
+			header.version     = mapped->version;
+			header.headerBytes = mapped->headerBytes;
+			header.channels    = mapped->channels;
+			header.laneBytes   = mapped->laneBytes;
+			munmap(h, sizeof(header));
+		}
+	}
+	
+	valid = valid && header.version == kSharedMemoryTapVersion &&
+			(size_t)info.st_size >= header.headerBytes + header.laneBytes * header.channels &&
+			_impl->mapping.map(fd, header.headerBytes, header.laneBytes, header.channels, false);
+	::close(fd);
+	
+	if(!valid) {
+		std::cout << "SharedMemoryTapReader couldn't map " << segmentName << " (it might not be ready yet, or be from a different version)" << std::endl;
+		return false;
+	}
+	
+	_position = getWritePosition();
+	_framesDropped = 0;
+	return true;
+}
+
+void SharedMemoryTapReader::close()
+{
+	_impl->mapping.unmap();
+	_position = 0;
+	_framesDropped = 0;
+}
+
+bool SharedMemoryTapReader::isOpen() const
+{
+	return _impl->mapping.header != NULL;
+}
+
+bool SharedMemoryTapReader::isWriterClosed() const
+{
+	return !isOpen() || _impl->mapping.header->closed.load(memory_order_acquire) != 0;
+}
+
+uint32_t SharedMemoryTapReader::getChannelCount() const
+{
+	return isOpen() ? _impl->mapping.header->channels : 0;
+}
+
+uint32_t SharedMemoryTapReader::getCapacity() const
+{
+	return isOpen() ? _impl->mapping.header->capacity : 0;
+}
+
+double SharedMemoryTapReader::getSampleRate() const
+{
+	return isOpen() ? _impl->mapping.header->sampleRate : 0;
+}
+
+uint64_t SharedMemoryTapReader::getWritePosition() const
+{
+	return isOpen() ? _impl->mapping.header->writePosition.load(memory_order_acquire) : 0;
+}
+
+const float * SharedMemoryTapReader::getChannel(uint32_t channel, uint64_t position) const
+{
+	if(!isOpen() || channel >= _impl->mapping.header->channels) return NULL;
+	return _impl->mapping.lane(channel, position);
+}
+
+bool SharedMemoryTapReader::isIntact(uint64_t position) const
+{
+	if(!isOpen()) return false;
+	atomic_thread_fence(memory_order_acquire);
+	const uint64_t reserve = _impl->mapping.header->reservePosition.load(memory_order_relaxed);
+	return position >= _impl->oldestIntactPosition(reserve);
+}
+
+uint32_t SharedMemoryTapReader::getAvailableFrames() const
+{
+	if(!isOpen()) return 0;
+	
+	const uint64_t write  = getWritePosition();
+	const uint64_t oldest = _impl->oldestIntactPosition(write);
+	return write - max(oldest, min(_position, write));
+}
+
+bool SharedMemoryTapReader::read(std::vector<std::vector<float> > &buffers, uint32_t maxFrames)
+{
+	if(!isOpen()) {
+		buffers.clear();
+		return false;
+	}
+	
+	const SharedMemoryTapHeader * h = _impl->mapping.header;
+	const uint64_t write = h->writePosition.load(memory_order_acquire);
+	const uint64_t requested = min(_position, write);
+	
+	uint64_t start = max(requested, _impl->oldestIntactPosition(write));
+	uint32_t frames = min<uint64_t>(write - start, maxFrames);
+	
+	buffers.resize(h->channels);
+	for(uint32_t ch = 0; ch < h->channels; ch++) {
+		const float * lane = _impl->mapping.lane(ch, start);
+		buffers[ch].assign(lane, lane + frames);
+	}
+	
+	// anything the writer reserved while we were copying can't be trusted
+	atomic_thread_fence(memory_order_acquire);
+	const uint64_t oldest = _impl->oldestIntactPosition(h->reservePosition.load(memory_order_relaxed));
+	
+	if(oldest > start) {
+		const uint32_t torn = min<uint64_t>(oldest - start, frames);
+		for(uint32_t ch = 0; ch < h->channels; ch++) {
+			buffers[ch].erase(buffers[ch].begin(), buffers[ch].begin() + torn);
+		}
+		start  += torn;
+		frames -= torn;
+	}
+	
+	_framesDropped += start - requested;
+	_position = start + frames;
+	return start == requested;
+}
+
+bool SharedMemoryTapReader::sampleTimeForPosition(uint64_t position, double &sampleTime) const
+{
+	if(!isOpen()) return false;
+	
+	const SharedMemoryTapHeader * h = _impl->mapping.header;
+	const uint64_t blocks = h->blocksWritten.load(memory_order_acquire);
+	const uint64_t oldestBlock = blocks > h->recordCount ? blocks - h->recordCount : 0;
+	
+	// newest first, since that's usually what's being asked about
+	for(uint64_t block = blocks; block > oldestBlock; block--) {
+		const SharedMemoryTapBlockRecord &record = _impl->mapping.records[(block - 1) % h->recordCount];
+		
+		if(record.sequence.load(memory_order_acquire) != block) return false;
+		const uint64_t p = record.position;
+		const double   t = record.sampleTime;
+		const uint32_t f = record.frames;
+		atomic_thread_fence(memory_order_acquire);
+		if(record.sequence.load(memory_order_relaxed) != block) return false;
+		
+		if(position >= p && position < p + f) {
+			sampleTime = t + (position - p);
+			return true;
+		}
+		
+		if(position > p) return false;
+	}
+	
+	return false;
+}
+
+const SharedMemoryTapHeader * SharedMemoryTapReader::getHeader() const
+{
+	return _impl->mapping.header;
+}
@@ -0,0 +1,195 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <boost/shared_ptr.hpp>
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace cinder { namespace audiounit {
+
+// The parts of a shared memory Tap that don't depend on Core Audio: the
+// segment's layout, the writer's side of the protocol, and the reader.
+// A process that only wants to follow a SharedMemoryTap (on any POSIX
+// system, OS X or not) can build this on its own, along with
+// SharedMemorySegment.cpp.
+
+// The layout, for readers that don't use SharedMemoryTapReader (ie.
+// that aren't written in C++). Everything is in the host's native byte
+// order.
+
+// The segment starts with a SharedMemoryTapHeader, followed directly by
+// recordCount SharedMemoryTapBlockRecords. The samples start at
+// headerBytes: channel n's samples are the float32s at headerBytes +
+// n * laneBytes, with frame p (counting from when the writer started)
+// at index p % capacity.
+
+// The writer follows the same protocol as BroadcastBuffer: it bumps
+// reservePosition before it writes a block and writePosition once the
+// block is in place. To read safely, load writePosition, copy what you
+// want from behind it (and no more than capacity frames back), then
+// load reservePosition again: any frame older than reservePosition -
+// capacity may have been overwritten while you were copying it.
+
+// Block records are written the same way: sequence is zeroed while
+// the writer fills record (block % recordCount) in, and set to the
+// block's number + 1 once it's done.
+
+struct SharedMemoryTapHeader
+{
+	char     magic[8];    // "AUTAPSHM"
+	uint32_t version;     // kSharedMemoryTapVersion
+	uint32_t headerBytes;
+	uint32_t channels;
+	uint32_t capacity;    // frames per channel
+	uint32_t recordCount;
+	uint32_t writerPID;
+	double   sampleRate;
+	uint64_t laneBytes;
+	std::atomic<uint64_t> reservePosition;
+	std::atomic<uint64_t> writePosition;
+	std::atomic<uint64_t> blocksWritten;
+	std::atomic<uint32_t> closed;   // set to 1 when the writer goes away
+	uint32_t reserved;
+};
+
+struct SharedMemoryTapBlockRecord
+{
+	std::atomic<uint64_t> sequence;
+	uint64_t position;
+	double   sampleTime;
+	uint64_t hostTime;    // 0 if the block didn't come with one
+	uint32_t frames;
+	uint32_t reserved;
+};
+
+static const uint32_t kSharedMemoryTapVersion = 1;
+
+// A mapped segment: the header (and block records) mapped once, and
+// each channel's lane mapped twice in a row, the same way
+// TPCircularBuffer mirrors its lanes.
+
+struct SharedMemoryMapping
+{
+	SharedMemoryTapHeader * header;
+	SharedMemoryTapBlockRecord * records;
+	char * lanes;
+	size_t headerBytes;
+	size_t laneBytes;
+	uint32_t channels;
+	
+	SharedMemoryMapping();
+	
+	bool map(int fd, size_t headerBytes, size_t laneBytes, uint32_t channels, bool writable);
+	void unmap();
+	
+	float * lane(uint32_t channel, uint64_t position) const;
+};
+
+// The writer's side of a segment, which SharedMemoryTap feeds from a Tap
+// or a render callback. open() replaces any segment left behind under
+// the same name, and close() marks the segment closed and unlinks it.
+// write() never blocks, allocates or makes a system call, so it can be
+// called from the render thread.
+
+class SharedMemorySegmentWriter
+{
+public:
+	SharedMemorySegmentWriter();
+	~SharedMemorySegmentWriter();
+	
+	bool open(const std::string &name, uint32_t channels, double sampleRate, uint32_t framesToKeep = 0);
+	void close();
+	bool isOpen() const {return _mapping.header != NULL;}
+	
+	const std::string& getName() const {return _name;}
+	uint32_t getCapacity() const {return _mapping.header ? _mapping.header->capacity : 0;}
+	
+	// A NULL channel (or one past channelCount) is written as silence.
+	// The block's sample time carries on from the last one unless it's
+	// given; hostTime is 0 if there isn't one
+	void write(const float * const * channels, uint32_t channelCount, uint32_t frames, const double * sampleTime = NULL, uint64_t hostTime = 0);
+
+private:
+	SharedMemorySegmentWriter(const SharedMemorySegmentWriter &);
+	SharedMemorySegmentWriter& operator=(const SharedMemorySegmentWriter &);
+	
+	void recordBlock(uint64_t position, uint32_t frames, const double * sampleTime, uint64_t hostTime);
+	
+	SharedMemoryMapping _mapping;
+	std::string _name;
+	double _nextSampleTime;
+};
+
+// Follows a SharedMemoryTap from another process, the same way a
+// TapReader follows a Tap: read() returns whatever's been written since
+// the last read(), and counts anything it missed in getFramesDropped().
+
+// Each channel is mapped twice in a row, so getChannel() can hand back
+// up to getCapacity() frames from any position as one contiguous run
+// of samples, with no copying. Check isIntact() after you've used them.
+
+class SharedMemoryTapReader
+{
+	struct ReaderImpl;
+	boost::shared_ptr<ReaderImpl> _impl;
+	uint64_t _position;
+	uint64_t _framesDropped;
+
+public:
+	SharedMemoryTapReader();
+	explicit SharedMemoryTapReader(const std::string &name);
+	~SharedMemoryTapReader();
+	
+	// Maps the named segment, and starts reading from its write position
+	bool open(const std::string &name);
+	void close();
+	bool isOpen() const;
+	
+	// true once the writer has stopped (or restarted, under a new segment)
+	bool isWriterClosed() const;
+	
+	uint32_t getChannelCount() const;
+	uint32_t getCapacity() const;
+	double   getSampleRate() const;
+	
+	bool read(std::vector<std::vector<float> > &buffers, uint32_t maxFrames = UINT32_MAX);
+	uint32_t getAvailableFrames() const;
+	uint64_t getFramesDropped() const {return _framesDropped;}
+	uint64_t getPosition() const {return _position;}
+	
+	// Zero-copy access
+	uint64_t getWritePosition() const;
+	const float * getChannel(uint32_t channel, uint64_t position) const;
+	bool isIntact(uint64_t position) const; // true if nothing from position on has been overwritten
+	
+	// the sample time of a position, if the writer was given timestamps
+	// and still has a record of the block it was in
+	bool sampleTimeForPosition(uint64_t position, double &sampleTime) const;
+	
+	const SharedMemoryTapHeader * getHeader() const;
+};
+
+} } // namespace cinder::audiounit
@@ -0,0 +1,288 @@
+#include "AudioUnitSpectrum.h"
+#include "DSP.h"
+#include "Semaphore.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <math.h>
+#include <thread>
+
+using namespace cinder::audiounit;
+using namespace std;
+
+static const float kLowestLogFrequency = 20;
+static const UInt32 kSmallestFFTSize = 4;
+
+// The FFT only comes in powers of two, and the band interpolation needs
+// at least three bins, so anything else is rounded up
+static UInt32 ValidFFTSize(UInt32 requested)
+{
+	UInt32 size = kSmallestFFTSize;
+	while(size < requested && size < 0x80000000) size <<= 1;
+	
+	if(size != requested) {
+		std::cout << "SpectrumTap's FFT size has to be a power of two of at least " << kSmallestFFTSize
+		<< ", so " << requested << " was rounded up to " << size << std::endl;
+	}
+	
+	return size;
+}
+
+static float HzToMel(float hz)  {return 2595.f * log10f(1.f + hz / 700.f);}
+static float MelToHz(float mel) {return 700.f * (powf(10.f, mel / 2595.f) - 1.f);}
+
+// wakes the worker up whenever the Tap has new audio
+static void SignalSemaphore(void * refCon, const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp)
+{
+	static_cast<Semaphore *>(refCon)->signal();
+}
+
+struct SpectrumTap::SpectrumImpl
+{
+	Tap tap;
+	TapReader reader;
+	UInt32 fftSize, hopSize, bandCount, channel;
+	SpectrumBandScale scale;
+	Float64 sampleRate;
+	
+	// worker state
+	FFT fft;
+	vector<float> window, history, windowed, bins, bands;
+	vector<TapSampleBuffer> incoming;
+	UInt32 framesSinceLastSpectrum;
+	
+	// each band covers the bins [firstBin, lastBin), or if it's narrower
+	// than a bin, is interpolated between the bins either side of centreBin
+	vector<UInt32> firstBin, lastBin;
+	vector<float> centreBin, centreFrequency;
+	
+	// Spectrum n goes in published[n % 2]. Same protocol as
+	// BroadcastBuffer: reserved is bumped before the worker touches a
+	// slot, and written once it's finished with it
+	vector<float> published[2];
+	atomic<UInt64> reserved, written;
+	
+	Semaphore semaphore;
+	atomic<bool> stopping;
+	thread worker;
+	
+	SpectrumImpl(Tap &tap, UInt32 fftSize, UInt32 hopSize, UInt32 bandCount, SpectrumBandScale scale, UInt32 channel)
+	: tap(tap)
+	, reader(tap)
+	, fftSize(fftSize)
+	, hopSize(max<UInt32>(1, min(hopSize, fftSize)))
+	, bandCount(bandCount)
+	, channel(channel)
+	, scale(scale)
+	, sampleRate(tap.getSampleRate())
+	, fft(fftSize)
+	, window(fftSize)
+	, history(fftSize)
+	, windowed(fftSize)
+	, bins(fftSize / 2 + 1)
+	, framesSinceLastSpectrum(0)
+	, reserved(0)
+	, written(0)
+	, stopping(false)
+	{
+		DSP::hannWindow(&window[0], fftSize);
+		setupBands();
+		
+		const size_t outputSize = bandCount > 0 ? bandCount : bins.size();
+		bands.resize(outputSize);
+		published[0].resize(outputSize);
+		published[1].resize(outputSize);
+		
+		worker = thread(&SpectrumImpl::run, this);
+		this->tap.addBlockCallback(SignalSemaphore, &semaphore);
+	}
+	
+	~SpectrumImpl()
+	{
+		tap.removeBlockCallback(SignalSemaphore, &semaphore);
+		stopping = true;
+		semaphore.signal();
+		worker.join();
+	}
+	
+	void setupBands()
+	{
+		const float binWidth = sampleRate / fftSize;
+		const float nyquist  = sampleRate / 2;
+		
+		if(bandCount == 0) {
+			for(UInt32 i = 0; i < bins.size(); i++) centreFrequency.push_back(i * binWidth);
+			return;
+		}
+		
+		for(UInt32 i = 0; i < bandCount; i++) {
+			float lo, hi, centre;
+			
+			if(scale == SpectrumBandsLog) {
+				const float ratio = nyquist / kLowestLogFrequency;
+				lo     = kLowestLogFrequency * powf(ratio, i / (float)bandCount);
+				hi     = kLowestLogFrequency * powf(ratio, (i + 1) / (float)bandCount);
+				centre = sqrtf(lo * hi);
+			} else if(scale == SpectrumBandsMel) {
+				const float top = HzToMel(nyquist);
+				lo     = MelToHz(top * i / bandCount);
+				hi     = MelToHz(top * (i + 1) / bandCount);
+				centre = MelToHz(top * (i + 0.5f) / bandCount);
+			} else {
+				lo     = nyquist * i / bandCount;
+				hi     = nyquist * (i + 1) / bandCount;
+				centre = (lo + hi) / 2;
+			}
+			
+			firstBin.push_back(min<UInt32>(ceilf(lo / binWidth), bins.size() - 1));
+			lastBin.push_back(min<UInt32>(ceilf(hi / binWidth), bins.size()));
+			centreBin.push_back(centre / binWidth);
+			centreFrequency.push_back(centre);
+		}
+	}
+	
+	void run()
+	{
+		while(!stopping) {
+			// the timeout is only there as a backstop, in case a
+			// wakeup gets lost while the Tap is being reconfigured
+			semaphore.waitFor(0.1);
+			
+			while(!stopping && readIncoming()) {
+				if(framesSinceLastSpectrum == hopSize) {
+					computeSpectrum();
+					framesSinceLastSpectrum = 0;
+				}
+			}
+		}
+	}
+	
+	// Moves up to the rest of the current hop into the history. Returns false if there's nothing new
+	bool readIncoming()
+	{
+		incoming.resize(max<UInt32>(1, tap.getChannelCount()));
+		reader.read(incoming, hopSize - framesSinceLastSpectrum);
+		
+		const UInt32 frames = incoming[0].size();
+		if(frames == 0) return false;
+		
+		memmove(&history[0], &history[frames], (fftSize - frames) * sizeof(float));
+		float * dst = &history[fftSize - frames];
+		
+		if(channel == kAllChannels) {
+			const float gain = 1.f / incoming.size();
+			for(UInt32 i = 0; i < frames; i++) {
+				float sum = 0;
+				for(size_t ch = 0; ch < incoming.size(); ch++) sum += incoming[ch][i];
+				dst[i] = sum * gain;
+			}
+		} else {
+			const TapSampleBuffer &src = incoming[channel < incoming.size() ? channel : 0];
+			copy(src.begin(), src.end(), dst);
+		}
+		
+		framesSinceLastSpectrum += frames;
+		return true;
+	}
+	
+	void computeSpectrum()
+	{
+		DSP::multiply(&history[0], &window[0], &windowed[0], fftSize);
+		fft.computeMagnitudes(&windowed[0], &bins[0]);
+		
+		if(bandCount == 0) {
+			publish(bins);
+			return;
+		}
+		
+		for(UInt32 b = 0; b < bandCount; b++) {
+			if(lastBin[b] > firstBin[b] + 1) {
+				float sum = 0;
+				for(UInt32 k = firstBin[b]; k < lastBin[b]; k++) sum += bins[k];
+				bands[b] = sum / (lastBin[b] - firstBin[b]);
+			} else {
+				const UInt32 below = min<UInt32>(centreBin[b], bins.size() - 2);
+				const float  t     = centreBin[b] - below;
+				bands[b] = bins[below] * (1 - t) + bins[below + 1] * t;
+			}
+		}
+		
+		publish(bands);
+	}
+	
+	void publish(const vector<float> &values)
+	{
+		const UInt64 n = written.load(memory_order_relaxed);
+		
+		reserved.store(n + 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+		copy(values.begin(), values.end(), published[n % 2].begin());
+		written.store(n + 1, memory_order_release);
+	}
+	
+	bool latest(vector<float> &magnitudes, UInt64 * index) const
+	{
+		for(int attempt = 0; attempt < 4; attempt++) {
+			const UInt64 n = written.load(memory_order_acquire);
+			if(n == 0) return false;
+			
+			const vector<float> &slot = published[(n - 1) % 2];
+			magnitudes.assign(slot.begin(), slot.end());
+			
+			// the slot is only reused for spectrum n + 1, so as long as
+			// the worker hasn't started on that, the copy is intact
+			atomic_thread_fence(memory_order_acquire);
+			if(reserved.load(memory_order_relaxed) <= n + 1) {
+				if(index) *index = n - 1;
+				return true;
+			}
+		}
+		
+		return false;
+	}
+};
+
+#pragma mark - SpectrumTap
+
+SpectrumTap::SpectrumTap()
+{
+}
+
+SpectrumTap::SpectrumTap(Tap &tap, UInt32 fftSize, UInt32 hopSize, UInt32 bandCount, SpectrumBandScale scale, UInt32 channel)
+: _impl(new SpectrumImpl(tap, ValidFFTSize(fftSize), hopSize, bandCount, scale, channel))
+{
+}
+
+SpectrumTap::~SpectrumTap()
+{
+}
+
+UInt32 SpectrumTap::getFFTSize() const
+{
+	return _impl ? _impl->fftSize : 0;
+}
+
+UInt32 SpectrumTap::getHopSize() const
+{
+	return _impl ? _impl->hopSize : 0;
+}
+
+UInt32 SpectrumTap::getBandCount() const
+{
+	return _impl ? _impl->bands.size() : 0;
+}
+
+std::vector<float> SpectrumTap::getBandFrequencies() const
+{
+	return _impl ? _impl->centreFrequency : vector<float>();
+}
+
+bool SpectrumTap::getSpectrum(std::vector<float> &magnitudes, UInt64 * spectrumIndex) const
+{
+	return _impl && _impl->latest(magnitudes, spectrumIndex);
+}
+
+UInt64 SpectrumTap::getSpectrumCount() const
+{
+	return _impl ? _impl->written.load(memory_order_acquire) : 0;
+}
@@ -7,107 +7,212 @@
 
 
 #include "TPCircularBuffer.h"
-#include <mach/mach.h>
 #include <stdio.h>
 
+#if defined(__APPLE__)
+
+#include <mach/mach.h>
+
 #define reportResult(result,operation) (_reportResult((result),(operation),strrchr(__FILE__, '/')+1,__LINE__))
 static inline bool _reportResult(kern_return_t result, const char *operation, const char* file, int line) {
     if ( result != ERR_SUCCESS ) {
-        printf("%s:%d: %s: %s\n", file, line, operation, mach_error_string(result)); 
+        printf("%s:%d: %s: %s\n", file, line, operation, mach_error_string(result));
         return false;
     }
     return true;
 }
 
-bool TPCircularBufferInit(TPCircularBuffer *buffer, int length) {
+int32_t TPCircularBufferRoundLength(int32_t length) {
+    return (int32_t)round_page(length);
+}
+
+void* TPCircularBufferMirroredAllocate(int32_t length, int32_t lanes) {
 
     // Keep trying until we get our buffer, needed to handle race conditions
     int retries = 3;
     while ( true ) {
 
-        buffer->length = round_page(length);    // We need whole page sizes
-
-        // Temporarily allocate twice the length, so we have the contiguous address space to
-        // support a second instance of the buffer directly after
+        // Temporarily allocate twice the length for every lane, so we have the contiguous address
+        // space to support a second instance of each lane directly after it
         vm_address_t bufferAddress;
         kern_return_t result = vm_allocate(mach_task_self(),
                                            &bufferAddress,
-                                           buffer->length * 2,
+                                           length * 2 * lanes,
                                            VM_FLAGS_ANYWHERE); // allocate anywhere it'll fit
         if ( result != ERR_SUCCESS ) {
             if ( retries-- == 0 ) {
                 reportResult(result, "Buffer allocation");
-                return false;
+                return NULL;
             }
             // Try again if we fail
             continue;
         }
-        
-        // Now replace the second half of the allocation with a virtual copy of the first half. Deallocate the second half...
-        result = vm_deallocate(mach_task_self(),
-                               bufferAddress + buffer->length,
-                               buffer->length);
-        if ( result != ERR_SUCCESS ) {
-            if ( retries-- == 0 ) {
-                reportResult(result, "Buffer deallocation");
-                return false;
+
+        bool mirrored = true;
+
+        for ( int32_t lane = 0; lane < lanes && mirrored; lane++ ) {
+            vm_address_t laneAddress = bufferAddress + (vm_address_t)lane * length * 2;
+
+            // Now replace the second half of the lane with a virtual copy of the first half. Deallocate the second half...
+            result = vm_deallocate(mach_task_self(),
+                                   laneAddress + length,
+                                   length);
+            if ( result != ERR_SUCCESS ) {
+                if ( retries == 0 ) reportResult(result, "Buffer deallocation");
+                mirrored = false;
+                break;
             }
-            // If this fails somehow, deallocate the whole region and try again
-            vm_deallocate(mach_task_self(), bufferAddress, buffer->length);
-            continue;
-        }
-        
-        // Re-map the buffer to the address space immediately after the buffer
-        vm_address_t virtualAddress = bufferAddress + buffer->length;
-        vm_prot_t cur_prot, max_prot;
-        result = vm_remap(mach_task_self(),
-                          &virtualAddress,   // mirror target
-                          buffer->length,    // size of mirror
-                          0,                 // auto alignment
-                          0,                 // force remapping to virtualAddress
-                          mach_task_self(),  // same task
-                          bufferAddress,     // mirror source
-                          0,                 // MAP READ-WRITE, NOT COPY
-                          &cur_prot,         // unused protection struct
-                          &max_prot,         // unused protection struct
-                          VM_INHERIT_DEFAULT);
-        if ( result != ERR_SUCCESS ) {
-            if ( retries-- == 0 ) {
-                reportResult(result, "Remap buffer memory");
-                return false;
+
+            // Re-map the lane to the address space immediately after the lane
+            vm_address_t virtualAddress = laneAddress + length;
+            vm_prot_t cur_prot, max_prot;
+            result = vm_remap(mach_task_self(),
+                              &virtualAddress,   // mirror target
+                              length,            // size of mirror
+                              0,                 // auto alignment
+                              0,                 // force remapping to virtualAddress
+                              mach_task_self(),  // same task
+                              laneAddress,       // mirror source
+                              0,                 // MAP READ-WRITE, NOT COPY
+                              &cur_prot,         // unused protection struct
+                              &max_prot,         // unused protection struct
+                              VM_INHERIT_DEFAULT);
+            if ( result != ERR_SUCCESS ) {
+                // If this remap failed, we hit a race condition
+                if ( retries == 0 ) reportResult(result, "Remap buffer memory");
+                mirrored = false;
+                break;
             }
-            // If this remap failed, we hit a race condition, so deallocate and try again
-            vm_deallocate(mach_task_self(), bufferAddress, buffer->length);
-            continue;
-        }
-        
-        if ( virtualAddress != bufferAddress+buffer->length ) {
-            // If the memory is not contiguous, clean up both allocated buffers and try again
-            if ( retries-- == 0 ) {
-                printf("Couldn't map buffer memory to end of buffer\n");
-                return false;
+
+            if ( virtualAddress != laneAddress + length ) {
+                // If the memory is not contiguous, give the stray mapping back
+                if ( retries == 0 ) printf("Couldn't map buffer memory to end of buffer\n");
+                vm_deallocate(mach_task_self(), virtualAddress, length);
+                mirrored = false;
+                break;
             }
+        }
 
-            vm_deallocate(mach_task_self(), virtualAddress, buffer->length);
-            vm_deallocate(mach_task_self(), bufferAddress, buffer->length);
+        if ( !mirrored ) {
+            // Clean up everything we've mapped so far and try again
+            vm_deallocate(mach_task_self(), bufferAddress, length * 2 * lanes);
+            if ( retries-- == 0 ) return NULL;
             continue;
         }
-        
-        buffer->buffer = (void*)bufferAddress;
-        buffer->fillCount = 0;
-        buffer->head = buffer->tail = 0;
-        
-        return true;
+
+        return (void*)bufferAddress;
+    }
+    return NULL;
+}
+
+void TPCircularBufferMirroredDeallocate(void *address, int32_t length, int32_t lanes) {
+    if ( address ) vm_deallocate(mach_task_self(), (vm_address_t)address, length * 2 * lanes);
+}
+
+#elif defined(__linux__)
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Linux version of the mirror: the buffer's pages live in an anonymous memfd, and each lane of it
+// is mapped twice, back to back, into a region reserved up front. Reserving first means nothing
+// else can claim the address space between the two mappings, so there's no race to retry around.
+
+static int _createMemoryFile(const char *name) {
+#if defined(SYS_memfd_create)
+    return (int)syscall(SYS_memfd_create, name, 1U /* MFD_CLOEXEC */);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+#define reportResult(result,operation) (_reportResult((result),(operation),strrchr(__FILE__, '/')+1,__LINE__))
+static inline bool _reportResult(bool result, const char *operation, const char* file, int line) {
+    if ( !result ) {
+        printf("%s:%d: %s: %s\n", file, line, operation, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+int32_t TPCircularBufferRoundLength(int32_t length) {
+    long pageSize = sysconf(_SC_PAGESIZE);
+    return (int32_t)(((length + pageSize - 1) / pageSize) * pageSize);
+}
+
+void* TPCircularBufferMirroredAllocate(int32_t length, int32_t lanes) {
+
+    int fd = _createMemoryFile("TPCircularBuffer");
+    if ( !reportResult(fd != -1, "Buffer allocation") ) return NULL;
+
+    if ( !reportResult(ftruncate(fd, (off_t)length * lanes) == 0, "Buffer sizing") ) {
+        close(fd);
+        return NULL;
+    }
+
+    // Reserve twice the length for every lane, so we have the contiguous address space to
+    // support a second instance of each lane directly after it
+    size_t reservedLength = (size_t)length * 2 * lanes;
+    char *bufferAddress = (char *)mmap(NULL, reservedLength, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( !reportResult(bufferAddress != MAP_FAILED, "Address space reservation") ) {
+        close(fd);
+        return NULL;
+    }
+
+    // Map each lane of the file over both halves of its slot in the reservation
+    bool mirrored = true;
+
+    for ( int32_t lane = 0; lane < lanes && mirrored; lane++ ) {
+        char *laneAddress = bufferAddress + (size_t)lane * length * 2;
+        off_t laneOffset  = (off_t)lane * length;
+
+        void *first  = mmap(laneAddress, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, laneOffset);
+        void *second = first == MAP_FAILED ? MAP_FAILED :
+                       mmap(laneAddress + length, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, laneOffset);
+
+        mirrored = reportResult(first == laneAddress && second == laneAddress + length, "Remap buffer memory");
+    }
+
+    // The mappings keep the file alive from here on
+    close(fd);
+
+    if ( !mirrored ) {
+        munmap(bufferAddress, reservedLength);
+        return NULL;
     }
-    return false;
+
+    return bufferAddress;
+}
+
+void TPCircularBufferMirroredDeallocate(void *address, int32_t length, int32_t lanes) {
+    if ( address ) munmap(address, (size_t)length * 2 * lanes);
+}
+
+#else
+    #error "TPCircularBuffer has no mirrored memory backend for this platform"
+#endif
+
+bool TPCircularBufferInit(TPCircularBuffer *buffer, int length) {
+    buffer->length = TPCircularBufferRoundLength(length);    // We need whole page sizes
+    buffer->buffer = TPCircularBufferMirroredAllocate(buffer->length, 1);
+    buffer->head = buffer->tail = 0;
+    _TPCircularBufferCountReset(&buffer->fillCount);
+
+    return buffer->buffer != NULL;
 }
 
 void TPCircularBufferCleanup(TPCircularBuffer *buffer) {
-    vm_deallocate(mach_task_self(), (vm_address_t)buffer->buffer, buffer->length * 2);
-    memset(buffer, 0, sizeof(TPCircularBuffer));
+    TPCircularBufferMirroredDeallocate(buffer->buffer, buffer->length, 1);
+    buffer->buffer = NULL;
+    buffer->length = 0;
+    buffer->head = buffer->tail = 0;
+    _TPCircularBufferCountReset(&buffer->fillCount);
 }
 
 void TPCircularBufferClear(TPCircularBuffer *buffer) {
     buffer->head = buffer->tail = 0;
-    buffer->fillCount = 0;
+    _TPCircularBufferCountReset(&buffer->fillCount);
 }
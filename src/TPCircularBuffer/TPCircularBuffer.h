@@ -16,25 +16,81 @@
 //  adapted to Darwin by Kurt Revis (http://www.snoize.com,
 //  http://www.snoize.com/Code/PlayBufferedSoundFile.tar.gz)
 //
+//  On Darwin the mirror is built with vm_allocate / vm_remap and the fill count is updated with
+//  OSAtomic. Everywhere else (or on Darwin if TPCIRCULARBUFFER_USE_STD_ATOMIC is defined) the
+//  fill count is a std::atomic with acquire / release ordering, and on Linux the mirror is built
+//  from a memfd mapped twice into one reserved region.
+//
 
 #ifndef TPCircularBuffer_h
 #define TPCircularBuffer_h
 
-#include <libkern/OSAtomic.h>
+#if defined(__APPLE__) && !defined(TPCIRCULARBUFFER_USE_STD_ATOMIC)
+    #include <libkern/OSAtomic.h>
+#else
+    #ifndef TPCIRCULARBUFFER_USE_STD_ATOMIC
+        #define TPCIRCULARBUFFER_USE_STD_ATOMIC 1
+    #endif
+    #include <atomic>
+#endif
+
+#include <stdint.h>
 #include <string.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
-    
+
+#if TPCIRCULARBUFFER_USE_STD_ATOMIC
+typedef std::atomic<int32_t> TPCircularBufferCount;
+#else
+typedef volatile int32_t     TPCircularBufferCount;
+#endif
+
 typedef struct {
-    void             *buffer;
-    int32_t           length;
-    int32_t           tail;
-    int32_t           head;
-    volatile int32_t  fillCount;
+    void                  *buffer;
+    int32_t                length;
+    int32_t                tail;
+    int32_t                head;
+    TPCircularBufferCount  fillCount;
 } TPCircularBuffer;
 
+// Fill count access. The consumer reads the count with acquire semantics so that it sees the
+// bytes the producer wrote before publishing them, and each side publishes with release semantics
+// so that the other side sees its reads / writes as finished before the space changes hands.
+
+static __inline__ __attribute__((always_inline)) int32_t _TPCircularBufferCountLoad(TPCircularBufferCount *count) {
+#if TPCIRCULARBUFFER_USE_STD_ATOMIC
+    return count->load(std::memory_order_acquire);
+#else
+    return *count;
+#endif
+}
+
+static __inline__ __attribute__((always_inline)) void _TPCircularBufferCountAdd(TPCircularBufferCount *count, int32_t amount) {
+#if TPCIRCULARBUFFER_USE_STD_ATOMIC
+    count->fetch_add(amount, std::memory_order_acq_rel);
+#else
+    OSAtomicAdd32Barrier(amount, count);
+#endif
+}
+
+static __inline__ __attribute__((always_inline)) void _TPCircularBufferCountAddNoBarrier(TPCircularBufferCount *count, int32_t amount) {
+#if TPCIRCULARBUFFER_USE_STD_ATOMIC
+    count->store(count->load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+#else
+    *count += amount;
+#endif
+}
+
+static __inline__ __attribute__((always_inline)) void _TPCircularBufferCountReset(TPCircularBufferCount *count) {
+#if TPCIRCULARBUFFER_USE_STD_ATOMIC
+    count->store(0, std::memory_order_release);
+#else
+    *count = 0;
+#endif
+}
+
 /*!
  * Initialise buffer
  *
@@ -61,6 +117,32 @@ void  TPCircularBufferCleanup(TPCircularBuffer *buffer);
  */
 void  TPCircularBufferClear(TPCircularBuffer *buffer);
 
+// Mirrored memory
+
+/*!
+ * Round a length up to the granularity of the mirror (the device page size)
+ */
+int32_t TPCircularBufferRoundLength(int32_t length);
+
+/*!
+ * Allocate mirrored lanes
+ *
+ *  Allocates one contiguous region holding `lanes` lanes of `length` bytes each. Every lane
+ *  is immediately followed by a virtual copy of itself, so lane n starts at
+ *  (char*)region + n * length * 2 and may be read or written up to `length` bytes past any
+ *  offset within it without wrapping.
+ *
+ * @param length Length of each lane, which must already be rounded with TPCircularBufferRoundLength
+ * @param lanes Number of lanes
+ * @return The region, or NULL if it couldn't be mapped
+ */
+void* TPCircularBufferMirroredAllocate(int32_t length, int32_t lanes);
+
+/*!
+ * Release a region from TPCircularBufferMirroredAllocate
+ */
+void  TPCircularBufferMirroredDeallocate(void *address, int32_t length, int32_t lanes);
+
 // Reading (consuming)
 
 /*!
@@ -74,7 +156,7 @@ void  TPCircularBufferClear(TPCircularBuffer *buffer);
  * @return Pointer to the first bytes ready for reading, or NULL if buffer is empty
  */
 static __inline__ __attribute__((always_inline)) void* TPCircularBufferTail(TPCircularBuffer *buffer, int32_t* availableBytes) {
-    *availableBytes = buffer->fillCount;
+    *availableBytes = _TPCircularBufferCountLoad(&buffer->fillCount);
     if ( *availableBytes == 0 ) return NULL;
     return (void*)((char*)buffer->buffer + buffer->tail);
 }
@@ -89,7 +171,7 @@ static __inline__ __attribute__((always_inline)) void* TPCircularBufferTail(TPCi
  */
 static __inline__ __attribute__((always_inline)) void TPCircularBufferConsume(TPCircularBuffer *buffer, int32_t amount) {
     buffer->tail = (buffer->tail + amount) % buffer->length;
-    OSAtomicAdd32Barrier(-amount, &buffer->fillCount);
+    _TPCircularBufferCountAdd(&buffer->fillCount, -amount);
 }
 
 /*!
@@ -97,7 +179,7 @@ static __inline__ __attribute__((always_inline)) void TPCircularBufferConsume(TP
  */
  static __inline__ __attribute__((always_inline)) void TPCircularBufferConsumeNoBarrier(TPCircularBuffer *buffer, int32_t amount) {
     buffer->tail = (buffer->tail + amount) % buffer->length;
-    buffer->fillCount -= amount;
+    _TPCircularBufferCountAddNoBarrier(&buffer->fillCount, -amount);
 }
 
 /*!
@@ -111,7 +193,7 @@ static __inline__ __attribute__((always_inline)) void TPCircularBufferConsume(TP
  * @return Pointer to the first bytes ready for writing, or NULL if buffer is full
  */
 static __inline__ __attribute__((always_inline)) void* TPCircularBufferHead(TPCircularBuffer *buffer, int32_t* availableBytes) {
-    *availableBytes = (buffer->length - buffer->fillCount);
+    *availableBytes = (buffer->length - _TPCircularBufferCountLoad(&buffer->fillCount));
     if ( *availableBytes == 0 ) return NULL;
     return (void*)((char*)buffer->buffer + buffer->head);
 }
@@ -128,7 +210,7 @@ static __inline__ __attribute__((always_inline)) void* TPCircularBufferHead(TPCi
  */
 static __inline__ __attribute__((always_inline)) void TPCircularBufferProduce(TPCircularBuffer *buffer, int amount) {
     buffer->head = (buffer->head + amount) % buffer->length;
-    OSAtomicAdd32Barrier(amount, &buffer->fillCount);
+    _TPCircularBufferCountAdd(&buffer->fillCount, amount);
 }
 
 /*!
@@ -136,7 +218,7 @@ static __inline__ __attribute__((always_inline)) void TPCircularBufferProduce(TP
  */
 static __inline__ __attribute__((always_inline)) void TPCircularBufferProduceNoBarrier(TPCircularBuffer *buffer, int amount) {
     buffer->head = (buffer->head + amount) % buffer->length;
-    buffer->fillCount += amount;
+    _TPCircularBufferCountAddNoBarrier(&buffer->fillCount, amount);
 }
 
 /*!
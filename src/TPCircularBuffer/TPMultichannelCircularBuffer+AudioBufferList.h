@@ -0,0 +1,82 @@
+//
+//  TPMultichannelCircularBuffer+AudioBufferList.h
+//  Helpers for moving non-interleaved AudioBufferLists in and out of a TPMultichannelCircularBuffer
+//
+//  Buffer n of the list maps to lane n of the circular buffer. Both helpers move every channel
+//  and then publish or release the whole block with a single atomic update.
+//
+
+#ifndef TPMultichannelCircularBuffer_AudioBufferList_h
+#define TPMultichannelCircularBuffer_AudioBufferList_h
+
+#include "TPMultichannelCircularBuffer.h"
+#if defined(__APPLE__)
+#include <CoreAudio/CoreAudioTypes.h>
+#else
+#include "../CoreAudioStandIn.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Copy the first `frames` frames of each buffer into the circular buffer
+ *
+ * @param buffer Circular buffer
+ * @param bufferList Non-interleaved float buffers
+ * @param frames Number of frames to copy
+ * @return true if the block was copied, false if there wasn't room for all of it (nothing is copied)
+ */
+static __inline__ __attribute__((always_inline)) bool TPMultichannelCircularBufferProduceAudioBufferList(TPMultichannelCircularBuffer *buffer, const AudioBufferList *bufferList, UInt32 frames) {
+    const UInt32 lanes = bufferList->mNumberBuffers < (UInt32)buffer->channels ? bufferList->mNumberBuffers : (UInt32)buffer->channels;
+    const int32_t bytes = frames * sizeof(AudioUnitSampleType);
+
+    if ( lanes == 0 ) return true;
+    if ( TPMultichannelCircularBufferSpace(buffer) < bytes ) return false;
+
+    for ( UInt32 i = 0; i < lanes; i++ ) {
+        memcpy(TPMultichannelCircularBufferHead(buffer, i), bufferList->mBuffers[i].mData, bytes);
+    }
+
+    TPMultichannelCircularBufferProduce(buffer, bytes);
+    return true;
+}
+
+/*!
+ * Fill each buffer in the list from the circular buffer
+ *
+ *  Copies as much as is available, up to the size of the list's buffers. If there isn't
+ *  enough to fill them, the buffers are zeroed first so that the shortfall is silence.
+ *
+ * @param buffer Circular buffer
+ * @param bufferList Non-interleaved float buffers to fill
+ * @param frames Number of frames requested
+ * @return true if there was enough audio to fill the request
+ */
+static __inline__ __attribute__((always_inline)) bool TPMultichannelCircularBufferConsumeAudioBufferList(TPMultichannelCircularBuffer *buffer, AudioBufferList *bufferList, UInt32 frames) {
+    const UInt32 lanes = bufferList->mNumberBuffers < (UInt32)buffer->channels ? bufferList->mNumberBuffers : (UInt32)buffer->channels;
+
+    if ( lanes == 0 ) return true;
+
+    const int32_t available = TPMultichannelCircularBufferFillCount(buffer);
+    const bool hasEnough = available / sizeof(AudioUnitSampleType) >= frames;
+    const int32_t bytes = bufferList->mBuffers[0].mDataByteSize < (UInt32)available ? bufferList->mBuffers[0].mDataByteSize : available;
+
+    for ( UInt32 i = 0; i < lanes; i++ ) {
+        if ( !hasEnough ) {
+            // clear buffer, so bytes that don't get written are silence instead of noise
+            memset(bufferList->mBuffers[i].mData, 0, bufferList->mBuffers[i].mDataByteSize);
+        }
+        memcpy(bufferList->mBuffers[i].mData, TPMultichannelCircularBufferTail(buffer, i), bytes);
+    }
+
+    TPMultichannelCircularBufferConsume(buffer, bytes);
+    return hasEnough;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,34 @@
+//
+//  TPMultichannelCircularBuffer.c
+//  Planar multichannel variant of TPCircularBuffer
+//
+
+#include "TPMultichannelCircularBuffer.h"
+
+bool TPMultichannelCircularBufferInit(TPMultichannelCircularBuffer *buffer, int32_t channels, int32_t length) {
+    buffer->channels = channels;
+    buffer->length   = TPCircularBufferRoundLength(length);
+    buffer->buffer   = channels > 0 ? TPCircularBufferMirroredAllocate(buffer->length, channels) : NULL;
+    buffer->head = buffer->tail = 0;
+    _TPCircularBufferCountReset(&buffer->fillCount);
+
+    if ( channels > 0 && !buffer->buffer ) {
+        buffer->channels = 0;
+        return false;
+    }
+    return true;
+}
+
+void TPMultichannelCircularBufferCleanup(TPMultichannelCircularBuffer *buffer) {
+    TPCircularBufferMirroredDeallocate(buffer->buffer, buffer->length, buffer->channels);
+    buffer->buffer   = NULL;
+    buffer->channels = 0;
+    buffer->length   = 0;
+    buffer->head = buffer->tail = 0;
+    _TPCircularBufferCountReset(&buffer->fillCount);
+}
+
+void TPMultichannelCircularBufferClear(TPMultichannelCircularBuffer *buffer) {
+    buffer->head = buffer->tail = 0;
+    _TPCircularBufferCountReset(&buffer->fillCount);
+}
@@ -0,0 +1,140 @@
+//
+//  TPMultichannelCircularBuffer.h
+//  Planar multichannel variant of TPCircularBuffer
+//
+//  All channels live in a single mirrored allocation (one lane per channel, each lane followed by
+//  its own virtual copy) and share one head, tail and fill count. A producer writes a frame range
+//  into every lane and then publishes all of them with a single atomic update, and a consumer
+//  releases them the same way.
+//
+//  As with TPCircularBuffer, this is thread-safe in the case of a single producer and single consumer.
+//
+
+#ifndef TPMultichannelCircularBuffer_h
+#define TPMultichannelCircularBuffer_h
+
+#include "TPCircularBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    void                  *buffer;
+    int32_t                channels;
+    int32_t                length;    // bytes per lane
+    int32_t                tail;      // byte offset into every lane
+    int32_t                head;      // byte offset into every lane
+    TPCircularBufferCount  fillCount; // bytes per lane
+} TPMultichannelCircularBuffer;
+
+/*!
+ * Initialise buffer
+ *
+ *  As with TPCircularBufferInit, the length is rounded up to a multiple of the page size.
+ *  A channel count of 0 leaves the buffer empty (but valid to clean up).
+ *
+ * @param buffer Circular buffer
+ * @param channels Number of lanes
+ * @param length Length of each lane, in bytes
+ */
+bool  TPMultichannelCircularBufferInit(TPMultichannelCircularBuffer *buffer, int32_t channels, int32_t length);
+
+/*!
+ * Cleanup buffer
+ *
+ *  Releases buffer resources.
+ */
+void  TPMultichannelCircularBufferCleanup(TPMultichannelCircularBuffer *buffer);
+
+/*!
+ * Clear buffer
+ *
+ *  Resets buffer to original, empty state.
+ */
+void  TPMultichannelCircularBufferClear(TPMultichannelCircularBuffer *buffer);
+
+/*!
+ * Access a lane
+ *
+ * @param buffer Circular buffer
+ * @param channel Lane index
+ * @param offset Byte offset into the lane (may run up to one lane length past the lane's end)
+ */
+static __inline__ __attribute__((always_inline)) void* TPMultichannelCircularBufferLane(TPMultichannelCircularBuffer *buffer, int32_t channel, int32_t offset) {
+    return (void*)((char*)buffer->buffer + (size_t)channel * buffer->length * 2 + offset);
+}
+
+// Reading (consuming)
+
+/*!
+ * Bytes ready for reading in every lane
+ */
+static __inline__ __attribute__((always_inline)) int32_t TPMultichannelCircularBufferFillCount(TPMultichannelCircularBuffer *buffer) {
+    return _TPCircularBufferCountLoad(&buffer->fillCount);
+}
+
+/*!
+ * Access end of a lane
+ *
+ *  Call TPMultichannelCircularBufferFillCount first to find how many bytes may be read.
+ *
+ * @param buffer Circular buffer
+ * @param channel Lane index
+ * @return Pointer to the first bytes ready for reading in that lane
+ */
+static __inline__ __attribute__((always_inline)) void* TPMultichannelCircularBufferTail(TPMultichannelCircularBuffer *buffer, int32_t channel) {
+    return TPMultichannelCircularBufferLane(buffer, channel, buffer->tail);
+}
+
+/*!
+ * Consume bytes in every lane
+ *
+ * @param buffer Circular buffer
+ * @param amount Number of bytes to consume from each lane
+ */
+static __inline__ __attribute__((always_inline)) void TPMultichannelCircularBufferConsume(TPMultichannelCircularBuffer *buffer, int32_t amount) {
+    buffer->tail = (buffer->tail + amount) % buffer->length;
+    _TPCircularBufferCountAdd(&buffer->fillCount, -amount);
+}
+
+// Writing (producing)
+
+/*!
+ * Bytes available for writing in every lane
+ */
+static __inline__ __attribute__((always_inline)) int32_t TPMultichannelCircularBufferSpace(TPMultichannelCircularBuffer *buffer) {
+    return buffer->length - _TPCircularBufferCountLoad(&buffer->fillCount);
+}
+
+/*!
+ * Access front of a lane
+ *
+ *  Call TPMultichannelCircularBufferSpace first to find how many bytes may be written.
+ *
+ * @param buffer Circular buffer
+ * @param channel Lane index
+ * @return Pointer to the first bytes ready for writing in that lane
+ */
+static __inline__ __attribute__((always_inline)) void* TPMultichannelCircularBufferHead(TPMultichannelCircularBuffer *buffer, int32_t channel) {
+    return TPMultichannelCircularBufferLane(buffer, channel, buffer->head);
+}
+
+/*!
+ * Produce bytes in every lane
+ *
+ *  This marks the given section of every lane ready for reading.
+ *
+ * @param buffer Circular buffer
+ * @param amount Number of bytes to produce in each lane
+ */
+static __inline__ __attribute__((always_inline)) void TPMultichannelCircularBufferProduce(TPMultichannelCircularBuffer *buffer, int32_t amount) {
+    buffer->head = (buffer->head + amount) % buffer->length;
+    _TPCircularBufferCountAdd(&buffer->fillCount, amount);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
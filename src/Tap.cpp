@@ -1,6 +1,8 @@
 #include "AudioUnitTap.h"
 #include "AudioUnitUtils.h"
-#include "TPCircularBuffer/TPCircularBuffer.h"
+#include "BroadcastBuffer.h"
+#include <mutex>
+#include <thread>
 
 using namespace cinder::audiounit;
 using namespace std;
@@ -27,25 +29,62 @@ typedef enum
 }
 TapSourceType;
 
+// Unless it's set, the history kept beyond samplesToTrack (so that views
+// of the most recent samples aren't overwritten the moment the next
+// render comes in) is samplesToTrack again, or this many blocks if
+// that's more. Until the Tap's told how big its blocks are, they're
+// taken to be kAssumedMaxFrames
+static const UInt32 kViewHeadroomBlocks = 4;
+static const UInt32 kAssumedMaxFrames   = 1024;
+
+static const int kMaxBlockCallbacks = 8;
+
+struct BlockCallbackSlot
+{
+	std::atomic<TapBlockCallback> proc;
+	std::atomic<void *> refCon;
+};
+
 struct TapContext
 {
 	TapSourceType sourceType;
 	GenericUnit * sourceUnit;
 	UInt32 sourceBus;
 	AURenderCallbackStruct sourceCallback;
-	vector<TPCircularBuffer> circularBuffers;
+	BroadcastBuffer buffer;
 	UInt32 samplesToTrack;
+	WaveformPyramid waveform;
+	bool waveformEnabled;
+	LevelMeter levelMeter;
+	bool levelMeteringEnabled;
+	Float64 sampleRate;
+	UInt32 maxFrames; // the biggest block it's been told to expect
+	UInt32 viewHeadroom; // 0 to work it out
+	RingHealth health;
+	
+	// the render thread bumps blockCallbacksInFlight while it's calling
+	// them, so that removeBlockCallback() knows when it's safe to return
+	BlockCallbackSlot blockCallbacks[kMaxBlockCallbacks];
+	std::atomic<int> blockCallbacksInFlight;
+	std::mutex blockCallbacksMutex;
+	
+	// the headroom has to cover at least a couple of blocks, or the
+	// newest samples would be overwritten by the very next render
+	UInt32 getHeadroom() const {
+		const UInt32 blocks = kViewHeadroomBlocks * (maxFrames > 0 ? maxFrames : kAssumedMaxFrames);
+		const UInt32 headroom = viewHeadroom > 0 ? viewHeadroom : max(samplesToTrack, blocks);
+		return max(headroom, 2 * maxFrames);
+	}
+	
+	UInt32 getCapacity() const {
+		return samplesToTrack + getHeadroom();
+	}
 	
 	void setCircularBufferCount(UInt32 bufferCount) {
-		for(int i = 0; i < circularBuffers.size(); i++) {
-			TPCircularBufferCleanup(&circularBuffers[i]);
-		}
-		
-		circularBuffers.resize(bufferCount);
-		
-		for(int i = 0; i < circularBuffers.size(); i++) {
-			TPCircularBufferInit(&circularBuffers[i], samplesToTrack * sizeof(AudioUnitSampleType));
-		}
+		buffer.allocate(bufferCount, getCapacity());
+		health.setCapacity(buffer.getCapacity());
+		waveform.allocate(waveformEnabled ? bufferCount : 0);
+		levelMeter.allocate(levelMeteringEnabled ? bufferCount : 0, sampleRate);
 	}
 };
 
@@ -58,22 +97,31 @@ Tap::Tap(unsigned int samplesToTrack) : _impl(new TapImpl)
 {
 	_impl->ctx.samplesToTrack = samplesToTrack;
 	_impl->ctx.sourceType = TapSourceNone;
+	_impl->ctx.sourceUnit = NULL;
+	_impl->ctx.waveformEnabled = false;
+	_impl->ctx.levelMeteringEnabled = false;
+	_impl->ctx.sampleRate = 44100;
+	_impl->ctx.maxFrames = 0;
+	_impl->ctx.viewHeadroom = 0;
+	_impl->ctx.blockCallbacksInFlight = 0;
+	
+	for(int i = 0; i < kMaxBlockCallbacks; i++) {
+		_impl->ctx.blockCallbacks[i].proc   = NULL;
+		_impl->ctx.blockCallbacks[i].refCon = NULL;
+	}
 	// TODO: allow non-0 source bus
 	_impl->ctx.sourceBus  = 0;
 }
 
 Tap::~Tap()
 {
-	for(int i = 0; i < _impl->ctx.circularBuffers.size(); i++) {
-		TPCircularBufferCleanup(&_impl->ctx.circularBuffers[i]);
-	}
 }
 
 #pragma mark - Connections
 
 GenericUnit& Tap::connectTo(GenericUnit &destination, UInt32 destinationBus, UInt32 sourceBus)
 {
-	if(_impl->ctx.sourceType == TapSourceNone || !_impl->ctx.sourceUnit) {
+	if(_impl->ctx.sourceType == TapSourceNone || (_impl->ctx.sourceType == TapSourceUnit && !_impl->ctx.sourceUnit)) {
 		std::cout << "Tap can't be connected without a source" << std::endl;
 		AURenderCallbackStruct silentCallback = {SilentRenderCallback};
 		destination.setRenderCallback(silentCallback);
@@ -85,6 +133,7 @@ GenericUnit& Tap::connectTo(GenericUnit &destination, UInt32 destinationBus, UIn
 	
 	AURenderCallbackStruct callback = {RenderAndCopy, &_impl->ctx};
 	destination.setRenderCallback(callback, destinationBus);
+	destination.setSource(destinationBus, NULL, this);
 	return destination;
 }
 
@@ -104,60 +153,396 @@ void Tap::setSource(GenericUnit * source)
 									  &ASBD_size),
 				 "getting tap source's ASBD");
 	
+	if(ASBD.mSampleRate > 0) _impl->ctx.sampleRate = ASBD.mSampleRate;
 	_impl->ctx.setCircularBufferCount(ASBD.mChannelsPerFrame);
 }
 
-void Tap::setSource(AURenderCallbackStruct callback, UInt32 channels)
+void Tap::setSource(AURenderCallbackStruct callback, UInt32 channels, Float64 sampleRate)
 {
 	_impl->ctx.sourceCallback = callback;
 	_impl->ctx.sourceType = TapSourceCallback;
+	_impl->ctx.sampleRate = sampleRate;
 	
 	_impl->ctx.setCircularBufferCount(channels);
 }
 
-#pragma mark - Getting samples
+GenericUnit * Tap::getSourceUnit() const
+{
+	return _impl->ctx.sourceType == TapSourceUnit ? _impl->ctx.sourceUnit : NULL;
+}
 
-void ExtractSamplesFromCircularBuffer(TapSampleBuffer &outBuffer, TPCircularBuffer * circularBuffer)
+bool Tap::setMaximumFramesPerSlice(UInt32 frames)
 {
-	if(circularBuffer == nullptr) {
-		outBuffer.clear();
-	} else {
-		int32_t circBufferSize;
-		AudioUnitSampleType * circBufferTail = (AudioUnitSampleType *)TPCircularBufferTail(circularBuffer, &circBufferSize);
-		AudioUnitSampleType * circBufferHead = circBufferTail + (circBufferSize / sizeof(AudioUnitSampleType));
+	TapContext &ctx = _impl->ctx;
+	const UInt32 capacity = ctx.getCapacity();
+	ctx.maxFrames = max(ctx.maxFrames, frames);
+	
+	// the history's only reallocated if it's grown (and there is one yet)
+	if(ctx.getCapacity() > capacity && ctx.buffer.getChannelCount() > 0) {
+		ctx.buffer.allocate(ctx.buffer.getChannelCount(), ctx.getCapacity());
+		ctx.health.setCapacity(ctx.buffer.getCapacity());
+	}
+	
+	return true;
+}
+
+void Tap::setViewHeadroom(UInt32 frames)
+{
+	TapContext &ctx = _impl->ctx;
+	const UInt32 capacity = ctx.getCapacity();
+	ctx.viewHeadroom = frames;
+	
+	if(ctx.getCapacity() != capacity && ctx.buffer.getChannelCount() > 0) {
+		ctx.buffer.allocate(ctx.buffer.getChannelCount(), ctx.getCapacity());
+		ctx.health.setCapacity(ctx.buffer.getCapacity());
+	}
+}
+
+UInt32 Tap::getViewHeadroom() const
+{
+	return _impl->ctx.getHeadroom();
+}
+
+OSStatus Tap::render(AudioUnitRenderActionFlags *ioActionFlags,
+					 const AudioTimeStamp *inTimeStamp,
+					 UInt32 inOutputBusNumber,
+					 UInt32 inNumberFrames,
+					 AudioBufferList *ioData)
+{
+	return RenderAndCopy(&_impl->ctx, ioActionFlags, inTimeStamp, inOutputBusNumber, inNumberFrames, ioData);
+}
+
+UInt32 Tap::getChannelCount() const
+{
+	return _impl->ctx.buffer.getChannelCount();
+}
+
+Float64 Tap::getSampleRate() const
+{
+	return _impl->ctx.sampleRate;
+}
+
+#pragma mark - Block callbacks
+
+bool Tap::addBlockCallback(TapBlockCallback callback, void * refCon)
+{
+	std::lock_guard<std::mutex> lock(_impl->ctx.blockCallbacksMutex);
+	
+	for(int i = 0; i < kMaxBlockCallbacks; i++) {
+		BlockCallbackSlot &slot = _impl->ctx.blockCallbacks[i];
+		
+		if(slot.proc.load() == NULL) {
+			// the refCon has to be in place before the render thread can see the proc
+			slot.refCon.store(refCon);
+			slot.proc.store(callback);
+			return true;
+		}
+	}
+	
+	std::cout << "Tap can't have more than " << kMaxBlockCallbacks << " block callbacks" << std::endl;
+	return false;
+}
+
+void Tap::removeBlockCallback(TapBlockCallback callback, void * refCon)
+{
+	std::lock_guard<std::mutex> lock(_impl->ctx.blockCallbacksMutex);
+	
+	for(int i = 0; i < kMaxBlockCallbacks; i++) {
+		BlockCallbackSlot &slot = _impl->ctx.blockCallbacks[i];
 		
-		outBuffer.assign(circBufferTail, circBufferHead);
+		if(slot.proc.load() == callback && slot.refCon.load() == refCon) {
+			slot.proc.store(NULL);
+		}
+	}
+	
+	// if the render thread is calling the callbacks right now, it might
+	// still have hold of this one
+	while(_impl->ctx.blockCallbacksInFlight.load() > 0) {
+		std::this_thread::yield();
+	}
+}
+
+static void CallBlockCallbacks(TapContext * ctx, const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp)
+{
+	ctx->blockCallbacksInFlight.fetch_add(1);
+	
+	for(int i = 0; i < kMaxBlockCallbacks; i++) {
+		TapBlockCallback proc = ctx->blockCallbacks[i].proc.load();
+		if(proc) {
+			proc(ctx->blockCallbacks[i].refCon.load(), bufferList, frames, timeStamp);
+		}
+	}
+	
+	ctx->blockCallbacksInFlight.fetch_sub(1);
+}
+
+#pragma mark - Getting samples
+
+TapView Tap::getView() const
+{
+	return _impl->ctx.buffer.viewLatest(_impl->ctx.samplesToTrack);
+}
+
+void Tap::setWaveformEnabled(bool enabled)
+{
+	_impl->ctx.waveformEnabled = enabled;
+	_impl->ctx.waveform.allocate(enabled ? _impl->ctx.buffer.getChannelCount() : 0);
+}
+
+bool Tap::isWaveformEnabled() const
+{
+	return _impl->ctx.waveformEnabled;
+}
+
+void Tap::getWaveform(std::vector<WaveformColumn> &columns, UInt32 columnCount, UInt32 framesToShow, UInt32 channel) const
+{
+	if(_impl->ctx.waveformEnabled) {
+		for(int attempt = 0; attempt < 3; attempt++) {
+			if(_impl->ctx.waveform.getColumns(columns, columnCount, framesToShow, channel)) return;
+		}
+	}
+	
+	// too far zoomed in for the pyramid (or it's turned off), so
+	// the columns come straight from the samples
+	for(int attempt = 0; attempt < 3; attempt++) {
+		const TapView view = _impl->ctx.buffer.viewLatest(framesToShow);
+		WaveformPyramid::summarize(columns, columnCount, view.getChannel(channel), view.size());
+		if(view.isValid()) return;
+	}
+}
+
+void ExtractSamplesFromTap(vector<TapSampleBuffer> &outBuffers, const Tap &tap)
+{
+	// copyTo() never hands back torn samples, but if the writer lapped
+	// us mid-copy the snapshot comes back short, so we try again with
+	// the newest audio (and settle for the short one if that keeps happening)
+	for(int attempt = 0; attempt < 3; attempt++) {
+		if(tap.getView().copyTo(outBuffers)) return;
 	}
 }
 
 void Tap::getSamples(TapSampleBuffer &buffer)
 {
-	ExtractSamplesFromCircularBuffer(buffer, &_impl->ctx.circularBuffers.front());
+	vector<TapSampleBuffer> buffers(1);
+	buffers[0].swap(buffer);
+	ExtractSamplesFromTap(buffers, *this);
+	buffers[0].swap(buffer);
 }
 
 void Tap::getSamples(std::vector<TapSampleBuffer> &buffers)
 {
-	const size_t buffersToCopy = min(buffers.size(), _impl->ctx.circularBuffers.size());
-	
-	for(int i = 0; i < buffersToCopy; i++) {
-		ExtractSamplesFromCircularBuffer(buffers[i], &_impl->ctx.circularBuffers[i]);
+	ExtractSamplesFromTap(buffers, *this);
+}
+
+#pragma mark - Levels
+
+void Tap::setLevelMeteringEnabled(bool enabled)
+{
+	_impl->ctx.levelMeteringEnabled = enabled;
+	_impl->ctx.levelMeter.allocate(enabled ? _impl->ctx.buffer.getChannelCount() : 0, _impl->ctx.sampleRate);
+}
+
+bool Tap::isLevelMeteringEnabled() const
+{
+	return _impl->ctx.levelMeteringEnabled;
+}
+
+LevelReading Tap::getLevels(UInt32 channel) const
+{
+	return _impl->ctx.levelMeter.getLevels(channel);
+}
+
+LevelMeter& Tap::getLevelMeter()
+{
+	return _impl->ctx.levelMeter;
+}
+
+#pragma mark - Ring Health
+
+RingHealthReading Tap::getRingHealth(bool reset)
+{
+	return _impl->ctx.health.getReading(reset);
+}
+
+void Tap::resetRingHealth()
+{
+	_impl->ctx.health.reset();
+}
+
+#pragma mark - Readers
+
+TapReader::TapReader()
+{
+}
+
+TapReader::TapReader(const Tap &tap)
+: _tapImpl(tap._impl)
+{
+	_cursor = tap._impl->ctx.buffer.cursorAtWritePosition();
+}
+
+bool TapReader::read(TapSampleBuffer &buffer, UInt32 maxFrames)
+{
+	vector<TapSampleBuffer> buffers(1);
+	buffers[0].swap(buffer);
+	bool kept = read(buffers, maxFrames);
+	buffers[0].swap(buffer);
+	return kept;
+}
+
+// Readers report how far behind the Tap they were when they came to
+// read, and anything they had to skip because the Tap lapped them
+static inline void RecordFill(TapContext &ctx, const BroadcastBuffer::Cursor &cursor)
+{
+	ctx.health.recordFill(ctx.buffer.getWritePosition() - cursor.position);
+}
+
+static inline void RecordDropped(TapContext &ctx, const BroadcastBuffer::Cursor &cursor, UInt64 droppedBefore)
+{
+	if(cursor.framesDropped > droppedBefore) {
+		ctx.health.recordOverrun(cursor.framesDropped - droppedBefore);
 	}
 }
 
-#pragma mark - Render callbacks
+bool TapReader::read(std::vector<TapSampleBuffer> &buffers, UInt32 maxFrames)
+{
+	if(!_tapImpl) {
+		buffers.clear();
+		return true;
+	}
+	
+	const UInt64 dropped = _cursor.framesDropped;
+	RecordFill(_tapImpl->ctx, _cursor);
+	
+	const bool kept = _tapImpl->ctx.buffer.read(_cursor, buffers, maxFrames);
+	RecordDropped(_tapImpl->ctx, _cursor, dropped);
+	return kept;
+}
 
-inline void CopyAudioBufferIntoCircularBuffer(TPCircularBuffer * circBuffer, const AudioBuffer &audioBuffer)
+TapView TapReader::readView(UInt32 maxFrames)
 {
-	int32_t availableBytesInCircBuffer;
-	TPCircularBufferHead(circBuffer, &availableBytesInCircBuffer);
+	if(!_tapImpl) return TapView();
+	
+	const UInt64 dropped = _cursor.framesDropped;
+	RecordFill(_tapImpl->ctx, _cursor);
 	
-	if(availableBytesInCircBuffer < audioBuffer.mDataByteSize) {
-		TPCircularBufferConsume(circBuffer, audioBuffer.mDataByteSize - availableBytesInCircBuffer);
+	const TapView view = _tapImpl->ctx.buffer.readView(_cursor, maxFrames);
+	RecordDropped(_tapImpl->ctx, _cursor, dropped);
+	return view;
+}
+
+UInt32 TapReader::getAvailableFrames() const
+{
+	return _tapImpl ? _tapImpl->ctx.buffer.getAvailableFrames(_cursor) : 0;
+}
+
+#pragma mark - Groups
+
+TapGroup::TapGroup()
+{
+}
+
+void TapGroup::add(const Tap &tap)
+{
+	_taps.push_back(tap._impl);
+}
+
+void TapGroup::clear()
+{
+	_taps.clear();
+}
+
+bool TapGroup::getViews(std::vector<TapView> &views, UInt32 frames, Float64 * sampleTime) const
+{
+	views.assign(_taps.size(), TapView());
+	if(_taps.empty()) return false;
+	
+	// the common range ends where the Tap that's furthest behind ends,
+	// and can't start before the Tap with the shortest history starts
+	Float64 end = 0, start = 0;
+	
+	for(size_t i = 0; i < _taps.size(); i++) {
+		const BroadcastBuffer &buffer = _taps[i]->ctx.buffer;
+		const UInt64 writePosition = buffer.getWritePosition();
+		Float64 newest;
+		
+		if(writePosition == 0 || !buffer.sampleTimeForPosition(writePosition - 1, newest)) {
+			return false;
+		}
+		
+		// (assuming the history has no gaps in it; if it does, that's caught below)
+		const Float64 oldest = newest + 1 - (writePosition - buffer.getOldestPosition());
+		
+		end   = (i == 0) ? newest + 1 : min(end, newest + 1);
+		start = (i == 0) ? oldest : max(start, oldest);
+	}
+	
+	if(end <= start) return false;
+	
+	start = max(start, end - frames);
+	const UInt32 framesInCommon = end - start;
+	
+	for(size_t i = 0; i < _taps.size(); i++) {
+		const BroadcastBuffer &buffer = _taps[i]->ctx.buffer;
+		UInt64 position;
+		
+		if(!buffer.positionForSampleTime(start, position)) return false;
+		views[i] = buffer.view(position, framesInCommon);
+		
+		// a Tap whose timeline has a gap in it can't be lined up with the others
+		if(views[i].size() != framesInCommon) return false;
+	}
+	
+	if(sampleTime) *sampleTime = start;
+	return true;
+}
+
+// Copies the group's views into buffers, with as many channels per
+// Tap as there are in buffers[i] (or all of them, if allChannels is set)
+static bool CopyAlignedSamples(const TapGroup &group, vector<vector<TapSampleBuffer> > &buffers, UInt32 frames, Float64 * sampleTime, bool allChannels)
+{
+	buffers.resize(group.size());
+	
+	// as with Tap::getSamples(), a copy that got lapped by the writer
+	// comes back short, so we try again with the newest audio
+	for(int attempt = 0; attempt < 3; attempt++) {
+		vector<TapView> views;
+		if(!group.getViews(views, frames, sampleTime)) break;
+		
+		bool intact = true;
+		for(size_t i = 0; i < views.size(); i++) {
+			if(allChannels) buffers[i].resize(views[i].getChannelCount());
+			intact = views[i].copyTo(buffers[i]) && intact;
+		}
+		
+		if(intact) return true;
+	}
+	
+	for(size_t i = 0; i < buffers.size(); i++) {
+		for(size_t ch = 0; ch < buffers[i].size(); ch++) buffers[i][ch].clear();
 	}
+	return false;
+}
 
-	TPCircularBufferProduceBytes(circBuffer, audioBuffer.mData, audioBuffer.mDataByteSize);
+bool TapGroup::getSamples(std::vector<std::vector<TapSampleBuffer> > &buffers, UInt32 frames, Float64 * sampleTime) const
+{
+	return CopyAlignedSamples(*this, buffers, frames, sampleTime, true);
 }
 
+bool TapGroup::getSamples(std::vector<TapSampleBuffer> &buffers, UInt32 frames, Float64 * sampleTime) const
+{
+	vector<vector<TapSampleBuffer> > mono(_taps.size(), vector<TapSampleBuffer>(1));
+	for(size_t i = 0; i < min(buffers.size(), mono.size()); i++) mono[i][0].swap(buffers[i]);
+	
+	const bool aligned = CopyAlignedSamples(*this, mono, frames, sampleTime, false);
+	
+	buffers.resize(mono.size());
+	for(size_t i = 0; i < buffers.size(); i++) buffers[i].swap(mono[i][0]);
+	return aligned;
+}
+
+#pragma mark - Render callbacks
+
 OSStatus RenderAndCopy(void * inRefCon,
 					   AudioUnitRenderActionFlags * ioActionFlags,
 					   const AudioTimeStamp * inTimeStamp,
@@ -185,11 +570,20 @@ OSStatus RenderAndCopy(void * inRefCon,
 	}
 	
 	if(status == noErr) {
-		const size_t buffersToCopy = min(ctx->circularBuffers.size(), ioData->mNumberBuffers);
+		// written once, no matter how many readers there are. The timestamp
+		// lets readers line this Tap up with others (see TapGroup)
+		ctx->buffer.write(ioData, inNumberFrames, inTimeStamp);
+		ctx->waveform.write(ioData, inNumberFrames);
+		ctx->levelMeter.process(ioData, inNumberFrames);
+		CallBlockCallbacks(ctx, ioData, inNumberFrames, inTimeStamp);
 		
-		for(int i = 0; i < buffersToCopy; i++) {
-			CopyAudioBufferIntoCircularBuffer(&ctx->circularBuffers[i], ioData->mBuffers[i]);
+		// a block longer than the whole history only has its end kept
+		if(inNumberFrames > ctx->buffer.getCapacity()) {
+			ctx->health.recordOverrun(inNumberFrames - ctx->buffer.getCapacity());
 		}
+	} else {
+		// the source didn't render, so there's a gap in the history
+		ctx->health.recordUnderrun(inNumberFrames);
 	}
 	
 	return status;
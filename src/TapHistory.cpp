@@ -0,0 +1,460 @@
+#include "AudioUnitTapHistory.h"
+#include "DSP.h"
+#include "RealtimeMemory.h"
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <new>
+#include <string.h>
+#include <thread>
+
+using namespace cinder::audiounit;
+using namespace std;
+
+static const UInt32 kBlockFrames = TapHistory::kBlockFrames;
+
+// Same idea as BroadcastBuffer's block records: sequence is zeroed
+// while the writer encodes the block, and set to the block's number
+// (+1) once it's done
+struct HistoryBlock
+{
+	std::atomic<UInt64> sequence;
+	Float64 sampleTime;
+	
+	HistoryBlock() : sequence(0), sampleTime(0) {}
+};
+
+struct TapHistory::HistoryImpl
+{
+	Tap tap;
+	bool attachedToTap;
+	
+	UInt32 channels;
+	Float64 sampleRate;
+	TapHistoryEncoding encoding;
+	UInt32 bytesPerSample;
+	UInt32 blockCount;
+	
+	HistoryBlock * blocks;
+	float * scales; // [block][channel], for TapHistoryBlockFloat
+	UInt8 * data;   // [block][channel][frame]
+	std::atomic<UInt64> blocksWritten;
+	
+	// writer only: the block that's being filled in
+	float * staging; // [channel][frame]
+	UInt32 stagedFrames;
+	Float64 stagingSampleTime;
+	Float64 nextSampleTime;
+	
+	// same as Recorder: lets stop() wait out a process() call that's in progress
+	std::atomic<bool> running;
+	std::atomic<int> inFlight;
+	
+	HistoryImpl()
+	: attachedToTap(false)
+	, channels(0)
+	, sampleRate(0)
+	, encoding(TapHistoryBlockFloat)
+	, bytesPerSample(0)
+	, blockCount(0)
+	, blocks(NULL)
+	, scales(NULL)
+	, data(NULL)
+	, blocksWritten(0)
+	, staging(NULL)
+	, stagedFrames(0)
+	, stagingSampleTime(0)
+	, nextSampleTime(0)
+	, running(false)
+	, inFlight(0)
+	{
+	}
+	
+	~HistoryImpl()
+	{
+		close();
+	}
+	
+	bool open(UInt32 channels, Float64 sampleRate, Float64 seconds, TapHistoryEncoding encoding)
+	{
+		if(channels == 0 || sampleRate <= 0 || seconds <= 0) {
+			std::cout << "TapHistory needs at least one channel, a sample rate and a length" << std::endl;
+			return false;
+		}
+		
+		this->channels   = channels;
+		this->sampleRate = sampleRate;
+		this->encoding   = encoding;
+		bytesPerSample   = encoding == TapHistoryInt24 ? 3 : 2;
+		
+		// one block more than asked for, since the oldest one is the
+		// one that's being overwritten
+		blockCount = ceil(seconds * sampleRate / kBlockFrames) + 1;
+		
+		void * blockMemory = RealtimeMemory::allocate(sizeof(HistoryBlock) * blockCount);
+		scales  = (float *)RealtimeMemory::allocate(sizeof(float) * blockCount * channels);
+		data    = (UInt8 *)RealtimeMemory::allocate((size_t)blockCount * channels * kBlockFrames * bytesPerSample);
+		staging = (float *)RealtimeMemory::allocate(sizeof(float) * channels * kBlockFrames);
+		
+		if(!blockMemory || !scales || !data || !staging) {
+			std::cout << "TapHistory couldn't allocate " << getMemoryUsage() << " bytes" << std::endl;
+			RealtimeMemory::deallocate(blockMemory);
+			blockCount = 0;
+			release();
+			return false;
+		}
+		
+		blocks = static_cast<HistoryBlock *>(blockMemory);
+		for(UInt32 i = 0; i < blockCount; i++) new (&blocks[i]) HistoryBlock();
+		
+		blocksWritten  = 0;
+		stagedFrames   = 0;
+		nextSampleTime = 0;
+		running = true;
+		return true;
+	}
+	
+	void close()
+	{
+		if(attachedToTap) {
+			tap.removeBlockCallback(RecordBlock, this);
+			tap = Tap();
+			attachedToTap = false;
+		}
+		
+		running = false;
+		while(inFlight.load() > 0) {
+			std::this_thread::yield();
+		}
+		
+		release();
+	}
+	
+	void release()
+	{
+		for(UInt32 i = 0; blocks && i < blockCount; i++) blocks[i].~HistoryBlock();
+		
+		RealtimeMemory::deallocate(blocks);
+		RealtimeMemory::deallocate(scales);
+		RealtimeMemory::deallocate(data);
+		RealtimeMemory::deallocate(staging);
+		blocks  = NULL;
+		scales  = NULL;
+		data    = NULL;
+		staging = NULL;
+		blockCount = 0;
+		blocksWritten = 0;
+	}
+	
+	size_t getMemoryUsage() const
+	{
+		return (size_t)blockCount * (sizeof(HistoryBlock) + channels * (sizeof(float) + kBlockFrames * bytesPerSample)) +
+			   sizeof(float) * channels * kBlockFrames;
+	}
+	
+	UInt8 * blockData(UInt64 block, UInt32 channel) const
+	{
+		return data + ((block % blockCount) * channels + channel) * kBlockFrames * bytesPerSample;
+	}
+	
+	float & blockScale(UInt64 block, UInt32 channel) const
+	{
+		return scales[(block % blockCount) * channels + channel];
+	}
+	
+	bool isBlockIntact(UInt64 block) const
+	{
+		return blocks[block % blockCount].sequence.load(memory_order_relaxed) == block + 1;
+	}
+	
+	UInt64 oldestBlock() const
+	{
+		const UInt64 written = blocksWritten.load(memory_order_acquire);
+		return written >= blockCount ? written - (blockCount - 1) : 0;
+	}
+	
+	#pragma mark Writing
+	
+	void write(const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp)
+	{
+		inFlight.fetch_add(1);
+		
+		if(running.load()) {
+			if(timeStamp && (timeStamp->mFlags & kAudioTimeStampSampleTimeValid)) {
+				nextSampleTime = timeStamp->mSampleTime;
+			}
+			
+			for(UInt32 done = 0; done < frames; ) {
+				if(stagedFrames == 0) stagingSampleTime = nextSampleTime;
+				
+				const UInt32 n = min(kBlockFrames - stagedFrames, frames - done);
+				
+				for(UInt32 ch = 0; ch < channels; ch++) {
+					float * out = staging + ch * kBlockFrames + stagedFrames;
+					if(ch < bufferList->mNumberBuffers && bufferList->mBuffers[ch].mData) {
+						memcpy(out, (const float *)bufferList->mBuffers[ch].mData + done, n * sizeof(float));
+					} else {
+						memset(out, 0, n * sizeof(float));
+					}
+				}
+				
+				stagedFrames   += n;
+				nextSampleTime += n;
+				done += n;
+				
+				if(stagedFrames == kBlockFrames) {
+					encodeBlock();
+					stagedFrames = 0;
+				}
+			}
+		}
+		
+		inFlight.fetch_sub(1);
+	}
+	
+	void encodeBlock()
+	{
+		const UInt64 block = blocksWritten.load(memory_order_relaxed);
+		HistoryBlock &record = blocks[block % blockCount];
+		
+		record.sequence.store(0, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+		record.sampleTime = stagingSampleTime;
+		
+		for(UInt32 ch = 0; ch < channels; ch++) {
+			const float * in = staging + ch * kBlockFrames;
+			UInt8 * out = blockData(block, ch);
+			
+			if(encoding == TapHistoryInt16) {
+				DSP::floatToInt16(in, (SInt16 *)out, kBlockFrames, 32767);
+			} else if(encoding == TapHistoryInt24) {
+				DSP::floatToInt24(in, out, kBlockFrames, 8388607);
+			} else {
+				// the loudest sample in the block maps to full scale
+				const float peak  = DSP::maxMagnitude(in, kBlockFrames);
+				const float scale = peak > 0 ? peak / 32767 : 1;
+				blockScale(block, ch) = scale;
+				DSP::floatToInt16(in, (SInt16 *)out, kBlockFrames, 1 / scale);
+			}
+		}
+		
+		record.sequence.store(block + 1, memory_order_release);
+		blocksWritten.store(block + 1, memory_order_release);
+	}
+	
+	static void RecordBlock(void * refCon, const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp)
+	{
+		static_cast<HistoryImpl *>(refCon)->write(bufferList, frames, timeStamp);
+	}
+	
+	#pragma mark Reading
+	
+	void decode(UInt64 block, UInt32 channel, UInt32 offset, UInt32 frames, float * out) const
+	{
+		const UInt8 * in = blockData(block, channel) + offset * bytesPerSample;
+		
+		if(encoding == TapHistoryInt16) {
+			DSP::int16ToFloat((const SInt16 *)in, out, frames, 1 / 32767.f);
+		} else if(encoding == TapHistoryInt24) {
+			DSP::int24ToFloat(in, out, frames, 1 / 8388607.f);
+		} else {
+			DSP::int16ToFloat((const SInt16 *)in, out, frames, blockScale(block, channel));
+		}
+	}
+	
+	UInt64 read(UInt64 position, UInt32 frames, vector<TapSampleBuffer> &buffers) const
+	{
+		buffers.resize(channels);
+		
+		const UInt64 end   = blocksWritten.load(memory_order_acquire) * kBlockFrames;
+		const UInt64 start = max(position, oldestBlock() * kBlockFrames);
+		const UInt64 stop  = min(position + frames, end);
+		
+		if(start >= stop) {
+			for(UInt32 ch = 0; ch < channels; ch++) buffers[ch].clear();
+			return min(start, end);
+		}
+		
+		for(UInt32 ch = 0; ch < channels; ch++) buffers[ch].resize(stop - start);
+		
+		for(UInt64 p = start; p < stop; ) {
+			const UInt64 block  = p / kBlockFrames;
+			const UInt32 offset = p % kBlockFrames;
+			const UInt32 n = min<UInt64>(kBlockFrames - offset, stop - p);
+			
+			for(UInt32 ch = 0; ch < channels; ch++) {
+				decode(block, ch, offset, n, &buffers[ch][p - start]);
+			}
+			
+			p += n;
+		}
+		
+		// the writer overwrites the oldest blocks first, so anything it
+		// got to while we were decoding is at the front
+		atomic_thread_fence(memory_order_acquire);
+		
+		UInt64 intactFrom = start;
+		for(UInt64 block = start / kBlockFrames; block <= (stop - 1) / kBlockFrames; block++) {
+			if(!isBlockIntact(block)) intactFrom = min(stop, (block + 1) * kBlockFrames);
+		}
+		
+		if(intactFrom > start) {
+			for(UInt32 ch = 0; ch < channels; ch++) {
+				buffers[ch].erase(buffers[ch].begin(), buffers[ch].begin() + (intactFrom - start));
+			}
+		}
+		
+		return intactFrom;
+	}
+	
+	bool blockSampleTime(UInt64 block, Float64 &sampleTime) const
+	{
+		const HistoryBlock &record = blocks[block % blockCount];
+		
+		if(record.sequence.load(memory_order_acquire) != block + 1) return false;
+		const Float64 t = record.sampleTime;
+		atomic_thread_fence(memory_order_acquire);
+		if(record.sequence.load(memory_order_relaxed) != block + 1) return false;
+		
+		sampleTime = t;
+		return true;
+	}
+};
+
+#pragma mark - TapHistory
+
+TapHistory::TapHistory() : _impl(new HistoryImpl)
+{
+}
+
+TapHistory::~TapHistory()
+{
+}
+
+bool TapHistory::start(Tap &tap, Float64 seconds, TapHistoryEncoding encoding)
+{
+	stop();
+	
+	if(tap.getChannelCount() == 0) {
+		std::cout << "TapHistory can't follow a Tap without a source" << std::endl;
+		return false;
+	}
+	
+	if(!_impl->open(tap.getChannelCount(), tap.getSampleRate(), seconds, encoding)) {
+		return false;
+	}
+	
+	if(!tap.addBlockCallback(HistoryImpl::RecordBlock, _impl.get())) {
+		_impl->close();
+		return false;
+	}
+	
+	_impl->tap = tap;
+	_impl->attachedToTap = true;
+	return true;
+}
+
+bool TapHistory::start(UInt32 channels, Float64 sampleRate, Float64 seconds, TapHistoryEncoding encoding)
+{
+	stop();
+	return _impl->open(channels, sampleRate, seconds, encoding);
+}
+
+void TapHistory::stop()
+{
+	_impl->close();
+}
+
+UInt32 TapHistory::getChannelCount() const
+{
+	return _impl->blocks ? _impl->channels : 0;
+}
+
+Float64 TapHistory::getSampleRate() const
+{
+	return _impl->sampleRate;
+}
+
+TapHistoryEncoding TapHistory::getEncoding() const
+{
+	return _impl->encoding;
+}
+
+size_t TapHistory::getMemoryUsage() const
+{
+	return _impl->getMemoryUsage();
+}
+
+UInt64 TapHistory::getOldestPosition() const
+{
+	return _impl->blocks ? _impl->oldestBlock() * kBlockFrames : 0;
+}
+
+UInt64 TapHistory::getEndPosition() const
+{
+	return _impl->blocksWritten.load() * kBlockFrames;
+}
+
+bool TapHistory::sampleTimeForPosition(UInt64 position, Float64 &sampleTime) const
+{
+	if(!_impl->blocks || position >= getEndPosition() || position < getOldestPosition()) return false;
+	
+	Float64 blockTime;
+	if(!_impl->blockSampleTime(position / kBlockFrames, blockTime)) return false;
+	
+	sampleTime = blockTime + position % kBlockFrames;
+	return true;
+}
+
+bool TapHistory::positionForSampleTime(Float64 sampleTime, UInt64 &position) const
+{
+	if(!_impl->blocks) return false;
+	
+	// blocks are in sample time order (as long as the timestamps are),
+	// so this looks for the last block that starts at or before sampleTime
+	UInt64 lo = _impl->oldestBlock();
+	UInt64 hi = _impl->blocksWritten.load(memory_order_acquire);
+	Float64 t;
+	
+	if(lo >= hi) return false;
+	
+	while(hi - lo > 1) {
+		const UInt64 mid = lo + (hi - lo) / 2;
+		if(!_impl->blockSampleTime(mid, t)) {
+			// overwritten while we were looking, so it's older than anything
+			// we're interested in
+			lo = mid;
+			continue;
+		}
+		if(t <= sampleTime) lo = mid; else hi = mid;
+	}
+	
+	if(!_impl->blockSampleTime(lo, t) || sampleTime < t || sampleTime >= t + kBlockFrames) return false;
+	
+	position = lo * kBlockFrames + (UInt64)(sampleTime - t);
+	return true;
+}
+
+UInt64 TapHistory::read(UInt64 position, UInt32 frames, std::vector<TapSampleBuffer> &buffers) const
+{
+	if(!_impl->blocks) {
+		buffers.clear();
+		return position;
+	}
+	
+	return _impl->read(position, frames, buffers);
+}
+
+bool TapHistory::readAtSampleTime(Float64 sampleTime, UInt32 frames, std::vector<TapSampleBuffer> &buffers) const
+{
+	UInt64 position;
+	if(!positionForSampleTime(sampleTime, position)) return false;
+	
+	const UInt64 first = read(position, frames, buffers);
+	return first == position && !buffers.empty() && buffers[0].size() == frames;
+}
+
+void TapHistory::process(const AudioBufferList * bufferList, UInt32 frames, const AudioTimeStamp * timeStamp)
+{
+	_impl->write(bufferList, frames, timeStamp);
+}
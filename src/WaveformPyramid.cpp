@@ -0,0 +1,217 @@
+#include "WaveformPyramid.h"
+#include "RealtimeMemory.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+using namespace cinder::audiounit;
+using namespace std;
+
+// Reading too close to the oldest summaries means racing the writer
+// for them, so readers stay this far away
+static const UInt32 kBucketsOfHeadroom = WaveformPyramid::kBucketsPerLevel / 8;
+
+WaveformPyramid::WaveformPyramid()
+: _memory(NULL)
+, _partial(NULL)
+, _channels(0)
+, _framesWritten(0)
+, _reservePosition(0)
+, _writePosition(0)
+{
+}
+
+WaveformPyramid::~WaveformPyramid()
+{
+	release();
+}
+
+bool WaveformPyramid::allocate(UInt32 channels)
+{
+	release();
+	
+	if(channels == 0) return true;
+	
+	_memory  = (Bucket *)RealtimeMemory::allocate(sizeof(Bucket) * kLevels * channels * kBucketsPerLevel);
+	_partial = (Bucket *)RealtimeMemory::allocate(sizeof(Bucket) * kLevels * channels);
+	
+	if(!_memory || !_partial) {
+		release();
+		return false;
+	}
+	
+	for(UInt32 i = 0; i < kLevels * channels; i++) {
+		_partial[i].min = FLT_MAX;
+		_partial[i].max = -FLT_MAX;
+	}
+	
+	_channels = channels;
+	return true;
+}
+
+void WaveformPyramid::release()
+{
+	RealtimeMemory::deallocate(_memory);
+	RealtimeMemory::deallocate(_partial);
+	_memory   = NULL;
+	_partial  = NULL;
+	_channels = 0;
+	_framesWritten = 0;
+	_reservePosition.store(0);
+	_writePosition.store(0);
+}
+
+UInt32 WaveformPyramid::framesPerBucket(UInt32 level)
+{
+	UInt32 frames = kFramesPerBucket;
+	for(UInt32 i = 0; i < level; i++) frames *= kBucketsPerBucket;
+	return frames;
+}
+
+WaveformPyramid::Bucket * WaveformPyramid::level(UInt32 level, UInt32 channel) const
+{
+	return _memory + ((size_t)level * _channels + channel) * kBucketsPerLevel;
+}
+
+#pragma mark - Writing
+
+void WaveformPyramid::write(const AudioBufferList * bufferList, UInt32 inNumberFrames)
+{
+	if(!_memory || inNumberFrames == 0) return;
+	
+	const UInt64 start = _framesWritten;
+	const UInt64 end   = start + inNumberFrames;
+	
+	_reservePosition.store(end, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	
+	for(UInt32 ch = 0; ch < _channels; ch++) {
+		const AudioUnitSampleType * samples = ch < bufferList->mNumberBuffers ? (const AudioUnitSampleType *)bufferList->mBuffers[ch].mData : NULL;
+		Bucket &bucket = _partial[ch * kLevels];
+		UInt32 i = 0;
+		
+		while(i < inNumberFrames) {
+			const UInt32 run = min(inNumberFrames - i, kFramesPerBucket - bucket.count);
+			float lo = bucket.min, hi = bucket.max, sum = bucket.sumOfSquares;
+			
+			if(samples) {
+				for(UInt32 j = i; j < i + run; j++) {
+					lo   = min(lo, samples[j]);
+					hi   = max(hi, samples[j]);
+					sum += samples[j] * samples[j];
+				}
+			} else {
+				lo = min(lo, 0.f);
+				hi = max(hi, 0.f);
+			}
+			
+			bucket.min = lo;
+			bucket.max = hi;
+			bucket.sumOfSquares = sum;
+			bucket.count += run;
+			i += run;
+			
+			if(bucket.count == kFramesPerBucket) {
+				finishBucket(ch, 0, (start + i) / kFramesPerBucket - 1);
+			}
+		}
+	}
+	
+	_framesWritten = end;
+	_writePosition.store(end, memory_order_release);
+}
+
+void WaveformPyramid::finishBucket(UInt32 channel, UInt32 lvl, UInt64 bucketIndex)
+{
+	Bucket &bucket = _partial[channel * kLevels + lvl];
+	level(lvl, channel)[bucketIndex % kBucketsPerLevel] = bucket;
+	
+	if(lvl + 1 < kLevels) {
+		Bucket &parent = _partial[channel * kLevels + lvl + 1];
+		parent.min = min(parent.min, bucket.min);
+		parent.max = max(parent.max, bucket.max);
+		parent.sumOfSquares += bucket.sumOfSquares;
+		
+		if(++parent.count == kBucketsPerBucket) {
+			finishBucket(channel, lvl + 1, bucketIndex / kBucketsPerBucket);
+		}
+	}
+	
+	bucket.min = FLT_MAX;
+	bucket.max = -FLT_MAX;
+	bucket.sumOfSquares = 0;
+	bucket.count = 0;
+}
+
+#pragma mark - Reading
+
+bool WaveformPyramid::getColumns(vector<WaveformColumn> &columns, UInt32 columnCount, UInt32 framesToShow, UInt32 channel) const
+{
+	const WaveformColumn silence = {0, 0, 0};
+	columns.assign(columnCount, silence);
+	
+	if(!_memory || channel >= _channels || columnCount == 0) return true;
+	
+	const UInt32 framesPerColumn = framesToShow / columnCount;
+	if(framesPerColumn < kFramesPerBucket) return false;
+	
+	// the coarsest level that still has at least one bucket per column
+	UInt32 lvl = 0;
+	while(lvl + 1 < kLevels && framesPerBucket(lvl + 1) <= framesPerColumn) lvl++;
+	
+	const UInt32 bucketFrames  = framesPerBucket(lvl);
+	const SInt64 endBucket     = _writePosition.load(memory_order_acquire) / bucketFrames;
+	const SInt64 bucketsToShow = min<UInt32>(framesToShow / bucketFrames, kBucketsPerLevel - kBucketsOfHeadroom);
+	const Bucket * buckets     = level(lvl, channel);
+	SInt64 firstBucketRead     = endBucket;
+	
+	for(UInt32 c = 0; c < columnCount; c++) {
+		const SInt64 first = max<SInt64>(0, endBucket - bucketsToShow + c * bucketsToShow / columnCount);
+		const SInt64 last  = endBucket - bucketsToShow + (c + 1) * bucketsToShow / columnCount;
+		if(first >= last) continue;
+		
+		float lo = FLT_MAX, hi = -FLT_MAX, sum = 0;
+		for(SInt64 b = first; b < last; b++) {
+			const Bucket &bucket = buckets[b % kBucketsPerLevel];
+			lo   = min(lo, bucket.min);
+			hi   = max(hi, bucket.max);
+			sum += bucket.sumOfSquares;
+		}
+		
+		columns[c].min = lo;
+		columns[c].max = hi;
+		columns[c].rms = sqrtf(sum / ((last - first) * bucketFrames));
+		firstBucketRead = min(firstBucketRead, first);
+	}
+	
+	// if the writer started on any of those buckets while we were
+	// reading them, the columns can't be trusted
+	atomic_thread_fence(memory_order_acquire);
+	const SInt64 reservedBuckets = _reservePosition.load(memory_order_relaxed) / bucketFrames;
+	return firstBucketRead >= reservedBuckets - (SInt64)kBucketsPerLevel;
+}
+
+void WaveformPyramid::summarize(vector<WaveformColumn> &columns, UInt32 columnCount, const AudioUnitSampleType * samples, UInt32 frames)
+{
+	const WaveformColumn silence = {0, 0, 0};
+	columns.assign(columnCount, silence);
+	
+	if(!samples) return;
+	
+	for(UInt32 c = 0; c < columnCount; c++) {
+		const UInt32 first = (UInt64)c * frames / columnCount;
+		const UInt32 last  = (UInt64)(c + 1) * frames / columnCount;
+		if(first >= last) continue;
+		
+		float lo = FLT_MAX, hi = -FLT_MAX, sum = 0;
+		for(UInt32 i = first; i < last; i++) {
+			lo   = min(lo, samples[i]);
+			hi   = max(hi, samples[i]);
+			sum += samples[i] * samples[i];
+		}
+		
+		columns[c].min = lo;
+		columns[c].max = hi;
+		columns[c].rms = sqrtf(sum / (last - first));
+	}
+}
@@ -0,0 +1,113 @@
+/*
+ This is part of a block for Audio Unit integration in Cinder (http://libcinder.org)
+ Copyright (c) 2013, Adam Carlucci. All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and
+ the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ the following disclaimer in the documentation and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "AudioUnitTypes.h"
+#include <atomic>
+
+namespace cinder { namespace audiounit {
+
+// A summary of a stretch of audio, good for drawing one column
+// (ie. one pixel's worth) of a waveform
+struct WaveformColumn
+{
+	float min;
+	float max;
+	float rms;
+};
+
+// WaveformPyramid keeps min / max / RMS summaries of a stream of
+// planar audio at several resolutions at once: one summary for every
+// 16 frames, one for every 64, every 256 and so on. It's updated by the
+// writer (typically on the render thread) a block at a time, so that
+// drawing a waveform never needs more than a few summaries per column,
+// however far out it's zoomed.
+
+// Each level remembers the same number of summaries, so the coarser
+// levels reach much further back in time than the finer ones (with
+// 4096 summaries per level, the finest covers 65536 frames and the
+// coarsest about 16.7 million).
+
+// As with BroadcastBuffer, the writer never waits on readers, and
+// readers throw away anything the writer touched while they were
+// reading it.
+
+class WaveformPyramid
+{
+public:
+	static const UInt32 kLevels = 5;
+	static const UInt32 kFramesPerBucket = 16;  // at the finest level
+	static const UInt32 kBucketsPerBucket = 4;  // between one level and the next
+	static const UInt32 kBucketsPerLevel = 4096;
+	
+	WaveformPyramid();
+	~WaveformPyramid();
+	
+	// (re)allocates the pyramid. This must not be called while the
+	// pyramid is being written or read
+	bool allocate(UInt32 channels);
+	void release();
+	
+	UInt32 getChannelCount() const {return _channels;}
+	
+	// Writer side
+	void write(const AudioBufferList * bufferList, UInt32 inNumberFrames);
+	
+	// Reader side. Summarizes the most recent framesToShow frames of the
+	// channel into columnCount columns (or fewer frames, if the pyramid
+	// doesn't reach back that far; missing columns at the start are
+	// zeroed). Returns false if the columns would be narrower than
+	// kFramesPerBucket (use the samples themselves for those), or if the
+	// writer overwrote the summaries while they were being read.
+	bool getColumns(std::vector<WaveformColumn> &columns, UInt32 columnCount, UInt32 framesToShow, UInt32 channel = 0) const;
+	
+	// Summarizes raw samples the same way, for when getColumns() can't
+	static void summarize(std::vector<WaveformColumn> &columns, UInt32 columnCount, const AudioUnitSampleType * samples, UInt32 frames);
+	
+private:
+	WaveformPyramid(const WaveformPyramid &);
+	WaveformPyramid& operator=(const WaveformPyramid &);
+	
+	struct Bucket
+	{
+		float min;
+		float max;
+		float sumOfSquares;
+		UInt32 count;
+	};
+	
+	static UInt32 framesPerBucket(UInt32 level);
+	Bucket * level(UInt32 level, UInt32 channel) const;
+	void finishBucket(UInt32 channel, UInt32 level, UInt64 bucketIndex);
+	
+	Bucket * _memory;   // [level][channel][bucket]
+	Bucket * _partial;  // [channel][level], the buckets being filled in (writer only)
+	UInt32 _channels;
+	UInt64 _framesWritten; // writer only
+	
+	// same protocol as BroadcastBuffer: bumped before and after each block
+	std::atomic<UInt64> _reservePosition;
+	std::atomic<UInt64> _writePosition;
+};
+
+} } // namespace cinder::audiounit
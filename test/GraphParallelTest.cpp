@@ -0,0 +1,250 @@
+// Renders a Graph with parallel rendering turned on against the software
+// stand-in for the Audio Unit calls (CoreAudioStandIn.cpp), for long
+// enough that the render thread and the workers race each other every
+// way they can. Branch b renders 1 << b, so the mixer's output says which
+// branches it heard each quantum. It's built the same way as
+// OfflineRendererTest.cpp:
+
+//   g++ -std=c++11 -O2 -pthread -Isrc -I$CINDER_PATH/include test/GraphParallelTest.cpp \
+//       src/CoreAudioStandIn.cpp src/GenericUnit.cpp src/Input.cpp src/Output.cpp src/Mixer.cpp \
+//       src/Tap.cpp src/Graph.cpp src/OfflineRenderer.cpp src/Recorder.cpp src/BroadcastBuffer.cpp \
+//       src/LevelMeter.cpp src/WaveformPyramid.cpp src/RingHealth.cpp src/DSP.cpp src/Resampler.cpp \
+//       src/RealtimeMemory.cpp src/Semaphore.cpp src/TPCircularBuffer/TPCircularBuffer.cpp \
+//       src/TPCircularBuffer/TPMultichannelCircularBuffer.cpp -lboost_filesystem -lboost_system -lrt \
+//       -o GraphParallelTest
+
+// It exits with 0 if every check passes, and prints the ones that don't.
+
+#include "AudioUnitGraph.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <unistd.h>
+
+using namespace cinder::audiounit;
+using namespace std;
+
+static const UInt32 kBranches = 4;
+static const UInt32 kFrames = 256;
+static int s_failures = 0;
+
+#define CHECK(condition) \
+if(!(condition)) {\
+	printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #condition);\
+	s_failures++;\
+}
+
+static thread::id s_renderThread;
+
+// Feeds one branch. It notices being rendered on two threads at once,
+// and can be made to stall on a worker every so often, or to sleep
+// briefly on the render thread so the workers get a look in on a
+// machine with one core
+struct BranchSource
+{
+	float value;
+	UInt32 stallEvery;
+	UInt32 stallMicroseconds;
+	UInt32 renderThreadMicroseconds;
+	atomic<UInt32> rendering;
+	atomic<UInt64> blocks;
+	atomic<UInt64> stalls;
+	atomic<UInt64> overlaps;
+	
+	BranchSource() : value(0), stallEvery(0), stallMicroseconds(0), renderThreadMicroseconds(0), rendering(0), blocks(0), stalls(0), overlaps(0) {}
+	
+	AURenderCallbackStruct callback() {AURenderCallbackStruct c = {Render, this}; return c;}
+	
+	static OSStatus Render(void * refCon, AudioUnitRenderActionFlags *, const AudioTimeStamp *, UInt32, UInt32 frames, AudioBufferList * ioData)
+	{
+		BranchSource * source = static_cast<BranchSource *>(refCon);
+		if(source->rendering.fetch_add(1) != 0) source->overlaps++;
+		
+		const UInt64 block = source->blocks++;
+		if(this_thread::get_id() == s_renderThread) {
+			if(source->renderThreadMicroseconds > 0) usleep(source->renderThreadMicroseconds);
+		} else if(source->stallEvery > 0 && block % source->stallEvery == 0) {
+			source->stalls++;
+			usleep(source->stallMicroseconds);
+		}
+		
+		for(UInt32 ch = 0; ch < ioData->mNumberBuffers; ch++) {
+			AudioUnitSampleType * samples = (AudioUnitSampleType *)ioData->mBuffers[ch].mData;
+			for(UInt32 i = 0; i < frames; i++) samples[i] = source->value;
+		}
+		
+		source->rendering--;
+		return noErr;
+	}
+};
+
+struct Result
+{
+	UInt64 quanta;
+	UInt64 missing;     // branches the mixer didn't hear, summed over every quantum
+	UInt64 lost;        // quanta where a branch the mixer had heard before went missing
+	UInt64 garbled;     // quanta where the mixer's output wasn't one mask throughout
+	UInt64 errors;
+	UInt64 maxRenderNanos;
+	GraphParallelStats stats;
+};
+
+static UInt32 CountBits(UInt32 bits)
+{
+	UInt32 count = 0;
+	for(; bits; bits &= bits - 1) count++;
+	return count;
+}
+
+// kBranches effects, each fed by a BranchSource, into a mixer
+static Result Run(BranchSource * sources, UInt64 quanta, UInt32 workers)
+{
+	vector<boost::shared_ptr<GenericUnit> > effects;
+	GenericUnit mixer(kAudioUnitType_Mixer, 'tstm');
+	
+	for(UInt32 b = 0; b < kBranches; b++) {
+		sources[b].value = 1 << b;
+		effects.push_back(boost::shared_ptr<GenericUnit>(new GenericUnit(kAudioUnitType_Effect, 'tst0' + b)));
+		effects[b]->setRenderCallback(sources[b].callback());
+		effects[b]->connectTo(mixer, b);
+	}
+	
+	Graph graph;
+	graph.setParallelRendering(true, workers);
+	CHECK(graph.capture(mixer));
+	CHECK(graph.prepare(kFrames) == kFrames);
+	CHECK(graph.getBranchCount() == kBranches);
+	
+	vector<AudioUnitSampleType> samples(kFrames * 2);
+	char listBytes[offsetof(AudioBufferList, mBuffers[0]) + 2 * sizeof(AudioBuffer)];
+	AudioBufferList * list = (AudioBufferList *)listBytes;
+	
+	AudioTimeStamp timeStamp = {0};
+	timeStamp.mFlags = kAudioTimeStampSampleTimeValid;
+	
+	Result result = {0};
+	UInt32 everHeard = 0;
+	graph.getParallelStats(true);
+	
+	for(UInt64 q = 0; q < quanta; q++, timeStamp.mSampleTime += kFrames) {
+		list->mNumberBuffers = 2;
+		for(UInt32 ch = 0; ch < 2; ch++) {
+			list->mBuffers[ch].mNumberChannels = 1;
+			list->mBuffers[ch].mDataByteSize = kFrames * sizeof(AudioUnitSampleType);
+			list->mBuffers[ch].mData = &samples[ch * kFrames];
+		}
+		
+		AudioUnitRenderActionFlags flags = 0;
+		const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		const OSStatus status = graph.render(&flags, &timeStamp, 0, kFrames, list);
+		const UInt64 renderNanos = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+		result.maxRenderNanos = max(result.maxRenderNanos, renderNanos);
+		if(status != noErr) {
+			result.errors++;
+			continue;
+		}
+		
+		const AudioUnitSampleType * left = (const AudioUnitSampleType *)list->mBuffers[0].mData;
+		const AudioUnitSampleType * right = (const AudioUnitSampleType *)list->mBuffers[1].mData;
+		const UInt32 heard = left[0];
+		for(UInt32 i = 0; i < kFrames; i++) {
+			if(left[i] != heard || right[i] != heard) {
+				result.garbled++;
+				break;
+			}
+		}
+		
+		const GraphParallelStats stats = graph.getParallelStats(true);
+		result.missing += CountBits(~heard & ((1 << kBranches) - 1));
+		if(everHeard & ~heard) result.lost++;
+		everHeard |= heard;
+		
+		result.quanta += stats.quanta;
+		result.stats.branchesOnWorkers += stats.branchesOnWorkers;
+		result.stats.branchesOnRenderThread += stats.branchesOnRenderThread;
+		result.stats.late += stats.late;
+	}
+	
+	return result;
+}
+
+static void Print(const char * name, const Result &result)
+{
+	printf("%s: %llu quanta, %llu branches on workers, %llu on the render thread, %llu late, %llu missing, longest render %.3f ms\n",
+		   name,
+		   (unsigned long long)result.quanta,
+		   (unsigned long long)result.stats.branchesOnWorkers,
+		   (unsigned long long)result.stats.branchesOnRenderThread,
+		   (unsigned long long)result.stats.late,
+		   (unsigned long long)result.missing,
+		   result.maxRenderNanos / 1e6);
+}
+
+// no branch goes missing once it's been heard, every unit's rendered
+// once a quantum on one thread at a time, and every quantum if no
+// worker ran late
+static void TestStress()
+{
+	const UInt64 kQuanta = 200000;
+	BranchSource sources[kBranches];
+	const Result result = Run(sources, kQuanta, 0);
+	Print("stress", result);
+	
+	CHECK(result.quanta == kQuanta);
+	CHECK(result.errors == 0);
+	CHECK(result.garbled == 0);
+	CHECK(result.lost == 0);
+	
+	for(UInt32 b = 0; b < kBranches; b++) {
+		CHECK(sources[b].overlaps == 0);
+		CHECK(sources[b].blocks <= kQuanta);
+		if(result.stats.late == 0) CHECK(sources[b].blocks == kQuanta);
+	}
+}
+
+// A worker that stalls for twenty quanta at a time. The render thread
+// has to carry on without waiting for it, the mixer has to keep hearing
+// the branch's last quantum meanwhile, and the other branches mustn't
+// notice
+static void TestStall()
+{
+	const UInt64 kQuanta = 2000;
+	const UInt32 quantumMicroseconds = kFrames * 1000000 / 44100;
+	
+	BranchSource sources[kBranches];
+	sources[0].stallEvery = 100;
+	sources[0].stallMicroseconds = 20 * quantumMicroseconds;
+	for(UInt32 b = 0; b < kBranches; b++) sources[b].renderThreadMicroseconds = 50;
+	
+	const Result result = Run(sources, kQuanta, 1);
+	Print("stall", result);
+	printf("stall: the worker stalled %llu times\n", (unsigned long long)sources[0].stalls.load());
+	
+	CHECK(result.errors == 0);
+	CHECK(result.garbled == 0);
+	CHECK(result.lost == 0);
+	CHECK(sources[0].overlaps == 0);
+	
+	CHECK(sources[0].stalls > 0);
+	CHECK(result.stats.late >= sources[0].stalls);
+	
+	// Rendering the branches itself takes the render thread 50 us apiece,
+	// 200 us at most, and the rest of a quantum is left for the scheduler
+	// on a machine with one core. Waiting out a stall would take 20
+	CHECK(result.maxRenderNanos < 1000 * quantumMicroseconds);
+	
+	// only the stalled branch ever went missing
+	for(UInt32 b = 1; b < kBranches; b++) CHECK(sources[b].blocks == kQuanta);
+}
+
+int main()
+{
+	s_renderThread = this_thread::get_id();
+	
+	TestStress();
+	TestStall();
+	
+	printf("%d check(s) failed\n", s_failures);
+	return s_failures == 0 ? 0 : 1;
+}
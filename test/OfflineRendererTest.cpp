@@ -0,0 +1,235 @@
+// Drives OfflineRenderer::render() against the software stand-in for
+// the Audio Unit calls (CoreAudioStandIn.cpp), the way a Linux build
+// machine would use it: a chain of stand-in units fed by render
+// callbacks, rendered to memory, through a Graph, until silence, and
+// to a file. It needs Cinder's include directory (for
+// cinder/Filesystem.h) and Boost:
+
+//   g++ -std=c++11 -O2 -pthread -Isrc -I$CINDER_PATH/include test/OfflineRendererTest.cpp \
+//       src/CoreAudioStandIn.cpp src/GenericUnit.cpp src/Input.cpp src/Output.cpp src/Mixer.cpp \
+//       src/Tap.cpp src/Graph.cpp src/OfflineRenderer.cpp src/Recorder.cpp src/BroadcastBuffer.cpp \
+//       src/LevelMeter.cpp src/WaveformPyramid.cpp src/RingHealth.cpp src/DSP.cpp src/Resampler.cpp \
+//       src/RealtimeMemory.cpp src/Semaphore.cpp src/TPCircularBuffer/TPCircularBuffer.cpp \
+//       src/TPCircularBuffer/TPMultichannelCircularBuffer.cpp -lboost_filesystem -lboost_system -lrt \
+//       -o OfflineRendererTest
+
+// It exits with 0 if every check passes, and prints the ones that don't.
+
+#include "AudioUnitOfflineRenderer.h"
+#include <cmath>
+#include <cstdio>
+#include <sys/stat.h>
+
+using namespace cinder::audiounit;
+using namespace std;
+
+static const Float64 kSampleRate = 44100;
+static int s_failures = 0;
+
+#define CHECK(condition) \
+if(!(condition)) {\
+	printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #condition);\
+	s_failures++;\
+}
+
+// A source whose samples say where they are: frame t of channel c is
+// (t % 1000) / 1000 + c, scaled by gain. It stops (renders zeros) at
+// silenceAt, and keeps track of the sample times it's asked for so
+// that gaps and repeats show up.
+struct CountingSource
+{
+	float gain;
+	Float64 silenceAt;
+	Float64 nextSampleTime;
+	UInt64 blocks;
+	UInt64 discontinuities;
+	
+	CountingSource(float gain = 1) : gain(gain), silenceAt(-1), nextSampleTime(0), blocks(0), discontinuities(0) {}
+	
+	AURenderCallbackStruct callback() {AURenderCallbackStruct c = {Render, this}; return c;}
+	
+	static float Sample(Float64 t, UInt32 channel) {return fmod(t, 1000) / 1000 + channel;}
+	
+	static OSStatus Render(void * refCon, AudioUnitRenderActionFlags *, const AudioTimeStamp * timeStamp, UInt32, UInt32 frames, AudioBufferList * ioData)
+	{
+		CountingSource * source = static_cast<CountingSource *>(refCon);
+		if(timeStamp->mSampleTime != source->nextSampleTime) source->discontinuities++;
+		source->nextSampleTime = timeStamp->mSampleTime + frames;
+		source->blocks++;
+		
+		for(UInt32 ch = 0; ch < ioData->mNumberBuffers; ch++) {
+			AudioUnitSampleType * samples = (AudioUnitSampleType *)ioData->mBuffers[ch].mData;
+			for(UInt32 i = 0; i < frames; i++) {
+				const Float64 t = timeStamp->mSampleTime + i;
+				samples[i] = source->silenceAt >= 0 && t >= source->silenceAt ? 0 : source->gain * Sample(t, ch);
+			}
+		}
+		
+		return noErr;
+	}
+};
+
+static bool Matches(const vector<TapSampleBuffer> &buffers, Float64 start, float gain)
+{
+	for(UInt32 ch = 0; ch < buffers.size(); ch++) {
+		for(size_t i = 0; i < buffers[ch].size(); i++) {
+			if(fabs(buffers[ch][i] - gain * CountingSource::Sample(start + i, ch)) > 1e-4) return false;
+		}
+	}
+	return true;
+}
+
+// one effect fed by a callback, rendered straight into memory
+static void TestMemory()
+{
+	CountingSource source;
+	GenericUnit effect(kAudioUnitType_Effect, 'tst1');
+	effect.setRenderCallback(source.callback());
+	
+	OfflineRenderer renderer(512);
+	renderer.setSource(effect);
+	CHECK(renderer.getChannelCount() == 2);
+	CHECK(renderer.getSampleRate() == kSampleRate);
+	
+	vector<TapSampleBuffer> buffers;
+	CHECK(renderer.render(2.0, buffers));
+	CHECK(renderer.getFramesRendered() == 2 * kSampleRate);
+	CHECK(buffers.size() == 2 && buffers[0].size() == 2 * kSampleRate);
+	CHECK(Matches(buffers, 0, 1));
+	CHECK(source.discontinuities == 0);
+	CHECK(!renderer.stoppedAtSilence());
+	CHECK(renderer.getSpeed() > 1);
+	
+	// the sample times carry on from one render() to the next
+	CHECK(renderer.render(0.5, buffers));
+	CHECK(Matches(buffers, 2 * kSampleRate, 1));
+	CHECK(source.discontinuities == 0);
+	
+	printf("memory: %llu frames at %.0fx realtime\n", (unsigned long long)renderer.getFramesRendered(), renderer.getSpeed());
+}
+
+// blocks bigger than the units' default quantum, which prepareChain() has to make room for
+static void TestBigBlocks()
+{
+	CountingSource source;
+	GenericUnit effect(kAudioUnitType_Effect, 'tst2');
+	effect.setRenderCallback(source.callback());
+	CHECK(effect.getMaximumFramesPerSlice() < 4096);
+	
+	OfflineRenderer renderer(4096);
+	renderer.setSource(effect);
+	
+	vector<TapSampleBuffer> buffers;
+	CHECK(renderer.render(1.0, buffers));
+	CHECK(effect.getMaximumFramesPerSlice() == 4096);
+	CHECK(Matches(buffers, 0, 1));
+}
+
+// two branches mixed together, rendered through a Graph and then on their own
+static void TestGraph()
+{
+	CountingSource left(1), right(0.5);
+	GenericUnit a(kAudioUnitType_Effect, 'tsta'), b(kAudioUnitType_Effect, 'tstb');
+	GenericUnit mixer(kAudioUnitType_Mixer, 'tstm');
+	a.setRenderCallback(left.callback());
+	b.setRenderCallback(right.callback());
+	a.connectTo(mixer, 0);
+	b.connectTo(mixer, 1);
+	
+	Graph graph;
+	CHECK(graph.capture(mixer));
+	CHECK(graph.getRenderOrder().size() == 3);
+	
+	OfflineRenderer renderer(512);
+	renderer.setSource(graph);
+	
+	vector<TapSampleBuffer> buffers;
+	CHECK(renderer.render(1.0, buffers));
+	CHECK(Matches(buffers, 0, 1.5));
+	
+	// each branch rendered once a block, even though the Graph renders it
+	// ahead of the mixer and the mixer then pulls it
+	CHECK(left.blocks == right.blocks);
+	CHECK(left.discontinuities == 0 && right.discontinuities == 0);
+	CHECK(left.nextSampleTime == kSampleRate);
+}
+
+static void TestSilence()
+{
+	CountingSource source;
+	source.silenceAt = kSampleRate / 2;
+	GenericUnit effect(kAudioUnitType_Effect, 'tst3');
+	effect.setRenderCallback(source.callback());
+	
+	OfflineRenderer renderer(512);
+	renderer.setSource(effect);
+	renderer.setStopAtSilence(true, -90, 0.25);
+	
+	vector<TapSampleBuffer> buffers;
+	CHECK(renderer.render(10.0, buffers));
+	CHECK(renderer.stoppedAtSilence());
+	
+	// the silence it waited through is kept, give or take a block
+	const Float64 seconds = renderer.getFramesRendered() / kSampleRate;
+	CHECK(seconds >= 0.75 && seconds < 0.75 + 2 * 512 / kSampleRate);
+	printf("silence: stopped after %.3f seconds\n", seconds);
+}
+
+static void TestFile()
+{
+	CountingSource source;
+	GenericUnit effect(kAudioUnitType_Effect, 'tst4');
+	effect.setRenderCallback(source.callback());
+	
+	OfflineRenderer renderer(512);
+	renderer.setSource(effect);
+	
+	const cinder::fs::path path = cinder::fs::temp_directory_path() / "OfflineRendererTest.wav";
+	CHECK(renderer.render(1.0, path, RecorderFileWAV, RecorderSamplesFloat32));
+	CHECK(renderer.getFramesRendered() == kSampleRate);
+	
+	struct stat info;
+	CHECK(stat(path.c_str(), &info) == 0);
+	CHECK(info.st_size >= kSampleRate * 2 * sizeof(float) && info.st_size < kSampleRate * 2 * sizeof(float) + 4096);
+	cinder::fs::remove(path);
+}
+
+// the stand-in holds a chain to the same rules Core Audio does
+static void TestStandInRules()
+{
+	GenericUnit effect(kAudioUnitType_Effect, 'tst5');
+	const UInt32 frames = effect.getMaximumFramesPerSlice() + 1;
+	
+	vector<AudioUnitSampleType> samples(frames * 2);
+	char listBytes[offsetof(AudioBufferList, mBuffers[0]) + 2 * sizeof(AudioBuffer)];
+	AudioBufferList * list = (AudioBufferList *)listBytes;
+	list->mNumberBuffers = 2;
+	for(UInt32 ch = 0; ch < 2; ch++) {
+		list->mBuffers[ch].mNumberChannels = 1;
+		list->mBuffers[ch].mDataByteSize = frames * sizeof(AudioUnitSampleType);
+		list->mBuffers[ch].mData = &samples[ch * frames];
+	}
+	
+	AudioTimeStamp timeStamp = {0};
+	timeStamp.mFlags = kAudioTimeStampSampleTimeValid;
+	AudioUnitRenderActionFlags flags = 0;
+	
+	CHECK(effect.render(&flags, &timeStamp, 0, frames, list) == kAudioUnitErr_TooManyFramesToProcess);
+	CHECK(effect.render(&flags, &timeStamp, 0, frames - 1, list) == noErr);
+	CHECK(AudioUnitUninitialize(effect) == noErr);
+	CHECK(effect.render(&flags, &timeStamp, 0, frames - 1, list) == kAudioUnitErr_Uninitialized);
+	CHECK(AudioUnitInitialize(effect) == noErr);
+}
+
+int main()
+{
+	TestMemory();
+	TestBigBlocks();
+	TestGraph();
+	TestSilence();
+	TestFile();
+	TestStandInRules();
+	
+	printf("%d check(s) failed\n", s_failures);
+	return s_failures == 0 ? 0 : 1;
+}
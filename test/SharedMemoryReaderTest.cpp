@@ -0,0 +1,124 @@
+// Checks SharedMemoryTapReader against a SharedMemorySegmentWriter in
+// another process: a writer and two forked readers, one keeping up and
+// one falling far enough behind to be lapped. Neither side needs Core
+// Audio, so this builds on any POSIX system:
+
+//   g++ -std=c++11 -O2 -pthread -Isrc test/SharedMemoryReaderTest.cpp src/SharedMemorySegment.cpp -lrt -o SharedMemoryReaderTest
+
+// It exits with 0 if every frame either reader got matches what was
+// written, and the slow reader saw (and counted) the frames it missed.
+
+#include "SharedMemorySegment.h"
+#include <cstdio>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace cinder::audiounit;
+using namespace std;
+
+static const char * kName = "/autap-reader-test";
+static const uint32_t kChannels = 2;
+static const uint32_t kBlockFrames = 512;
+static const uint32_t kBlocks = 1000;
+static const uint32_t kFramesToKeep = 8000;
+
+static float ExpectedSample(uint64_t position, uint32_t channel)
+{
+	return (float)((position * 7 + channel * 1000003) % 65521) / 65521.f;
+}
+
+// returns the number of mismatched samples, or -1 if the reader failed outright
+static long Follow(bool slow)
+{
+	SharedMemoryTapReader reader;
+	for(int i = 0; i < 200 && !reader.open(kName); i++) {
+		usleep(10000);
+	}
+	
+	if(!reader.isOpen() || reader.getChannelCount() != kChannels) return -1;
+	
+	vector<vector<float> > buffers;
+	long mismatched = 0;
+	
+	while(!reader.isWriterClosed() || reader.getAvailableFrames() > 0) {
+		reader.read(buffers, slow ? 700 : UINT32_MAX);
+		
+		const uint64_t start = reader.getPosition() - buffers[0].size();
+		for(uint32_t ch = 0; ch < kChannels; ch++) {
+			for(size_t i = 0; i < buffers[ch].size(); i++) {
+				if(buffers[ch][i] != ExpectedSample(start + i, ch)) mismatched++;
+			}
+		}
+		
+		usleep(slow ? 20000 : 1000);
+	}
+	
+	// the last frames are still mapped, and are one contiguous run even across the wrap
+	const uint64_t end = reader.getWritePosition();
+	const float * tail = reader.getChannel(1, end - 1000);
+	for(uint32_t i = 0; i < 1000; i++) {
+		if(tail[i] != ExpectedSample(end - 1000 + i, 1)) mismatched++;
+	}
+	
+	double sampleTime = 0;
+	const bool timed = reader.sampleTimeForPosition(end - 1, sampleTime);
+	
+	printf("%s reader: read up to %llu, %llu dropped, %ld mismatched, last sample time %.0f\n",
+		   slow ? "slow" : "fast",
+		   (unsigned long long)reader.getPosition(),
+		   (unsigned long long)reader.getFramesDropped(),
+		   mismatched, sampleTime);
+	
+	if(!timed || sampleTime != 1000 + end - 1) return -1;
+	if(slow && reader.getFramesDropped() == 0) return -1; // it was meant to be lapped
+	if(reader.getPosition() != end) return -1;
+	return mismatched;
+}
+
+int main()
+{
+	SharedMemorySegmentWriter writer;
+	if(!writer.open(kName, kChannels, 48000, kFramesToKeep)) return 1;
+	
+	pid_t readers[2];
+	for(int r = 0; r < 2; r++) {
+		readers[r] = fork();
+		if(readers[r] == 0) {
+			const long mismatched = Follow(r == 1);
+			fflush(stdout);
+			_exit(mismatched == 0 ? 0 : 1);
+		}
+	}
+	
+	vector<vector<float> > block(kChannels, vector<float>(kBlockFrames));
+	const float * channels[kChannels] = {&block[0][0], &block[1][0]};
+	uint64_t position = 0;
+	
+	for(uint32_t b = 0; b < kBlocks; b++) {
+		for(uint32_t i = 0; i < kBlockFrames; i++, position++) {
+			for(uint32_t ch = 0; ch < kChannels; ch++) {
+				block[ch][i] = ExpectedSample(position, ch);
+			}
+		}
+		
+		const double sampleTime = 1000 + b * kBlockFrames;
+		writer.write(channels, kChannels, kBlockFrames, b == 0 ? &sampleTime : NULL);
+		usleep(2000);
+	}
+	
+	// give the readers a moment to catch up before the segment's unlinked
+	usleep(100000);
+	writer.close();
+	
+	int failures = 0;
+	for(int r = 0; r < 2; r++) {
+		int status = 0;
+		waitpid(readers[r], &status, 0);
+		if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) failures++;
+	}
+	
+	printf("wrote %llu frames, %d reader(s) failed\n", (unsigned long long)position, failures);
+	return failures == 0 ? 0 : 1;
+}